@@ -24,8 +24,9 @@
 #include <assert.h>
 
 #include "bip32template.h"
+#include "bip32template_internal.h"
 
-#define HARDENED_INDEX_START 0x80000000
+#define HARDENED_INDEX_START BIP32_TEMPLATE_HARDENED_INDEX_START
 #define MAX_INDEX_VALUE (HARDENED_INDEX_START-1)
 #define INVALID_INDEX HARDENED_INDEX_START
 
@@ -120,10 +121,60 @@ static int process_digit(char c, uint32_t* index_value_p,
     return 1;
 }
 
-static bip32_template_section_type* get_last_section(bip32_template_type* template_p)
+/* The "m/" prefix, shared by the parser and the validator.
+ * Returns 1 if c is a part of the prefix and is consumed, with *state_p set
+ * to STATE_PARSE_ERROR if the prefix is not followed by '/' */
+static int process_prefix_char(char c, unsigned int pos, int* is_partial_p,
+                               parse_state_type* state_p, bip32_template_error_type* error_p)
 {
-    assert( template_p->num_sections < BIP32_TEMPLATE_MAX_SECTIONS );
-    return &template_p->sections[template_p->num_sections];
+    if( c == 'm' && pos == 1 ) {
+        *is_partial_p = 0;
+        return 1;
+    }
+    if( !*is_partial_p && pos == 2 ) {
+        if( c != '/' ) {
+            *state_p = STATE_PARSE_ERROR;
+            *error_p = unexpected_char_error(c);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* The error for a character that cannot start a section */
+static bip32_template_error_type section_start_error(char c, unsigned int num_sections)
+{
+    if( c == '/' ) {
+        return BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH;
+    }
+    if( c == 0 ) {
+        return ( num_sections == 0 ? BIP32_TEMPLATE_ERROR_PATH_EMPTY
+                                   : BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH );
+    }
+    return unexpected_char_error(c);
+}
+
+/* The error for a character within the braces that is not a digit and cannot follow
+ * the value before it. index_value is INVALID_INDEX if there is no value yet */
+static bip32_template_error_type range_char_error(char c, uint32_t index_value)
+{
+    if( c == 0 ) {
+        return BIP32_TEMPLATE_ERROR_UNEXPECTED_FINISH;
+    }
+    if( index_value == INVALID_INDEX ) {
+        return ( c == ' ' ? BIP32_TEMPLATE_ERROR_UNEXPECTED_SPACE
+                          : BIP32_TEMPLATE_ERROR_DIGIT_EXPECTED );
+    }
+    return unexpected_char_error(c);
+}
+
+/* The error for a character after a section that neither ends it nor is the accepted hardened marker */
+static bip32_template_error_type section_end_error(char c)
+{
+    if( c == HARDENED_MARKER_LETTER || c == HARDENED_MARKER_APOSTROPHE ) {
+        return BIP32_TEMPLATE_ERROR_UNEXPECTED_HARDENED_MARKER;
+    }
+    return unexpected_char_error(c);
 }
 
 static bip32_template_section_range_type* get_last_section_range(bip32_template_section_type* section_p)
@@ -133,9 +184,9 @@ static bip32_template_section_range_type* get_last_section_range(bip32_template_
     return &section_p->ranges[section_p->num_ranges];
 }
 
-static void open_path_section_range(bip32_template_type* template_p, uint32_t index_value)
+static void open_path_section_range(bip32_template_section_type* section_p, uint32_t index_value)
 {
-    bip32_template_section_range_type* range_p = get_last_section_range(get_last_section(template_p));
+    bip32_template_section_range_type* range_p = get_last_section_range(section_p);
 
     assert( range_p->range_start == INVALID_INDEX );
     assert( range_p->range_end == INVALID_INDEX );
@@ -148,10 +199,9 @@ static int is_range_open(bip32_template_section_range_type* range_p)
     return range_p->range_start != INVALID_INDEX && range_p->range_end == INVALID_INDEX;
 }
 
-static int finalize_last_section_range(bip32_template_type* template_p, uint32_t index_value)
+static int finalize_range(bip32_template_section_range_type* range_p, uint32_t index_value)
 {
     assert( index_value != INVALID_INDEX );
-    bip32_template_section_range_type* range_p = get_last_section_range(get_last_section(template_p));
     if( range_p->range_start != INVALID_INDEX && range_p->range_end != INVALID_INDEX ) {
         /* Because we call this funcion from two different FSM states
          * (RANGE_WITHIN_SECTION and SECTION_END), and the function _changes_ the range,
@@ -171,10 +221,24 @@ static int finalize_last_section_range(bip32_template_type* template_p, uint32_t
     return 0;
 }
 
-static void normalize_last_section_and_advance_ranges(bip32_template_type* template_p)
+static int finalize_last_section_range(bip32_template_section_type* section_p, uint32_t index_value)
+{
+    return finalize_range(get_last_section_range(section_p), index_value);
+}
+
+/* If range_p starts right after prev_range_p ends, extend prev_range_p over it and return 1 */
+static int join_adjacent_range(bip32_template_section_range_type* prev_range_p,
+                               const bip32_template_section_range_type* range_p)
 {
-    bip32_template_section_type* section_p = get_last_section(template_p);
+    if( prev_range_p->range_end + 1 != range_p->range_start ) {
+        return 0;
+    }
+    prev_range_p->range_end = range_p->range_end;
+    return 1;
+}
 
+static void normalize_last_section_and_advance_ranges(bip32_template_section_type* section_p)
+{
     assert( section_p->num_ranges < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION );
 
     bip32_template_section_range_type* last_range_p = &section_p->ranges[section_p->num_ranges];
@@ -191,8 +255,7 @@ static void normalize_last_section_and_advance_ranges(bip32_template_type* templ
     assert( prev_range_p->range_start <= MAX_INDEX_VALUE );
     assert( prev_range_p->range_end <= MAX_INDEX_VALUE );
 
-    if( prev_range_p->range_end + 1 == last_range_p->range_start ) {
-        prev_range_p->range_end = last_range_p->range_end;
+    if( join_adjacent_range(prev_range_p, last_range_p) ) {
         last_range_p->range_start = INVALID_INDEX;
         last_range_p->range_end = INVALID_INDEX;
     }
@@ -201,12 +264,10 @@ static void normalize_last_section_and_advance_ranges(bip32_template_type* templ
     }
 }
 
-static void harden_last_section(bip32_template_type* template_p)
+static void harden_last_section(bip32_template_section_type* section_p)
 {
     int i;
 
-    bip32_template_section_type* section_p = get_last_section(template_p);
-
     for( i = 0; i < section_p->num_ranges; i++ ) {
         assert( section_p->ranges[i].range_start <= MAX_INDEX_VALUE );
         assert( section_p->ranges[i].range_end <= MAX_INDEX_VALUE );
@@ -216,46 +277,13 @@ static void harden_last_section(bip32_template_type* template_p)
     }
 }
 
-static int is_prev_section_hardened(bip32_template_type* template_p)
-{
-    assert( template_p->num_sections > 0 );
-
-    int i;
-    int is_hardened = -1;
-    bip32_template_section_type* section_p = &template_p->sections[template_p->num_sections-1];
-
-    for( i = 0; i < section_p->num_ranges; i++ ) {
-        if( section_p->ranges[i].range_start >= HARDENED_INDEX_START ) {
-            assert( is_hardened != 0 );
-            is_hardened = 1;
-        }
-        else {
-            assert( is_hardened != 1 );
-            is_hardened = 0;
-        }
-
-        if( section_p->ranges[i].range_end >= HARDENED_INDEX_START ) {
-            assert( is_hardened != 0 );
-            is_hardened = 1;
-        }
-        else {
-            assert( is_hardened != 1 );
-            is_hardened = 0;
-        }
-    }
-
-    return is_hardened;
-}
-
-static int check_range_correctness(bip32_template_type* template_p,
+/* prev_range_p is the previous range within the section, or NULL if there is none */
+static int check_range_correctness(const bip32_template_section_range_type* range_p,
+                                   const bip32_template_section_range_type* prev_range_p,
                                    parse_state_type* state_p, bip32_template_error_type* error_p,
                                    int range_was_open, int is_format_unambiguous,
                                    range_correctness_flag_type flag)
 {
-    bip32_template_section_type* section_p = get_last_section(template_p);
-    bip32_template_section_range_type* range_p = get_last_section_range(section_p);
-    bip32_template_section_range_type* prev_range_p;
-
     assert( range_p->range_start <= MAX_INDEX_VALUE );
     assert( range_p->range_end <= MAX_INDEX_VALUE );
 
@@ -263,13 +291,12 @@ static int check_range_correctness(bip32_template_type* template_p,
     int is_range_equals_wildcard = range_p->range_start == 0 && range_p->range_end == MAX_INDEX_VALUE;
     int is_start_larger_than_end = range_p->range_start > range_p->range_end;
     int is_single_index = ( flag == RANGE_CORRECTNESS_FLAG_RANGE_LAST
-                            && section_p->num_ranges == 0 && is_start_equals_end );
+                            && prev_range_p == 0 && is_start_equals_end );
 
     int is_start_before_previous = 0;
     int is_start_in_previous = 0;
     int is_start_next_to_previous = 0;
-    if( section_p->num_ranges > 0 ) {
-        prev_range_p = &section_p->ranges[section_p->num_ranges-1];
+    if( prev_range_p ) {
         assert( prev_range_p->range_start <= MAX_INDEX_VALUE );
         assert( prev_range_p->range_end <= MAX_INDEX_VALUE );
         is_start_before_previous = prev_range_p->range_start > range_p->range_start;
@@ -317,6 +344,195 @@ static int check_range_correctness(bip32_template_type* template_p,
     return 1;
 }
 
+static int check_last_section_range_correctness(bip32_template_section_type* section_p,
+                                                parse_state_type* state_p, bip32_template_error_type* error_p,
+                                                int range_was_open, int is_format_unambiguous,
+                                                range_correctness_flag_type flag)
+{
+    bip32_template_section_range_type* prev_range_p = 0;
+
+    if( section_p->num_ranges > 0 ) {
+        prev_range_p = &section_p->ranges[section_p->num_ranges-1];
+    }
+
+    return check_range_correctness(get_last_section_range(section_p), prev_range_p,
+                                   state_p, error_p, range_was_open, is_format_unambiguous, flag);
+}
+
+/* Path scanner is the ONLYPATH subset of the parser FSM in bip32_template_parse()
+ * that does not build a template, but yields the path indexes one by one
+ * as soon as each index (with its hardened marker, if any) is complete.
+ * The error codes and positions are the same as with BIP32_TEMPLATE_FORMAT_ONLYPATH */
+typedef struct {
+    const char* str;
+    size_t len;
+    unsigned int pos;
+    unsigned int max_sections;
+    unsigned int num_sections;
+    uint8_t is_partial;
+    int is_prev_section_hardened;
+    char accepted_hardened_markers[2];
+    parse_state_type state;
+    uint32_t index_value;
+    bip32_template_error_type error;
+} path_scanner_type;
+
+static void path_scanner_init(path_scanner_type* scanner_p, const char* path_string, size_t len,
+                              unsigned int max_sections)
+{
+    scanner_p->str = path_string;
+    scanner_p->len = len;
+    scanner_p->pos = 0;
+    scanner_p->max_sections = max_sections;
+    scanner_p->num_sections = 0;
+    scanner_p->is_partial = 1;
+    scanner_p->is_prev_section_hardened = 0;
+    scanner_p->accepted_hardened_markers[0] = HARDENED_MARKER_LETTER;
+    scanner_p->accepted_hardened_markers[1] = HARDENED_MARKER_APOSTROPHE;
+    scanner_p->state = STATE_PARSE_SECTION_START;
+    scanner_p->index_value = INVALID_INDEX;
+    scanner_p->error = BIP32_TEMPLATE_ERROR_UNDEFINED;
+}
+
+/* Returns 1 and puts the next index (hardened, if it had hardened marker) into *index_p,
+ * or returns 0 if the scan is finished. In the latter case, scanner_p->state
+ * is either STATE_PARSE_SUCCESS or STATE_PARSE_ERROR */
+static int path_scanner_next(path_scanner_type* scanner_p, uint32_t* index_p)
+{
+    char c;
+
+    while( !is_parse_finished(scanner_p->state) ) {
+        if( scanner_p->pos == UINT_MAX ) {
+            scanner_p->state = STATE_PARSE_ERROR;
+            scanner_p->error = BIP32_TEMPLATE_ERROR_GETCHAR_FAILED;
+            break;
+        }
+
+        /* End of the span is treated the same as the terminating zero */
+        c = scanner_p->pos < scanner_p->len ? scanner_p->str[scanner_p->pos] : 0;
+        scanner_p->pos++;
+
+        if( c == 'm' && scanner_p->pos == 1 ) {
+            scanner_p->is_partial = 0;
+            continue;
+        }
+        else if( !scanner_p->is_partial && scanner_p->pos == 2 ) {
+            if( c == '/' ) {
+                continue;
+            }
+            scanner_p->state = STATE_PARSE_ERROR;
+            scanner_p->error = unexpected_char_error(c);
+            break;
+        }
+
+        if( scanner_p->state == STATE_PARSE_VALUE ) {
+            if( is_digit(c) ) {
+                process_digit(c, &scanner_p->index_value, &scanner_p->state, &scanner_p->error);
+                continue;
+            }
+            scanner_p->state = STATE_PARSE_SECTION_END;
+        }
+
+        switch( scanner_p->state ) {
+            case STATE_PARSE_SECTION_START:
+                {
+                    if( c == '/' ) {
+                        scanner_p->state = STATE_PARSE_ERROR;
+                        scanner_p->error = BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH;
+                    }
+                    else if( is_digit(c) ) {
+                        if( process_digit(c, &scanner_p->index_value,
+                                          &scanner_p->state, &scanner_p->error) )
+                        {
+                            if( scanner_p->num_sections == scanner_p->max_sections ) {
+                                scanner_p->state = STATE_PARSE_ERROR;
+                                scanner_p->error = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+                            }
+                            else {
+                                scanner_p->state = STATE_PARSE_VALUE;
+                            }
+                        }
+                    }
+                    else if( c == 0 ) {
+                        scanner_p->state = STATE_PARSE_ERROR;
+                        if( scanner_p->num_sections == 0 ) {
+                            scanner_p->error = BIP32_TEMPLATE_ERROR_PATH_EMPTY;
+                        }
+                        else {
+                            scanner_p->error = BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH;
+                        }
+                    }
+                    else {
+                        scanner_p->state = STATE_PARSE_ERROR;
+                        scanner_p->error = unexpected_char_error(c);
+                    }
+                } break;
+
+            case STATE_PARSE_NEXT_SECTION:
+                {
+                    if( c == '/' ) {
+                        scanner_p->state = STATE_PARSE_SECTION_START;
+                    }
+                    else if( c == 0 ) {
+                        scanner_p->state = STATE_PARSE_SUCCESS;
+                    }
+                    else {
+                        scanner_p->state = STATE_PARSE_ERROR;
+                        scanner_p->error = unexpected_char_error(c);
+                    }
+                } break;
+
+            case STATE_PARSE_SECTION_END:
+                {
+                    assert( scanner_p->index_value != INVALID_INDEX );
+                    if( c == '/' || c == 0 ) {
+                        *index_p = scanner_p->index_value;
+                        scanner_p->index_value = INVALID_INDEX;
+                        scanner_p->num_sections++;
+                        scanner_p->is_prev_section_hardened = 0;
+                        scanner_p->state = ( c == 0 ? STATE_PARSE_SUCCESS : STATE_PARSE_SECTION_START );
+                        return 1;
+                    }
+                    else if( c == scanner_p->accepted_hardened_markers[0]
+                                || c == scanner_p->accepted_hardened_markers[1] )
+                    {
+                        if( scanner_p->num_sections > 0 && !scanner_p->is_prev_section_hardened ) {
+                            scanner_p->state = STATE_PARSE_ERROR;
+                            scanner_p->error = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
+                        }
+                        else {
+                            scanner_p->accepted_hardened_markers[0] = c;
+                            scanner_p->accepted_hardened_markers[1] = c;
+                            *index_p = scanner_p->index_value + HARDENED_INDEX_START;
+                            scanner_p->index_value = INVALID_INDEX;
+                            scanner_p->num_sections++;
+                            scanner_p->is_prev_section_hardened = 1;
+                            scanner_p->state = STATE_PARSE_NEXT_SECTION;
+                            return 1;
+                        }
+                    }
+                    else if( c == HARDENED_MARKER_LETTER
+                                || c == HARDENED_MARKER_APOSTROPHE )
+                    {
+                        scanner_p->state = STATE_PARSE_ERROR;
+                        scanner_p->error = BIP32_TEMPLATE_ERROR_UNEXPECTED_HARDENED_MARKER;
+                    }
+                    else {
+                        scanner_p->state = STATE_PARSE_ERROR;
+                        scanner_p->error = unexpected_char_error(c);
+                    }
+                } break;
+
+            default:
+                /* should not happen, all cases must be hanlded */
+                assert(0); /* UNREACHABLE */
+        }
+    }
+
+    return 0;
+}
+
+BIP32_TEMPLATE_API
 void bip32_template_context_set_string(const char* template_string, bip32_template_getchar_context_type* ctx)
 {
     ctx->pos = 0;
@@ -324,6 +540,7 @@ void bip32_template_context_set_string(const char* template_string, bip32_templa
     ctx->data.str = template_string;
 }
 
+BIP32_TEMPLATE_API
 int bip32_template_getchar(bip32_template_getchar_context_type* ctx, char* out_p)
 {
     if( ctx->pos == UINT_MAX ) {
@@ -345,9 +562,101 @@ int bip32_template_getchar(bip32_template_getchar_context_type* ctx, char* out_p
     return 1;
 }
 
+/* The span does not need to be NUL-terminated. The end of the span is seen
+ * by the parser as the terminating NUL, so that the template can be parsed
+ * in place from within a larger string */
+BIP32_TEMPLATE_API
+void bip32_template_context_set_span(const char* str, size_t len, bip32_template_getchar_context_type* ctx)
+{
+    ctx->pos = 0;
+    ctx->stop = 0;
+    ctx->data.span.str = str;
+    ctx->data.span.len = len;
+}
+
+BIP32_TEMPLATE_API
+int bip32_template_getchar_span(bip32_template_getchar_context_type* ctx, char* out_p)
+{
+    if( ctx->pos == UINT_MAX ) {
+        ctx->stop = 1;
+    }
+
+    if( ctx->stop ) {
+        return 0;
+    }
+
+    ctx->pos++;
+
+    *out_p = (size_t)ctx->pos <= ctx->data.span.len ? ctx->data.span.str[ctx->pos-1] : 0;
+
+    if( *out_p == 0 ) {
+        ctx->stop = 1;
+    }
+
+    return 1;
+}
+
+BIP32_TEMPLATE_API
 int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_template_getchar_context_type* ctx,
                          bip32_template_format_mode_type mode,
                          bip32_template_type* template_p, bip32_template_error_type* error_p)
+{
+    return bip32_template_parse_resumable(get_char, ctx, mode, template_p, error_p, 0, 0, 0, 0);
+}
+
+/* Report the boundary after the '/' just read. Returns the result of boundary_func */
+static int report_boundary(unsigned int num_sections, int is_partial, int is_prev_section_hardened,
+                           unsigned int pos, const char* accepted_hardened_markers,
+                           bip32_template_boundary_func_type boundary_func, void* boundary_arg)
+{
+    bip32_template_boundary_type boundary;
+
+    assert( num_sections > 0 );
+
+    boundary.pos = pos;
+    boundary.num_sections = (uint8_t)num_sections;
+    boundary.is_partial = (uint8_t)is_partial;
+    boundary.is_prev_section_hardened = (uint8_t)is_prev_section_hardened;
+    boundary.hardened_marker = ( accepted_hardened_markers[0] == accepted_hardened_markers[1]
+                                 ? accepted_hardened_markers[0] : 0 );
+
+    return boundary_func(&boundary, boundary_arg);
+}
+
+/* Make the section at num_sections ready to receive ranges, and return it.
+ * Returns 0 when the template is full: the FSM reports PATH_TOO_LONG before touching the section then */
+static bip32_template_section_type* start_section(bip32_template_type* template_p, unsigned int num_sections)
+{
+    bip32_template_section_type* section_p;
+    int i;
+
+    if( num_sections == BIP32_TEMPLATE_MAX_SECTIONS ) {
+        return 0;
+    }
+
+    section_p = &template_p->sections[num_sections];
+    section_p->num_ranges = 0;
+    for( i = 0; i < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; i++ ) {
+        section_p->ranges[i].range_start = INVALID_INDEX;
+        section_p->ranges[i].range_end = INVALID_INDEX;
+    }
+
+    return section_p;
+}
+
+/* Same as bip32_template_parse(), but boundary_func (if not 0) is called after each '/'
+ * that ends a section, and the parsing can be continued from a boundary reported earlier:
+ * with resume_p not 0, template_p must hold the sections parsed before the boundary,
+ * and ctx must return the character after the '/' next.
+ * If boundary_func returns 0, the parsing stops, 0 is returned and *is_stopped_p is set to 1 */
+BIP32_TEMPLATE_API
+int bip32_template_parse_resumable(bip32_template_getchar_func_type get_char,
+                                   bip32_template_getchar_context_type* ctx,
+                                   bip32_template_format_mode_type mode,
+                                   bip32_template_type* template_p, bip32_template_error_type* error_p,
+                                   const bip32_template_boundary_type* resume_p,
+                                   bip32_template_boundary_func_type boundary_func, void* boundary_arg,
+                                   int* is_stopped_p)
 {
     parse_state_type state = STATE_PARSE_SECTION_START;
     bip32_template_error_type error = BIP32_TEMPLATE_ERROR_UNDEFINED;
@@ -357,19 +666,33 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
     int is_format_onlypath = mode == BIP32_TEMPLATE_FORMAT_ONLYPATH;
     char accepted_hardened_markers[2] = { HARDENED_MARKER_LETTER,
                                           HARDENED_MARKER_APOSTROPHE };
+    int is_stopped = 0;
+    unsigned int num_sections = 0;
+    int is_partial = 1;
+    int is_prev_section_hardened = 0;
+    bip32_template_section_type* section_p;
     char c;
-    int i, ii;
-
-    template_p->is_partial = 1;
-    template_p->num_sections = 0;
-    for( i = 0; i < BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
-        template_p->sections[i].num_ranges = 0;
-        for( ii = 0; ii < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; ii++ ) {
-            template_p->sections[i].ranges[ii].range_start = INVALID_INDEX;
-            template_p->sections[i].ranges[ii].range_end = INVALID_INDEX;
+    unsigned int i;
+
+    if( resume_p ) {
+        assert( resume_p->num_sections > 0 );
+        assert( resume_p->num_sections <= BIP32_TEMPLATE_MAX_SECTIONS );
+        is_partial = resume_p->is_partial;
+        num_sections = resume_p->num_sections;
+        is_prev_section_hardened = resume_p->is_prev_section_hardened;
+        if( resume_p->hardened_marker ) {
+            accepted_hardened_markers[0] = resume_p->hardened_marker;
+            accepted_hardened_markers[1] = resume_p->hardened_marker;
         }
     }
 
+    template_p->is_partial = (uint8_t)is_partial;
+    template_p->num_sections = (uint8_t)num_sections;
+    for( i = num_sections + 1; i < BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
+        start_section(template_p, i);
+    }
+    section_p = start_section(template_p, num_sections);
+
     while( !is_parse_finished(state) ) {
         if( !get_char(ctx, &c) ) {
             state = STATE_PARSE_ERROR;
@@ -377,20 +700,13 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
             break;
         }
 
-        /* PrefixParserFSM logic starts */
-        if( c == 'm' && ctx->pos == 1 ) {
-            template_p->is_partial = 0;
-            continue;
-        }
-        else if ( !template_p->is_partial && ctx->pos == 2 ) {
-            if( c == '/' ) {
-                continue;
+        if( process_prefix_char(c, ctx->pos, &is_partial, &state, &error) ) {
+            if( state == STATE_PARSE_ERROR ) {
+                break;
             }
-            state = STATE_PARSE_ERROR;
-            error = unexpected_char_error(c);
-            break;
+            template_p->is_partial = (uint8_t)is_partial;
+            continue;
         }
-        /* PrefixParserFSM logic ends */
 
         if( state == STATE_PARSE_VALUE && !is_digit(c) ) {
             assert( return_state != STATE_PARSE_INVALID );
@@ -403,7 +719,7 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
             case STATE_PARSE_SECTION_START:
                 {
                     if( (c == '{' || c == '*') && !is_format_onlypath
-                        && template_p->num_sections == BIP32_TEMPLATE_MAX_SECTIONS )
+                        && num_sections == BIP32_TEMPLATE_MAX_SECTIONS )
                     {
                         state = STATE_PARSE_ERROR;
                         error = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
@@ -414,16 +730,12 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                         return_state = STATE_PARSE_RANGE_WITHIN_SECTION;
                     }
                     else if( c == '*' && !is_format_onlypath ) {
-                        open_path_section_range(template_p, 0);
+                        open_path_section_range(section_p, 0);
                         index_value = MAX_INDEX_VALUE;
                         state = STATE_PARSE_SECTION_END;
                     }
-                    else if( c == '/' ) {
-                        state = STATE_PARSE_ERROR;
-                        error = BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH;
-                    }
                     else if( is_digit(c)
-                             && template_p->num_sections == BIP32_TEMPLATE_MAX_SECTIONS )
+                             && num_sections == BIP32_TEMPLATE_MAX_SECTIONS )
                     {
                         if( process_digit(c, &index_value, &state, &error) ) {
                             state = STATE_PARSE_ERROR;
@@ -436,19 +748,9 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                             return_state = STATE_PARSE_SECTION_END;
                         }
                     }
-                    else if( c == 0 ) {
-                        if( template_p->num_sections == 0 ) {
-                            state = STATE_PARSE_ERROR;
-                            error = BIP32_TEMPLATE_ERROR_PATH_EMPTY;
-                        }
-                        else {
-                            state = STATE_PARSE_ERROR;
-                            error = BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH;
-                        }
-                    }
                     else {
                         state = STATE_PARSE_ERROR;
-                        error = unexpected_char_error(c);
+                        error = section_start_error(c, num_sections);
                     }
                 } break;
 
@@ -456,6 +758,11 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                 {
                     if( c == '/' ) {
                         state = STATE_PARSE_SECTION_START;
+                        if( boundary_func ) {
+                            is_stopped = !report_boundary(num_sections, is_partial, is_prev_section_hardened,
+                                                          ctx->pos, accepted_hardened_markers,
+                                                          boundary_func, boundary_arg);
+                        }
                     }
                     else if( c == 0 ) {
                         state = STATE_PARSE_SUCCESS;
@@ -470,26 +777,13 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                 {
                     assert( !is_format_onlypath );
 
-                    if( c == 0 ) {
+                    if( c == 0 || index_value == INVALID_INDEX ) {
                         state = STATE_PARSE_ERROR;
-                        error = BIP32_TEMPLATE_ERROR_UNEXPECTED_FINISH;
-                    }
-                    else if( index_value == INVALID_INDEX ) {
-                        if( c == ' ' ) {
-                            state = STATE_PARSE_ERROR;
-                            error = BIP32_TEMPLATE_ERROR_UNEXPECTED_SPACE;
-                        }
-                        else {
-                            state = STATE_PARSE_ERROR;
-                            error = BIP32_TEMPLATE_ERROR_DIGIT_EXPECTED;
-                        }
+                        error = range_char_error(c, index_value);
                     }
                     else if( c == '-' ) {
-                        if( !is_range_open(
-                                    get_last_section_range(
-                                        get_last_section(template_p))) )
-                        {
-                            open_path_section_range(template_p, index_value);
+                        if( !is_range_open(get_last_section_range(section_p)) ) {
+                            open_path_section_range(section_p, index_value);
                             index_value = INVALID_INDEX;
                             state = STATE_PARSE_VALUE;
                             return_state = STATE_PARSE_RANGE_WITHIN_SECTION;
@@ -500,19 +794,19 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                         }
                     }
                     else if( c == ',' ) {
-                        if( template_p->sections[template_p->num_sections].num_ranges
-                                == BIP32_TEMPLATE_MAX_RANGES_PER_SECTION - 1 )
+                        if( section_p->num_ranges == BIP32_TEMPLATE_MAX_RANGES_PER_SECTION - 1 )
                         {
                             state = STATE_PARSE_ERROR;
                             error = BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG;
                         }
                         else {
-                            int was_open = finalize_last_section_range(template_p, index_value);
-                            if( check_range_correctness(template_p, &state, &error,
-                                                        was_open, is_format_unambiguous,
-                                                        RANGE_CORRECTNESS_FLAG_RANGE_NEXT) )
+                            int was_open = finalize_last_section_range(section_p, index_value);
+                            if( check_last_section_range_correctness(
+                                        section_p, &state, &error,
+                                        was_open, is_format_unambiguous,
+                                        RANGE_CORRECTNESS_FLAG_RANGE_NEXT) )
                             {
-                                normalize_last_section_and_advance_ranges(template_p);
+                                normalize_last_section_and_advance_ranges(section_p);
                                 index_value = INVALID_INDEX;
                                 state = STATE_PARSE_VALUE;
                                 return_state = STATE_PARSE_RANGE_WITHIN_SECTION;
@@ -520,17 +814,18 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                         }
                     }
                     else if( c == '}' ) {
-                        int was_open = finalize_last_section_range(template_p, index_value);
-                        if( check_range_correctness(template_p, &state, &error,
-                                                    was_open, is_format_unambiguous,
-                                                    RANGE_CORRECTNESS_FLAG_RANGE_LAST) )
+                        int was_open = finalize_last_section_range(section_p, index_value);
+                        if( check_last_section_range_correctness(
+                                    section_p, &state, &error,
+                                    was_open, is_format_unambiguous,
+                                    RANGE_CORRECTNESS_FLAG_RANGE_LAST) )
                         {
                             state = STATE_PARSE_SECTION_END;
                         }
                     }
                     else {
                         state = STATE_PARSE_ERROR;
-                        error = unexpected_char_error(c);
+                        error = range_char_error(c, index_value);
                     }
                 } break;
 
@@ -538,18 +833,25 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                 {
                     assert( index_value != INVALID_INDEX );
                     if( c == '/' || c == 0 ) {
-                        finalize_last_section_range(template_p, index_value);
-                        normalize_last_section_and_advance_ranges(template_p);
-                        assert( template_p->num_sections < BIP32_TEMPLATE_MAX_SECTIONS );
-                        template_p->num_sections++;
+                        finalize_last_section_range(section_p, index_value);
+                        normalize_last_section_and_advance_ranges(section_p);
+                        assert( num_sections < BIP32_TEMPLATE_MAX_SECTIONS );
+                        num_sections++;
+                        is_prev_section_hardened = 0;
+                        template_p->num_sections = (uint8_t)num_sections;
+                        section_p = start_section(template_p, num_sections);
                         index_value = INVALID_INDEX;
                         state = ( c == 0 ? STATE_PARSE_SUCCESS : STATE_PARSE_SECTION_START );
+                        if( c == '/' && boundary_func ) {
+                            is_stopped = !report_boundary(num_sections, is_partial, is_prev_section_hardened,
+                                                          ctx->pos, accepted_hardened_markers,
+                                                          boundary_func, boundary_arg);
+                        }
                     }
                     else if( c == accepted_hardened_markers[0]
                                 || c == accepted_hardened_markers[1] )
                     {
-                        if( template_p->num_sections > 0
-                            && !is_prev_section_hardened(template_p) )
+                        if( num_sections > 0 && !is_prev_section_hardened )
                         {
                             state = STATE_PARSE_ERROR;
                             error = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
@@ -557,24 +859,21 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
                         else {
                             accepted_hardened_markers[0] = c;
                             accepted_hardened_markers[1] = c;
-                            finalize_last_section_range(template_p, index_value);
-                            normalize_last_section_and_advance_ranges(template_p);
-                            harden_last_section(template_p);
-                            assert( template_p->num_sections < BIP32_TEMPLATE_MAX_SECTIONS );
-                            template_p->num_sections++;
+                            finalize_last_section_range(section_p, index_value);
+                            normalize_last_section_and_advance_ranges(section_p);
+                            harden_last_section(section_p);
+                            assert( num_sections < BIP32_TEMPLATE_MAX_SECTIONS );
+                            num_sections++;
+                            is_prev_section_hardened = 1;
+                            template_p->num_sections = (uint8_t)num_sections;
+                            section_p = start_section(template_p, num_sections);
                             index_value = INVALID_INDEX;
                             state = STATE_PARSE_NEXT_SECTION;
                         }
                     }
-                    else if( c == HARDENED_MARKER_LETTER
-                                || c == HARDENED_MARKER_APOSTROPHE )
-                    {
-                        state = STATE_PARSE_ERROR;
-                        error = BIP32_TEMPLATE_ERROR_UNEXPECTED_HARDENED_MARKER;
-                    }
                     else {
                         state = STATE_PARSE_ERROR;
-                        error = unexpected_char_error(c);
+                        error = section_end_error(c);
                     }
                 } break;
 
@@ -592,6 +891,20 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
             assert( is_parse_finished(state) );
             break;
         }
+
+        if( is_stopped ) {
+            break;
+        }
+    }
+
+    if( is_stopped_p ) {
+        *is_stopped_p = is_stopped;
+    }
+    if( is_stopped ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+        }
+        return 0;
     }
 
     assert( error == BIP32_TEMPLATE_ERROR_UNDEFINED || state == STATE_PARSE_ERROR );
@@ -603,6 +916,7 @@ int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_templa
     return state == STATE_PARSE_SUCCESS;
 }
 
+BIP32_TEMPLATE_API
 int bip32_template_parse_string(const char* template_string, bip32_template_format_mode_type mode,
                                 bip32_template_type* template_p, bip32_template_error_type* error_p,
                                 unsigned int* last_pos_p)
@@ -616,51 +930,421 @@ int bip32_template_parse_string(const char* template_string, bip32_template_form
     return result;
 }
 
-int bip32_template_match(const bip32_template_type* template_p, const uint32_t* path_p, unsigned int path_len)
+/* The state that bip32_template_validate() keeps instead of the template:
+ * only the counters, the hardened flag of the previous section, the range being parsed
+ * and the previous range within the section. Its size does not depend on the configured limits */
+typedef struct {
+    unsigned int num_sections;
+    unsigned int num_ranges;
+    int is_partial;
+    int is_prev_section_hardened;
+    bip32_template_section_range_type prev_range;
+    bip32_template_section_range_type range;
+} validation_state_type;
+
+static void validation_reset_range(validation_state_type* vstate_p)
 {
-    int i, ii;
-    int range_match;
-
-    if( template_p->num_sections != path_len ) {
-        return 0;
-    }
-    for( i = 0; i < template_p->num_sections; i++ ) {
-        range_match = 0;
-        for( ii = 0; ii < template_p->sections[i].num_ranges; ii++ ) {
-            if( path_p[i] < template_p->sections[i].ranges[ii].range_start
-                || path_p[i] > template_p->sections[i].ranges[ii].range_end )
-            {
-                /* Do nothing.
-                 * This way the condition check here matches
-                 * the condition check in the formal spec */
-            }
-            else {
-                range_match = 1;
-                break;
-            }
-        }
-        if( ! range_match ) {
-            return 0;
-        }
-    }
+    vstate_p->range.range_start = INVALID_INDEX;
+    vstate_p->range.range_end = INVALID_INDEX;
+}
 
-    return 1;
+static int check_validated_range_correctness(validation_state_type* vstate_p,
+                                             parse_state_type* state_p, bip32_template_error_type* error_p,
+                                             int range_was_open, int is_format_unambiguous,
+                                             range_correctness_flag_type flag)
+{
+    return check_range_correctness(&vstate_p->range,
+                                   vstate_p->num_ranges > 0 ? &vstate_p->prev_range : 0,
+                                   state_p, error_p, range_was_open, is_format_unambiguous, flag);
 }
 
-/* Convert template to a simple path.
- * Returns 0 if any section contains more than one range
- * or any range has range_start != range_end,
- * Returns 1 otherwise, and puts the path into path_p and path len into path_len_p
- * Caller must set *path_len_p to the available number of elements in path_p */
-int bip32_template_to_path(const bip32_template_type* template_p, uint32_t* path_p, unsigned int* path_len_p)
+/* Same as normalize_last_section_and_advance_ranges(), but on the rolling state */
+static void validation_normalize_and_advance_ranges(validation_state_type* vstate_p)
 {
-    int i;
+    assert( vstate_p->num_ranges < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION );
+    assert( vstate_p->range.range_start <= MAX_INDEX_VALUE );
+    assert( vstate_p->range.range_end <= MAX_INDEX_VALUE );
 
-    if( template_p->num_sections > *path_len_p ) {
-        return 0;
+    if( vstate_p->num_ranges == 0 || !join_adjacent_range(&vstate_p->prev_range, &vstate_p->range) ) {
+        vstate_p->prev_range = vstate_p->range;
+        vstate_p->num_ranges++;
     }
+    validation_reset_range(vstate_p);
+}
 
-    for( i = 0; i < template_p->num_sections; i++ ) {
+static void validation_finish_section(validation_state_type* vstate_p, int is_hardened)
+{
+    assert( vstate_p->num_sections < BIP32_TEMPLATE_MAX_SECTIONS );
+    vstate_p->num_sections++;
+    vstate_p->num_ranges = 0;
+    vstate_p->is_prev_section_hardened = is_hardened;
+}
+
+/* Check the template without building it.
+ * The result, the error and the position of the error are the same
+ * as of bip32_template_parse() with the same mode: the states follow the parser FSM,
+ * and the character classes, the errors and the range checks are the same functions.
+ * Only the fixed-size rolling state is kept on the stack, regardless of the
+ * BIP32_TEMPLATE_MAX_SECTIONS and BIP32_TEMPLATE_MAX_RANGES_PER_SECTION values */
+BIP32_TEMPLATE_API
+int bip32_template_validate(bip32_template_getchar_func_type get_char, bip32_template_getchar_context_type* ctx,
+                            bip32_template_format_mode_type mode, bip32_template_error_type* error_p)
+{
+    parse_state_type state = STATE_PARSE_SECTION_START;
+    bip32_template_error_type error = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    parse_state_type return_state = STATE_PARSE_INVALID;
+    uint32_t index_value = INVALID_INDEX;
+    int is_format_unambiguous = mode == BIP32_TEMPLATE_FORMAT_UNAMBIGOUS;
+    int is_format_onlypath = mode == BIP32_TEMPLATE_FORMAT_ONLYPATH;
+    char accepted_hardened_markers[2] = { HARDENED_MARKER_LETTER,
+                                          HARDENED_MARKER_APOSTROPHE };
+    validation_state_type vstate;
+    char c;
+
+    vstate.num_sections = 0;
+    vstate.num_ranges = 0;
+    vstate.is_partial = 1;
+    vstate.is_prev_section_hardened = 0;
+    vstate.prev_range.range_start = INVALID_INDEX;
+    vstate.prev_range.range_end = INVALID_INDEX;
+    validation_reset_range(&vstate);
+
+    while( !is_parse_finished(state) ) {
+        if( !get_char(ctx, &c) ) {
+            state = STATE_PARSE_ERROR;
+            error = BIP32_TEMPLATE_ERROR_GETCHAR_FAILED;
+            break;
+        }
+
+        if( process_prefix_char(c, ctx->pos, &vstate.is_partial, &state, &error) ) {
+            if( state == STATE_PARSE_ERROR ) {
+                break;
+            }
+            continue;
+        }
+
+        if( state == STATE_PARSE_VALUE && !is_digit(c) ) {
+            assert( return_state != STATE_PARSE_INVALID );
+            assert( return_state != STATE_PARSE_VALUE );
+            state = return_state;
+            return_state = STATE_PARSE_INVALID;
+        }
+
+        switch( state ) {
+            case STATE_PARSE_SECTION_START:
+                {
+                    if( (c == '{' || c == '*') && !is_format_onlypath
+                        && vstate.num_sections == BIP32_TEMPLATE_MAX_SECTIONS )
+                    {
+                        state = STATE_PARSE_ERROR;
+                        error = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+                    }
+                    else if( c == '{' && !is_format_onlypath ) {
+                        index_value = INVALID_INDEX;
+                        state = STATE_PARSE_VALUE;
+                        return_state = STATE_PARSE_RANGE_WITHIN_SECTION;
+                    }
+                    else if( c == '*' && !is_format_onlypath ) {
+                        vstate.range.range_start = 0;
+                        index_value = MAX_INDEX_VALUE;
+                        state = STATE_PARSE_SECTION_END;
+                    }
+                    else if( is_digit(c)
+                             && vstate.num_sections == BIP32_TEMPLATE_MAX_SECTIONS )
+                    {
+                        if( process_digit(c, &index_value, &state, &error) ) {
+                            state = STATE_PARSE_ERROR;
+                            error = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+                        }
+                    }
+                    else if( is_digit(c) ) {
+                        if( process_digit(c, &index_value, &state, &error) ) {
+                            state = STATE_PARSE_VALUE;
+                            return_state = STATE_PARSE_SECTION_END;
+                        }
+                    }
+                    else {
+                        state = STATE_PARSE_ERROR;
+                        error = section_start_error(c, vstate.num_sections);
+                    }
+                } break;
+
+            case STATE_PARSE_NEXT_SECTION:
+                {
+                    if( c == '/' ) {
+                        state = STATE_PARSE_SECTION_START;
+                    }
+                    else if( c == 0 ) {
+                        state = STATE_PARSE_SUCCESS;
+                    }
+                    else {
+                        state = STATE_PARSE_ERROR;
+                        error = unexpected_char_error(c);
+                    }
+                } break;
+
+            case STATE_PARSE_RANGE_WITHIN_SECTION:
+                {
+                    assert( !is_format_onlypath );
+
+                    if( c == 0 || index_value == INVALID_INDEX ) {
+                        state = STATE_PARSE_ERROR;
+                        error = range_char_error(c, index_value);
+                    }
+                    else if( c == '-' ) {
+                        if( !is_range_open(&vstate.range) ) {
+                            assert( vstate.range.range_start == INVALID_INDEX );
+                            vstate.range.range_start = index_value;
+                            index_value = INVALID_INDEX;
+                            state = STATE_PARSE_VALUE;
+                            return_state = STATE_PARSE_RANGE_WITHIN_SECTION;
+                        }
+                        else {
+                            state = STATE_PARSE_ERROR;
+                            error = range_char_error(c, index_value);
+                        }
+                    }
+                    else if( c == ',' ) {
+                        if( vstate.num_ranges == BIP32_TEMPLATE_MAX_RANGES_PER_SECTION - 1 ) {
+                            state = STATE_PARSE_ERROR;
+                            error = BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG;
+                        }
+                        else {
+                            int was_open = finalize_range(&vstate.range, index_value);
+                            if( check_validated_range_correctness(
+                                        &vstate, &state, &error,
+                                        was_open, is_format_unambiguous,
+                                        RANGE_CORRECTNESS_FLAG_RANGE_NEXT) )
+                            {
+                                validation_normalize_and_advance_ranges(&vstate);
+                                index_value = INVALID_INDEX;
+                                state = STATE_PARSE_VALUE;
+                                return_state = STATE_PARSE_RANGE_WITHIN_SECTION;
+                            }
+                        }
+                    }
+                    else if( c == '}' ) {
+                        int was_open = finalize_range(&vstate.range, index_value);
+                        if( check_validated_range_correctness(
+                                    &vstate, &state, &error,
+                                    was_open, is_format_unambiguous,
+                                    RANGE_CORRECTNESS_FLAG_RANGE_LAST) )
+                        {
+                            state = STATE_PARSE_SECTION_END;
+                        }
+                    }
+                    else {
+                        state = STATE_PARSE_ERROR;
+                        error = range_char_error(c, index_value);
+                    }
+                } break;
+
+            case STATE_PARSE_SECTION_END:
+                {
+                    assert( index_value != INVALID_INDEX );
+                    if( c == '/' || c == 0 ) {
+                        finalize_range(&vstate.range, index_value);
+                        validation_normalize_and_advance_ranges(&vstate);
+                        validation_finish_section(&vstate, 0);
+                        index_value = INVALID_INDEX;
+                        state = ( c == 0 ? STATE_PARSE_SUCCESS : STATE_PARSE_SECTION_START );
+                    }
+                    else if( c == accepted_hardened_markers[0]
+                                || c == accepted_hardened_markers[1] )
+                    {
+                        if( vstate.num_sections > 0 && !vstate.is_prev_section_hardened ) {
+                            state = STATE_PARSE_ERROR;
+                            error = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
+                        }
+                        else {
+                            accepted_hardened_markers[0] = c;
+                            accepted_hardened_markers[1] = c;
+                            finalize_range(&vstate.range, index_value);
+                            validation_normalize_and_advance_ranges(&vstate);
+                            validation_finish_section(&vstate, 1);
+                            index_value = INVALID_INDEX;
+                            state = STATE_PARSE_NEXT_SECTION;
+                        }
+                    }
+                    else {
+                        state = STATE_PARSE_ERROR;
+                        error = section_end_error(c);
+                    }
+                } break;
+
+            case STATE_PARSE_VALUE:
+                {
+                    process_digit(c, &index_value, &state, &error);
+                } break;
+
+            default:
+                /* should not happen, all cases must be hanlded */
+                assert(0); /* UNREACHABLE */
+        }
+
+        if( c == 0 ) {
+            assert( is_parse_finished(state) );
+            break;
+        }
+    }
+
+    assert( error == BIP32_TEMPLATE_ERROR_UNDEFINED || state == STATE_PARSE_ERROR );
+    assert( error != BIP32_TEMPLATE_ERROR_UNDEFINED || state == STATE_PARSE_SUCCESS );
+
+    if( error_p ) {
+        *error_p = error;
+    }
+    return state == STATE_PARSE_SUCCESS;
+}
+
+BIP32_TEMPLATE_API
+int bip32_template_validate_string(const char* template_string, bip32_template_format_mode_type mode,
+                                   bip32_template_error_type* error_p, unsigned int* last_pos_p)
+{
+    bip32_template_getchar_context_type ctx;
+    bip32_template_context_set_string(template_string, &ctx);
+    int result = bip32_template_validate(bip32_template_getchar, &ctx, mode, error_p);
+    if( last_pos_p ) {
+        *last_pos_p = ctx.pos;
+    }
+    return result;
+}
+
+BIP32_TEMPLATE_API
+int bip32_template_match(const bip32_template_type* template_p, const uint32_t* path_p, unsigned int path_len)
+{
+    int i;
+
+    if( template_p->num_sections != path_len ) {
+        return 0;
+    }
+    for( i = 0; i < template_p->num_sections; i++ ) {
+        if( ! bip32_template_is_index_in_section(&template_p->sections[i], path_p[i]) ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Match the path given as a string directly against the template,
+ * without building intermediate template or path.
+ * The string is parsed as with BIP32_TEMPLATE_FORMAT_ONLYPATH, the end of the string
+ * is at path_len bytes or at the first zero byte, whichever comes first.
+ * Each index is checked against its section as soon as it is read,
+ * and the function returns 0 at the first index that does not match.
+ * Returns 1 if the string is a valid path that matches the template, 0 otherwise */
+BIP32_TEMPLATE_API
+int bip32_template_match_string(const bip32_template_type* template_p, const char* path_string, size_t path_len)
+{
+    path_scanner_type scanner;
+    uint32_t index;
+
+    path_scanner_init(&scanner, path_string, path_len, template_p->num_sections);
+
+    while( path_scanner_next(&scanner, &index) ) {
+        if( ! bip32_template_is_index_in_section(&template_p->sections[scanner.num_sections-1], index) ) {
+            return 0;
+        }
+    }
+
+    return ( scanner.state == STATE_PARSE_SUCCESS
+             && scanner.num_sections == template_p->num_sections );
+}
+
+/* Find the smallest index of the section that is not less than value.
+ * The ranges of the section must be sorted, as the parser makes them.
+ * value is 64-bit so that the caller can ask for the index after 0xFFFFFFFF */
+static int find_section_index_at_or_after(const bip32_template_section_type* section_p,
+                                          uint64_t value, uint32_t* index_p)
+{
+    int lo = 0;
+    int hi = section_p->num_ranges;
+    int mid;
+
+    /* Find the first range that ends at or after the value */
+    while( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if( section_p->ranges[mid].range_end < value ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    if( lo == section_p->num_ranges ) {
+        return 0;
+    }
+
+    if( value < section_p->ranges[lo].range_start ) {
+        *index_p = section_p->ranges[lo].range_start;
+    }
+    else {
+        *index_p = (uint32_t)value;
+    }
+
+    return 1;
+}
+
+/* Find the smallest path that matches the template and is lexicographically
+ * not less than path_p. Both path_p and out_p have template_p->num_sections elements.
+ * Returns 1 and puts the path into out_p if there is such path, returns 0 otherwise */
+BIP32_TEMPLATE_API
+int bip32_template_next_match(const bip32_template_type* template_p, const uint32_t* path_p, uint32_t* out_p)
+{
+    int i, ii;
+    uint32_t index;
+
+    for( i = 0; i < template_p->num_sections; i++ ) {
+        if( !find_section_index_at_or_after(&template_p->sections[i], path_p[i], &index) ) {
+            break;
+        }
+        out_p[i] = index;
+        if( index > path_p[i] ) {
+            /* Already greater than the path, the rest can be the smallest indexes */
+            for( ii = i + 1; ii < template_p->num_sections; ii++ ) {
+                out_p[ii] = template_p->sections[ii].ranges[0].range_start;
+            }
+            return 1;
+        }
+    }
+
+    if( i == template_p->num_sections ) {
+        /* The path itself matches */
+        return 1;
+    }
+
+    /* The section i is exhausted. The sections before it are equal to the path,
+     * find the nearest of them that can be increased */
+    for( i = i - 1; i >= 0; i-- ) {
+        if( find_section_index_at_or_after(&template_p->sections[i], (uint64_t)path_p[i] + 1, &index) ) {
+            out_p[i] = index;
+            for( ii = i + 1; ii < template_p->num_sections; ii++ ) {
+                out_p[ii] = template_p->sections[ii].ranges[0].range_start;
+            }
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Convert template to a simple path.
+ * Returns 0 if any section contains more than one range
+ * or any range has range_start != range_end,
+ * Returns 1 otherwise, and puts the path into path_p and path len into path_len_p
+ * Caller must set *path_len_p to the available number of elements in path_p */
+BIP32_TEMPLATE_API
+int bip32_template_to_path(const bip32_template_type* template_p, uint32_t* path_p, unsigned int* path_len_p)
+{
+    int i;
+
+    if( template_p->num_sections > *path_len_p ) {
+        return 0;
+    }
+
+    for( i = 0; i < template_p->num_sections; i++ ) {
         if( template_p->sections[i].num_ranges != 1 ) {
             return 0;
         }
@@ -677,6 +1361,407 @@ int bip32_template_to_path(const bip32_template_type* template_p, uint32_t* path
     return 1;
 }
 
+/* Parse the path string directly into the array of indexes,
+ * with the same error codes and error positions as bip32_template_parse_string()
+ * with BIP32_TEMPLATE_FORMAT_ONLYPATH.
+ * The end of the string is at path_string_len bytes or at the first zero byte,
+ * whichever comes first.
+ * Caller must set *path_len_p to the available number of elements in path_p.
+ * If it is less than BIP32_TEMPLATE_MAX_SECTIONS, paths longer than *path_len_p
+ * fail with BIP32_TEMPLATE_ERROR_PATH_TOO_LONG.
+ * Returns 1 on success, and puts the path len into path_len_p,
+ * and 0 or 1 into is_partial_p (if it is not NULL) depending on the "m/" prefix.
+ * Returns 0 on failure, with error and position put into error_p and last_pos_p
+ * (if they are not NULL) */
+BIP32_TEMPLATE_API
+int bip32_path_parse(const char* path_string, size_t path_string_len,
+                     uint32_t* path_p, unsigned int* path_len_p, unsigned int* is_partial_p,
+                     bip32_template_error_type* error_p, unsigned int* last_pos_p)
+{
+    path_scanner_type scanner;
+    uint32_t index;
+    unsigned int max_sections = BIP32_TEMPLATE_MAX_SECTIONS;
+
+    if( *path_len_p < max_sections ) {
+        max_sections = *path_len_p;
+    }
+
+    path_scanner_init(&scanner, path_string, path_string_len, max_sections);
+
+    while( path_scanner_next(&scanner, &index) ) {
+        assert( scanner.num_sections <= max_sections );
+        path_p[scanner.num_sections-1] = index;
+    }
+
+    assert( scanner.error == BIP32_TEMPLATE_ERROR_UNDEFINED || scanner.state == STATE_PARSE_ERROR );
+    assert( scanner.error != BIP32_TEMPLATE_ERROR_UNDEFINED || scanner.state == STATE_PARSE_SUCCESS );
+
+    if( error_p ) {
+        *error_p = scanner.error;
+    }
+    if( last_pos_p ) {
+        *last_pos_p = scanner.pos;
+    }
+    if( scanner.state != STATE_PARSE_SUCCESS ) {
+        return 0;
+    }
+
+    *path_len_p = scanner.num_sections;
+    if( is_partial_p ) {
+        *is_partial_p = scanner.is_partial;
+    }
+
+    return 1;
+}
+
+/* Section editing.
+ * The indexes given to these functions are without the hardened bit: the section keeps
+ * its hardened flag, and the ranges are kept sorted, disjoint and with adjacent ranges merged,
+ * as they are after parsing in BIP32_TEMPLATE_FORMAT_AMBIGOUS mode. The ranges to replace
+ * are found with binary search, and on error the template is not changed. */
+
+static uint32_t section_hardened_offset(const bip32_template_section_type* section_p)
+{
+    assert( section_p->num_ranges > 0 );
+
+    return section_p->ranges[0].range_start >= HARDENED_INDEX_START ? HARDENED_INDEX_START : 0;
+}
+
+/* The first range of the section that ends at or after the index, num_ranges if none */
+static int find_range_ending_at_or_after(const bip32_template_section_type* section_p,
+                                         uint32_t offset, uint32_t index)
+{
+    int lo = 0;
+    int hi = section_p->num_ranges;
+    int mid;
+
+    while( lo < hi ) {
+        mid = (lo + hi) / 2;
+        if( section_p->ranges[mid].range_end - offset < index ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* The first range of the section that starts after the index, num_ranges if none */
+static int find_range_starting_after(const bip32_template_section_type* section_p,
+                                     uint32_t offset, uint32_t index)
+{
+    int lo = 0;
+    int hi = section_p->num_ranges;
+    int mid;
+
+    while( lo < hi ) {
+        mid = (lo + hi) / 2;
+        if( section_p->ranges[mid].range_start - offset <= index ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Replace the ranges from first up to (not including) last with num_new ranges */
+static void splice_section_ranges(bip32_template_section_type* section_p, int first, int last,
+                                  const bip32_template_section_range_type* new_ranges, int num_new)
+{
+    int num_ranges = section_p->num_ranges - (last - first) + num_new;
+    int i;
+
+    assert( first <= last && last <= section_p->num_ranges );
+    assert( num_ranges > 0 && num_ranges <= BIP32_TEMPLATE_MAX_RANGES_PER_SECTION );
+
+    if( num_new < last - first ) {
+        for( i = last; i < section_p->num_ranges; i++ ) {
+            section_p->ranges[i - (last - first) + num_new] = section_p->ranges[i];
+        }
+    }
+    else {
+        for( i = section_p->num_ranges - 1; i >= last; i-- ) {
+            section_p->ranges[i - (last - first) + num_new] = section_p->ranges[i];
+        }
+    }
+
+    for( i = 0; i < num_new; i++ ) {
+        section_p->ranges[first + i] = new_ranges[i];
+    }
+
+    for( i = num_ranges; i < section_p->num_ranges; i++ ) {
+        section_p->ranges[i].range_start = INVALID_INDEX;
+        section_p->ranges[i].range_end = INVALID_INDEX;
+    }
+
+    section_p->num_ranges = (uint8_t)num_ranges;
+}
+
+static int check_edit_range(uint32_t range_start, uint32_t range_end, bip32_template_error_type* error_p)
+{
+    if( range_start > MAX_INDEX_VALUE || range_end > MAX_INDEX_VALUE ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_INDEX_TOO_BIG;
+        }
+        return 0;
+    }
+    if( range_start > range_end ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD;
+        }
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Add the indexes from range_start to range_end (inclusive) to the section.
+ * The indexes that are already in the section are allowed, and the ranges that overlap
+ * or are next to the added one are merged with it.
+ * Returns 0 with BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG in error_p if the result
+ * does not fit into BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ranges, with
+ * BIP32_TEMPLATE_ERROR_INDEX_TOO_BIG or BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD for bad range,
+ * and with BIP32_TEMPLATE_ERROR_PATH_TOO_LONG if the section is past the end of the template.
+ * error_p can be 0 */
+BIP32_TEMPLATE_API
+int bip32_template_section_add_range(bip32_template_type* template_p, unsigned int section,
+                                     uint32_t range_start, uint32_t range_end,
+                                     bip32_template_error_type* error_p)
+{
+    bip32_template_section_type* section_p;
+    bip32_template_section_range_type merged;
+    uint32_t offset;
+    int first, last;
+
+    if( error_p ) {
+        *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    }
+
+    if( section >= template_p->num_sections ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+        }
+        return 0;
+    }
+    if( !check_edit_range(range_start, range_end, error_p) ) {
+        return 0;
+    }
+
+    section_p = &template_p->sections[section];
+    offset = section_hardened_offset(section_p);
+
+    /* The ranges from first to last overlap the added range or are next to it */
+    first = find_range_ending_at_or_after(section_p, offset, range_start > 0 ? range_start - 1 : 0);
+    last = find_range_starting_after(section_p, offset, range_end + 1);
+
+    merged.range_start = range_start + offset;
+    merged.range_end = range_end + offset;
+    if( first < last ) {
+        if( section_p->ranges[first].range_start < merged.range_start ) {
+            merged.range_start = section_p->ranges[first].range_start;
+        }
+        if( section_p->ranges[last-1].range_end > merged.range_end ) {
+            merged.range_end = section_p->ranges[last-1].range_end;
+        }
+    }
+
+    if( section_p->num_ranges - (last - first) + 1 > BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG;
+        }
+        return 0;
+    }
+
+    splice_section_ranges(section_p, first, last, &merged, 1);
+
+    return 1;
+}
+
+/* Remove the indexes from range_start to range_end (inclusive) from the section.
+ * The indexes that are not in the section are allowed. A range can be split in two,
+ * so the result can need one more range than before.
+ * Returns 0 with BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG in error_p if the result
+ * does not fit into BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ranges, with
+ * BIP32_TEMPLATE_ERROR_PATH_EMPTY if no indexes would be left in the section,
+ * with BIP32_TEMPLATE_ERROR_INDEX_TOO_BIG or BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD for bad range,
+ * and with BIP32_TEMPLATE_ERROR_PATH_TOO_LONG if the section is past the end of the template.
+ * error_p can be 0 */
+BIP32_TEMPLATE_API
+int bip32_template_section_remove_range(bip32_template_type* template_p, unsigned int section,
+                                        uint32_t range_start, uint32_t range_end,
+                                        bip32_template_error_type* error_p)
+{
+    bip32_template_section_type* section_p;
+    bip32_template_section_range_type pieces[2];
+    int num_pieces = 0;
+    uint32_t offset;
+    int first, last;
+
+    if( error_p ) {
+        *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    }
+
+    if( section >= template_p->num_sections ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+        }
+        return 0;
+    }
+    if( !check_edit_range(range_start, range_end, error_p) ) {
+        return 0;
+    }
+
+    section_p = &template_p->sections[section];
+    offset = section_hardened_offset(section_p);
+
+    /* The ranges from first to last overlap the removed range */
+    first = find_range_ending_at_or_after(section_p, offset, range_start);
+    last = find_range_starting_after(section_p, offset, range_end);
+
+    if( first >= last ) {
+        return 1;
+    }
+
+    if( section_p->ranges[first].range_start < range_start + offset ) {
+        pieces[num_pieces].range_start = section_p->ranges[first].range_start;
+        pieces[num_pieces].range_end = range_start - 1 + offset;
+        num_pieces++;
+    }
+    if( section_p->ranges[last-1].range_end > range_end + offset ) {
+        pieces[num_pieces].range_start = range_end + 1 + offset;
+        pieces[num_pieces].range_end = section_p->ranges[last-1].range_end;
+        num_pieces++;
+    }
+
+    if( section_p->num_ranges - (last - first) + num_pieces > BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG;
+        }
+        return 0;
+    }
+    if( section_p->num_ranges - (last - first) + num_pieces == 0 ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_EMPTY;
+        }
+        return 0;
+    }
+
+    splice_section_ranges(section_p, first, last, pieces, num_pieces);
+
+    return 1;
+}
+
+/* Make the section hardened or unhardened.
+ * Returns 0 with BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED in error_p
+ * if the section would be hardened after an unhardened one,
+ * and with BIP32_TEMPLATE_ERROR_PATH_TOO_LONG if the section is past the end of the template.
+ * error_p can be 0 */
+BIP32_TEMPLATE_API
+int bip32_template_section_set_hardened(bip32_template_type* template_p, unsigned int section,
+                                        int is_hardened, bip32_template_error_type* error_p)
+{
+    bip32_template_section_type* section_p;
+    uint32_t offset;
+    int i;
+
+    if( error_p ) {
+        *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    }
+
+    if( section >= template_p->num_sections ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+        }
+        return 0;
+    }
+
+    section_p = &template_p->sections[section];
+    offset = section_hardened_offset(section_p);
+
+    if( (offset != 0) == (is_hardened != 0) ) {
+        return 1;
+    }
+
+    if( is_hardened && section > 0
+        && !section_hardened_offset(&template_p->sections[section-1]) )
+    {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
+        }
+        return 0;
+    }
+    if( !is_hardened && section + 1 < template_p->num_sections
+        && section_hardened_offset(&template_p->sections[section+1]) )
+    {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
+        }
+        return 0;
+    }
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        section_p->ranges[i].range_start ^= HARDENED_INDEX_START;
+        section_p->ranges[i].range_end ^= HARDENED_INDEX_START;
+    }
+
+    return 1;
+}
+
+/* Append the section with the single range from range_start to range_end (inclusive).
+ * Returns 0 with BIP32_TEMPLATE_ERROR_PATH_TOO_LONG in error_p if the template
+ * already has BIP32_TEMPLATE_MAX_SECTIONS sections, with
+ * BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED if hardened section would follow
+ * an unhardened one, and with BIP32_TEMPLATE_ERROR_INDEX_TOO_BIG
+ * or BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD for bad range. error_p can be 0 */
+BIP32_TEMPLATE_API
+int bip32_template_append_section(bip32_template_type* template_p, uint32_t range_start, uint32_t range_end,
+                                  int is_hardened, bip32_template_error_type* error_p)
+{
+    bip32_template_section_type* section_p;
+    uint32_t offset = is_hardened ? HARDENED_INDEX_START : 0;
+    int i;
+
+    if( error_p ) {
+        *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    }
+
+    if( template_p->num_sections >= BIP32_TEMPLATE_MAX_SECTIONS ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+        }
+        return 0;
+    }
+    if( !check_edit_range(range_start, range_end, error_p) ) {
+        return 0;
+    }
+    if( is_hardened && template_p->num_sections > 0
+        && !section_hardened_offset(&template_p->sections[template_p->num_sections-1]) )
+    {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
+        }
+        return 0;
+    }
+
+    section_p = &template_p->sections[template_p->num_sections];
+    section_p->num_ranges = 1;
+    section_p->ranges[0].range_start = range_start + offset;
+    section_p->ranges[0].range_end = range_end + offset;
+    for( i = 1; i < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; i++ ) {
+        section_p->ranges[i].range_start = INVALID_INDEX;
+        section_p->ranges[i].range_end = INVALID_INDEX;
+    }
+    template_p->num_sections++;
+
+    return 1;
+}
+
+BIP32_TEMPLATE_API
 const char* bip32_template_error_to_string(bip32_template_error_type error)
 {
     switch( error ) {
@@ -23,8 +23,25 @@
 #ifndef _BIP32_TEMPLATE_H_
 #define _BIP32_TEMPLATE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* With BIP32_TEMPLATE_HEADER_ONLY defined, the implementation is included into each
+ * translation unit that includes this header, and all functions are static inline,
+ * so that the compiler can inline them into the caller and resolve the getchar callback */
+#ifdef BIP32_TEMPLATE_HEADER_ONLY
+#define BIP32_TEMPLATE_API static inline
+#else
+#define BIP32_TEMPLATE_API
+#endif
+
+#ifdef __cplusplus
+#define BIP32_TEMPLATE_STATIC_ASSERT static_assert
+extern "C" {
+#else
+#define BIP32_TEMPLATE_STATIC_ASSERT _Static_assert
+#endif
+
 /* NOTE: uint8_t is used to hold number of sections and ranges */
 #ifndef BIP32_TEMPLATE_MAX_SECTIONS
 #define BIP32_TEMPLATE_MAX_SECTIONS 8
@@ -34,11 +51,11 @@
 #define BIP32_TEMPLATE_MAX_RANGES_PER_SECTION 4
 #endif
 
-_Static_assert(BIP32_TEMPLATE_MAX_SECTIONS <= 255, "should fit into uint8_t");
-_Static_assert(BIP32_TEMPLATE_MAX_SECTIONS > 0, "cannot be zero");
-_Static_assert(BIP32_TEMPLATE_MAX_RANGES_PER_SECTION <= 255,
-               "should fit into uint8_t");
-_Static_assert(BIP32_TEMPLATE_MAX_RANGES_PER_SECTION > 0, "cannot be zero");
+BIP32_TEMPLATE_STATIC_ASSERT(BIP32_TEMPLATE_MAX_SECTIONS <= 255, "should fit into uint8_t");
+BIP32_TEMPLATE_STATIC_ASSERT(BIP32_TEMPLATE_MAX_SECTIONS > 0, "cannot be zero");
+BIP32_TEMPLATE_STATIC_ASSERT(BIP32_TEMPLATE_MAX_RANGES_PER_SECTION <= 255,
+                             "should fit into uint8_t");
+BIP32_TEMPLATE_STATIC_ASSERT(BIP32_TEMPLATE_MAX_RANGES_PER_SECTION > 0, "cannot be zero");
 
 typedef struct {
     uint32_t range_start;
@@ -91,6 +108,10 @@ typedef struct {
     union {
         void* opaque;
         const char* str;
+        struct {
+            const char* str;
+            size_t len;
+        } span;
     } data;
 } bip32_template_getchar_context_type;
 
@@ -102,16 +123,84 @@ typedef enum {
 
 typedef int (*bip32_template_getchar_func_type)(bip32_template_getchar_context_type*, char*);
 
+/* The parser state after the '/' that ends a section. Together with the sections
+ * parsed before it, this is all that parsing of the rest of the string depends on */
+typedef struct {
+    unsigned int pos; /* ctx->pos after reading the '/' */
+    uint8_t num_sections;
+    uint8_t is_partial;
+    uint8_t is_prev_section_hardened;
+    char hardened_marker; /* 0 until the first hardened section */
+} bip32_template_boundary_type;
+
+/* Called at each section boundary. Returning 0 stops the parsing */
+typedef int (*bip32_template_boundary_func_type)(const bip32_template_boundary_type*, void*);
+
+BIP32_TEMPLATE_API
 void bip32_template_context_set_string(const char* template_string, bip32_template_getchar_context_type* ctx);
+BIP32_TEMPLATE_API
 int bip32_template_getchar(bip32_template_getchar_context_type* ctx, char* out_p);
+BIP32_TEMPLATE_API
+void bip32_template_context_set_span(const char* str, size_t len, bip32_template_getchar_context_type* ctx);
+BIP32_TEMPLATE_API
+int bip32_template_getchar_span(bip32_template_getchar_context_type* ctx, char* out_p);
+BIP32_TEMPLATE_API
 int bip32_template_parse(bip32_template_getchar_func_type get_char, bip32_template_getchar_context_type* ctx,
                          bip32_template_format_mode_type mode,
                          bip32_template_type* template_p, bip32_template_error_type* error_p);
+BIP32_TEMPLATE_API
+int bip32_template_parse_resumable(bip32_template_getchar_func_type get_char,
+                                   bip32_template_getchar_context_type* ctx,
+                                   bip32_template_format_mode_type mode,
+                                   bip32_template_type* template_p, bip32_template_error_type* error_p,
+                                   const bip32_template_boundary_type* resume_p,
+                                   bip32_template_boundary_func_type boundary_func, void* boundary_arg,
+                                   int* is_stopped_p);
+BIP32_TEMPLATE_API
 int bip32_template_parse_string(const char* template_string, bip32_template_format_mode_type mode,
                                 bip32_template_type* template_p, bip32_template_error_type* error_p,
                                 unsigned int* last_pos_p);
+BIP32_TEMPLATE_API
+int bip32_template_validate(bip32_template_getchar_func_type get_char, bip32_template_getchar_context_type* ctx,
+                            bip32_template_format_mode_type mode, bip32_template_error_type* error_p);
+BIP32_TEMPLATE_API
+int bip32_template_validate_string(const char* template_string, bip32_template_format_mode_type mode,
+                                   bip32_template_error_type* error_p, unsigned int* last_pos_p);
+BIP32_TEMPLATE_API
 int bip32_template_match(const bip32_template_type* template_p, const uint32_t* path_p, unsigned int path_len);
+BIP32_TEMPLATE_API
+int bip32_template_next_match(const bip32_template_type* template_p, const uint32_t* path_p, uint32_t* out_p);
+BIP32_TEMPLATE_API
+int bip32_template_match_string(const bip32_template_type* template_p, const char* path_string, size_t path_len);
+BIP32_TEMPLATE_API
 const char* bip32_template_error_to_string(bip32_template_error_type error);
+BIP32_TEMPLATE_API
 int bip32_template_to_path(const bip32_template_type* template_p, uint32_t* path_p, unsigned int* path_len_p);
+BIP32_TEMPLATE_API
+int bip32_template_section_add_range(bip32_template_type* template_p, unsigned int section,
+                                     uint32_t range_start, uint32_t range_end,
+                                     bip32_template_error_type* error_p);
+BIP32_TEMPLATE_API
+int bip32_template_section_remove_range(bip32_template_type* template_p, unsigned int section,
+                                        uint32_t range_start, uint32_t range_end,
+                                        bip32_template_error_type* error_p);
+BIP32_TEMPLATE_API
+int bip32_template_section_set_hardened(bip32_template_type* template_p, unsigned int section,
+                                        int is_hardened, bip32_template_error_type* error_p);
+BIP32_TEMPLATE_API
+int bip32_template_append_section(bip32_template_type* template_p, uint32_t range_start, uint32_t range_end,
+                                  int is_hardened, bip32_template_error_type* error_p);
+BIP32_TEMPLATE_API
+int bip32_path_parse(const char* path_string, size_t path_string_len,
+                     uint32_t* path_p, unsigned int* path_len_p, unsigned int* is_partial_p,
+                     bip32_template_error_type* error_p, unsigned int* last_pos_p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef BIP32_TEMPLATE_HEADER_ONLY
+#include "bip32template.c"
+#endif
 
 #endif /* _BIP32_TEMPLATE_H_ */
@@ -0,0 +1,381 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* C++20 interface to the parser and the matcher.
+ *
+ * bip32::path_template is a value type around bip32_template_type.
+ * bip32::path_template::parse() parses a std::string_view in place (through
+ * bip32_template_getchar_span()) and returns bip32::result, which is
+ * std::expected<path_template, bip32::error> when the standard library has it,
+ * and a small class with the same interface otherwise.
+ *
+ * path_template::paths() is a random-access view over the paths that match
+ * the template, in lexicographic order. An iterator is a pointer to the template
+ * and the ordinal of the path, and dereferencing it computes the path from
+ * the ordinal, so the std::ranges algorithms can jump to any point of the view.
+ * The paths are returned by value in bip32::path, a fixed-size array.
+ *
+ * The header needs C++20: the view and its iterators are defined with the concepts
+ * of <ranges> and <iterator>, and there is no fallback for the older standards.
+ *
+ * Nothing here allocates memory. The library itself is compiled as C and linked
+ * as usual (BIP32_TEMPLATE_HEADER_ONLY is not supported from C++). */
+
+#ifndef _BIP32_TEMPLATE_HPP_
+#define _BIP32_TEMPLATE_HPP_
+
+#if __cplusplus < 202002L
+#error "bip32template.hpp needs C++20"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <variant>
+#if __has_include(<expected>)
+#include <expected>
+#endif
+
+#include "bip32template.h"
+
+namespace bip32 {
+
+enum class format_mode {
+    ambiguous = BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+    unambiguous = BIP32_TEMPLATE_FORMAT_UNAMBIGOUS,
+    only_path = BIP32_TEMPLATE_FORMAT_ONLYPATH,
+};
+
+/* The error code and the position where it was found, as returned by the C functions */
+class error {
+public:
+    constexpr error() noexcept = default;
+    constexpr error(bip32_template_error_type code, unsigned int pos) noexcept : code_(code), pos_(pos) {}
+
+    constexpr bip32_template_error_type code() const noexcept { return code_; }
+    constexpr unsigned int pos() const noexcept { return pos_; }
+    const char* message() const noexcept { return bip32_template_error_to_string(code_); }
+
+    friend constexpr bool operator==(const error&, const error&) noexcept = default;
+
+private:
+    bip32_template_error_type code_ = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    unsigned int pos_ = 0;
+};
+
+#if defined(__cpp_lib_expected) && __cpp_lib_expected >= 202202L
+
+template <class T>
+using result = std::expected<T, error>;
+
+namespace detail {
+inline std::unexpected<error> make_unexpected(const error& e) noexcept { return std::unexpected<error>(e); }
+}
+
+#else
+
+class bad_result_access : public std::exception {
+public:
+    const char* what() const noexcept override { return "bip32::result does not hold a value"; }
+};
+
+namespace detail {
+struct unexpected_error {
+    error value;
+};
+inline unexpected_error make_unexpected(const error& e) noexcept { return unexpected_error{e}; }
+}
+
+/* The subset of std::expected<T, bip32::error> used here */
+template <class T>
+class result {
+public:
+    result(const T& value) : v_(std::in_place_index<0>, value) {}
+    result(T&& value) : v_(std::in_place_index<0>, std::move(value)) {}
+    result(const detail::unexpected_error& e) : v_(std::in_place_index<1>, e.value) {}
+
+    bool has_value() const noexcept { return v_.index() == 0; }
+    explicit operator bool() const noexcept { return has_value(); }
+
+    T& value() &
+    {
+        if( !has_value() ) {
+            throw bad_result_access();
+        }
+        return *std::get_if<0>(&v_);
+    }
+    const T& value() const&
+    {
+        if( !has_value() ) {
+            throw bad_result_access();
+        }
+        return *std::get_if<0>(&v_);
+    }
+    template <class U>
+    T value_or(U&& default_value) const& { return has_value() ? **this : static_cast<T>(std::forward<U>(default_value)); }
+
+    const bip32::error& error() const& noexcept { return *std::get_if<1>(&v_); }
+
+    T& operator*() & noexcept { return *std::get_if<0>(&v_); }
+    const T& operator*() const& noexcept { return *std::get_if<0>(&v_); }
+    T* operator->() noexcept { return std::get_if<0>(&v_); }
+    const T* operator->() const noexcept { return std::get_if<0>(&v_); }
+
+private:
+    std::variant<T, bip32::error> v_;
+};
+
+#endif
+
+/* The indexes of a path, with the hardened ones having the 0x80000000 bit set */
+class path {
+public:
+    using value_type = uint32_t;
+    using size_type = std::size_t;
+    using const_iterator = const uint32_t*;
+
+    constexpr path() noexcept = default;
+
+    constexpr size_type size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr bool is_partial() const noexcept { return is_partial_; }
+    constexpr const uint32_t* data() const noexcept { return indexes_.data(); }
+    constexpr const_iterator begin() const noexcept { return indexes_.data(); }
+    constexpr const_iterator end() const noexcept { return indexes_.data() + size_; }
+    constexpr uint32_t operator[](size_type i) const noexcept { return indexes_[i]; }
+    constexpr operator std::span<const uint32_t>() const noexcept { return { indexes_.data(), size_ }; }
+
+    friend constexpr bool operator==(const path& a, const path& b) noexcept
+    {
+        return a.is_partial_ == b.is_partial_ && std::ranges::equal(a, b);
+    }
+
+private:
+    friend class path_template;
+
+    std::array<uint32_t, BIP32_TEMPLATE_MAX_SECTIONS> indexes_{};
+    uint8_t size_ = 0;
+    bool is_partial_ = false;
+};
+
+class paths_view;
+
+class path_template {
+public:
+    /* The template without sections, that does not match any path */
+    path_template() noexcept = default;
+
+    explicit path_template(const bip32_template_type& tmpl) noexcept : tmpl_(tmpl) { compute_strides(); }
+
+    static result<path_template> parse(std::string_view str, format_mode mode = format_mode::unambiguous) noexcept
+    {
+        bip32_template_getchar_context_type ctx;
+        bip32_template_error_type code;
+        path_template t;
+
+        bip32_template_context_set_span(str.data(), str.size(), &ctx);
+        if( !bip32_template_parse(bip32_template_getchar_span, &ctx,
+                                  static_cast<bip32_template_format_mode_type>(mode), &t.tmpl_, &code) )
+        {
+            return detail::make_unexpected(error(code, ctx.pos));
+        }
+        t.compute_strides();
+        return t;
+    }
+
+    const bip32_template_type& c_template() const noexcept { return tmpl_; }
+    bool is_partial() const noexcept { return tmpl_.is_partial; }
+    std::size_t num_sections() const noexcept { return tmpl_.num_sections; }
+
+    std::span<const bip32_template_section_range_type> ranges(std::size_t section) const noexcept
+    {
+        assert( section < tmpl_.num_sections );
+        return { tmpl_.sections[section].ranges, tmpl_.sections[section].num_ranges };
+    }
+
+    bool match(std::span<const uint32_t> p) const noexcept
+    {
+        return bip32_template_match(&tmpl_, p.data(), static_cast<unsigned int>(p.size()));
+    }
+
+    bool match(std::string_view path_string) const noexcept
+    {
+        return bip32_template_match_string(&tmpl_, path_string.data(), path_string.size());
+    }
+
+    /* Empty if the number of the paths does not fit into int64_t */
+    std::optional<uint64_t> num_paths() const noexcept
+    {
+        if( !is_countable_ ) {
+            return std::nullopt;
+        }
+        return num_paths_;
+    }
+
+    /* The path with the ordinal, which must be less than num_paths() */
+    path path_at(uint64_t ordinal) const noexcept
+    {
+        path p;
+
+        assert( is_countable_ && ordinal < num_paths_ );
+        p.size_ = tmpl_.num_sections;
+        p.is_partial_ = tmpl_.is_partial;
+        for( int i = 0; i < tmpl_.num_sections; i++ ) {
+            p.indexes_[i] = index_at(tmpl_.sections[i], ordinal / strides_[i]);
+            ordinal %= strides_[i];
+        }
+        return p;
+    }
+
+    /* num_paths() must not be empty */
+    paths_view paths() const noexcept;
+
+private:
+    static uint64_t section_width(const bip32_template_section_type& section) noexcept
+    {
+        uint64_t width = 0;
+
+        for( int i = 0; i < section.num_ranges; i++ ) {
+            width += uint64_t(section.ranges[i].range_end) - section.ranges[i].range_start + 1;
+        }
+        return width;
+    }
+
+    static uint32_t index_at(const bip32_template_section_type& section, uint64_t pos) noexcept
+    {
+        for( int i = 0; i < section.num_ranges; i++ ) {
+            uint64_t width = uint64_t(section.ranges[i].range_end) - section.ranges[i].range_start + 1;
+            if( pos < width ) {
+                return section.ranges[i].range_start + uint32_t(pos);
+            }
+            pos -= width;
+        }
+        assert( 0 ); /* UNREACHABLE */
+        return 0;
+    }
+
+    /* strides_[i] is the number of paths that share the indexes of the sections up to i */
+    void compute_strides() noexcept
+    {
+        uint64_t count = 1;
+
+        is_countable_ = true;
+        for( int i = tmpl_.num_sections - 1; i >= 0; i-- ) {
+            uint64_t width = section_width(tmpl_.sections[i]);
+
+            strides_[i] = count;
+            if( count > uint64_t(INT64_MAX) / width ) {
+                is_countable_ = false;
+                return;
+            }
+            count *= width;
+        }
+        num_paths_ = tmpl_.num_sections > 0 ? count : 0;
+    }
+
+    bip32_template_type tmpl_{};
+    std::array<uint64_t, BIP32_TEMPLATE_MAX_SECTIONS> strides_{};
+    uint64_t num_paths_ = 0;
+    bool is_countable_ = true;
+};
+
+/* Random-access view over the paths of a template. The iterators refer to the template,
+ * not to the view, so they stay valid while the template is alive.
+ * The iterators return the paths by value, so they are random access iterators
+ * only in the C++20 sense, through iterator_concept. For the older algorithms that look
+ * at iterator_category, including the parallel ones from <execution>, they are only
+ * input iterators: a legacy forward iterator must return a reference */
+class paths_view : public std::ranges::view_interface<paths_view> {
+public:
+    class iterator {
+    public:
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = path;
+        using difference_type = std::int64_t;
+        using reference = path;
+        using pointer = void;
+
+        iterator() noexcept = default;
+        iterator(const path_template* tmpl, uint64_t ordinal) noexcept : tmpl_(tmpl), ordinal_(ordinal) {}
+
+        path operator*() const noexcept { return tmpl_->path_at(ordinal_); }
+        path operator[](difference_type n) const noexcept { return tmpl_->path_at(ordinal_ + n); }
+        uint64_t ordinal() const noexcept { return ordinal_; }
+
+        iterator& operator++() noexcept { ++ordinal_; return *this; }
+        iterator operator++(int) noexcept { iterator it = *this; ++ordinal_; return it; }
+        iterator& operator--() noexcept { --ordinal_; return *this; }
+        iterator operator--(int) noexcept { iterator it = *this; --ordinal_; return it; }
+        iterator& operator+=(difference_type n) noexcept { ordinal_ += n; return *this; }
+        iterator& operator-=(difference_type n) noexcept { ordinal_ -= n; return *this; }
+
+        friend iterator operator+(iterator it, difference_type n) noexcept { return it += n; }
+        friend iterator operator+(difference_type n, iterator it) noexcept { return it += n; }
+        friend iterator operator-(iterator it, difference_type n) noexcept { return it -= n; }
+        friend difference_type operator-(const iterator& a, const iterator& b) noexcept
+        {
+            return difference_type(a.ordinal_ - b.ordinal_);
+        }
+        friend bool operator==(const iterator& a, const iterator& b) noexcept { return a.ordinal_ == b.ordinal_; }
+        friend auto operator<=>(const iterator& a, const iterator& b) noexcept { return a.ordinal_ <=> b.ordinal_; }
+
+    private:
+        const path_template* tmpl_ = nullptr;
+        uint64_t ordinal_ = 0;
+    };
+
+    paths_view() noexcept = default;
+    explicit paths_view(const path_template& tmpl) noexcept : tmpl_(&tmpl), size_(*tmpl.num_paths()) {}
+
+    iterator begin() const noexcept { return iterator(tmpl_, 0); }
+    iterator end() const noexcept { return iterator(tmpl_, size_); }
+    uint64_t size() const noexcept { return size_; }
+
+private:
+    const path_template* tmpl_ = nullptr;
+    uint64_t size_ = 0;
+};
+
+inline paths_view path_template::paths() const noexcept
+{
+    assert( is_countable_ );
+    return paths_view(*this);
+}
+
+} /* namespace bip32 */
+
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<bip32::paths_view> = true;
+
+#endif /* _BIP32_TEMPLATE_HPP_ */
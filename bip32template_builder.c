@@ -0,0 +1,357 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Template synthesis: compress a stream of sorted concrete paths into templates.
+ *
+ * Each path is turned into a template of single-index sections, and is merged
+ * into the last pending template. Two templates that differ in only one section
+ * are merged into one by the union of the ranges of that section, with adjacent
+ * indexes joined into one range (the same way normalize_last_section_and_advance_ranges()
+ * does while parsing). Such union is exact. Consecutive indexes of the last section
+ * thus become ranges, and then the templates with the same sections after the prefix
+ * are merged at the upper levels: 0/0/{0-9} and 0/1/{0-9} become 0/{0-1}/{0-9}.
+ *
+ * When the union does not fit into BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ranges,
+ * the builder either starts a new template (exact mode, max_false_positive_permille == 0),
+ * or joins the ranges separated by the smallest gaps, as long as the share of the paths
+ * matched by the template that were not in the input stays within
+ * max_false_positive_permille / 1000 (cover mode).
+ *
+ * Templates that can not be merged anymore are passed to the emit callback.
+ * Each path is processed in O(depth * BIP32_TEMPLATE_MAX_RANGES_PER_SECTION),
+ * and the memory used does not depend on the number of paths. */
+
+#include <assert.h>
+
+#include "bip32template_builder.h"
+#include "bip32template_internal.h"
+
+#define MAX_UNION_RANGES (2*BIP32_TEMPLATE_MAX_RANGES_PER_SECTION)
+/* The value of the unused ranges, as the parser sets them */
+#define INVALID_INDEX BIP32_TEMPLATE_HARDENED_INDEX_START
+
+static int is_same_half(uint32_t a, uint32_t b)
+{
+    return (a >= BIP32_TEMPLATE_HARDENED_INDEX_START) == (b >= BIP32_TEMPLATE_HARDENED_INDEX_START);
+}
+
+/* Returns the index of the only section where the templates differ,
+ * or -1 if they differ in more than one section, or have different number of sections */
+static int find_differing_section(const bip32_template_type* a, const bip32_template_type* b)
+{
+    int differing_section = -1;
+    int i, ii;
+
+    if( a->num_sections != b->num_sections ) {
+        return -1;
+    }
+
+    for( i = 0; i < a->num_sections; i++ ) {
+        int is_equal = a->sections[i].num_ranges == b->sections[i].num_ranges;
+        for( ii = 0; is_equal && ii < a->sections[i].num_ranges; ii++ ) {
+            is_equal = ( a->sections[i].ranges[ii].range_start == b->sections[i].ranges[ii].range_start
+                         && a->sections[i].ranges[ii].range_end == b->sections[i].ranges[ii].range_end );
+        }
+        if( !is_equal ) {
+            if( differing_section >= 0 ) {
+                return -1;
+            }
+            differing_section = i;
+        }
+    }
+
+    return differing_section;
+}
+
+static void append_joined_range(bip32_template_section_range_type* ranges, unsigned int* num_ranges_p,
+                                const bip32_template_section_range_type* range_p)
+{
+    bip32_template_section_range_type* last_p;
+
+    if( *num_ranges_p > 0 ) {
+        last_p = &ranges[*num_ranges_p-1];
+        if( is_same_half(last_p->range_end, range_p->range_start)
+            && (uint64_t)range_p->range_start <= (uint64_t)last_p->range_end + 1 )
+        {
+            if( range_p->range_end > last_p->range_end ) {
+                last_p->range_end = range_p->range_end;
+            }
+            return;
+        }
+    }
+
+    assert( *num_ranges_p < MAX_UNION_RANGES );
+    ranges[(*num_ranges_p)++] = *range_p;
+}
+
+/* Puts the union of the sections into out_p. Returns 0 if the union does not fit
+ * into the section, or if one section is hardened and the other is not: a template section
+ * cannot hold indexes from both halves. If allow_cover is set, the ranges separated by the smallest gaps
+ * are joined to make it fit, and *is_cover_p is set to 1 */
+static int union_sections(const bip32_template_section_type* a, const bip32_template_section_type* b,
+                          int allow_cover, bip32_template_section_type* out_p, int* is_cover_p)
+{
+    bip32_template_section_range_type ranges[MAX_UNION_RANGES];
+    unsigned int num_ranges = 0;
+    int ia = 0, ib = 0;
+    unsigned int i;
+
+    *is_cover_p = 0;
+
+    assert( a->num_ranges > 0 && b->num_ranges > 0 );
+    if( !is_same_half(a->ranges[0].range_start, b->ranges[0].range_start) ) {
+        return 0;
+    }
+
+    while( ia < a->num_ranges || ib < b->num_ranges ) {
+        if( ib >= b->num_ranges
+            || ( ia < a->num_ranges && a->ranges[ia].range_start <= b->ranges[ib].range_start ) )
+        {
+            append_joined_range(ranges, &num_ranges, &a->ranges[ia++]);
+        }
+        else {
+            append_joined_range(ranges, &num_ranges, &b->ranges[ib++]);
+        }
+    }
+
+    while( num_ranges > BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ) {
+        unsigned int best = num_ranges;
+        uint32_t best_gap = 0;
+
+        if( !allow_cover ) {
+            return 0;
+        }
+        for( i = 0; i + 1 < num_ranges; i++ ) {
+            uint32_t gap = ranges[i+1].range_start - ranges[i].range_end - 1;
+            if( is_same_half(ranges[i].range_end, ranges[i+1].range_start)
+                && ( best == num_ranges || gap < best_gap ) )
+            {
+                best = i;
+                best_gap = gap;
+            }
+        }
+        if( best == num_ranges ) {
+            return 0;
+        }
+        ranges[best].range_end = ranges[best+1].range_end;
+        for( i = best + 1; i + 1 < num_ranges; i++ ) {
+            ranges[i] = ranges[i+1];
+        }
+        num_ranges--;
+        *is_cover_p = 1;
+    }
+
+    out_p->num_ranges = num_ranges;
+    for( i = 0; i < num_ranges; i++ ) {
+        out_p->ranges[i] = ranges[i];
+    }
+    for( ; i < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; i++ ) {
+        out_p->ranges[i].range_start = INVALID_INDEX;
+        out_p->ranges[i].range_end = INVALID_INDEX;
+    }
+
+    return 1;
+}
+
+static int merge_pending(const bip32_template_builder_type* builder_p,
+                         const bip32_template_builder_pending_type* a,
+                         const bip32_template_builder_pending_type* b,
+                         bip32_template_builder_pending_type* out_p)
+{
+    bip32_template_section_type section;
+    uint64_t num_paths;
+    int is_cover;
+    int i = find_differing_section(&a->tmpl, &b->tmpl);
+
+    if( i < 0 ) {
+        return 0;
+    }
+    if( i == a->tmpl.num_sections ) {
+        /* Identical templates can only come from the same paths, and duplicate paths
+         * are skipped in bip32_template_builder_add_path() */
+        assert( 0 ); /* UNREACHABLE */
+        return 0;
+    }
+
+    if( !union_sections(&a->tmpl.sections[i], &b->tmpl.sections[i],
+                        builder_p->max_false_positive_permille > 0, &section, &is_cover) )
+    {
+        return 0;
+    }
+
+    if( is_cover ) {
+        bip32_template_type tmpl = a->tmpl;
+        tmpl.sections[i] = section;
+        num_paths = bip32_template_num_paths(&tmpl);
+        if( num_paths == UINT64_MAX
+            || (double)(num_paths - (a->num_input_paths + b->num_input_paths)) * 1000
+                > (double)builder_p->max_false_positive_permille * num_paths )
+        {
+            return 0;
+        }
+    }
+
+    out_p->tmpl = a->tmpl;
+    out_p->tmpl.sections[i] = section;
+    out_p->num_input_paths = a->num_input_paths + b->num_input_paths;
+
+    return 1;
+}
+
+static void emit_bottom_pending(bip32_template_builder_type* builder_p)
+{
+    unsigned int i;
+
+    assert( builder_p->num_pending > 0 );
+
+    builder_p->emit(&builder_p->pending[0].tmpl, builder_p->emit_arg);
+    for( i = 1; i < builder_p->num_pending; i++ ) {
+        builder_p->pending[i-1] = builder_p->pending[i];
+    }
+    builder_p->num_pending--;
+}
+
+void bip32_template_builder_init(bip32_template_builder_type* builder_p, int is_partial,
+                                 unsigned int max_false_positive_permille,
+                                 bip32_template_builder_emit_func_type emit, void* emit_arg)
+{
+    builder_p->is_partial = is_partial ? 1 : 0;
+    builder_p->max_false_positive_permille = max_false_positive_permille;
+    builder_p->emit = emit;
+    builder_p->emit_arg = emit_arg;
+    builder_p->num_pending = 0;
+    builder_p->last_path_len = 0;
+}
+
+/* Paths must be added in lexicographic order, where a path goes before the paths it is
+ * the prefix of. Duplicate paths are ignored.
+ * Returns 0 and sets the error if the path is empty (BIP32_TEMPLATE_ERROR_PATH_EMPTY),
+ * longer than BIP32_TEMPLATE_MAX_SECTIONS (BIP32_TEMPLATE_ERROR_PATH_TOO_LONG),
+ * has a hardened index after an unhardened one (BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED),
+ * or goes before the previously added path (BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD) */
+int bip32_template_builder_add_path(bip32_template_builder_type* builder_p,
+                                    const uint32_t* path_p, unsigned int path_len,
+                                    bip32_template_error_type* error_p)
+{
+    bip32_template_builder_pending_type path_tmpl;
+    bip32_template_builder_pending_type merged;
+    unsigned int i, ii;
+    int cmp = 0;
+
+    if( path_len == 0 ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_EMPTY;
+        }
+        return 0;
+    }
+    if( path_len > BIP32_TEMPLATE_MAX_SECTIONS ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+        }
+        return 0;
+    }
+    for( i = 1; i < path_len; i++ ) {
+        if( path_p[i] >= BIP32_TEMPLATE_HARDENED_INDEX_START
+            && path_p[i-1] < BIP32_TEMPLATE_HARDENED_INDEX_START )
+        {
+            if( error_p ) {
+                *error_p = BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED;
+            }
+            return 0;
+        }
+    }
+
+    if( builder_p->last_path_len > 0 ) {
+        for( i = 0; i < path_len && i < builder_p->last_path_len && cmp == 0; i++ ) {
+            if( path_p[i] != builder_p->last_path[i] ) {
+                cmp = path_p[i] < builder_p->last_path[i] ? -1 : 1;
+            }
+        }
+        if( cmp == 0 ) {
+            cmp = ( path_len < builder_p->last_path_len ? -1
+                    : path_len > builder_p->last_path_len ? 1 : 0 );
+        }
+        if( cmp < 0 ) {
+            if( error_p ) {
+                *error_p = BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD;
+            }
+            return 0;
+        }
+        if( cmp == 0 ) {
+            return 1;
+        }
+    }
+
+    for( i = 0; i < path_len; i++ ) {
+        builder_p->last_path[i] = path_p[i];
+    }
+    builder_p->last_path_len = path_len;
+
+    path_tmpl.tmpl.is_partial = builder_p->is_partial;
+    path_tmpl.tmpl.num_sections = path_len;
+    for( i = 0; i < path_len; i++ ) {
+        path_tmpl.tmpl.sections[i].num_ranges = 1;
+        path_tmpl.tmpl.sections[i].ranges[0].range_start = path_p[i];
+        path_tmpl.tmpl.sections[i].ranges[0].range_end = path_p[i];
+        for( ii = 1; ii < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; ii++ ) {
+            path_tmpl.tmpl.sections[i].ranges[ii].range_start = INVALID_INDEX;
+            path_tmpl.tmpl.sections[i].ranges[ii].range_end = INVALID_INDEX;
+        }
+    }
+    path_tmpl.num_input_paths = 1;
+
+    if( builder_p->num_pending > 0
+        && merge_pending(builder_p, &builder_p->pending[builder_p->num_pending-1], &path_tmpl, &merged) )
+    {
+        builder_p->pending[builder_p->num_pending-1] = merged;
+
+        /* The grown template may now differ from the one before it only in one section */
+        while( builder_p->num_pending > 1
+               && merge_pending(builder_p, &builder_p->pending[builder_p->num_pending-2],
+                                &builder_p->pending[builder_p->num_pending-1], &merged) )
+        {
+            builder_p->num_pending--;
+            builder_p->pending[builder_p->num_pending-1] = merged;
+        }
+    }
+    else {
+        if( builder_p->num_pending == BIP32_TEMPLATE_MAX_SECTIONS ) {
+            emit_bottom_pending(builder_p);
+        }
+        builder_p->pending[builder_p->num_pending++] = path_tmpl;
+    }
+
+    if( error_p ) {
+        *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+    }
+
+    return 1;
+}
+
+/* Emit all pending templates. The builder can be used again after this,
+ * but the paths added after it will not be merged into already emitted templates */
+void bip32_template_builder_finish(bip32_template_builder_type* builder_p)
+{
+    while( builder_p->num_pending > 0 ) {
+        emit_bottom_pending(builder_p);
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _BIP32_TEMPLATE_BUILDER_H_
+#define _BIP32_TEMPLATE_BUILDER_H_
+
+#include "bip32template.h"
+
+typedef void (*bip32_template_builder_emit_func_type)(const bip32_template_type* template_p, void* arg);
+
+/* Templates that are not yet emitted. Each of them can still be merged
+ * with the template that follows it, so there is one for each depth of the prefix */
+typedef struct {
+    bip32_template_type tmpl;
+    uint64_t num_input_paths;
+} bip32_template_builder_pending_type;
+
+typedef struct {
+    uint8_t is_partial;
+    unsigned int max_false_positive_permille;
+    bip32_template_builder_emit_func_type emit;
+    void* emit_arg;
+    unsigned int num_pending;
+    bip32_template_builder_pending_type pending[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t last_path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int last_path_len;
+} bip32_template_builder_type;
+
+void bip32_template_builder_init(bip32_template_builder_type* builder_p, int is_partial,
+                                 unsigned int max_false_positive_permille,
+                                 bip32_template_builder_emit_func_type emit, void* emit_arg);
+int bip32_template_builder_add_path(bip32_template_builder_type* builder_p,
+                                    const uint32_t* path_p, unsigned int path_len,
+                                    bip32_template_error_type* error_p);
+void bip32_template_builder_finish(bip32_template_builder_type* builder_p);
+
+#endif /* _BIP32_TEMPLATE_BUILDER_H_ */
@@ -0,0 +1,342 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Parse cache for the templates that share prefixes.
+ *
+ * The cache is a trie of the segments of the template strings: the first segment
+ * is the text of the first section with the "m/" before it, if any, and the '/' after it,
+ * the next segments are the text of the next sections with the '/' after each.
+ * Each node keeps the parser state after its segment (bip32_template_boundary_type,
+ * the parser is always at the start of a section there), and the section parsed
+ * from the segment.
+ *
+ * A parse walks the trie along the string as far as it can, copies the sections
+ * of the nodes passed into the template, and runs the parser only on the rest
+ * of the string, from the state of the last node. The parser is deterministic
+ * and does not look past the '/', so the result is the same as of parsing
+ * the whole string. The boundaries that the parser reports on the rest
+ * of the string are added to the trie.
+ *
+ * The nodes and the hash table that finds a child of a node by its segment are
+ * in caller-provided arrays. When all nodes are taken, the least recently used
+ * node without children is reused, so the nodes that other nodes depend on
+ * are never removed. */
+
+#include <assert.h>
+#include <string.h>
+
+#include "bip32template_cache.h"
+
+typedef struct {
+    bip32_template_cache_type* cache_p;
+    const char* str;
+    const bip32_template_type* template_p;
+    uint32_t parent;
+    size_t segment_start;
+    int is_caching;
+} cache_parse_context_type;
+
+static uint32_t segment_hash(uint32_t parent, const char* segment, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for( i = 0; i < 4; i++ ) {
+        hash = (hash ^ ((parent >> (8 * i)) & 0xFF)) * 16777619u;
+    }
+    for( i = 0; i < len; i++ ) {
+        hash = (hash ^ (uint8_t)segment[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t find_node(const bip32_template_cache_type* cache_p, uint32_t parent,
+                          const char* segment, size_t len)
+{
+    uint32_t index = cache_p->buckets[segment_hash(parent, segment, len) & (cache_p->num_buckets - 1)];
+    const bip32_template_cache_node_type* node_p;
+
+    while( index != BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        node_p = &cache_p->nodes[index];
+        if( node_p->parent == parent && node_p->segment_len == len && memcmp(node_p->segment, segment, len) == 0 ) {
+            return index;
+        }
+        index = node_p->hash_next;
+    }
+    return BIP32_TEMPLATE_CACHE_NO_NODE;
+}
+
+static void lru_remove(bip32_template_cache_type* cache_p, uint32_t index)
+{
+    bip32_template_cache_node_type* node_p = &cache_p->nodes[index];
+
+    if( node_p->lru_prev != BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        cache_p->nodes[node_p->lru_prev].lru_next = node_p->lru_next;
+    }
+    else {
+        cache_p->lru_head = node_p->lru_next;
+    }
+    if( node_p->lru_next != BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        cache_p->nodes[node_p->lru_next].lru_prev = node_p->lru_prev;
+    }
+    else {
+        cache_p->lru_tail = node_p->lru_prev;
+    }
+}
+
+static void lru_push_head(bip32_template_cache_type* cache_p, uint32_t index)
+{
+    bip32_template_cache_node_type* node_p = &cache_p->nodes[index];
+
+    node_p->lru_prev = BIP32_TEMPLATE_CACHE_NO_NODE;
+    node_p->lru_next = cache_p->lru_head;
+    if( cache_p->lru_head != BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        cache_p->nodes[cache_p->lru_head].lru_prev = index;
+    }
+    else {
+        cache_p->lru_tail = index;
+    }
+    cache_p->lru_head = index;
+}
+
+static void lru_push_tail(bip32_template_cache_type* cache_p, uint32_t index)
+{
+    bip32_template_cache_node_type* node_p = &cache_p->nodes[index];
+
+    node_p->lru_next = BIP32_TEMPLATE_CACHE_NO_NODE;
+    node_p->lru_prev = cache_p->lru_tail;
+    if( cache_p->lru_tail != BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        cache_p->nodes[cache_p->lru_tail].lru_next = index;
+    }
+    else {
+        cache_p->lru_head = index;
+    }
+    cache_p->lru_tail = index;
+}
+
+static void touch_node(bip32_template_cache_type* cache_p, uint32_t index)
+{
+    if( cache_p->nodes[index].num_children == 0 ) {
+        lru_remove(cache_p, index);
+        lru_push_head(cache_p, index);
+    }
+}
+
+static void hash_remove(bip32_template_cache_type* cache_p, uint32_t index)
+{
+    const bip32_template_cache_node_type* node_p = &cache_p->nodes[index];
+    uint32_t* link_p = &cache_p->buckets[segment_hash(node_p->parent, node_p->segment, node_p->segment_len)
+                                         & (cache_p->num_buckets - 1)];
+
+    while( *link_p != index ) {
+        assert( *link_p != BIP32_TEMPLATE_CACHE_NO_NODE );
+        link_p = &cache_p->nodes[*link_p].hash_next;
+    }
+    *link_p = node_p->hash_next;
+}
+
+/* Take the least recently used node without children, other than keep.
+ * When its parent is left without children, the parent becomes the least recently used */
+static uint32_t evict_node(bip32_template_cache_type* cache_p, uint32_t keep)
+{
+    uint32_t index = cache_p->lru_tail;
+    uint32_t parent;
+
+    while( index == keep ) {
+        index = cache_p->nodes[index].lru_prev;
+    }
+    if( index == BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        return index;
+    }
+
+    lru_remove(cache_p, index);
+    hash_remove(cache_p, index);
+    parent = cache_p->nodes[index].parent;
+    if( parent != BIP32_TEMPLATE_CACHE_NO_NODE && --cache_p->nodes[parent].num_children == 0 ) {
+        lru_push_tail(cache_p, parent);
+    }
+    cache_p->stats.num_evictions++;
+
+    return index;
+}
+
+static uint32_t add_node(bip32_template_cache_type* cache_p, uint32_t parent,
+                         const char* segment, size_t len,
+                         const bip32_template_boundary_type* boundary_p,
+                         const bip32_template_section_type* section_p)
+{
+    bip32_template_cache_node_type* node_p;
+    uint32_t index;
+    uint32_t* bucket_p;
+
+    if( cache_p->num_nodes < cache_p->max_nodes ) {
+        index = cache_p->num_nodes++;
+    }
+    else {
+        index = evict_node(cache_p, parent);
+        if( index == BIP32_TEMPLATE_CACHE_NO_NODE ) {
+            return index;
+        }
+    }
+
+    node_p = &cache_p->nodes[index];
+    node_p->parent = parent;
+    node_p->num_children = 0;
+    node_p->segment_len = (uint8_t)len;
+    memcpy(node_p->segment, segment, len);
+    node_p->boundary = *boundary_p;
+    node_p->section = *section_p;
+
+    bucket_p = &cache_p->buckets[segment_hash(parent, segment, len) & (cache_p->num_buckets - 1)];
+    node_p->hash_next = *bucket_p;
+    *bucket_p = index;
+
+    lru_push_head(cache_p, index);
+    if( parent != BIP32_TEMPLATE_CACHE_NO_NODE && cache_p->nodes[parent].num_children++ == 0 ) {
+        lru_remove(cache_p, parent);
+    }
+
+    return index;
+}
+
+/* Returns 0 if max_nodes is zero or num_buckets is not a power of two */
+int bip32_template_cache_init(bip32_template_cache_type* cache_p, bip32_template_format_mode_type mode,
+                              bip32_template_cache_node_type* nodes, uint32_t max_nodes,
+                              uint32_t* buckets, uint32_t num_buckets)
+{
+    uint32_t i;
+
+    if( max_nodes == 0 || max_nodes == BIP32_TEMPLATE_CACHE_NO_NODE
+        || num_buckets == 0 || (num_buckets & (num_buckets - 1)) != 0 )
+    {
+        return 0;
+    }
+
+    cache_p->mode = mode;
+    cache_p->nodes = nodes;
+    cache_p->max_nodes = max_nodes;
+    cache_p->num_nodes = 0;
+    cache_p->buckets = buckets;
+    cache_p->num_buckets = num_buckets;
+    cache_p->lru_head = BIP32_TEMPLATE_CACHE_NO_NODE;
+    cache_p->lru_tail = BIP32_TEMPLATE_CACHE_NO_NODE;
+    memset(&cache_p->stats, 0, sizeof(cache_p->stats));
+
+    for( i = 0; i < num_buckets; i++ ) {
+        buckets[i] = BIP32_TEMPLATE_CACHE_NO_NODE;
+    }
+
+    return 1;
+}
+
+static int on_boundary(const bip32_template_boundary_type* boundary_p, void* arg)
+{
+    cache_parse_context_type* pctx = arg;
+    size_t len = boundary_p->pos - pctx->segment_start;
+    uint32_t index;
+
+    if( !pctx->is_caching ) {
+        return 1;
+    }
+    if( len > BIP32_TEMPLATE_CACHE_SEGMENT_MAX ) {
+        pctx->is_caching = 0;
+        return 1;
+    }
+
+    index = find_node(pctx->cache_p, pctx->parent, pctx->str + pctx->segment_start, len);
+    if( index == BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        index = add_node(pctx->cache_p, pctx->parent, pctx->str + pctx->segment_start, len, boundary_p,
+                         &pctx->template_p->sections[boundary_p->num_sections-1]);
+    }
+    if( index == BIP32_TEMPLATE_CACHE_NO_NODE ) {
+        pctx->is_caching = 0;
+        return 1;
+    }
+
+    pctx->parent = index;
+    pctx->segment_start = boundary_p->pos;
+    return 1;
+}
+
+/* Parse the len bytes of str in the mode of the cache, with the same result, error and
+ * error position as bip32_template_parse() with bip32_template_getchar_span() */
+int bip32_template_cache_parse(bip32_template_cache_type* cache_p, const char* str, size_t len,
+                               bip32_template_type* template_p, bip32_template_error_type* error_p,
+                               unsigned int* last_pos_p)
+{
+    cache_parse_context_type pctx = { cache_p, str, template_p, BIP32_TEMPLATE_CACHE_NO_NODE, 0, 1 };
+    const bip32_template_boundary_type* resume_p = 0;
+    bip32_template_getchar_context_type ctx;
+    const bip32_template_cache_node_type* node_p;
+    size_t end, limit;
+    unsigned int start_pos;
+    uint32_t index;
+    int result;
+
+    /* Restore the longest cached prefix */
+    for( ;; ) {
+        end = pctx.segment_start;
+        if( pctx.parent == BIP32_TEMPLATE_CACHE_NO_NODE && len >= 2 && str[0] == 'm' ) {
+            end = 2;
+        }
+        limit = pctx.segment_start + BIP32_TEMPLATE_CACHE_SEGMENT_MAX;
+        while( end < len && end < limit && str[end] != '/' ) {
+            end++;
+        }
+        if( end >= len || end >= limit ) {
+            break;
+        }
+        end++;
+
+        index = find_node(cache_p, pctx.parent, str + pctx.segment_start, end - pctx.segment_start);
+        if( index == BIP32_TEMPLATE_CACHE_NO_NODE ) {
+            break;
+        }
+        node_p = &cache_p->nodes[index];
+        template_p->sections[node_p->boundary.num_sections-1] = node_p->section;
+        touch_node(cache_p, index);
+        resume_p = &node_p->boundary;
+        pctx.parent = index;
+        pctx.segment_start = end;
+    }
+
+    /* The nodes change while parsing, resume_p is not used after the start */
+    start_pos = resume_p ? resume_p->pos : 0;
+    bip32_template_context_set_span(str, len, &ctx);
+    ctx.pos = start_pos;
+
+    cache_p->stats.num_parses++;
+    if( resume_p ) {
+        cache_p->stats.num_hits++;
+        cache_p->stats.num_bytes_restored += start_pos;
+    }
+
+    result = bip32_template_parse_resumable(bip32_template_getchar_span, &ctx, cache_p->mode,
+                                            template_p, error_p, resume_p, on_boundary, &pctx, 0);
+
+    cache_p->stats.num_bytes_parsed += ctx.pos - start_pos;
+    if( last_pos_p ) {
+        *last_pos_p = ctx.pos;
+    }
+    return result;
+}
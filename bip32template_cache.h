@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_CACHE_H_
+#define _BIP32_TEMPLATE_CACHE_H_
+
+#include "bip32template.h"
+
+/* The sections whose text with the '/' after it is longer than this are not cached */
+#ifndef BIP32_TEMPLATE_CACHE_SEGMENT_MAX
+#define BIP32_TEMPLATE_CACHE_SEGMENT_MAX 32
+#endif
+
+_Static_assert(BIP32_TEMPLATE_CACHE_SEGMENT_MAX <= 255, "should fit into uint8_t");
+
+#define BIP32_TEMPLATE_CACHE_NO_NODE UINT32_MAX
+
+/* The parser state after a prefix of the string that ends with a '/'. The prefix
+ * is the segments of the node and of all its parents. Only the section parsed
+ * from the segment of the node is kept, the rest are in the parents */
+typedef struct {
+    uint32_t parent;
+    uint32_t hash_next;
+    /* Only the nodes without children are in the LRU list */
+    uint32_t lru_prev;
+    uint32_t lru_next;
+    uint32_t num_children;
+    uint8_t segment_len;
+    char segment[BIP32_TEMPLATE_CACHE_SEGMENT_MAX];
+    bip32_template_boundary_type boundary;
+    bip32_template_section_type section;
+} bip32_template_cache_node_type;
+
+typedef struct {
+    uint64_t num_parses;
+    /* The parses that started from a cached prefix */
+    uint64_t num_hits;
+    uint64_t num_bytes_restored;
+    uint64_t num_bytes_parsed;
+    uint64_t num_evictions;
+} bip32_template_cache_stats_type;
+
+typedef struct {
+    bip32_template_format_mode_type mode;
+    bip32_template_cache_node_type* nodes;
+    uint32_t max_nodes;
+    uint32_t num_nodes;
+    uint32_t* buckets;
+    uint32_t num_buckets;
+    uint32_t lru_head; /* the most recently used */
+    uint32_t lru_tail;
+    bip32_template_cache_stats_type stats;
+} bip32_template_cache_type;
+
+int bip32_template_cache_init(bip32_template_cache_type* cache_p, bip32_template_format_mode_type mode,
+                              bip32_template_cache_node_type* nodes, uint32_t max_nodes,
+                              uint32_t* buckets, uint32_t num_buckets);
+int bip32_template_cache_parse(bip32_template_cache_type* cache_p, const char* str, size_t len,
+                               bip32_template_type* template_p, bip32_template_error_type* error_p,
+                               unsigned int* last_pos_p);
+
+#endif /* _BIP32_TEMPLATE_CACHE_H_ */
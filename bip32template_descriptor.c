@@ -0,0 +1,307 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Scanner for the paths within output descriptors.
+ *
+ * The descriptor is walked once, and each key origin path and each derivation path
+ * after a key is parsed in place: the parser reads the span of the descriptor
+ * through bip32_template_getchar_descriptor_span(), which sees the end of the span
+ * as the end of the string. Nothing is copied and nothing is allocated.
+ *
+ * The key origin path is a path from the master key, so its template is a full one
+ * (is_partial is 0) even though it is not prefixed with "m/". The derivation path
+ * after the key is relative to the key and its template is partial.
+ *
+ * The derivation path ends at ',', ')' or '}' that is not within the braces of the
+ * template, or at '#' that starts the checksum.
+ *
+ * The alternatives of the multipath specifier (BIP 389) are an ordered list, not a set:
+ * xpub.../<1;0>/5 means the paths 1/5 and 0/5, in this order. So a path with the specifier
+ * is parsed once per alternative, each time with the specifier replaced by the alternative.
+ * The replacement is done by the getchar function, that skips the rest of the specifier
+ * while reading the span. The position in the getchar context jumps over the skipped
+ * characters, so the error positions are still the positions within the descriptor.
+ *
+ * The scanner does not check the rest of the descriptor syntax, including that all
+ * the multipath specifiers of the descriptor have the same number of alternatives. */
+
+#include <assert.h>
+#include <limits.h>
+
+#include "bip32template_descriptor.h"
+
+/* The span of the path, and the part of it that is read instead of the multipath specifier.
+ * All the positions are within the span */
+typedef struct {
+    const char* str;
+    size_t len;
+    /* The position of '<', and the position after '>' */
+    size_t group_start;
+    size_t group_end;
+    /* The alternative that is read: from alt_start up to alt_end, not including it */
+    size_t alt_start;
+    size_t alt_end;
+} multipath_span_type;
+
+/* Like bip32_template_getchar_span(), but with the multipath specifier replaced
+ * by one alternative. ctx->data.opaque points to multipath_span_type */
+static int getchar_multipath_span(bip32_template_getchar_context_type* ctx, char* out_p)
+{
+    const multipath_span_type* span_p = (const multipath_span_type*)ctx->data.opaque;
+    size_t i;
+
+    if( ctx->stop ) {
+        return 0;
+    }
+
+    i = ctx->pos;
+    if( i == span_p->group_start ) {
+        i = span_p->alt_start;
+    }
+    if( i == span_p->alt_end ) {
+        i = span_p->group_end;
+    }
+    if( i >= UINT_MAX ) {
+        ctx->stop = 1;
+        return 0;
+    }
+    ctx->pos = (unsigned int)(i + 1);
+
+    *out_p = i < span_p->len ? span_p->str[i] : 0;
+
+    if( *out_p == 0 ) {
+        ctx->stop = 1;
+    }
+
+    return 1;
+}
+
+static size_t find_char(const char* str, size_t start, size_t end, char c)
+{
+    for( ; start < end && str[start] != c; start++ ) {
+    }
+    return start;
+}
+
+static size_t find_suffix_end(const char* str, size_t start, size_t end)
+{
+    unsigned int depth = 0;
+    char c;
+
+    for( ; start < end; start++ ) {
+        c = str[start];
+        if( c == '{' || c == '<' ) {
+            depth++;
+        }
+        else if( (c == '}' || c == '>') && depth > 0 ) {
+            depth--;
+        }
+        else if( depth == 0 && (c == ',' || c == ')' || c == '}' || c == '#') ) {
+            break;
+        }
+    }
+
+    return start;
+}
+
+/* All the error outputs are optional */
+static int report_error(bip32_template_descriptor_error_type error, bip32_template_error_type template_error,
+                        size_t offset, bip32_template_descriptor_error_type* error_p,
+                        bip32_template_error_type* template_error_p, size_t* error_offset_p)
+{
+    if( error_p ) {
+        *error_p = error;
+    }
+    if( template_error_p ) {
+        *template_error_p = template_error;
+    }
+    if( error_offset_p ) {
+        *error_offset_p = offset;
+    }
+    return 0;
+}
+
+static int parse_item(const char* descriptor, size_t start, size_t end,
+                      bip32_template_format_mode_type mode,
+                      bip32_template_descriptor_item_kind_type kind,
+                      bip32_template_descriptor_item_type* items, unsigned int max_items,
+                      unsigned int* num_items_p,
+                      bip32_template_descriptor_error_type* error_p,
+                      bip32_template_error_type* template_error_p, size_t* error_offset_p)
+{
+    bip32_template_getchar_context_type ctx;
+    bip32_template_descriptor_item_type* item_p;
+    bip32_template_error_type template_error;
+    multipath_span_type span;
+    unsigned int num_multipath = 1;
+    unsigned int i;
+    size_t pos;
+
+    span.str = &descriptor[start];
+    span.len = end - start;
+    /* Without the specifier, the group is past the end and is never reached */
+    span.group_start = span.group_end = span.alt_start = span.alt_end = span.len + 1;
+
+    /* Only the derivation path after the key can have the specifier, and only one */
+    if( kind == BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX ) {
+        for( pos = 0; pos < span.len && span.str[pos] != '<'; pos++ ) {
+        }
+        if( pos < span.len ) {
+            span.group_start = pos;
+            for( pos++; pos < span.len && span.str[pos] != '>'; pos++ ) {
+                num_multipath += span.str[pos] == ';';
+            }
+            if( pos == span.len ) {
+                return report_error(BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_MULTIPATH,
+                                    BIP32_TEMPLATE_ERROR_UNDEFINED, start + span.group_start,
+                                    error_p, template_error_p, error_offset_p);
+            }
+            if( num_multipath < 2 ) {
+                return report_error(BIP32_TEMPLATE_DESCRIPTOR_ERROR_MULTIPATH_TOO_SHORT,
+                                    BIP32_TEMPLATE_ERROR_UNDEFINED, start + span.group_start,
+                                    error_p, template_error_p, error_offset_p);
+            }
+            span.group_end = pos + 1;
+            span.alt_end = span.group_start;
+        }
+    }
+
+    if( max_items - *num_items_p < num_multipath ) {
+        return report_error(BIP32_TEMPLATE_DESCRIPTOR_ERROR_TOO_MANY_PATHS,
+                            BIP32_TEMPLATE_ERROR_UNDEFINED, start,
+                            error_p, template_error_p, error_offset_p);
+    }
+
+    for( i = 0; i < num_multipath; i++ ) {
+        if( num_multipath > 1 ) {
+            span.alt_start = span.alt_end + 1;
+            for( span.alt_end = span.alt_start;
+                 span.str[span.alt_end] != ';' && span.str[span.alt_end] != '>';
+                 span.alt_end++ )
+            {
+            }
+        }
+
+        item_p = &items[*num_items_p];
+        item_p->kind = kind;
+        item_p->offset = start;
+        item_p->len = end - start;
+        item_p->multipath_index = i;
+        item_p->num_multipath = num_multipath;
+
+        ctx.pos = 0;
+        ctx.stop = 0;
+        ctx.data.opaque = &span;
+        if( !bip32_template_parse(getchar_multipath_span, &ctx, mode, &item_p->tmpl, &template_error) ) {
+            return report_error(BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, template_error,
+                                start + (ctx.pos > 0 ? ctx.pos - 1 : 0),
+                                error_p, template_error_p, error_offset_p);
+        }
+
+        if( kind == BIP32_TEMPLATE_DESCRIPTOR_KEY_ORIGIN ) {
+            item_p->tmpl.is_partial = 0;
+        }
+
+        (*num_items_p)++;
+    }
+
+    return 1;
+}
+
+/* Find the key origin and derivation paths within the descriptor and parse them
+ * into items, in the order they appear in the descriptor. The descriptor does not
+ * need to be NUL-terminated.
+ * Returns 0 on failure, with error_offset_p set to the position within the descriptor
+ * where the error was found. If a path does not parse, error_p is set to
+ * BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE and template_error_p to the error of the parser.
+ * If there are more than max_items paths, the error is BIP32_TEMPLATE_DESCRIPTOR_ERROR_TOO_MANY_PATHS
+ * and error_offset_p is the start of the path that did not fit.
+ * error_p, template_error_p and error_offset_p can be 0 */
+int bip32_template_descriptor_scan(const char* descriptor, size_t descriptor_len,
+                                   bip32_template_format_mode_type mode,
+                                   bip32_template_descriptor_item_type* items, unsigned int max_items,
+                                   unsigned int* num_items_p,
+                                   bip32_template_descriptor_error_type* error_p,
+                                   bip32_template_error_type* template_error_p, size_t* error_offset_p)
+{
+    size_t pos = 0;
+    size_t end, slash;
+
+    *num_items_p = 0;
+
+    while( pos < descriptor_len && descriptor[pos] != '#' ) {
+        if( descriptor[pos] == '[' ) {
+            end = find_char(descriptor, pos + 1, descriptor_len, ']');
+            if( end == descriptor_len ) {
+                return report_error(BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_KEY_ORIGIN,
+                                    BIP32_TEMPLATE_ERROR_UNDEFINED, descriptor_len,
+                                    error_p, template_error_p, error_offset_p);
+            }
+            /* The origin that has only the fingerprint has no path */
+            slash = find_char(descriptor, pos + 1, end, '/');
+            if( slash < end
+                && !parse_item(descriptor, slash + 1, end, mode, BIP32_TEMPLATE_DESCRIPTOR_KEY_ORIGIN,
+                               items, max_items, num_items_p, error_p, template_error_p, error_offset_p) )
+            {
+                return 0;
+            }
+            pos = end + 1;
+        }
+        else if( descriptor[pos] == '/' ) {
+            end = find_suffix_end(descriptor, pos + 1, descriptor_len);
+            if( !parse_item(descriptor, pos + 1, end, mode, BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX,
+                            items, max_items, num_items_p, error_p, template_error_p, error_offset_p) )
+            {
+                return 0;
+            }
+            pos = end;
+        }
+        else {
+            pos++;
+        }
+    }
+
+    return 1;
+}
+
+const char* bip32_template_descriptor_error_to_string(bip32_template_descriptor_error_type error)
+{
+    switch( error ) {
+        case BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE:
+            return "the path is not a valid template";
+        case BIP32_TEMPLATE_DESCRIPTOR_ERROR_TOO_MANY_PATHS:
+            return "too many paths";
+        case BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_KEY_ORIGIN:
+            return "key origin is not terminated with ']'";
+        case BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_MULTIPATH:
+            return "multipath specifier is not terminated with '>'";
+        case BIP32_TEMPLATE_DESCRIPTOR_ERROR_MULTIPATH_TOO_SHORT:
+            return "multipath specifier has less than two alternatives";
+        case BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNDEFINED:
+            return "<undefined error>";
+        default:
+            /* should not happen, all cases must be hanlded */
+            assert( 0 ); /* UNREACHABLE */
+            return "<unexpected error code>";
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_DESCRIPTOR_H_
+#define _BIP32_TEMPLATE_DESCRIPTOR_H_
+
+#include "bip32template.h"
+
+typedef enum {
+    /* The path after the fingerprint in the key origin, like 84h/0h/0h in [d34db33f/84h/0h/0h] */
+    BIP32_TEMPLATE_DESCRIPTOR_KEY_ORIGIN,
+    /* The derivation path after the key, like <0;1> in xpub.../<0;1> */
+    BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX,
+} bip32_template_descriptor_item_kind_type;
+
+/* The errors of the descriptor scanner. The errors of the paths themselves are reported
+ * as BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, with the parser's error code alongside */
+typedef enum {
+    BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNDEFINED,
+    BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE,
+    BIP32_TEMPLATE_DESCRIPTOR_ERROR_TOO_MANY_PATHS,
+    BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_KEY_ORIGIN,
+    BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_MULTIPATH,
+    BIP32_TEMPLATE_DESCRIPTOR_ERROR_MULTIPATH_TOO_SHORT,
+} bip32_template_descriptor_error_type;
+
+typedef struct {
+    bip32_template_descriptor_item_kind_type kind;
+    /* The position and the length of the path within the descriptor string */
+    size_t offset;
+    size_t len;
+    /* A path with the multipath specifier <a;b;...> gives one item per alternative,
+     * in the order of the specifier, all with the same offset and length.
+     * multipath_index is the number of the alternative, and num_multipath is the number
+     * of the alternatives. They are 0 and 1 for a path without the specifier */
+    unsigned int multipath_index;
+    unsigned int num_multipath;
+    bip32_template_type tmpl;
+} bip32_template_descriptor_item_type;
+
+int bip32_template_descriptor_scan(const char* descriptor, size_t descriptor_len,
+                                   bip32_template_format_mode_type mode,
+                                   bip32_template_descriptor_item_type* items, unsigned int max_items,
+                                   unsigned int* num_items_p,
+                                   bip32_template_descriptor_error_type* error_p,
+                                   bip32_template_error_type* template_error_p, size_t* error_offset_p);
+const char* bip32_template_descriptor_error_to_string(bip32_template_descriptor_error_type error);
+
+#endif /* _BIP32_TEMPLATE_DESCRIPTOR_H_ */
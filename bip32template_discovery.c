@@ -0,0 +1,244 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Gap-limit discovery over the last section of a template.
+ *
+ * Every combination of indexes of the sections before the last one is a branch:
+ * for {0-99}'/{0,1} followed by the wildcard section there are 200 branches,
+ * and for each of them the last section is walked until gap_limit unused
+ * indexes in a row are found after the last used one.
+ *
+ * Each branch keeps only a sliding window: the position of the next candidate
+ * and the position after the last used index. The candidates are given out
+ * while they are within gap_limit from the last used index, and the results
+ * can be reported back in any order. When all candidates of the window
+ * are reported and none of them was used, the branch is done.
+ *
+ * The branches are kept in the slots provided by the caller. The next branch
+ * is activated when a slot becomes free, so the memory used is bounded by the
+ * number of slots, regardless of the number of branches in the template. */
+
+#include <assert.h>
+
+#include "bip32template_discovery.h"
+#include "bip32template_internal.h"
+
+static const bip32_template_section_type* last_section(const bip32_template_type* template_p)
+{
+    return &template_p->sections[template_p->num_sections-1];
+}
+
+/* Advance the prefix cursor to the next combination of indexes, the last prefix section
+ * changes first, so the branches are activated in lexicographic order */
+static void advance_prefix(bip32_template_discovery_type* discovery_p)
+{
+    int i = discovery_p->tmpl.num_sections - 2;
+
+    for( ; i >= 0; i-- ) {
+        const bip32_template_section_type* section_p = &discovery_p->tmpl.sections[i];
+        const bip32_template_section_range_type* range_p = &section_p->ranges[discovery_p->prefix_range[i]];
+
+        if( discovery_p->prefix[i] < range_p->range_end ) {
+            discovery_p->prefix[i]++;
+            return;
+        }
+        if( discovery_p->prefix_range[i] + 1 < section_p->num_ranges ) {
+            discovery_p->prefix_range[i]++;
+            discovery_p->prefix[i] = section_p->ranges[discovery_p->prefix_range[i]].range_start;
+            return;
+        }
+        discovery_p->prefix_range[i] = 0;
+        discovery_p->prefix[i] = section_p->ranges[0].range_start;
+    }
+
+    discovery_p->is_prefix_exhausted = 1;
+}
+
+static void activate_branches(bip32_template_discovery_type* discovery_p)
+{
+    bip32_template_discovery_branch_type* branch_p;
+    unsigned int slot;
+    int i;
+
+    for( slot = 0;
+         slot < discovery_p->max_branches && !discovery_p->is_prefix_exhausted
+             && discovery_p->num_active_branches < discovery_p->max_branches;
+         slot++ )
+    {
+        branch_p = &discovery_p->branches[slot];
+        if( branch_p->is_active ) {
+            continue;
+        }
+        for( i = 0; i < discovery_p->tmpl.num_sections - 1; i++ ) {
+            branch_p->prefix[i] = discovery_p->prefix[i];
+        }
+        branch_p->generation++;
+        branch_p->is_active = 1;
+        branch_p->next_ordinal = 0;
+        branch_p->used_end = 0;
+        branch_p->num_outstanding = 0;
+        discovery_p->num_active_branches++;
+        advance_prefix(discovery_p);
+    }
+}
+
+static uint64_t window_end(const bip32_template_discovery_type* discovery_p,
+                           const bip32_template_discovery_branch_type* branch_p)
+{
+    uint64_t end = branch_p->used_end + discovery_p->gap_limit;
+
+    if( end > discovery_p->last_section_width ) {
+        end = discovery_p->last_section_width;
+    }
+
+    return end;
+}
+
+/* Returns 0 if the template has no sections, or gap_limit or max_branches is zero */
+int bip32_template_discovery_init(bip32_template_discovery_type* discovery_p,
+                                  const bip32_template_type* template_p, uint32_t gap_limit,
+                                  bip32_template_discovery_branch_type* branches, unsigned int max_branches,
+                                  bip32_template_discovery_done_func_type done, void* done_arg)
+{
+    unsigned int i;
+
+    if( template_p->num_sections == 0 || gap_limit == 0 || max_branches == 0 ) {
+        return 0;
+    }
+
+    discovery_p->tmpl = *template_p;
+    discovery_p->gap_limit = gap_limit;
+    discovery_p->last_section_width = bip32_template_section_width(last_section(template_p));
+    discovery_p->done = done;
+    discovery_p->done_arg = done_arg;
+    discovery_p->branches = branches;
+    discovery_p->max_branches = max_branches;
+    discovery_p->num_active_branches = 0;
+    discovery_p->next_slot = 0;
+    discovery_p->is_prefix_exhausted = 0;
+
+    for( i = 0; i + 1 < template_p->num_sections; i++ ) {
+        discovery_p->prefix_range[i] = 0;
+        discovery_p->prefix[i] = template_p->sections[i].ranges[0].range_start;
+    }
+
+    for( i = 0; i < max_branches; i++ ) {
+        branches[i].is_active = 0;
+        branches[i].generation = 0;
+    }
+
+    return 1;
+}
+
+/* Put up to max_candidates paths to check into candidates, taking one candidate
+ * from each branch in turn. Returns the number of candidates.
+ * Zero is returned when no branch can give more candidates until the results
+ * for the outstanding candidates are reported */
+unsigned int bip32_template_discovery_next_batch(bip32_template_discovery_type* discovery_p,
+                                                 bip32_template_discovery_candidate_type* candidates,
+                                                 unsigned int max_candidates)
+{
+    bip32_template_discovery_branch_type* branch_p;
+    bip32_template_discovery_candidate_type* candidate_p;
+    unsigned int num_candidates = 0;
+    unsigned int num_idle = 0;
+    unsigned int slot;
+    int i;
+
+    activate_branches(discovery_p);
+
+    /* Stop after a full round over the slots without any candidate given out */
+    while( num_candidates < max_candidates && num_idle < discovery_p->max_branches ) {
+        slot = discovery_p->next_slot;
+        discovery_p->next_slot = (slot + 1) % discovery_p->max_branches;
+        branch_p = &discovery_p->branches[slot];
+
+        if( !branch_p->is_active || branch_p->next_ordinal >= window_end(discovery_p, branch_p) ) {
+            num_idle++;
+            continue;
+        }
+        num_idle = 0;
+
+        candidate_p = &candidates[num_candidates++];
+        candidate_p->path_len = discovery_p->tmpl.num_sections;
+        for( i = 0; i < discovery_p->tmpl.num_sections - 1; i++ ) {
+            candidate_p->path[i] = branch_p->prefix[i];
+        }
+        candidate_p->path[i] = bip32_template_section_index_at(last_section(&discovery_p->tmpl),
+                                                                 branch_p->next_ordinal);
+        candidate_p->slot = slot;
+        candidate_p->generation = branch_p->generation;
+        candidate_p->ordinal = branch_p->next_ordinal;
+
+        branch_p->next_ordinal++;
+        branch_p->num_outstanding++;
+    }
+
+    return num_candidates;
+}
+
+/* Report whether the candidate path was used. The results can be reported in any order,
+ * but each candidate must be reported exactly once.
+ * Returns 0 if the candidate does not belong to an active branch
+ * (for example, given out by another discovery) */
+int bip32_template_discovery_report(bip32_template_discovery_type* discovery_p,
+                                    const bip32_template_discovery_candidate_type* candidate_p,
+                                    int is_used)
+{
+    bip32_template_discovery_branch_type* branch_p;
+
+    if( candidate_p->slot >= discovery_p->max_branches ) {
+        return 0;
+    }
+    branch_p = &discovery_p->branches[candidate_p->slot];
+    if( !branch_p->is_active || branch_p->generation != candidate_p->generation
+        || branch_p->num_outstanding == 0 || candidate_p->ordinal >= branch_p->next_ordinal )
+    {
+        return 0;
+    }
+
+    branch_p->num_outstanding--;
+    if( is_used && candidate_p->ordinal >= branch_p->used_end ) {
+        branch_p->used_end = candidate_p->ordinal + 1;
+    }
+
+    if( branch_p->num_outstanding == 0 && branch_p->next_ordinal >= window_end(discovery_p, branch_p) ) {
+        branch_p->is_active = 0;
+        discovery_p->num_active_branches--;
+        if( discovery_p->done ) {
+            discovery_p->done(branch_p->prefix, discovery_p->tmpl.num_sections - 1,
+                              branch_p->used_end > 0,
+                              branch_p->used_end > 0
+                                ? bip32_template_section_index_at(last_section(&discovery_p->tmpl),
+                                                                  branch_p->used_end - 1)
+                                : 0,
+                              discovery_p->done_arg);
+        }
+    }
+
+    return 1;
+}
+
+int bip32_template_discovery_is_finished(const bip32_template_discovery_type* discovery_p)
+{
+    return discovery_p->is_prefix_exhausted && discovery_p->num_active_branches == 0;
+}
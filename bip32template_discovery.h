@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _BIP32_TEMPLATE_DISCOVERY_H_
+#define _BIP32_TEMPLATE_DISCOVERY_H_
+
+#include "bip32template.h"
+
+/* Called when the gap limit is reached for the branch.
+ * prefix_p contains the indexes of all sections except the last one.
+ * If any path of the branch was used, has_used is 1 and last_used_index
+ * is the last section index of the last used path */
+typedef void (*bip32_template_discovery_done_func_type)(const uint32_t* prefix_p, unsigned int prefix_len,
+                                                        int has_used, uint32_t last_used_index,
+                                                        void* arg);
+
+typedef struct {
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int path_len;
+    /* Used to find the branch when the result is reported back */
+    unsigned int slot;
+    uint32_t generation;
+    uint64_t ordinal;
+} bip32_template_discovery_candidate_type;
+
+typedef struct {
+    uint32_t prefix[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t generation;
+    uint8_t is_active;
+    /* Position within the last section of the next candidate to give out */
+    uint64_t next_ordinal;
+    /* Position after the last used index, 0 if none was used */
+    uint64_t used_end;
+    uint32_t num_outstanding;
+} bip32_template_discovery_branch_type;
+
+typedef struct {
+    bip32_template_type tmpl;
+    uint32_t gap_limit;
+    uint64_t last_section_width;
+    bip32_template_discovery_done_func_type done;
+    void* done_arg;
+    bip32_template_discovery_branch_type* branches;
+    unsigned int max_branches;
+    unsigned int num_active_branches;
+    unsigned int next_slot;
+    /* Cursor over the prefixes of the branches that are not yet activated */
+    int is_prefix_exhausted;
+    uint8_t prefix_range[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t prefix[BIP32_TEMPLATE_MAX_SECTIONS];
+} bip32_template_discovery_type;
+
+int bip32_template_discovery_init(bip32_template_discovery_type* discovery_p,
+                                  const bip32_template_type* template_p, uint32_t gap_limit,
+                                  bip32_template_discovery_branch_type* branches, unsigned int max_branches,
+                                  bip32_template_discovery_done_func_type done, void* done_arg);
+unsigned int bip32_template_discovery_next_batch(bip32_template_discovery_type* discovery_p,
+                                                 bip32_template_discovery_candidate_type* candidates,
+                                                 unsigned int max_candidates);
+int bip32_template_discovery_report(bip32_template_discovery_type* discovery_p,
+                                    const bip32_template_discovery_candidate_type* candidate_p,
+                                    int is_used);
+int bip32_template_discovery_is_finished(const bip32_template_discovery_type* discovery_p);
+
+#endif /* _BIP32_TEMPLATE_DISCOVERY_H_ */
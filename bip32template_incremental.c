@@ -0,0 +1,205 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Incremental reparsing of a template string after an edit.
+ *
+ * Between the sections, right after the '/', the parser holds nothing but
+ * the number of sections, the partial path flag, the hardened marker accepted
+ * from now on, and whether the previous section is hardened (that decides
+ * GOT_HARDENED_AFTER_UNHARDENED for the next one). These boundary states are
+ * recorded during the parse.
+ *
+ * After an edit, the parsing continues from the last boundary before
+ * the edited bytes, with the sections parsed before it kept as they are.
+ * Once the parser reaches a boundary after the edited bytes that was also
+ * recorded by the previous parse (at the position shifted by the size change)
+ * with the same state, the rest of the string would be parsed the same way
+ * as before, so the parsing stops, and the rest of the sections, the boundaries
+ * and the result are taken from the previous parse.
+ *
+ * If the previous parse failed before the edited bytes, nothing is parsed. */
+
+#include <assert.h>
+
+#include "bip32template_incremental.h"
+
+typedef struct {
+    bip32_template_incremental_type* inc_p;
+    const bip32_template_incremental_type* old_p;
+    size_t edited_end; /* the end of the inserted bytes */
+    long delta;
+    int converged_at; /* the index of the old boundary, or -1 */
+} update_context_type;
+
+static int is_same_state(const bip32_template_boundary_type* a, const bip32_template_boundary_type* b)
+{
+    return a->num_sections == b->num_sections
+        && a->is_partial == b->is_partial
+        && a->is_prev_section_hardened == b->is_prev_section_hardened
+        && a->hardened_marker == b->hardened_marker;
+}
+
+static int on_boundary(const bip32_template_boundary_type* boundary_p, void* arg)
+{
+    update_context_type* uctx = arg;
+    const bip32_template_incremental_type* old_p = uctx->old_p;
+    unsigned int i;
+
+    assert( uctx->inc_p->num_boundaries < BIP32_TEMPLATE_MAX_SECTIONS );
+    uctx->inc_p->boundaries[uctx->inc_p->num_boundaries++] = *boundary_p;
+
+    /* The '/' is at boundary_p->pos - 1 */
+    if( !old_p || boundary_p->pos - 1 < uctx->edited_end ) {
+        return 1;
+    }
+
+    for( i = 0; i < old_p->num_boundaries; i++ ) {
+        if( (long)old_p->boundaries[i].pos + uctx->delta == (long)boundary_p->pos ) {
+            if( is_same_state(&old_p->boundaries[i], boundary_p) ) {
+                uctx->converged_at = (int)i;
+                return 0;
+            }
+            break;
+        }
+    }
+
+    return 1;
+}
+
+static int run_parse(bip32_template_incremental_type* inc_p, const char* str, size_t len,
+                     const bip32_template_boundary_type* resume_p, update_context_type* uctx)
+{
+    bip32_template_getchar_context_type ctx;
+    unsigned int start_pos = resume_p ? resume_p->pos : 0;
+    int is_stopped;
+
+    bip32_template_context_set_span(str, len, &ctx);
+    ctx.pos = start_pos;
+
+    inc_p->is_valid = bip32_template_parse_resumable(bip32_template_getchar_span, &ctx, inc_p->mode,
+                                                     &inc_p->tmpl, &inc_p->error,
+                                                     resume_p, on_boundary, uctx, &is_stopped);
+    inc_p->last_pos = ctx.pos;
+    inc_p->len = len;
+    inc_p->num_chars_parsed = ctx.pos - start_pos;
+
+    return is_stopped;
+}
+
+int bip32_template_incremental_parse(bip32_template_incremental_type* inc_p,
+                                     const char* str, size_t len, bip32_template_format_mode_type mode)
+{
+    update_context_type uctx = { inc_p, 0, 0, 0, -1 };
+
+    inc_p->mode = mode;
+    inc_p->num_boundaries = 0;
+    run_parse(inc_p, str, len, 0, &uctx);
+
+    return inc_p->is_valid;
+}
+
+/* Reparse after removed_len bytes at edit_offset were replaced with inserted_len bytes.
+ * str and len are the whole edited string.
+ * Returns the same result as bip32_template_incremental_parse() of the edited string */
+int bip32_template_incremental_update(bip32_template_incremental_type* inc_p, const char* str, size_t len,
+                                      size_t edit_offset, size_t removed_len, size_t inserted_len)
+{
+    bip32_template_incremental_type old = *inc_p;
+    update_context_type uctx = { inc_p, &old, edit_offset + inserted_len,
+                                 (long)inserted_len - (long)removed_len, -1 };
+    const bip32_template_boundary_type* resume_p = 0;
+    unsigned int i;
+    int ii;
+
+    assert( edit_offset + removed_len <= inc_p->len );
+    assert( inc_p->len - removed_len + inserted_len == len );
+
+    /* The previous parse failed on a character before the edit */
+    if( inc_p->last_pos - 1 < edit_offset ) {
+        inc_p->len = len;
+        inc_p->num_chars_parsed = 0;
+        return inc_p->is_valid;
+    }
+
+    inc_p->num_boundaries = 0;
+    for( i = 0; i < old.num_boundaries && old.boundaries[i].pos <= edit_offset; i++ ) {
+        inc_p->num_boundaries = i + 1;
+        resume_p = &old.boundaries[i];
+    }
+
+    if( !run_parse(inc_p, str, len, resume_p, &uctx) ) {
+        return inc_p->is_valid;
+    }
+
+    assert( uctx.converged_at >= 0 );
+
+    for( ii = inc_p->tmpl.num_sections; ii < BIP32_TEMPLATE_MAX_SECTIONS; ii++ ) {
+        inc_p->tmpl.sections[ii] = old.tmpl.sections[ii];
+    }
+    inc_p->tmpl.num_sections = old.tmpl.num_sections;
+
+    for( i = (unsigned int)uctx.converged_at + 1; i < old.num_boundaries; i++ ) {
+        inc_p->boundaries[inc_p->num_boundaries] = old.boundaries[i];
+        inc_p->boundaries[inc_p->num_boundaries].pos = (unsigned int)((long)old.boundaries[i].pos + uctx.delta);
+        inc_p->num_boundaries++;
+    }
+
+    inc_p->is_valid = old.is_valid;
+    inc_p->error = old.error;
+    inc_p->last_pos = (unsigned int)((long)old.last_pos + uctx.delta);
+
+    return inc_p->is_valid;
+}
+
+/* Get the bytes of the string that the section was parsed from, including the hardened marker.
+ * Returns 0 if there is no such section */
+int bip32_template_incremental_section_span(const bip32_template_incremental_type* inc_p, unsigned int section,
+                                            size_t* offset_p, size_t* len_p)
+{
+    size_t start;
+    size_t end;
+
+    if( section >= inc_p->tmpl.num_sections ) {
+        return 0;
+    }
+
+    if( section == 0 ) {
+        start = inc_p->tmpl.is_partial ? 0 : 2;
+    }
+    else {
+        start = inc_p->boundaries[section-1].pos;
+    }
+
+    /* The section is followed by a '/', or by the character where the parse ended */
+    if( section < inc_p->num_boundaries ) {
+        end = inc_p->boundaries[section].pos - 1;
+    }
+    else {
+        end = inc_p->last_pos - 1;
+    }
+
+    *offset_p = start;
+    *len_p = end - start;
+
+    return 1;
+}
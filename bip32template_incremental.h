@@ -0,0 +1,52 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_INCREMENTAL_H_
+#define _BIP32_TEMPLATE_INCREMENTAL_H_
+
+#include "bip32template.h"
+
+/* The template parsed from a string, with the parser state at each '/'
+ * that ends a section, so that after an edit of the string only the part
+ * that can be affected by the edit has to be parsed again */
+typedef struct {
+    bip32_template_format_mode_type mode;
+    bip32_template_type tmpl;
+    int is_valid;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    size_t len;
+    unsigned int num_boundaries;
+    bip32_template_boundary_type boundaries[BIP32_TEMPLATE_MAX_SECTIONS];
+    /* The number of characters read by the last parse or update */
+    unsigned int num_chars_parsed;
+} bip32_template_incremental_type;
+
+int bip32_template_incremental_parse(bip32_template_incremental_type* inc_p,
+                                     const char* str, size_t len, bip32_template_format_mode_type mode);
+int bip32_template_incremental_update(bip32_template_incremental_type* inc_p, const char* str, size_t len,
+                                      size_t edit_offset, size_t removed_len, size_t inserted_len);
+int bip32_template_incremental_section_span(const bip32_template_incremental_type* inc_p, unsigned int section,
+                                            size_t* offset_p, size_t* len_p);
+
+#endif /* _BIP32_TEMPLATE_INCREMENTAL_H_ */
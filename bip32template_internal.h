@@ -0,0 +1,112 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_INTERNAL_H_
+#define _BIP32_TEMPLATE_INTERNAL_H_
+
+/* Helpers on the template sections that the library modules share.
+ * This header is not a part of the API: it is included only by the .c files
+ * of the library, and its contents can change at any time.
+ * The sections here are the ones the parser produces: non-empty, with ranges
+ * ordered, disjoint and all within one half (hardened or unhardened) */
+
+#include <assert.h>
+
+#include "bip32template.h"
+
+#define BIP32_TEMPLATE_HARDENED_INDEX_START 0x80000000
+
+static inline int bip32_template_is_index_in_section(const bip32_template_section_type* section_p,
+                                                     uint32_t index)
+{
+    int i;
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        if( index < section_p->ranges[i].range_start
+            || index > section_p->ranges[i].range_end )
+        {
+            /* Do nothing.
+             * This way the condition check here matches
+             * the condition check in the formal spec */
+        }
+        else {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* The number of indexes the section matches */
+static inline uint64_t bip32_template_section_width(const bip32_template_section_type* section_p)
+{
+    uint64_t width = 0;
+    int i;
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        width += (uint64_t)section_p->ranges[i].range_end - section_p->ranges[i].range_start + 1;
+    }
+
+    return width;
+}
+
+/* The index at the position pos among the indexes the section matches, in ascending order.
+ * pos must be less than the width of the section */
+static inline uint32_t bip32_template_section_index_at(const bip32_template_section_type* section_p,
+                                                       uint64_t pos)
+{
+    uint64_t width;
+    int i;
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        width = (uint64_t)section_p->ranges[i].range_end - section_p->ranges[i].range_start + 1;
+        if( pos < width ) {
+            return section_p->ranges[i].range_start + (uint32_t)pos;
+        }
+        pos -= width;
+    }
+
+    assert( 0 ); /* UNREACHABLE */
+    return 0;
+}
+
+/* The number of paths the template matches.
+ * Returns UINT64_MAX if the number does not fit into uint64_t */
+static inline uint64_t bip32_template_num_paths(const bip32_template_type* template_p)
+{
+    uint64_t num_paths = 1;
+    uint64_t width;
+    int i;
+
+    for( i = 0; i < template_p->num_sections; i++ ) {
+        width = bip32_template_section_width(&template_p->sections[i]);
+        if( num_paths > UINT64_MAX / width ) {
+            return UINT64_MAX;
+        }
+        num_paths *= width;
+    }
+
+    return num_paths;
+}
+
+#endif /* _BIP32_TEMPLATE_INTERNAL_H_ */
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Order-preserving keys for paths, and the key ranges that cover a template.
+ *
+ * Keys of the paths with the same length and the same partial marker
+ * compare with memcmp() in the same order as the paths compare index by index,
+ * so all the paths that share a prefix make one contiguous range of keys.
+ *
+ * The template is expanded section by section into the list of prefixes,
+ * and the ranges of the deepest expanded section give the key ranges.
+ * The sections after it are covered entirely by each range, so if they do not
+ * match every index, the ranges also cover the paths that the template
+ * does not match, and the caller has to check the found records with
+ * bip32_template_match(). The deepest section to expand is chosen so that
+ * the number of ranges does not exceed the limit given by the caller.
+ * For 84'/0'/0'/{0,1} followed by the wildcard section that is two ranges,
+ * one for each branch, as the wildcard section is contiguous within each of them. */
+
+#include <assert.h>
+#include <string.h>
+
+#include "bip32template_keys.h"
+#include "bip32template_internal.h"
+
+static void put_index(uint8_t* p, uint32_t index)
+{
+    p[0] = (uint8_t)(index >> 24);
+    p[1] = (uint8_t)(index >> 16);
+    p[2] = (uint8_t)(index >> 8);
+    p[3] = (uint8_t)index;
+}
+
+static uint32_t get_index(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Put the key for the path into key_p, that must have space for
+ * BIP32_PATH_KEY_MAX_SIZE bytes. Returns the size of the key,
+ * or 0 if the path is longer than BIP32_TEMPLATE_MAX_SECTIONS */
+unsigned int bip32_path_to_key(const uint32_t* path_p, unsigned int path_len, int is_partial,
+                               uint8_t* key_p)
+{
+    unsigned int i;
+
+    if( path_len > BIP32_TEMPLATE_MAX_SECTIONS ) {
+        return 0;
+    }
+
+    key_p[0] = is_partial ? 1 : 0;
+    key_p[1] = (uint8_t)path_len;
+    for( i = 0; i < path_len; i++ ) {
+        put_index(&key_p[BIP32_PATH_KEY_HEADER_SIZE + i*4], path_p[i]);
+    }
+
+    return BIP32_PATH_KEY_HEADER_SIZE + path_len*4;
+}
+
+/* Returns 0 if the key is malformed */
+int bip32_path_from_key(const uint8_t* key_p, unsigned int key_len,
+                        uint32_t* path_p, unsigned int* path_len_p, unsigned int* is_partial_p)
+{
+    unsigned int i;
+
+    if( key_len < BIP32_PATH_KEY_HEADER_SIZE || key_p[0] > 1
+        || key_p[1] > BIP32_TEMPLATE_MAX_SECTIONS
+        || key_len != BIP32_PATH_KEY_HEADER_SIZE + (unsigned int)key_p[1]*4 )
+    {
+        return 0;
+    }
+
+    *is_partial_p = key_p[0];
+    *path_len_p = key_p[1];
+    for( i = 0; i < *path_len_p; i++ ) {
+        path_p[i] = get_index(&key_p[BIP32_PATH_KEY_HEADER_SIZE + i*4]);
+    }
+
+    return 1;
+}
+
+static int is_section_full(const bip32_template_section_type* section_p)
+{
+    return section_p->num_ranges == 1 && section_p->ranges[0].range_start == 0
+        && section_p->ranges[0].range_end == 0xFFFFFFFF;
+}
+
+/* Set hi to the smallest key of the same size that is greater than all the keys
+ * that start with key. Returns 0 if there is no such key */
+static int key_successor(const uint8_t* key_p, unsigned int key_len, uint8_t* hi_p)
+{
+    int i;
+
+    memcpy(hi_p, key_p, key_len);
+    for( i = (int)key_len - 1; i >= 0; i-- ) {
+        if( hi_p[i] != 0xFF ) {
+            hi_p[i]++;
+            return 1;
+        }
+        hi_p[i] = 0;
+    }
+
+    return 0;
+}
+
+/* Append the range [lo, successor(last)) to the list, or extend the previous range
+ * if it ends where this one starts */
+static void add_key_range(bip32_path_key_range_type* ranges, unsigned int* num_ranges_p,
+                          const uint8_t* lo_p, const uint8_t* last_p, unsigned int key_len)
+{
+    bip32_path_key_range_type* range_p;
+
+    if( *num_ranges_p > 0 ) {
+        range_p = &ranges[*num_ranges_p - 1];
+        if( range_p->hi_len == key_len && memcmp(range_p->hi, lo_p, key_len) == 0 ) {
+            range_p->hi_len = key_successor(last_p, key_len, range_p->hi) ? key_len : 0;
+            return;
+        }
+    }
+
+    range_p = &ranges[(*num_ranges_p)++];
+    memcpy(range_p->lo, lo_p, key_len);
+    range_p->lo_len = key_len;
+    range_p->hi_len = key_successor(last_p, key_len, range_p->hi) ? key_len : 0;
+}
+
+/* Put the ranges of keys that contain the keys of all the paths the template matches
+ * into ranges, in ascending order. No more than max_ranges ranges are produced.
+ * is_exact_p is set to 1 if the ranges contain only the keys of the matching paths.
+ * Returns 0 if max_ranges is 0 */
+int bip32_template_to_key_ranges(const bip32_template_type* template_p,
+                                 bip32_path_key_range_type* ranges, unsigned int max_ranges,
+                                 unsigned int* num_ranges_p, int* is_exact_p)
+{
+    uint8_t lo[BIP32_PATH_KEY_MAX_SIZE];
+    uint8_t last[BIP32_PATH_KEY_MAX_SIZE];
+    uint8_t range_pos[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t prefix[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint64_t num_prefixes = 1;
+    unsigned int key_len;
+    int num_sections = template_p->num_sections;
+    int num_exact = num_sections;
+    int level = -1;
+    int i, r;
+
+    *num_ranges_p = 0;
+    if( max_ranges == 0 ) {
+        return 0;
+    }
+
+    /* The trailing sections that match any index do not need to be expanded */
+    while( num_exact > 0 && is_section_full(&template_p->sections[num_exact-1]) ) {
+        num_exact--;
+    }
+
+    /* Find the deepest section which ranges can all be listed within the limit */
+    for( i = 0; i < num_exact; i++ ) {
+        if( num_prefixes * template_p->sections[i].num_ranges > max_ranges ) {
+            break;
+        }
+        level = i;
+        num_prefixes *= bip32_template_section_width(&template_p->sections[i]);
+        if( num_prefixes > max_ranges ) {
+            /* Prevent overflow, this is enough to stop at the next section */
+            num_prefixes = (uint64_t)max_ranges + 1;
+        }
+    }
+
+    *is_exact_p = (level == num_exact - 1);
+
+    lo[0] = last[0] = template_p->is_partial ? 1 : 0;
+    lo[1] = last[1] = (uint8_t)num_sections;
+    key_len = BIP32_PATH_KEY_HEADER_SIZE + (level + 1)*4;
+
+    if( level < 0 ) {
+        add_key_range(ranges, num_ranges_p, lo, last, key_len);
+        return 1;
+    }
+
+    for( i = 0; i < level; i++ ) {
+        range_pos[i] = 0;
+        prefix[i] = template_p->sections[i].ranges[0].range_start;
+    }
+
+    for( ;; ) {
+        const bip32_template_section_type* section_p = &template_p->sections[level];
+
+        for( i = 0; i < level; i++ ) {
+            put_index(&lo[BIP32_PATH_KEY_HEADER_SIZE + i*4], prefix[i]);
+        }
+        memcpy(last, lo, BIP32_PATH_KEY_HEADER_SIZE + level*4);
+        for( r = 0; r < section_p->num_ranges; r++ ) {
+            put_index(&lo[BIP32_PATH_KEY_HEADER_SIZE + level*4], section_p->ranges[r].range_start);
+            put_index(&last[BIP32_PATH_KEY_HEADER_SIZE + level*4], section_p->ranges[r].range_end);
+            assert( *num_ranges_p < max_ranges );
+            add_key_range(ranges, num_ranges_p, lo, last, key_len);
+        }
+
+        /* Advance to the next prefix, the last section changes first */
+        for( i = level - 1; i >= 0; i-- ) {
+            const bip32_template_section_range_type* range_p =
+                &template_p->sections[i].ranges[range_pos[i]];
+            if( prefix[i] < range_p->range_end ) {
+                prefix[i]++;
+                break;
+            }
+            if( range_pos[i] + 1 < template_p->sections[i].num_ranges ) {
+                range_pos[i]++;
+                prefix[i] = template_p->sections[i].ranges[range_pos[i]].range_start;
+                break;
+            }
+            range_pos[i] = 0;
+            prefix[i] = template_p->sections[i].ranges[0].range_start;
+        }
+        if( i < 0 ) {
+            break;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _BIP32_TEMPLATE_KEYS_H_
+#define _BIP32_TEMPLATE_KEYS_H_
+
+#include "bip32template.h"
+
+/* The key is the partial path marker byte, the path length byte,
+ * and then each index as 4 bytes in big-endian order */
+#define BIP32_PATH_KEY_HEADER_SIZE 2
+#define BIP32_PATH_KEY_MAX_SIZE (BIP32_PATH_KEY_HEADER_SIZE + 4*BIP32_TEMPLATE_MAX_SECTIONS)
+
+/* The range of keys from lo (inclusive) to hi (exclusive).
+ * hi_len is 0 if the range is not bounded from above */
+typedef struct {
+    uint8_t lo[BIP32_PATH_KEY_MAX_SIZE];
+    unsigned int lo_len;
+    uint8_t hi[BIP32_PATH_KEY_MAX_SIZE];
+    unsigned int hi_len;
+} bip32_path_key_range_type;
+
+unsigned int bip32_path_to_key(const uint32_t* path_p, unsigned int path_len, int is_partial,
+                               uint8_t* key_p);
+int bip32_path_from_key(const uint8_t* key_p, unsigned int key_len,
+                        uint32_t* path_p, unsigned int* path_len_p, unsigned int* is_partial_p);
+int bip32_template_to_key_ranges(const bip32_template_type* template_p,
+                                 bip32_path_key_range_type* ranges, unsigned int max_ranges,
+                                 unsigned int* num_ranges_p, int* is_exact_p);
+
+#endif /* _BIP32_TEMPLATE_KEYS_H_ */
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* The registry of templates that can be matched against by many threads
+ * while the templates are added and removed.
+ *
+ * The templates are kept in an immutable snapshot. The writer makes a changed copy
+ * of the current snapshot, publishes it with one atomic store and increments the epoch.
+ * The readers load the current snapshot with one atomic load, and use it without
+ * any synchronization.
+ *
+ * The replaced snapshot is freed when all the readers have been seen at a quiescent point
+ * after it was replaced (quiescent state based reclamation). Each reader announces
+ * the epoch it has seen in its own slot when it calls bip32_template_registry_quiescent(),
+ * between the batches of work, when it does not hold any snapshot. The reader that is
+ * offline does not hold any snapshot and does not delay reclamation.
+ *
+ * There can be only one writer at a time, the changes from different threads
+ * must be serialized by the caller. */
+
+#include <string.h>
+
+#include "bip32template_registry.h"
+
+#define READER_OFFLINE UINT64_MAX
+
+static bip32_template_registry_snapshot_type* alloc_snapshot(bip32_template_registry_type* registry_p,
+                                                            unsigned int num_entries)
+{
+    bip32_template_registry_snapshot_type* snapshot_p;
+
+    snapshot_p = registry_p->allocator.alloc(
+        sizeof(*snapshot_p) + num_entries * sizeof(snapshot_p->entries[0]), registry_p->allocator.arg);
+    if( snapshot_p ) {
+        snapshot_p->num_entries = num_entries;
+        snapshot_p->next_retired = 0;
+        snapshot_p->retire_epoch = 0;
+    }
+
+    return snapshot_p;
+}
+
+static void publish(bip32_template_registry_type* registry_p, bip32_template_registry_snapshot_type* snapshot_p)
+{
+    bip32_template_registry_snapshot_type* old_p = atomic_load_explicit(&registry_p->current,
+                                                                        memory_order_relaxed);
+
+    snapshot_p->version = old_p->version + 1;
+    atomic_store_explicit(&registry_p->current, snapshot_p, memory_order_release);
+
+    /* The readers that announce this epoch or later have loaded the new snapshot */
+    old_p->retire_epoch = atomic_fetch_add(&registry_p->epoch, 1) + 1;
+    old_p->next_retired = registry_p->retired;
+    registry_p->retired = old_p;
+
+    bip32_template_registry_reclaim(registry_p);
+}
+
+/* Returns the position of the entry with the id, or the position where it should be inserted */
+static unsigned int find_entry(const bip32_template_registry_snapshot_type* snapshot_p, uint32_t id)
+{
+    unsigned int lo = 0;
+    unsigned int hi = snapshot_p->num_entries;
+    unsigned int mid;
+
+    while( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if( snapshot_p->entries[mid].id < id ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* The readers are all offline after init.
+ * Returns 0 if the memory for the initial empty snapshot could not be allocated */
+int bip32_template_registry_init(bip32_template_registry_type* registry_p,
+                                 bip32_template_registry_reader_type* readers, unsigned int max_readers,
+                                 const bip32_template_allocator_type* allocator_p)
+{
+    bip32_template_registry_snapshot_type* snapshot_p;
+    unsigned int i;
+
+    registry_p->allocator = *allocator_p;
+    registry_p->readers = readers;
+    registry_p->max_readers = max_readers;
+    registry_p->retired = 0;
+    atomic_init(&registry_p->epoch, 0);
+
+    for( i = 0; i < max_readers; i++ ) {
+        atomic_init(&readers[i].epoch, READER_OFFLINE);
+    }
+
+    snapshot_p = alloc_snapshot(registry_p, 0);
+    if( !snapshot_p ) {
+        return 0;
+    }
+    snapshot_p->version = 0;
+    atomic_init(&registry_p->current, snapshot_p);
+
+    return 1;
+}
+
+/* Frees all the snapshots. No reader can be online at this point */
+void bip32_template_registry_destroy(bip32_template_registry_type* registry_p)
+{
+    bip32_template_registry_snapshot_type* snapshot_p;
+
+    while( registry_p->retired ) {
+        snapshot_p = registry_p->retired;
+        registry_p->retired = snapshot_p->next_retired;
+        registry_p->allocator.free(snapshot_p, registry_p->allocator.arg);
+    }
+
+    registry_p->allocator.free(atomic_load_explicit(&registry_p->current, memory_order_relaxed),
+                               registry_p->allocator.arg);
+    atomic_store_explicit(&registry_p->current, 0, memory_order_relaxed);
+}
+
+/* Add the template with the id, or replace the template that has this id.
+ * Returns 0 if the memory for the new snapshot could not be allocated */
+int bip32_template_registry_add(bip32_template_registry_type* registry_p,
+                                uint32_t id, const bip32_template_type* template_p)
+{
+    const bip32_template_registry_snapshot_type* old_p =
+        atomic_load_explicit(&registry_p->current, memory_order_relaxed);
+    bip32_template_registry_snapshot_type* snapshot_p;
+    unsigned int pos = find_entry(old_p, id);
+    int is_replaced = pos < old_p->num_entries && old_p->entries[pos].id == id;
+
+    snapshot_p = alloc_snapshot(registry_p, old_p->num_entries + !is_replaced);
+    if( !snapshot_p ) {
+        return 0;
+    }
+
+    memcpy(snapshot_p->entries, old_p->entries, pos * sizeof(old_p->entries[0]));
+    snapshot_p->entries[pos].id = id;
+    snapshot_p->entries[pos].tmpl = *template_p;
+    memcpy(&snapshot_p->entries[pos + 1], &old_p->entries[pos + is_replaced],
+           (old_p->num_entries - pos - is_replaced) * sizeof(old_p->entries[0]));
+
+    publish(registry_p, snapshot_p);
+
+    return 1;
+}
+
+/* Returns 0 if there is no template with the id, or if the memory
+ * for the new snapshot could not be allocated */
+int bip32_template_registry_remove(bip32_template_registry_type* registry_p, uint32_t id)
+{
+    const bip32_template_registry_snapshot_type* old_p =
+        atomic_load_explicit(&registry_p->current, memory_order_relaxed);
+    bip32_template_registry_snapshot_type* snapshot_p;
+    unsigned int pos = find_entry(old_p, id);
+
+    if( pos == old_p->num_entries || old_p->entries[pos].id != id ) {
+        return 0;
+    }
+
+    snapshot_p = alloc_snapshot(registry_p, old_p->num_entries - 1);
+    if( !snapshot_p ) {
+        return 0;
+    }
+
+    memcpy(snapshot_p->entries, old_p->entries, pos * sizeof(old_p->entries[0]));
+    memcpy(&snapshot_p->entries[pos], &old_p->entries[pos + 1],
+           (old_p->num_entries - pos - 1) * sizeof(old_p->entries[0]));
+
+    publish(registry_p, snapshot_p);
+
+    return 1;
+}
+
+/* Free the replaced snapshots that no reader can hold anymore.
+ * This is done on each change, but the writer can call it again later
+ * to free the snapshots that were held by the readers at that time.
+ * Returns the number of snapshots freed */
+unsigned int bip32_template_registry_reclaim(bip32_template_registry_type* registry_p)
+{
+    bip32_template_registry_snapshot_type** link_p = &registry_p->retired;
+    bip32_template_registry_snapshot_type* snapshot_p;
+    uint64_t min_epoch = READER_OFFLINE;
+    uint64_t epoch;
+    unsigned int num_freed = 0;
+    unsigned int i;
+
+    for( i = 0; i < registry_p->max_readers; i++ ) {
+        epoch = atomic_load(&registry_p->readers[i].epoch);
+        if( epoch < min_epoch ) {
+            min_epoch = epoch;
+        }
+    }
+
+    while( *link_p ) {
+        snapshot_p = *link_p;
+        if( snapshot_p->retire_epoch <= min_epoch ) {
+            *link_p = snapshot_p->next_retired;
+            registry_p->allocator.free(snapshot_p, registry_p->allocator.arg);
+            num_freed++;
+        }
+        else {
+            link_p = &snapshot_p->next_retired;
+        }
+    }
+
+    return num_freed;
+}
+
+/* Must be called by the reader thread before it acquires any snapshot */
+void bip32_template_registry_reader_online(bip32_template_registry_type* registry_p, unsigned int reader_num)
+{
+    atomic_store(&registry_p->readers[reader_num].epoch, atomic_load(&registry_p->epoch));
+    /* The announcement must be visible to the writer before the snapshot is loaded,
+     * otherwise the writer could free the snapshot the reader is about to load */
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+/* The reader must not use any snapshot it has acquired after this call */
+void bip32_template_registry_reader_offline(bip32_template_registry_type* registry_p, unsigned int reader_num)
+{
+    atomic_store(&registry_p->readers[reader_num].epoch, READER_OFFLINE);
+}
+
+/* The reader must not use any snapshot it has acquired before this call */
+void bip32_template_registry_quiescent(bip32_template_registry_type* registry_p, unsigned int reader_num)
+{
+    atomic_store(&registry_p->readers[reader_num].epoch, atomic_load(&registry_p->epoch));
+}
+
+/* Put the ids of up to max_ids templates in the snapshot that match the path into ids.
+ * Returns the number of all matching templates */
+unsigned int bip32_template_registry_snapshot_match(const bip32_template_registry_snapshot_type* snapshot_p,
+                                                    const uint32_t* path_p, unsigned int path_len,
+                                                    uint32_t* ids, unsigned int max_ids)
+{
+    unsigned int num_matched = 0;
+    unsigned int i;
+
+    for( i = 0; i < snapshot_p->num_entries; i++ ) {
+        if( bip32_template_match(&snapshot_p->entries[i].tmpl, path_p, path_len) ) {
+            if( num_matched < max_ids ) {
+                ids[num_matched] = snapshot_p->entries[i].id;
+            }
+            num_matched++;
+        }
+    }
+
+    return num_matched;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_REGISTRY_H_
+#define _BIP32_TEMPLATE_REGISTRY_H_
+
+#include <stdatomic.h>
+
+#include "bip32template.h"
+
+typedef struct {
+    void* (*alloc)(size_t size, void* arg);
+    void (*free)(void* p, void* arg);
+    void* arg;
+} bip32_template_allocator_type;
+
+typedef struct {
+    uint32_t id;
+    bip32_template_type tmpl;
+} bip32_template_registry_entry_type;
+
+/* The immutable set of templates. Entries are sorted by id */
+typedef struct bip32_template_registry_snapshot {
+    uint64_t version;
+    /* The value of the registry epoch when the snapshot was replaced */
+    uint64_t retire_epoch;
+    struct bip32_template_registry_snapshot* next_retired;
+    unsigned int num_entries;
+    bip32_template_registry_entry_type entries[];
+} bip32_template_registry_snapshot_type;
+
+/* The epoch the reader has last seen at a quiescent point. Each reader has its own slot,
+ * aligned so that the slots of different readers do not share a cache line */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t epoch;
+} bip32_template_registry_reader_type;
+
+typedef struct {
+    _Atomic(bip32_template_registry_snapshot_type*) current;
+    _Atomic uint64_t epoch;
+    bip32_template_registry_reader_type* readers;
+    unsigned int max_readers;
+    /* Only used by the writer */
+    bip32_template_registry_snapshot_type* retired;
+    bip32_template_allocator_type allocator;
+} bip32_template_registry_type;
+
+int bip32_template_registry_init(bip32_template_registry_type* registry_p,
+                                 bip32_template_registry_reader_type* readers, unsigned int max_readers,
+                                 const bip32_template_allocator_type* allocator_p);
+void bip32_template_registry_destroy(bip32_template_registry_type* registry_p);
+
+int bip32_template_registry_add(bip32_template_registry_type* registry_p,
+                                uint32_t id, const bip32_template_type* template_p);
+int bip32_template_registry_remove(bip32_template_registry_type* registry_p, uint32_t id);
+unsigned int bip32_template_registry_reclaim(bip32_template_registry_type* registry_p);
+
+void bip32_template_registry_reader_online(bip32_template_registry_type* registry_p, unsigned int reader_num);
+void bip32_template_registry_reader_offline(bip32_template_registry_type* registry_p, unsigned int reader_num);
+void bip32_template_registry_quiescent(bip32_template_registry_type* registry_p, unsigned int reader_num);
+
+/* Returns the current snapshot. It stays valid until the reader passes
+ * a quiescent point or goes offline */
+static inline const bip32_template_registry_snapshot_type*
+bip32_template_registry_acquire(bip32_template_registry_type* registry_p)
+{
+    return atomic_load_explicit(&registry_p->current, memory_order_acquire);
+}
+
+unsigned int bip32_template_registry_snapshot_match(const bip32_template_registry_snapshot_type* snapshot_p,
+                                                    const uint32_t* path_p, unsigned int path_len,
+                                                    uint32_t* ids, unsigned int max_ids);
+
+#endif /* _BIP32_TEMPLATE_REGISTRY_H_ */
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Random sampling of the paths that match a template.
+ *
+ * The sections of a template are independent, so a uniformly random matching path
+ * is a uniformly random index drawn from each section. The index is drawn as its
+ * position within the section, and the range that has this position is found
+ * with binary search over the cumulative widths of the ranges, so drawing a path
+ * takes O(sections * log(ranges)) and does not depend on the number of paths,
+ * which for the templates with wildcard sections is too large to enumerate.
+ *
+ * A position below the width of the section is drawn from 32 random bits by
+ * multiplying them by the width and taking the upper half of the product. The few
+ * draws that would make some positions more likely than others are rejected, as
+ * described by D. Lemire in "Fast Random Integer Generation in an Interval".
+ * Each call of the caller's random function gives the bits for two draws.
+ *
+ * To sample from several templates, the template is first chosen with probability
+ * proportional to the number of its paths, with Walker's alias method: a random entry
+ * of the table is taken, and then either the entry or its alias, with the probability
+ * stored in the entry. The table is built in O(templates) with Vose's algorithm,
+ * and the work lists of the algorithm are kept in the alias fields of the table.
+ * The paths that match several of the templates are drawn more often. */
+
+#include "bip32template_sample.h"
+
+/* The alias of the entry that is not yet in a work list */
+#define NO_ALIAS ((unsigned int)-1)
+
+typedef struct {
+    bip32_template_random_func_type func;
+    void* arg;
+    uint64_t bits;
+    int has_bits;
+} random_source_type;
+
+static void random_source_init(random_source_type* source_p,
+                               bip32_template_random_func_type random_func, void* random_arg)
+{
+    source_p->func = random_func;
+    source_p->arg = random_arg;
+    source_p->has_bits = 0;
+}
+
+static uint32_t random_u32(random_source_type* source_p)
+{
+    if( source_p->has_bits ) {
+        source_p->has_bits = 0;
+        return (uint32_t)(source_p->bits >> 32);
+    }
+    source_p->bits = source_p->func(source_p->arg);
+    source_p->has_bits = 1;
+    return (uint32_t)source_p->bits;
+}
+
+/* Uniformly random number below width, threshold must be 2^32 mod width */
+static uint32_t random_below(random_source_type* source_p, uint32_t width, uint32_t threshold)
+{
+    uint64_t m = (uint64_t)random_u32(source_p) * width;
+
+    while( (uint32_t)m < threshold ) {
+        m = (uint64_t)random_u32(source_p) * width;
+    }
+
+    return (uint32_t)(m >> 32);
+}
+
+static void sample_path(const bip32_template_sampler_type* sampler_p, random_source_type* source_p,
+                        uint32_t* path_p)
+{
+    const bip32_template_section_type* section_p;
+    const uint32_t* cumulative_p;
+    uint32_t pos;
+    int lo, hi, mid;
+    int i;
+
+    for( i = 0; i < sampler_p->tmpl.num_sections; i++ ) {
+        section_p = &sampler_p->tmpl.sections[i];
+        cumulative_p = sampler_p->cumulative_widths[i];
+        pos = random_below(source_p, cumulative_p[section_p->num_ranges-1], sampler_p->rejection_thresholds[i]);
+
+        /* The first range with the cumulative width above the position */
+        lo = 0;
+        hi = section_p->num_ranges - 1;
+        while( lo < hi ) {
+            mid = (lo + hi) / 2;
+            if( cumulative_p[mid] <= pos ) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+
+        path_p[i] = section_p->ranges[lo].range_start + pos - (lo > 0 ? cumulative_p[lo-1] : 0);
+    }
+}
+
+/* Returns 0 if the template has no sections, or has a section that is empty or wider
+ * than 2^31 indexes, which can only happen when the template was not made by the parser */
+int bip32_template_sampler_init(bip32_template_sampler_type* sampler_p, const bip32_template_type* template_p)
+{
+    const bip32_template_section_type* section_p;
+    uint64_t width;
+    int i, r;
+
+    if( template_p->num_sections == 0 ) {
+        return 0;
+    }
+
+    sampler_p->tmpl = *template_p;
+
+    for( i = 0; i < template_p->num_sections; i++ ) {
+        section_p = &template_p->sections[i];
+        width = 0;
+        for( r = 0; r < section_p->num_ranges; r++ ) {
+            width += (uint64_t)section_p->ranges[r].range_end - section_p->ranges[r].range_start + 1;
+            sampler_p->cumulative_widths[i][r] = (uint32_t)width;
+        }
+        /* The indexes of a parsed section are all hardened or all unhardened, so its width fits */
+        if( width == 0 || width > 0x80000000 ) {
+            return 0;
+        }
+        sampler_p->rejection_thresholds[i] = (uint32_t)(((uint64_t)1 << 32) % width);
+    }
+
+    return 1;
+}
+
+/* The number of the paths of the template, as a floating point number,
+ * because it does not fit into 64 bits for templates with several wildcard sections */
+double bip32_template_sampler_num_paths(const bip32_template_sampler_type* sampler_p)
+{
+    double num_paths = 1;
+    int i;
+
+    for( i = 0; i < sampler_p->tmpl.num_sections; i++ ) {
+        num_paths *= sampler_p->cumulative_widths[i][sampler_p->tmpl.sections[i].num_ranges-1];
+    }
+
+    return num_paths;
+}
+
+/* Put a uniformly random path that matches the template into path_p,
+ * which must have room for the number of sections of the template */
+void bip32_template_sample(const bip32_template_sampler_type* sampler_p,
+                           bip32_template_random_func_type random_func, void* random_arg,
+                           uint32_t* path_p)
+{
+    random_source_type source;
+
+    random_source_init(&source, random_func, random_arg);
+    sample_path(sampler_p, &source, path_p);
+}
+
+/* Put num_paths uniformly random paths into paths, one after another,
+ * each taking the number of sections of the template */
+void bip32_template_sample_batch(const bip32_template_sampler_type* sampler_p,
+                                 bip32_template_random_func_type random_func, void* random_arg,
+                                 uint32_t* paths, size_t num_paths)
+{
+    random_source_type source;
+    size_t i;
+
+    random_source_init(&source, random_func, random_arg);
+    for( i = 0; i < num_paths; i++ ) {
+        sample_path(sampler_p, &source, paths + i * sampler_p->tmpl.num_sections);
+    }
+}
+
+/* Build the alias table over the samplers, with the probability of each
+ * proportional to the number of its paths. entries must have num_samplers elements.
+ * The samplers and the entries must stay in place while the multi-sampler is used.
+ * Returns 0 if there are no samplers */
+int bip32_template_multi_sampler_init(bip32_template_multi_sampler_type* multi_p,
+                                      const bip32_template_sampler_type* samplers, unsigned int num_samplers,
+                                      bip32_template_alias_entry_type* entries)
+{
+    unsigned int small_head = NO_ALIAS;
+    unsigned int large_head = NO_ALIAS;
+    unsigned int i, s, l;
+    double total = 0;
+
+    if( num_samplers == 0 ) {
+        return 0;
+    }
+
+    multi_p->samplers = samplers;
+    multi_p->num_samplers = num_samplers;
+    multi_p->entries = entries;
+    multi_p->rejection_threshold = (uint32_t)(((uint64_t)1 << 32) % num_samplers);
+
+    for( i = 0; i < num_samplers; i++ ) {
+        entries[i].probability = bip32_template_sampler_num_paths(&samplers[i]);
+        total += entries[i].probability;
+    }
+
+    /* Scale the probabilities so that they average to 1, and put each entry
+     * into the list of the small (below 1) or the large ones, linked through the alias */
+    for( i = 0; i < num_samplers; i++ ) {
+        entries[i].probability = entries[i].probability / total * num_samplers;
+        if( entries[i].probability < 1 ) {
+            entries[i].alias = small_head;
+            small_head = i;
+        }
+        else {
+            entries[i].alias = large_head;
+            large_head = i;
+        }
+    }
+
+    /* Fill the rest of each small entry with a large one */
+    while( small_head != NO_ALIAS && large_head != NO_ALIAS ) {
+        s = small_head;
+        small_head = entries[s].alias;
+        l = large_head;
+        entries[s].alias = l;
+        entries[l].probability -= 1 - entries[s].probability;
+        if( entries[l].probability < 1 ) {
+            large_head = entries[l].alias;
+            entries[l].alias = small_head;
+            small_head = l;
+        }
+    }
+
+    /* What is left differs from 1 only by rounding errors */
+    while( small_head != NO_ALIAS ) {
+        s = small_head;
+        small_head = entries[s].alias;
+        entries[s].probability = 1;
+        entries[s].alias = s;
+    }
+    while( large_head != NO_ALIAS ) {
+        l = large_head;
+        large_head = entries[l].alias;
+        entries[l].probability = 1;
+        entries[l].alias = l;
+    }
+
+    return 1;
+}
+
+/* Choose the template with the probability proportional to the number of its paths,
+ * and put a uniformly random path of it into path_p, and its length into path_len_p.
+ * path_p must have room for BIP32_TEMPLATE_MAX_SECTIONS indexes.
+ * Returns the number of the chosen template */
+unsigned int bip32_template_multi_sample(const bip32_template_multi_sampler_type* multi_p,
+                                         bip32_template_random_func_type random_func, void* random_arg,
+                                         uint32_t* path_p, unsigned int* path_len_p)
+{
+    const bip32_template_alias_entry_type* entry_p;
+    random_source_type source;
+    unsigned int chosen;
+    double u;
+
+    random_source_init(&source, random_func, random_arg);
+
+    chosen = random_below(&source, multi_p->num_samplers, multi_p->rejection_threshold);
+    entry_p = &multi_p->entries[chosen];
+    /* 53 random bits, as many as the double has */
+    u = (double)(random_func(random_arg) >> 11) / (double)((uint64_t)1 << 53);
+    if( u >= entry_p->probability ) {
+        chosen = entry_p->alias;
+    }
+
+    sample_path(&multi_p->samplers[chosen], &source, path_p);
+    *path_len_p = multi_p->samplers[chosen].tmpl.num_sections;
+
+    return chosen;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_SAMPLE_H_
+#define _BIP32_TEMPLATE_SAMPLE_H_
+
+#include "bip32template.h"
+
+/* Returns 64 uniformly distributed random bits */
+typedef uint64_t (*bip32_template_random_func_type)(void* arg);
+
+typedef struct {
+    bip32_template_type tmpl;
+    /* cumulative_widths[i][r] is the number of indexes in the ranges up to and including r of section i */
+    uint32_t cumulative_widths[BIP32_TEMPLATE_MAX_SECTIONS][BIP32_TEMPLATE_MAX_RANGES_PER_SECTION];
+    /* 2^32 mod width of each section, the draws below it are rejected to keep the result uniform */
+    uint32_t rejection_thresholds[BIP32_TEMPLATE_MAX_SECTIONS];
+} bip32_template_sampler_type;
+
+typedef struct {
+    /* The entry is taken with this probability, and the alias otherwise */
+    double probability;
+    unsigned int alias;
+} bip32_template_alias_entry_type;
+
+typedef struct {
+    const bip32_template_sampler_type* samplers;
+    unsigned int num_samplers;
+    uint32_t rejection_threshold;
+    bip32_template_alias_entry_type* entries;
+} bip32_template_multi_sampler_type;
+
+int bip32_template_sampler_init(bip32_template_sampler_type* sampler_p, const bip32_template_type* template_p);
+double bip32_template_sampler_num_paths(const bip32_template_sampler_type* sampler_p);
+void bip32_template_sample(const bip32_template_sampler_type* sampler_p,
+                           bip32_template_random_func_type random_func, void* random_arg,
+                           uint32_t* path_p);
+void bip32_template_sample_batch(const bip32_template_sampler_type* sampler_p,
+                                 bip32_template_random_func_type random_func, void* random_arg,
+                                 uint32_t* paths, size_t num_paths);
+int bip32_template_multi_sampler_init(bip32_template_multi_sampler_type* multi_p,
+                                      const bip32_template_sampler_type* samplers, unsigned int num_samplers,
+                                      bip32_template_alias_entry_type* entries);
+unsigned int bip32_template_multi_sample(const bip32_template_multi_sampler_type* multi_p,
+                                         bip32_template_random_func_type random_func, void* random_arg,
+                                         uint32_t* path_p, unsigned int* path_len_p);
+
+#endif /* _BIP32_TEMPLATE_SAMPLE_H_ */
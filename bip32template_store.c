@@ -0,0 +1,448 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Compressed store of paths, kept column by column.
+ *
+ * The paths are grouped into blocks of up to BIP32_TEMPLATE_STORE_BLOCK_SIZE paths.
+ * All paths in the block have the same prefix (all sections except the last one),
+ * which is stored once in the prefix dictionary, and the block keeps only its id.
+ * The last indexes within the block do not decrease, the first of them is kept
+ * in the block as is, and the others as the differences to the previous one,
+ * packed with the number of bits needed for the largest difference in the block.
+ * A new block is started when the prefix changes, when the last index is less
+ * than the previous one, or when the block is full. The paths are best added
+ * in sorted order, then each prefix is stored only once, but any order is accepted.
+ *
+ * The block keeps the minimum and the maximum of its last indexes. When the template
+ * is matched, the blocks which prefix does not match are skipped, as well as the blocks
+ * which last index range does not intersect the last section of the template.
+ * If the range is within one range of the last section, all the paths of the block
+ * match, and the block is not unpacked.
+ *
+ * All memory is provided by the caller. The block that is being filled is kept
+ * unpacked within the store until the next block is started. */
+
+#include <assert.h>
+
+#include "bip32template_store.h"
+#include "bip32template_internal.h"
+
+typedef enum {
+    BLOCK_MATCHES_NONE,
+    BLOCK_MATCHES_ALL,
+    BLOCK_MATCHES_SOME
+} block_match_type;
+
+static void put_bits(uint32_t* words, uint64_t bit_pos, uint32_t value, unsigned int bit_width)
+{
+    uint64_t shifted = (uint64_t)value << (bit_pos % 32);
+    uint64_t word = bit_pos / 32;
+
+    if( bit_width == 0 ) {
+        return;
+    }
+    words[word] |= (uint32_t)shifted;
+    if( bit_pos % 32 + bit_width > 32 ) {
+        words[word + 1] |= (uint32_t)(shifted >> 32);
+    }
+}
+
+static uint32_t get_bits(const uint32_t* words, uint64_t bit_pos, unsigned int bit_width)
+{
+    uint64_t word = bit_pos / 32;
+    uint64_t value;
+
+    if( bit_width == 0 ) {
+        return 0;
+    }
+    value = words[word] >> (bit_pos % 32);
+
+    if( bit_pos % 32 + bit_width > 32 ) {
+        value |= (uint64_t)words[word + 1] << (32 - bit_pos % 32);
+    }
+
+    return (uint32_t)(value & (((uint64_t)1 << bit_width) - 1));
+}
+
+static unsigned int bits_needed(uint32_t value)
+{
+    unsigned int bits = 0;
+
+    while( value ) {
+        bits++;
+        value >>= 1;
+    }
+
+    return bits;
+}
+
+static uint32_t num_block_words(unsigned int num_paths, unsigned int bit_width)
+{
+    return (uint32_t)(((uint64_t)(num_paths - 1) * bit_width + 31) / 32);
+}
+
+static unsigned int pending_bit_width(const bip32_template_store_type* store_p)
+{
+    uint32_t max_delta = 0;
+    unsigned int i;
+
+    for( i = 1; i < store_p->num_pending; i++ ) {
+        if( store_p->pending_last[i] - store_p->pending_last[i-1] > max_delta ) {
+            max_delta = store_p->pending_last[i] - store_p->pending_last[i-1];
+        }
+    }
+
+    return bits_needed(max_delta);
+}
+
+/* Pack the pending block. Returns 0 if there is no space for it */
+static int seal_pending_block(bip32_template_store_type* store_p)
+{
+    bip32_template_store_block_type* block_p;
+    unsigned int bit_width = pending_bit_width(store_p);
+    uint32_t num_words = num_block_words(store_p->num_pending, bit_width);
+    uint32_t i;
+
+    assert( store_p->num_pending > 0 );
+
+    if( store_p->num_blocks == store_p->max_blocks
+        || store_p->max_words - store_p->num_words < num_words )
+    {
+        return 0;
+    }
+
+    block_p = &store_p->blocks[store_p->num_blocks++];
+    block_p->first_path_num = store_p->num_paths - store_p->num_pending;
+    block_p->prefix_id = store_p->pending_prefix_id;
+    block_p->word_offset = store_p->num_words;
+    block_p->min_last = store_p->pending_last[0];
+    block_p->max_last = store_p->pending_last[store_p->num_pending - 1];
+    block_p->num_paths = store_p->num_pending;
+    block_p->bit_width = (uint8_t)bit_width;
+
+    for( i = 0; i < num_words; i++ ) {
+        store_p->words[store_p->num_words + i] = 0;
+    }
+    for( i = 1; i < store_p->num_pending; i++ ) {
+        put_bits(&store_p->words[block_p->word_offset], (uint64_t)(i - 1) * bit_width,
+                 store_p->pending_last[i] - store_p->pending_last[i-1], bit_width);
+    }
+    store_p->num_words += num_words;
+    store_p->num_pending = 0;
+
+    return 1;
+}
+
+static void unpack_block(const bip32_template_store_type* store_p, const bip32_template_store_block_type* block_p,
+                         uint32_t* last_p)
+{
+    const uint32_t* words = &store_p->words[block_p->word_offset];
+    unsigned int i;
+
+    last_p[0] = block_p->min_last;
+    for( i = 1; i < block_p->num_paths; i++ ) {
+        last_p[i] = last_p[i-1] + get_bits(words, (uint64_t)(i - 1) * block_p->bit_width, block_p->bit_width);
+    }
+}
+
+static int is_same_prefix(const bip32_template_store_prefix_type* prefix_p,
+                          const uint32_t* path_p, unsigned int prefix_len)
+{
+    unsigned int i;
+
+    if( prefix_p->len != prefix_len ) {
+        return 0;
+    }
+    for( i = 0; i < prefix_len; i++ ) {
+        if( prefix_p->indexes[i] != path_p[i] ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void bip32_template_store_init(bip32_template_store_type* store_p,
+                               bip32_template_store_prefix_type* prefixes, uint32_t max_prefixes,
+                               bip32_template_store_block_type* blocks, uint32_t max_blocks,
+                               uint32_t* words, uint32_t max_words)
+{
+    store_p->prefixes = prefixes;
+    store_p->max_prefixes = max_prefixes;
+    store_p->num_prefixes = 0;
+    store_p->blocks = blocks;
+    store_p->max_blocks = max_blocks;
+    store_p->num_blocks = 0;
+    store_p->words = words;
+    store_p->max_words = max_words;
+    store_p->num_words = 0;
+    store_p->num_paths = 0;
+    store_p->pending_prefix_id = 0;
+    store_p->num_pending = 0;
+}
+
+/* Returns 0 if the path is empty or too long, or if there is no space left in the store.
+ * In the last case error_p (if not 0) is set to BIP32_TEMPLATE_ERROR_UNDEFINED, and the path
+ * is not added */
+int bip32_template_store_add_path(bip32_template_store_type* store_p, const uint32_t* path_p, unsigned int path_len,
+                                  bip32_template_error_type* error_p)
+{
+    bip32_template_store_prefix_type* prefix_p;
+    unsigned int prefix_len = path_len - 1;
+    uint32_t last;
+    int is_new_prefix;
+    unsigned int i;
+
+    if( path_len == 0 ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_EMPTY;
+        }
+        return 0;
+    }
+    if( path_len > BIP32_TEMPLATE_MAX_SECTIONS ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_PATH_TOO_LONG;
+        }
+        return 0;
+    }
+
+    last = path_p[prefix_len];
+    is_new_prefix = store_p->num_prefixes == 0
+        || !is_same_prefix(&store_p->prefixes[store_p->num_prefixes - 1], path_p, prefix_len);
+
+    if( is_new_prefix && store_p->num_prefixes == store_p->max_prefixes ) {
+        if( error_p ) {
+            *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+        }
+        return 0;
+    }
+
+    if( store_p->num_pending > 0
+        && ( is_new_prefix || store_p->num_pending == BIP32_TEMPLATE_STORE_BLOCK_SIZE
+             || last < store_p->pending_last[store_p->num_pending - 1] ) )
+    {
+        if( !seal_pending_block(store_p) ) {
+            if( error_p ) {
+                *error_p = BIP32_TEMPLATE_ERROR_UNDEFINED;
+            }
+            return 0;
+        }
+    }
+
+    if( is_new_prefix ) {
+        prefix_p = &store_p->prefixes[store_p->num_prefixes];
+        prefix_p->len = (uint8_t)prefix_len;
+        for( i = 0; i < prefix_len; i++ ) {
+            prefix_p->indexes[i] = path_p[i];
+        }
+        store_p->pending_prefix_id = store_p->num_prefixes++;
+    }
+
+    store_p->pending_last[store_p->num_pending++] = last;
+    store_p->num_paths++;
+
+    return 1;
+}
+
+/* Get the path by its number, in the order the paths were added.
+ * Returns 0 if there is no such path */
+int bip32_template_store_get_path(const bip32_template_store_type* store_p, uint64_t path_num,
+                                  uint32_t* path_p, unsigned int* path_len_p)
+{
+    uint32_t last[BIP32_TEMPLATE_STORE_BLOCK_SIZE];
+    const bip32_template_store_prefix_type* prefix_p;
+    uint64_t pending_start = store_p->num_paths - store_p->num_pending;
+    uint32_t lo = 0;
+    uint32_t hi = store_p->num_blocks;
+    uint32_t mid;
+    unsigned int i;
+
+    if( path_num >= store_p->num_paths ) {
+        return 0;
+    }
+
+    if( path_num >= pending_start ) {
+        prefix_p = &store_p->prefixes[store_p->pending_prefix_id];
+        last[0] = store_p->pending_last[path_num - pending_start];
+    }
+    else {
+        /* The last block that starts at or before the path */
+        while( hi - lo > 1 ) {
+            mid = lo + (hi - lo) / 2;
+            if( store_p->blocks[mid].first_path_num <= path_num ) {
+                lo = mid;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        unpack_block(store_p, &store_p->blocks[lo], last);
+        prefix_p = &store_p->prefixes[store_p->blocks[lo].prefix_id];
+        last[0] = last[path_num - store_p->blocks[lo].first_path_num];
+    }
+
+    for( i = 0; i < prefix_p->len; i++ ) {
+        path_p[i] = prefix_p->indexes[i];
+    }
+    path_p[prefix_p->len] = last[0];
+    *path_len_p = prefix_p->len + 1;
+
+    return 1;
+}
+
+static int is_prefix_matched(const bip32_template_store_prefix_type* prefix_p,
+                             const bip32_template_type* template_p)
+{
+    unsigned int i;
+
+    if( template_p->num_sections != prefix_p->len + 1 ) {
+        return 0;
+    }
+    for( i = 0; i < prefix_p->len; i++ ) {
+        if( !bip32_template_is_index_in_section(&template_p->sections[i], prefix_p->indexes[i]) ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static block_match_type match_last_index_range(const bip32_template_section_type* section_p,
+                                               uint32_t min_last, uint32_t max_last)
+{
+    block_match_type result = BLOCK_MATCHES_NONE;
+    int i;
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        if( section_p->ranges[i].range_start <= min_last && max_last <= section_p->ranges[i].range_end ) {
+            return BLOCK_MATCHES_ALL;
+        }
+        if( section_p->ranges[i].range_start <= max_last && min_last <= section_p->ranges[i].range_end ) {
+            result = BLOCK_MATCHES_SOME;
+        }
+    }
+
+    return result;
+}
+
+static uint64_t match_block(const bip32_template_store_prefix_type* prefix_p,
+                            const bip32_template_section_type* last_section_p,
+                            uint64_t first_path_num, const uint32_t* last_p, unsigned int num_paths,
+                            int is_all_matched,
+                            bip32_template_store_match_func_type matched, void* arg)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint64_t num_matched = 0;
+    unsigned int i;
+
+    if( is_all_matched && !matched ) {
+        return num_paths;
+    }
+
+    for( i = 0; i < prefix_p->len; i++ ) {
+        path[i] = prefix_p->indexes[i];
+    }
+    for( i = 0; i < num_paths; i++ ) {
+        if( is_all_matched || bip32_template_is_index_in_section(last_section_p, last_p[i]) ) {
+            num_matched++;
+            if( matched ) {
+                path[prefix_p->len] = last_p[i];
+                matched(first_path_num + i, path, prefix_p->len + 1, arg);
+            }
+        }
+    }
+
+    return num_matched;
+}
+
+/* Call matched (if it is not NULL) for each path in the store that matches the template,
+ * in the order the paths were added. Returns the number of matching paths.
+ * If stats_p is not NULL, the numbers of the blocks that were skipped, matched entirely,
+ * and unpacked are added to it */
+uint64_t bip32_template_store_match(const bip32_template_store_type* store_p, const bip32_template_type* template_p,
+                                    bip32_template_store_match_func_type matched, void* arg,
+                                    bip32_template_store_match_stats_type* stats_p)
+{
+    uint32_t last[BIP32_TEMPLATE_STORE_BLOCK_SIZE];
+    const bip32_template_section_type* last_section_p;
+    const bip32_template_store_block_type* block_p;
+    bip32_template_store_match_stats_type stats = { 0, 0, 0 };
+    uint64_t num_matched = 0;
+    uint32_t cached_prefix_id = 0;
+    int is_cached_prefix_matched = -1;
+    block_match_type block_match;
+    uint32_t i;
+
+    if( template_p->num_sections == 0 ) {
+        return 0;
+    }
+    last_section_p = &template_p->sections[template_p->num_sections - 1];
+
+    for( i = 0; i < store_p->num_blocks; i++ ) {
+        block_p = &store_p->blocks[i];
+
+        /* Consecutive blocks usually have the same prefix */
+        if( is_cached_prefix_matched < 0 || block_p->prefix_id != cached_prefix_id ) {
+            cached_prefix_id = block_p->prefix_id;
+            is_cached_prefix_matched = is_prefix_matched(&store_p->prefixes[cached_prefix_id], template_p);
+        }
+        block_match = is_cached_prefix_matched
+            ? match_last_index_range(last_section_p, block_p->min_last, block_p->max_last)
+            : BLOCK_MATCHES_NONE;
+
+        if( block_match == BLOCK_MATCHES_NONE ) {
+            stats.num_blocks_skipped++;
+            continue;
+        }
+        if( block_match == BLOCK_MATCHES_ALL ) {
+            stats.num_blocks_matched++;
+            if( !matched ) {
+                num_matched += block_p->num_paths;
+                continue;
+            }
+        }
+        else {
+            stats.num_blocks_unpacked++;
+        }
+        unpack_block(store_p, block_p, last);
+        num_matched += match_block(&store_p->prefixes[block_p->prefix_id], last_section_p,
+                                   block_p->first_path_num, last, block_p->num_paths,
+                                   block_match == BLOCK_MATCHES_ALL, matched, arg);
+    }
+
+    if( store_p->num_pending > 0
+        && is_prefix_matched(&store_p->prefixes[store_p->pending_prefix_id], template_p) )
+    {
+        num_matched += match_block(&store_p->prefixes[store_p->pending_prefix_id], last_section_p,
+                                   store_p->num_paths - store_p->num_pending,
+                                   store_p->pending_last, store_p->num_pending, 0, matched, arg);
+    }
+
+    if( stats_p ) {
+        stats_p->num_blocks_skipped += stats.num_blocks_skipped;
+        stats_p->num_blocks_matched += stats.num_blocks_matched;
+        stats_p->num_blocks_unpacked += stats.num_blocks_unpacked;
+    }
+
+    return num_matched;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_STORE_H_
+#define _BIP32_TEMPLATE_STORE_H_
+
+#include "bip32template.h"
+
+#ifndef BIP32_TEMPLATE_STORE_BLOCK_SIZE
+#define BIP32_TEMPLATE_STORE_BLOCK_SIZE 128
+#endif
+
+_Static_assert(BIP32_TEMPLATE_STORE_BLOCK_SIZE > 0 && BIP32_TEMPLATE_STORE_BLOCK_SIZE <= 65535,
+               "should fit into uint16_t");
+
+/* All sections of the path except the last one */
+typedef struct {
+    uint8_t len;
+    uint32_t indexes[BIP32_TEMPLATE_MAX_SECTIONS];
+} bip32_template_store_prefix_type;
+
+/* The paths of the block share the prefix, and their last indexes do not decrease.
+ * The first last index is min_last, the differences between the consecutive
+ * last indexes are packed with bit_width bits each, starting at word_offset */
+typedef struct {
+    uint64_t first_path_num;
+    uint32_t prefix_id;
+    uint32_t word_offset;
+    uint32_t min_last;
+    uint32_t max_last;
+    uint16_t num_paths;
+    uint8_t bit_width;
+} bip32_template_store_block_type;
+
+typedef struct {
+    bip32_template_store_prefix_type* prefixes;
+    uint32_t max_prefixes;
+    uint32_t num_prefixes;
+    bip32_template_store_block_type* blocks;
+    uint32_t max_blocks;
+    uint32_t num_blocks;
+    uint32_t* words;
+    uint32_t max_words;
+    uint32_t num_words;
+    uint64_t num_paths;
+    /* The block that is being filled, kept unpacked */
+    uint32_t pending_prefix_id;
+    uint16_t num_pending;
+    uint32_t pending_last[BIP32_TEMPLATE_STORE_BLOCK_SIZE];
+} bip32_template_store_type;
+
+typedef struct {
+    uint64_t num_blocks_skipped;
+    /* The blocks where all paths match, without unpacking */
+    uint64_t num_blocks_matched;
+    uint64_t num_blocks_unpacked;
+} bip32_template_store_match_stats_type;
+
+typedef void (*bip32_template_store_match_func_type)(uint64_t path_num, const uint32_t* path_p,
+                                                     unsigned int path_len, void* arg);
+
+void bip32_template_store_init(bip32_template_store_type* store_p,
+                               bip32_template_store_prefix_type* prefixes, uint32_t max_prefixes,
+                               bip32_template_store_block_type* blocks, uint32_t max_blocks,
+                               uint32_t* words, uint32_t max_words);
+int bip32_template_store_add_path(bip32_template_store_type* store_p, const uint32_t* path_p, unsigned int path_len,
+                                  bip32_template_error_type* error_p);
+int bip32_template_store_get_path(const bip32_template_store_type* store_p, uint64_t path_num,
+                                  uint32_t* path_p, unsigned int* path_len_p);
+uint64_t bip32_template_store_match(const bip32_template_store_type* store_p, const bip32_template_type* template_p,
+                                    bip32_template_store_match_func_type matched, void* arg,
+                                    bip32_template_store_match_stats_type* stats_p);
+
+#endif /* _BIP32_TEMPLATE_STORE_H_ */
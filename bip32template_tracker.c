@@ -0,0 +1,724 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Tracking of the used paths of one template, by their ordinals.
+ *
+ * The paths that match the template are numbered in lexicographic order:
+ * the ordinal of a path is a number in the mixed radix where each digit
+ * is the position of the index within its section, and the base of the digit
+ * is the number of indexes in the section.
+ *
+ * The set of the ordinals is kept as a roaring bitmap: the ordinals are split
+ * by their high bits into chunks of 65536, and only the chunks with any ordinal
+ * set have a container. A container with few ordinals is a sorted array of their
+ * low 16 bits, and it is replaced with a bitmap of 8 KB when the array would take
+ * more than that. So the sparse used indexes take 2 bytes each, and the dense
+ * ones take one bit each, regardless of how many paths the template has.
+ *
+ * The containers are allocated with the caller-provided allocator. */
+
+#include <assert.h>
+#include <string.h>
+
+#include "bip32template_tracker.h"
+#include "bip32template_internal.h"
+
+#define CHUNK_BITS 16
+#define CHUNK_SIZE (1UL << CHUNK_BITS)
+#define MAX_KEY (UINT64_MAX >> CHUNK_BITS)
+
+static int section_position(const bip32_template_section_type* section_p, uint32_t index, uint64_t* pos_p)
+{
+    uint64_t pos = 0;
+    int i;
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        if( index < section_p->ranges[i].range_start ) {
+            return 0;
+        }
+        if( index <= section_p->ranges[i].range_end ) {
+            *pos_p = pos + (index - section_p->ranges[i].range_start);
+            return 1;
+        }
+        pos += (uint64_t)section_p->ranges[i].range_end - section_p->ranges[i].range_start + 1;
+    }
+
+    return 0;
+}
+
+static unsigned int popcount64(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (unsigned int)((v * 0x0101010101010101ULL) >> 56);
+}
+
+static unsigned int lowest_bit(uint64_t v)
+{
+    unsigned int bit = 0;
+
+    assert( v != 0 );
+    while( !(v & 1) ) {
+        v >>= 1;
+        bit++;
+    }
+    return bit;
+}
+
+static int is_bitmap(const bip32_template_tracker_container_type* container_p)
+{
+    return container_p->cardinality > BIP32_TEMPLATE_TRACKER_ARRAY_MAX;
+}
+
+/* The position of the first element of the array that is not less than value */
+static uint32_t array_lower_bound(const bip32_template_tracker_container_type* container_p, uint32_t value)
+{
+    uint32_t lo = 0;
+    uint32_t hi = container_p->cardinality;
+    uint32_t mid;
+
+    while( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if( container_p->data.array[mid] < value ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Returns 1 if the container for the key exists, its position or the position
+ * to insert it at is put into index_p */
+static int find_container(const bip32_template_tracker_type* tracker_p, uint64_t key, uint64_t* index_p)
+{
+    uint64_t lo = 0;
+    uint64_t hi = tracker_p->num_containers;
+    uint64_t mid;
+
+    while( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if( tracker_p->containers[mid].key < key ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    *index_p = lo;
+    return lo < tracker_p->num_containers && tracker_p->containers[lo].key == key;
+}
+
+static int reserve_containers(bip32_template_tracker_type* tracker_p, uint64_t num_containers)
+{
+    bip32_template_tracker_container_type* containers;
+    uint64_t max_containers = tracker_p->max_containers ? tracker_p->max_containers : 4;
+
+    if( num_containers <= tracker_p->max_containers ) {
+        return 1;
+    }
+    while( max_containers < num_containers ) {
+        max_containers *= 2;
+    }
+
+    containers = tracker_p->allocator.alloc(max_containers * sizeof(containers[0]), tracker_p->allocator.arg);
+    if( !containers ) {
+        return 0;
+    }
+    if( tracker_p->containers ) {
+        memcpy(containers, tracker_p->containers, tracker_p->num_containers * sizeof(containers[0]));
+        tracker_p->allocator.free(tracker_p->containers, tracker_p->allocator.arg);
+    }
+    tracker_p->containers = containers;
+    tracker_p->max_containers = max_containers;
+
+    return 1;
+}
+
+static void free_containers(bip32_template_tracker_type* tracker_p)
+{
+    uint64_t i;
+
+    for( i = 0; i < tracker_p->num_containers; i++ ) {
+        tracker_p->allocator.free(tracker_p->containers[i].data.array, tracker_p->allocator.arg);
+    }
+    if( tracker_p->containers ) {
+        tracker_p->allocator.free(tracker_p->containers, tracker_p->allocator.arg);
+    }
+    tracker_p->containers = 0;
+    tracker_p->num_containers = 0;
+    tracker_p->max_containers = 0;
+    tracker_p->num_set = 0;
+}
+
+/* Returns 0 if the template has no sections, or the number of its paths does not fit into uint64_t */
+int bip32_template_tracker_init(bip32_template_tracker_type* tracker_p, const bip32_template_type* template_p,
+                                const bip32_template_tracker_allocator_type* allocator_p)
+{
+    uint64_t width;
+    int i;
+
+    if( template_p->num_sections == 0 ) {
+        return 0;
+    }
+
+    tracker_p->tmpl = *template_p;
+    tracker_p->strides[template_p->num_sections-1] = 1;
+    for( i = template_p->num_sections - 1; i >= 0; i-- ) {
+        width = bip32_template_section_width(&template_p->sections[i]);
+        if( tracker_p->strides[i] > UINT64_MAX / width ) {
+            return 0;
+        }
+        if( i > 0 ) {
+            tracker_p->strides[i-1] = tracker_p->strides[i] * width;
+        }
+        else {
+            tracker_p->num_paths = tracker_p->strides[0] * width;
+        }
+    }
+
+    tracker_p->containers = 0;
+    tracker_p->num_containers = 0;
+    tracker_p->max_containers = 0;
+    tracker_p->num_set = 0;
+    tracker_p->allocator = *allocator_p;
+
+    return 1;
+}
+
+void bip32_template_tracker_destroy(bip32_template_tracker_type* tracker_p)
+{
+    free_containers(tracker_p);
+}
+
+/* Returns 0 if the path does not match the template */
+int bip32_template_tracker_path_ordinal(const bip32_template_tracker_type* tracker_p,
+                                        const uint32_t* path_p, unsigned int path_len, uint64_t* ordinal_p)
+{
+    uint64_t ordinal = 0;
+    uint64_t pos;
+    unsigned int i;
+
+    if( path_len != tracker_p->tmpl.num_sections ) {
+        return 0;
+    }
+
+    for( i = 0; i < path_len; i++ ) {
+        if( !section_position(&tracker_p->tmpl.sections[i], path_p[i], &pos) ) {
+            return 0;
+        }
+        ordinal += pos * tracker_p->strides[i];
+    }
+
+    *ordinal_p = ordinal;
+    return 1;
+}
+
+/* ordinal must be less than num_paths, path_p must have room for num_sections indexes */
+void bip32_template_tracker_path_at(const bip32_template_tracker_type* tracker_p, uint64_t ordinal,
+                                    uint32_t* path_p)
+{
+    int i;
+
+    assert( ordinal < tracker_p->num_paths );
+
+    for( i = 0; i < tracker_p->tmpl.num_sections; i++ ) {
+        path_p[i] = bip32_template_section_index_at(&tracker_p->tmpl.sections[i],
+                                                    ordinal / tracker_p->strides[i]);
+        ordinal %= tracker_p->strides[i];
+    }
+}
+
+static int array_to_bitmap(bip32_template_tracker_type* tracker_p,
+                           bip32_template_tracker_container_type* container_p)
+{
+    uint64_t* bitmap;
+    uint32_t i;
+
+    bitmap = tracker_p->allocator.alloc(BIP32_TEMPLATE_TRACKER_BITMAP_WORDS * sizeof(bitmap[0]),
+                                        tracker_p->allocator.arg);
+    if( !bitmap ) {
+        return 0;
+    }
+    memset(bitmap, 0, BIP32_TEMPLATE_TRACKER_BITMAP_WORDS * sizeof(bitmap[0]));
+    for( i = 0; i < container_p->cardinality; i++ ) {
+        bitmap[container_p->data.array[i] / 64] |= 1ULL << (container_p->data.array[i] % 64);
+    }
+    tracker_p->allocator.free(container_p->data.array, tracker_p->allocator.arg);
+    container_p->data.bitmap = bitmap;
+    container_p->capacity = 0;
+
+    return 1;
+}
+
+static int grow_array(bip32_template_tracker_type* tracker_p, bip32_template_tracker_container_type* container_p)
+{
+    uint32_t capacity = container_p->capacity ? container_p->capacity * 2 : 4;
+    uint16_t* array;
+
+    if( capacity > BIP32_TEMPLATE_TRACKER_ARRAY_MAX ) {
+        capacity = BIP32_TEMPLATE_TRACKER_ARRAY_MAX;
+    }
+    array = tracker_p->allocator.alloc(capacity * sizeof(array[0]), tracker_p->allocator.arg);
+    if( !array ) {
+        return 0;
+    }
+    if( container_p->data.array ) {
+        memcpy(array, container_p->data.array, container_p->cardinality * sizeof(array[0]));
+        tracker_p->allocator.free(container_p->data.array, tracker_p->allocator.arg);
+    }
+    container_p->data.array = array;
+    container_p->capacity = capacity;
+
+    return 1;
+}
+
+/* Mark the path with the ordinal as used.
+ * Returns 0 if the ordinal is not less than num_paths or the memory could not be allocated */
+int bip32_template_tracker_set(bip32_template_tracker_type* tracker_p, uint64_t ordinal)
+{
+    bip32_template_tracker_container_type* container_p;
+    uint64_t key = ordinal >> CHUNK_BITS;
+    uint32_t low = (uint32_t)(ordinal & (CHUNK_SIZE - 1));
+    uint64_t index, i;
+    uint32_t pos;
+
+    if( ordinal >= tracker_p->num_paths ) {
+        return 0;
+    }
+
+    if( !find_container(tracker_p, key, &index) ) {
+        if( !reserve_containers(tracker_p, tracker_p->num_containers + 1) ) {
+            return 0;
+        }
+        container_p = &tracker_p->containers[index];
+        for( i = tracker_p->num_containers; i > index; i-- ) {
+            tracker_p->containers[i] = tracker_p->containers[i-1];
+        }
+        container_p->key = key;
+        container_p->cardinality = 0;
+        container_p->capacity = 0;
+        container_p->data.array = 0;
+        if( !grow_array(tracker_p, container_p) ) {
+            for( i = index; i < tracker_p->num_containers; i++ ) {
+                tracker_p->containers[i] = tracker_p->containers[i+1];
+            }
+            return 0;
+        }
+        tracker_p->num_containers++;
+    }
+    container_p = &tracker_p->containers[index];
+
+    if( !is_bitmap(container_p) ) {
+        pos = array_lower_bound(container_p, low);
+        if( pos < container_p->cardinality && container_p->data.array[pos] == low ) {
+            return 1;
+        }
+        if( container_p->cardinality == BIP32_TEMPLATE_TRACKER_ARRAY_MAX ) {
+            if( !array_to_bitmap(tracker_p, container_p) ) {
+                return 0;
+            }
+        }
+        else {
+            if( container_p->cardinality == container_p->capacity && !grow_array(tracker_p, container_p) ) {
+                return 0;
+            }
+            memmove(&container_p->data.array[pos+1], &container_p->data.array[pos],
+                    (container_p->cardinality - pos) * sizeof(container_p->data.array[0]));
+            container_p->data.array[pos] = (uint16_t)low;
+            container_p->cardinality++;
+            tracker_p->num_set++;
+            return 1;
+        }
+    }
+
+    if( !(container_p->data.bitmap[low / 64] & (1ULL << (low % 64))) ) {
+        container_p->data.bitmap[low / 64] |= 1ULL << (low % 64);
+        container_p->cardinality++;
+        tracker_p->num_set++;
+    }
+
+    return 1;
+}
+
+int bip32_template_tracker_test(const bip32_template_tracker_type* tracker_p, uint64_t ordinal)
+{
+    const bip32_template_tracker_container_type* container_p;
+    uint32_t low = (uint32_t)(ordinal & (CHUNK_SIZE - 1));
+    uint64_t index;
+    uint32_t pos;
+
+    if( !find_container(tracker_p, ordinal >> CHUNK_BITS, &index) ) {
+        return 0;
+    }
+    container_p = &tracker_p->containers[index];
+
+    if( is_bitmap(container_p) ) {
+        return (container_p->data.bitmap[low / 64] >> (low % 64)) & 1;
+    }
+    pos = array_lower_bound(container_p, low);
+    return pos < container_p->cardinality && container_p->data.array[pos] == low;
+}
+
+/* Find the first ordinal not less than from that is not set.
+ * Returns 0 if all paths from that ordinal on are used */
+int bip32_template_tracker_next_unused(const bip32_template_tracker_type* tracker_p, uint64_t from,
+                                       uint64_t* ordinal_p)
+{
+    const bip32_template_tracker_container_type* container_p;
+    uint64_t key, index, word;
+    uint32_t low, pos, w;
+
+    while( from < tracker_p->num_paths ) {
+        key = from >> CHUNK_BITS;
+        low = (uint32_t)(from & (CHUNK_SIZE - 1));
+
+        if( !find_container(tracker_p, key, &index) ) {
+            *ordinal_p = from;
+            return 1;
+        }
+        container_p = &tracker_p->containers[index];
+
+        if( is_bitmap(container_p) ) {
+            for( w = low / 64; w < BIP32_TEMPLATE_TRACKER_BITMAP_WORDS; w++ ) {
+                word = container_p->data.bitmap[w];
+                if( w == low / 64 ) {
+                    word |= (1ULL << (low % 64)) - 1;
+                }
+                if( word != UINT64_MAX ) {
+                    low = w * 64 + lowest_bit(~word);
+                    break;
+                }
+            }
+            if( w == BIP32_TEMPLATE_TRACKER_BITMAP_WORDS ) {
+                low = CHUNK_SIZE;
+            }
+        }
+        else {
+            for( pos = array_lower_bound(container_p, low);
+                 pos < container_p->cardinality && container_p->data.array[pos] == low;
+                 pos++ )
+            {
+                low++;
+            }
+        }
+
+        if( low < CHUNK_SIZE ) {
+            from = (key << CHUNK_BITS) | low;
+            if( from >= tracker_p->num_paths ) {
+                return 0;
+            }
+            *ordinal_p = from;
+            return 1;
+        }
+        if( key == MAX_KEY ) {
+            return 0;
+        }
+        from = (key + 1) << CHUNK_BITS;
+    }
+
+    return 0;
+}
+
+static uint64_t count_in_container(const bip32_template_tracker_container_type* container_p,
+                                   uint32_t lo, uint32_t hi)
+{
+    uint64_t count = 0;
+    uint64_t word;
+    uint32_t w;
+
+    if( lo == 0 && hi == CHUNK_SIZE ) {
+        return container_p->cardinality;
+    }
+
+    if( !is_bitmap(container_p) ) {
+        return array_lower_bound(container_p, hi) - array_lower_bound(container_p, lo);
+    }
+
+    for( w = lo / 64; w <= (hi - 1) / 64; w++ ) {
+        word = container_p->data.bitmap[w];
+        if( w == lo / 64 ) {
+            word &= ~((1ULL << (lo % 64)) - 1);
+        }
+        if( w == (hi - 1) / 64 && hi % 64 != 0 ) {
+            word &= (1ULL << (hi % 64)) - 1;
+        }
+        count += popcount64(word);
+    }
+
+    return count;
+}
+
+/* The number of the ordinals from start (inclusive) to end (exclusive) that are set */
+uint64_t bip32_template_tracker_count(const bip32_template_tracker_type* tracker_p, uint64_t start, uint64_t end)
+{
+    const bip32_template_tracker_container_type* container_p;
+    uint64_t first_key, last_key, index;
+    uint64_t count = 0;
+
+    if( end > tracker_p->num_paths ) {
+        end = tracker_p->num_paths;
+    }
+    if( start >= end ) {
+        return 0;
+    }
+
+    first_key = start >> CHUNK_BITS;
+    last_key = (end - 1) >> CHUNK_BITS;
+    find_container(tracker_p, first_key, &index);
+
+    for( ; index < tracker_p->num_containers && tracker_p->containers[index].key <= last_key; index++ ) {
+        container_p = &tracker_p->containers[index];
+        count += count_in_container(container_p,
+                                    container_p->key == first_key ? (uint32_t)(start & (CHUNK_SIZE - 1)) : 0,
+                                    container_p->key == last_key
+                                        ? (uint32_t)((end - 1) & (CHUNK_SIZE - 1)) + 1
+                                        : CHUNK_SIZE);
+    }
+
+    return count;
+}
+
+/* The number of the used paths that start with the given indexes.
+ * Returns 0 if the prefix does not match the template */
+int bip32_template_tracker_branch_count(const bip32_template_tracker_type* tracker_p,
+                                        const uint32_t* prefix_p, unsigned int prefix_len, uint64_t* count_p)
+{
+    uint64_t start = 0;
+    uint64_t pos;
+    unsigned int i;
+
+    if( prefix_len > tracker_p->tmpl.num_sections ) {
+        return 0;
+    }
+
+    for( i = 0; i < prefix_len; i++ ) {
+        if( !section_position(&tracker_p->tmpl.sections[i], prefix_p[i], &pos) ) {
+            return 0;
+        }
+        start += pos * tracker_p->strides[i];
+    }
+
+    *count_p = bip32_template_tracker_count(tracker_p, start,
+                                            start + (prefix_len ? tracker_p->strides[prefix_len-1]
+                                                                : tracker_p->num_paths));
+    return 1;
+}
+
+/* The serialized form is little-endian: the number of paths of the template (8 bytes),
+ * the number of containers (8 bytes), and for each container its key (8 bytes),
+ * the number of ordinals set (4 bytes), and the array (2 bytes per element)
+ * or the bitmap (8192 bytes) */
+static void put_le(uint8_t* buf, uint64_t value, unsigned int size)
+{
+    unsigned int i;
+
+    for( i = 0; i < size; i++ ) {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const uint8_t* buf, unsigned int size)
+{
+    uint64_t value = 0;
+    unsigned int i;
+
+    for( i = 0; i < size; i++ ) {
+        value |= (uint64_t)buf[i] << (8 * i);
+    }
+    return value;
+}
+
+static size_t container_data_size(uint32_t cardinality)
+{
+    return cardinality > BIP32_TEMPLATE_TRACKER_ARRAY_MAX
+        ? BIP32_TEMPLATE_TRACKER_BITMAP_WORDS * 8 : (size_t)cardinality * 2;
+}
+
+size_t bip32_template_tracker_serialized_size(const bip32_template_tracker_type* tracker_p)
+{
+    size_t size = 16;
+    uint64_t i;
+
+    for( i = 0; i < tracker_p->num_containers; i++ ) {
+        size += 12 + container_data_size(tracker_p->containers[i].cardinality);
+    }
+    return size;
+}
+
+/* Returns the number of bytes written, or 0 if buf_size is too small */
+size_t bip32_template_tracker_serialize(const bip32_template_tracker_type* tracker_p,
+                                        uint8_t* buf, size_t buf_size)
+{
+    const bip32_template_tracker_container_type* container_p;
+    size_t size = bip32_template_tracker_serialized_size(tracker_p);
+    uint64_t i;
+    uint32_t ii;
+
+    if( buf_size < size ) {
+        return 0;
+    }
+
+    put_le(buf, tracker_p->num_paths, 8);
+    put_le(buf + 8, tracker_p->num_containers, 8);
+    buf += 16;
+
+    for( i = 0; i < tracker_p->num_containers; i++ ) {
+        container_p = &tracker_p->containers[i];
+        put_le(buf, container_p->key, 8);
+        put_le(buf + 8, container_p->cardinality, 4);
+        buf += 12;
+        if( is_bitmap(container_p) ) {
+            for( ii = 0; ii < BIP32_TEMPLATE_TRACKER_BITMAP_WORDS; ii++ ) {
+                put_le(buf, container_p->data.bitmap[ii], 8);
+                buf += 8;
+            }
+        }
+        else {
+            for( ii = 0; ii < container_p->cardinality; ii++ ) {
+                put_le(buf, container_p->data.array[ii], 2);
+                buf += 2;
+            }
+        }
+    }
+
+    return size;
+}
+
+static int read_container(bip32_template_tracker_type* tracker_p, const uint8_t* buf,
+                          bip32_template_tracker_container_type* container_p)
+{
+    uint64_t count = 0;
+    uint32_t i;
+
+    if( is_bitmap(container_p) ) {
+        container_p->data.bitmap = tracker_p->allocator.alloc(
+            BIP32_TEMPLATE_TRACKER_BITMAP_WORDS * sizeof(container_p->data.bitmap[0]), tracker_p->allocator.arg);
+        if( !container_p->data.bitmap ) {
+            return 0;
+        }
+        for( i = 0; i < BIP32_TEMPLATE_TRACKER_BITMAP_WORDS; i++ ) {
+            container_p->data.bitmap[i] = get_le(buf + 8 * i, 8);
+            count += popcount64(container_p->data.bitmap[i]);
+        }
+        return count == container_p->cardinality;
+    }
+
+    container_p->data.array = tracker_p->allocator.alloc(container_p->cardinality * sizeof(container_p->data.array[0]),
+                                                         tracker_p->allocator.arg);
+    if( !container_p->data.array ) {
+        return 0;
+    }
+    container_p->capacity = container_p->cardinality;
+    for( i = 0; i < container_p->cardinality; i++ ) {
+        container_p->data.array[i] = (uint16_t)get_le(buf + 2 * i, 2);
+        if( i > 0 && container_p->data.array[i] <= container_p->data.array[i-1] ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Replace the ordinals set in the tracker with the serialized ones. The tracker must be
+ * initialized with the same template as the serialized one.
+ * Returns 0 if the data is malformed, does not belong to a template with the same number
+ * of paths, or the memory could not be allocated. In that case the tracker is left empty */
+int bip32_template_tracker_deserialize(bip32_template_tracker_type* tracker_p, const uint8_t* buf, size_t buf_size)
+{
+    bip32_template_tracker_container_type* container_p;
+    uint64_t num_containers;
+    uint64_t last_ordinal, ordinal;
+    size_t data_size;
+
+    free_containers(tracker_p);
+
+    if( buf_size < 16 || get_le(buf, 8) != tracker_p->num_paths ) {
+        return 0;
+    }
+    num_containers = get_le(buf + 8, 8);
+    buf += 16;
+    buf_size -= 16;
+
+    if( num_containers > buf_size / 12 || !reserve_containers(tracker_p, num_containers) ) {
+        return 0;
+    }
+
+    while( tracker_p->num_containers < num_containers ) {
+        if( buf_size < 12 ) {
+            break;
+        }
+        container_p = &tracker_p->containers[tracker_p->num_containers];
+        container_p->key = get_le(buf, 8);
+        container_p->cardinality = (uint32_t)get_le(buf + 8, 4);
+        container_p->capacity = 0;
+        buf += 12;
+        buf_size -= 12;
+
+        data_size = container_data_size(container_p->cardinality);
+        if( container_p->cardinality == 0 || container_p->cardinality > CHUNK_SIZE || buf_size < data_size
+            || container_p->key > ((tracker_p->num_paths - 1) >> CHUNK_BITS)
+            || (tracker_p->num_containers > 0 && container_p->key <= container_p[-1].key) )
+        {
+            break;
+        }
+        if( !read_container(tracker_p, buf, container_p) ) {
+            /* Allocated but invalid data is freed with the rest */
+            if( container_p->data.array ) {
+                tracker_p->num_containers++;
+            }
+            break;
+        }
+        tracker_p->num_containers++;
+        tracker_p->num_set += container_p->cardinality;
+        buf += data_size;
+        buf_size -= data_size;
+    }
+
+    if( tracker_p->num_containers < num_containers || buf_size != 0 ) {
+        free_containers(tracker_p);
+        return 0;
+    }
+
+    /* The ordinals of the last container must be within the template */
+    if( num_containers > 0 ) {
+        container_p = &tracker_p->containers[num_containers-1];
+        last_ordinal = (container_p->key << CHUNK_BITS)
+            + (is_bitmap(container_p) ? CHUNK_SIZE - 1 : container_p->data.array[container_p->cardinality-1]);
+        if( is_bitmap(container_p) ) {
+            for( ordinal = tracker_p->num_paths; ordinal <= last_ordinal; ordinal++ ) {
+                if( bip32_template_tracker_test(tracker_p, ordinal) ) {
+                    free_containers(tracker_p);
+                    return 0;
+                }
+            }
+        }
+        else if( last_ordinal >= tracker_p->num_paths ) {
+            free_containers(tracker_p);
+            return 0;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_TRACKER_H_
+#define _BIP32_TEMPLATE_TRACKER_H_
+
+#include "bip32template.h"
+
+/* The ordinals are split into chunks of 65536. A chunk with more than this many
+ * ordinals set is kept as a bitmap, otherwise as a sorted array of the low 16 bits */
+#define BIP32_TEMPLATE_TRACKER_ARRAY_MAX 4096
+#define BIP32_TEMPLATE_TRACKER_BITMAP_WORDS (65536 / 64)
+
+/* The same as bip32_template_allocator_type of the registry, that is not included here
+ * because the registry header needs C11 atomics */
+typedef struct {
+    void* (*alloc)(size_t size, void* arg);
+    void (*free)(void* p, void* arg);
+    void* arg;
+} bip32_template_tracker_allocator_type;
+
+typedef struct {
+    uint64_t key; /* ordinal >> 16 */
+    uint32_t cardinality;
+    uint32_t capacity; /* of the array, in elements */
+    union {
+        uint16_t* array;
+        uint64_t* bitmap;
+    } data;
+} bip32_template_tracker_container_type;
+
+typedef struct {
+    bip32_template_type tmpl;
+    uint64_t num_paths;
+    /* The number of paths that share the indexes of the sections before and at the given one */
+    uint64_t strides[BIP32_TEMPLATE_MAX_SECTIONS];
+    bip32_template_tracker_container_type* containers; /* sorted by key */
+    uint64_t num_containers;
+    uint64_t max_containers;
+    uint64_t num_set;
+    bip32_template_tracker_allocator_type allocator;
+} bip32_template_tracker_type;
+
+int bip32_template_tracker_init(bip32_template_tracker_type* tracker_p, const bip32_template_type* template_p,
+                                const bip32_template_tracker_allocator_type* allocator_p);
+void bip32_template_tracker_destroy(bip32_template_tracker_type* tracker_p);
+
+int bip32_template_tracker_path_ordinal(const bip32_template_tracker_type* tracker_p,
+                                        const uint32_t* path_p, unsigned int path_len, uint64_t* ordinal_p);
+void bip32_template_tracker_path_at(const bip32_template_tracker_type* tracker_p, uint64_t ordinal,
+                                    uint32_t* path_p);
+
+int bip32_template_tracker_set(bip32_template_tracker_type* tracker_p, uint64_t ordinal);
+int bip32_template_tracker_test(const bip32_template_tracker_type* tracker_p, uint64_t ordinal);
+int bip32_template_tracker_next_unused(const bip32_template_tracker_type* tracker_p, uint64_t from,
+                                       uint64_t* ordinal_p);
+uint64_t bip32_template_tracker_count(const bip32_template_tracker_type* tracker_p, uint64_t start, uint64_t end);
+int bip32_template_tracker_branch_count(const bip32_template_tracker_type* tracker_p,
+                                        const uint32_t* prefix_p, unsigned int prefix_len, uint64_t* count_p);
+
+size_t bip32_template_tracker_serialized_size(const bip32_template_tracker_type* tracker_p);
+size_t bip32_template_tracker_serialize(const bip32_template_tracker_type* tracker_p,
+                                        uint8_t* buf, size_t buf_size);
+int bip32_template_tracker_deserialize(bip32_template_tracker_type* tracker_p, const uint8_t* buf, size_t buf_size);
+
+#endif /* _BIP32_TEMPLATE_TRACKER_H_ */
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Union of the paths of several templates, in order, each path once.
+ *
+ * Each source template has a cursor that walks its paths by runs: one combination
+ * of the indexes of the sections before the last one, and one range of the last
+ * section. The cursors are kept in a min-heap by the first path of their current run.
+ *
+ * The cursors with the smallest first path are taken from the heap together.
+ * The run given out starts at that path and ends at the earliest end of their
+ * current runs, or just before the start of the next cursor in the heap,
+ * if it has the same prefix. No other cursor can have paths within this run,
+ * so the run is matched by exactly the taken cursors. The taken cursors then
+ * either move past the run within their current range, or to their next run,
+ * and go back to the heap.
+ *
+ * The paths are ordered as the keys of bip32template_keys.c: the full paths
+ * before the partial ones, then the shorter paths before the longer ones, and then
+ * lexicographically. This way the paths of one run are not interleaved with
+ * the paths of other lengths. */
+
+#include <assert.h>
+
+#include "bip32template_union.h"
+
+static uint32_t cursor_index(const bip32_template_union_cursor_type* cursor_p, int i)
+{
+    return i < cursor_p->template_p->num_sections - 1 ? cursor_p->prefix[i] : cursor_p->start;
+}
+
+static uint32_t cursor_range_end(const bip32_template_union_cursor_type* cursor_p)
+{
+    const bip32_template_type* template_p = cursor_p->template_p;
+
+    return template_p->sections[template_p->num_sections-1].ranges[cursor_p->last_range].range_end;
+}
+
+/* Compare the first paths of the current runs. With is_prefix_only, the last index
+ * is not compared, and only 0 or non-zero is returned */
+static int compare_cursors(const bip32_template_union_cursor_type* a, const bip32_template_union_cursor_type* b,
+                           int is_prefix_only)
+{
+    int len = a->template_p->num_sections;
+    uint32_t index_a, index_b;
+    int i;
+
+    if( a->template_p->is_partial != b->template_p->is_partial ) {
+        return a->template_p->is_partial ? 1 : -1;
+    }
+    if( len != b->template_p->num_sections ) {
+        return len < b->template_p->num_sections ? -1 : 1;
+    }
+
+    for( i = 0; i < len - (is_prefix_only ? 1 : 0); i++ ) {
+        index_a = cursor_index(a, i);
+        index_b = cursor_index(b, i);
+        if( index_a != index_b ) {
+            return index_a < index_b ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+static int is_heap_less(const bip32_template_union_type* union_p, unsigned int a, unsigned int b)
+{
+    return compare_cursors(&union_p->cursors[union_p->heap[a]], &union_p->cursors[union_p->heap[b]], 0) < 0;
+}
+
+static void heap_swap(bip32_template_union_type* union_p, unsigned int a, unsigned int b)
+{
+    unsigned int tmp = union_p->heap[a];
+
+    union_p->heap[a] = union_p->heap[b];
+    union_p->heap[b] = tmp;
+}
+
+static void heap_push(bip32_template_union_type* union_p, unsigned int cursor)
+{
+    unsigned int i = union_p->heap_size++;
+
+    union_p->heap[i] = cursor;
+    while( i > 0 && is_heap_less(union_p, i, (i - 1) / 2) ) {
+        heap_swap(union_p, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static unsigned int heap_pop(bip32_template_union_type* union_p)
+{
+    unsigned int top = union_p->heap[0];
+    unsigned int i = 0;
+    unsigned int child;
+
+    assert( union_p->heap_size > 0 );
+
+    union_p->heap[0] = union_p->heap[--union_p->heap_size];
+    for( ;; ) {
+        child = 2 * i + 1;
+        if( child >= union_p->heap_size ) {
+            break;
+        }
+        if( child + 1 < union_p->heap_size && is_heap_less(union_p, child + 1, child) ) {
+            child++;
+        }
+        if( !is_heap_less(union_p, child, i) ) {
+            break;
+        }
+        heap_swap(union_p, i, child);
+        i = child;
+    }
+
+    return top;
+}
+
+/* Move the cursor to its next run. Returns 0 if the template has no more paths */
+static int advance_cursor(bip32_template_union_cursor_type* cursor_p)
+{
+    const bip32_template_type* template_p = cursor_p->template_p;
+    const bip32_template_section_type* section_p = &template_p->sections[template_p->num_sections-1];
+    int i;
+
+    if( cursor_p->last_range + 1 < section_p->num_ranges ) {
+        cursor_p->last_range++;
+        cursor_p->start = section_p->ranges[cursor_p->last_range].range_start;
+        return 1;
+    }
+    cursor_p->last_range = 0;
+    cursor_p->start = section_p->ranges[0].range_start;
+
+    /* The last prefix section changes first */
+    for( i = template_p->num_sections - 2; i >= 0; i-- ) {
+        const bip32_template_section_type* prefix_section_p = &template_p->sections[i];
+        const bip32_template_section_range_type* range_p = &prefix_section_p->ranges[cursor_p->prefix_range[i]];
+
+        if( cursor_p->prefix[i] < range_p->range_end ) {
+            cursor_p->prefix[i]++;
+            return 1;
+        }
+        if( cursor_p->prefix_range[i] + 1 < prefix_section_p->num_ranges ) {
+            cursor_p->prefix_range[i]++;
+            cursor_p->prefix[i] = prefix_section_p->ranges[cursor_p->prefix_range[i]].range_start;
+            return 1;
+        }
+        cursor_p->prefix_range[i] = 0;
+        cursor_p->prefix[i] = prefix_section_p->ranges[0].range_start;
+    }
+
+    return 0;
+}
+
+/* cursors and heap must have num_templates elements each.
+ * The templates must stay unchanged while the union is used. Templates without sections are skipped */
+void bip32_template_union_init(bip32_template_union_type* union_p,
+                               const bip32_template_type* templates, unsigned int num_templates,
+                               bip32_template_union_cursor_type* cursors, unsigned int* heap)
+{
+    unsigned int t;
+    int i;
+
+    union_p->cursors = cursors;
+    union_p->num_cursors = num_templates;
+    union_p->heap = heap;
+    union_p->heap_size = 0;
+
+    for( t = 0; t < num_templates; t++ ) {
+        cursors[t].template_p = &templates[t];
+        if( templates[t].num_sections == 0 ) {
+            continue;
+        }
+        for( i = 0; i + 1 < templates[t].num_sections; i++ ) {
+            cursors[t].prefix_range[i] = 0;
+            cursors[t].prefix[i] = templates[t].sections[i].ranges[0].range_start;
+        }
+        cursors[t].last_range = 0;
+        cursors[t].start = templates[t].sections[templates[t].num_sections-1].ranges[0].range_start;
+        heap_push(union_p, t);
+    }
+}
+
+/* Get the next run of the union. sources must have room for num_templates elements.
+ * Returns 0 when all paths are given out */
+int bip32_template_union_next(bip32_template_union_type* union_p, bip32_template_union_run_type* run_p,
+                              unsigned int* sources)
+{
+    bip32_template_union_cursor_type* cursor_p;
+    bip32_template_union_cursor_type* next_p;
+    unsigned int num_sources = 0;
+    unsigned int i, ii, tmp;
+    uint32_t end;
+    int len;
+
+    if( union_p->heap_size == 0 ) {
+        return 0;
+    }
+
+    sources[num_sources++] = heap_pop(union_p);
+    cursor_p = &union_p->cursors[sources[0]];
+    end = cursor_range_end(cursor_p);
+
+    while( union_p->heap_size > 0
+           && compare_cursors(&union_p->cursors[union_p->heap[0]], cursor_p, 0) == 0 )
+    {
+        sources[num_sources] = heap_pop(union_p);
+        if( cursor_range_end(&union_p->cursors[sources[num_sources]]) < end ) {
+            end = cursor_range_end(&union_p->cursors[sources[num_sources]]);
+        }
+        num_sources++;
+    }
+
+    if( union_p->heap_size > 0 ) {
+        next_p = &union_p->cursors[union_p->heap[0]];
+        if( compare_cursors(next_p, cursor_p, 1) == 0 && next_p->start <= end ) {
+            assert( next_p->start > cursor_p->start );
+            end = next_p->start - 1;
+        }
+    }
+
+    len = cursor_p->template_p->num_sections;
+    for( i = 0; i < (unsigned int)len; i++ ) {
+        run_p->path[i] = cursor_index(cursor_p, (int)i);
+    }
+    run_p->path_len = (unsigned int)len;
+    run_p->is_partial = cursor_p->template_p->is_partial;
+    run_p->last_end = end;
+    run_p->num_sources = num_sources;
+
+    for( i = 0; i < num_sources; i++ ) {
+        bip32_template_union_cursor_type* source_p = &union_p->cursors[sources[i]];
+
+        if( cursor_range_end(source_p) == end ) {
+            if( !advance_cursor(source_p) ) {
+                continue;
+            }
+        }
+        else {
+            source_p->start = end + 1;
+        }
+        heap_push(union_p, sources[i]);
+    }
+
+    /* The sources are few, insertion sort is enough */
+    for( i = 1; i < num_sources; i++ ) {
+        for( ii = i; ii > 0 && sources[ii-1] > sources[ii]; ii-- ) {
+            tmp = sources[ii];
+            sources[ii] = sources[ii-1];
+            sources[ii-1] = tmp;
+        }
+    }
+
+    return 1;
+}
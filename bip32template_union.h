@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _BIP32_TEMPLATE_UNION_H_
+#define _BIP32_TEMPLATE_UNION_H_
+
+#include "bip32template.h"
+
+/* The position of the merge within one source template: the indexes of all sections
+ * except the last one, and the part of the current range of the last section
+ * that is not yet given out */
+typedef struct {
+    const bip32_template_type* template_p;
+    uint32_t prefix[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint8_t prefix_range[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint8_t last_range;
+    uint32_t start;
+} bip32_template_union_cursor_type;
+
+typedef struct {
+    bip32_template_union_cursor_type* cursors;
+    unsigned int num_cursors;
+    /* Min-heap of the indexes of the cursors that are not exhausted */
+    unsigned int* heap;
+    unsigned int heap_size;
+} bip32_template_union_type;
+
+/* The paths that differ only in the last index, from path[path_len-1] to last_end inclusive,
+ * all matched by the same source templates. num_sources indexes of these templates,
+ * in ascending order, are written to the array given to bip32_template_union_next() */
+typedef struct {
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int path_len;
+    unsigned int is_partial;
+    uint32_t last_end;
+    unsigned int num_sources;
+} bip32_template_union_run_type;
+
+void bip32_template_union_init(bip32_template_union_type* union_p,
+                               const bip32_template_type* templates, unsigned int num_templates,
+                               bip32_template_union_cursor_type* cursors, unsigned int* heap);
+int bip32_template_union_next(bip32_template_union_type* union_p, bip32_template_union_run_type* run_p,
+                              unsigned int* sources);
+
+#endif /* _BIP32_TEMPLATE_UNION_H_ */
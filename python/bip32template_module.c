@@ -0,0 +1,598 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* CPython extension module for the BIP32 template parser.
+ *
+ * The batch functions work on the data in place: the template strings are parsed
+ * directly from the str objects or from the bytes-like buffer, and the paths are read
+ * directly from any buffer of uint32 values (array.array('I'), numpy arrays, ...).
+ * The GIL is released while the batch is processed, so several Python threads
+ * can process their batches in parallel. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "bip32template.h"
+
+typedef struct {
+    PyObject_HEAD
+    bip32_template_type tmpl;
+} TemplateObject;
+
+typedef struct {
+    const char* str;
+    size_t len;
+    int is_ok;
+    bip32_template_error_type error;
+    unsigned int pos;
+    bip32_template_type tmpl;
+} parse_item_type;
+
+static PyTypeObject TemplateType;
+
+static int check_mode(int mode)
+{
+    if( mode != BIP32_TEMPLATE_FORMAT_AMBIGOUS && mode != BIP32_TEMPLATE_FORMAT_UNAMBIGOUS
+        && mode != BIP32_TEMPLATE_FORMAT_ONLYPATH )
+    {
+        PyErr_SetString(PyExc_ValueError, "unknown mode");
+        return 0;
+    }
+    return 1;
+}
+
+static PyObject* new_template(const bip32_template_type* template_p)
+{
+    TemplateObject* self = PyObject_New(TemplateObject, &TemplateType);
+
+    if( self ) {
+        self->tmpl = *template_p;
+    }
+    return (PyObject*)self;
+}
+
+static void parse_item(parse_item_type* item_p, bip32_template_format_mode_type mode)
+{
+    bip32_template_getchar_context_type ctx;
+
+    bip32_template_context_set_span(item_p->str, item_p->len, &ctx);
+    item_p->is_ok = bip32_template_parse(bip32_template_getchar_span, &ctx, mode,
+                                         &item_p->tmpl, &item_p->error);
+    item_p->pos = ctx.pos;
+}
+
+/* Read the path from a sequence of ints. Returns -1 with exception set on failure */
+static Py_ssize_t read_path(PyObject* path_obj, uint32_t* path_p)
+{
+    PyObject* seq = PySequence_Fast(path_obj, "path must be a sequence of indexes");
+    Py_ssize_t len, i;
+    unsigned long value;
+
+    if( !seq ) {
+        return -1;
+    }
+    len = PySequence_Fast_GET_SIZE(seq);
+    for( i = 0; i < len; i++ ) {
+        value = PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(seq, i));
+        if( value == (unsigned long)-1 && PyErr_Occurred() ) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        if( value > 0xFFFFFFFFUL ) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_OverflowError, "path index does not fit into uint32");
+            return -1;
+        }
+        /* Longer paths cannot match, only the length is needed for them */
+        if( i < BIP32_TEMPLATE_MAX_SECTIONS ) {
+            path_p[i] = (uint32_t)value;
+        }
+    }
+    Py_DECREF(seq);
+
+    return len;
+}
+
+static int is_little_endian(void)
+{
+    const uint16_t probe = 1;
+    return *(const uint8_t*)&probe == 1;
+}
+
+/* Get the buffer of uint32 values, C-contiguous, in native byte order */
+static int get_uint32_buffer(PyObject* obj, Py_buffer* view_p)
+{
+    const char* format;
+
+    if( PyObject_GetBuffer(obj, view_p, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0 ) {
+        return 0;
+    }
+
+    format = view_p->format ? view_p->format : "B";
+    if( *format == '@' || *format == '=' || (*format == '<' && is_little_endian())
+        || (*format == '>' && !is_little_endian()) )
+    {
+        format++;
+    }
+    if( view_p->itemsize != 4 || ((format[0] != 'I' && format[0] != 'L') || format[1] != 0) ) {
+        PyBuffer_Release(view_p);
+        PyErr_SetString(PyExc_TypeError, "paths must be a buffer of native uint32 values");
+        return 0;
+    }
+
+    return 1;
+}
+
+static PyObject* Template_match(TemplateObject* self, PyObject* path_obj)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    Py_ssize_t len = read_path(path_obj, path);
+
+    if( len < 0 ) {
+        return 0;
+    }
+    if( len > BIP32_TEMPLATE_MAX_SECTIONS ) {
+        Py_RETURN_FALSE;
+    }
+
+    return PyBool_FromLong(bip32_template_match(&self->tmpl, path, (unsigned int)len));
+}
+
+PyDoc_STRVAR(Template_match_batch_doc,
+"match_batch(paths, path_len=0, out=None)\n\n"
+"Match each path in paths, a C-contiguous buffer of uint32 values.\n"
+"For a two-dimensional buffer each row is a path, otherwise path_len must be given.\n"
+"The result for each path (1 if it matches, 0 if not) is written into out, a writable\n"
+"buffer of at least as many bytes as there are paths. If out is not given,\n"
+"a new bytearray is returned.");
+
+static PyObject* Template_match_batch(TemplateObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "paths", "path_len", "out", 0 };
+    PyObject* paths_obj;
+    PyObject* out_obj = Py_None;
+    Py_ssize_t path_len = 0;
+    Py_buffer paths_view, out_view;
+    Py_ssize_t num_values, num_paths, i;
+    const uint32_t* paths_p;
+    uint8_t* out_p;
+
+    if( !PyArg_ParseTupleAndKeywords(args, kwargs, "O|nO", kwlist, &paths_obj, &path_len, &out_obj) ) {
+        return 0;
+    }
+    if( !get_uint32_buffer(paths_obj, &paths_view) ) {
+        return 0;
+    }
+
+    if( paths_view.ndim == 2 ) {
+        if( path_len != 0 && path_len != paths_view.shape[1] ) {
+            PyBuffer_Release(&paths_view);
+            PyErr_SetString(PyExc_ValueError, "path_len does not match the shape of paths");
+            return 0;
+        }
+        path_len = paths_view.shape[1];
+    }
+    num_values = paths_view.len / 4;
+    if( path_len <= 0 || num_values % path_len != 0 ) {
+        PyBuffer_Release(&paths_view);
+        PyErr_SetString(PyExc_ValueError, "path_len must be positive and divide the number of values");
+        return 0;
+    }
+    num_paths = num_values / path_len;
+
+    if( out_obj == Py_None ) {
+        out_obj = PyByteArray_FromStringAndSize(0, num_paths);
+        if( !out_obj ) {
+            PyBuffer_Release(&paths_view);
+            return 0;
+        }
+    }
+    else {
+        Py_INCREF(out_obj);
+    }
+    if( PyObject_GetBuffer(out_obj, &out_view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0 ) {
+        PyBuffer_Release(&paths_view);
+        Py_DECREF(out_obj);
+        return 0;
+    }
+    if( out_view.len < num_paths ) {
+        PyBuffer_Release(&out_view);
+        PyBuffer_Release(&paths_view);
+        Py_DECREF(out_obj);
+        PyErr_SetString(PyExc_ValueError, "out is too small");
+        return 0;
+    }
+
+    paths_p = paths_view.buf;
+    out_p = out_view.buf;
+
+    Py_BEGIN_ALLOW_THREADS
+    if( path_len != self->tmpl.num_sections ) {
+        for( i = 0; i < num_paths; i++ ) {
+            out_p[i] = 0;
+        }
+    }
+    else {
+        for( i = 0; i < num_paths; i++ ) {
+            out_p[i] = (uint8_t)bip32_template_match(&self->tmpl, &paths_p[i * path_len],
+                                                     (unsigned int)path_len);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&out_view);
+    PyBuffer_Release(&paths_view);
+
+    return out_obj;
+}
+
+static PyObject* Template_get_is_partial(TemplateObject* self, void* closure)
+{
+    (void)closure;
+    return PyBool_FromLong(self->tmpl.is_partial);
+}
+
+static PyObject* Template_get_sections(TemplateObject* self, void* closure)
+{
+    PyObject* sections;
+    PyObject* ranges;
+    PyObject* range;
+    int i, ii;
+
+    (void)closure;
+    sections = PyTuple_New(self->tmpl.num_sections);
+    if( !sections ) {
+        return 0;
+    }
+    for( i = 0; i < self->tmpl.num_sections; i++ ) {
+        const bip32_template_section_type* section_p = &self->tmpl.sections[i];
+        ranges = PyTuple_New(section_p->num_ranges);
+        if( !ranges ) {
+            Py_DECREF(sections);
+            return 0;
+        }
+        PyTuple_SET_ITEM(sections, i, ranges);
+        for( ii = 0; ii < section_p->num_ranges; ii++ ) {
+            range = Py_BuildValue("(kk)", (unsigned long)section_p->ranges[ii].range_start,
+                                  (unsigned long)section_p->ranges[ii].range_end);
+            if( !range ) {
+                Py_DECREF(sections);
+                return 0;
+            }
+            PyTuple_SET_ITEM(ranges, ii, range);
+        }
+    }
+
+    return sections;
+}
+
+static PyObject* Template_repr(TemplateObject* self)
+{
+    PyObject* sections = Template_get_sections(self, 0);
+    PyObject* result;
+
+    if( !sections ) {
+        return 0;
+    }
+    result = PyUnicode_FromFormat("Template(is_partial=%s, sections=%R)",
+                                  self->tmpl.is_partial ? "True" : "False", sections);
+    Py_DECREF(sections);
+
+    return result;
+}
+
+static PyMethodDef Template_methods[] = {
+    { "match", (PyCFunction)Template_match, METH_O,
+      PyDoc_STR("match(path)\n\nReturn True if the path, a sequence of indexes, matches the template.") },
+    { "match_batch", (PyCFunction)(void(*)(void))Template_match_batch, METH_VARARGS | METH_KEYWORDS,
+      Template_match_batch_doc },
+    { 0 }
+};
+
+static PyGetSetDef Template_getset[] = {
+    { "is_partial", (getter)Template_get_is_partial, 0, PyDoc_STR("True if the template is partial"), 0 },
+    { "sections", (getter)Template_get_sections, 0,
+      PyDoc_STR("Tuple of sections, each a tuple of (range_start, range_end) pairs.\n"
+                "Hardened indexes have the 0x80000000 bit set."), 0 },
+    { 0 }
+};
+
+static PyTypeObject TemplateType = {
+    PyVarObject_HEAD_INIT(0, 0)
+    .tp_name = "bip32template.Template",
+    .tp_basicsize = sizeof(TemplateObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR("Parsed BIP32 path template"),
+    .tp_repr = (reprfunc)Template_repr,
+    .tp_methods = Template_methods,
+    .tp_getset = Template_getset,
+};
+
+static PyObject* raise_parse_error(bip32_template_error_type error, unsigned int pos)
+{
+    PyObject* exc_args = Py_BuildValue("(sIi)", bip32_template_error_to_string(error), pos, (int)error);
+
+    if( exc_args ) {
+        PyErr_SetObject(PyExc_ValueError, exc_args);
+        Py_DECREF(exc_args);
+    }
+    return 0;
+}
+
+PyDoc_STRVAR(parse_doc,
+"parse(template_string, mode=MODE_AMBIGOUS)\n\n"
+"Parse the template from str or bytes. On failure ValueError is raised\n"
+"with (message, position, error_code) as args.");
+
+static PyObject* module_parse(PyObject* module, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "template_string", "mode", 0 };
+    parse_item_type item;
+    Py_buffer view;
+    int mode = BIP32_TEMPLATE_FORMAT_AMBIGOUS;
+
+    (void)module;
+    if( !PyArg_ParseTupleAndKeywords(args, kwargs, "s*|i", kwlist, &view, &mode) ) {
+        return 0;
+    }
+    if( !check_mode(mode) ) {
+        PyBuffer_Release(&view);
+        return 0;
+    }
+
+    item.str = view.buf;
+    item.len = (size_t)view.len;
+    parse_item(&item, mode);
+    PyBuffer_Release(&view);
+
+    if( !item.is_ok ) {
+        return raise_parse_error(item.error, item.pos);
+    }
+    return new_template(&item.tmpl);
+}
+
+/* Build the result list: Template for each parsed item, (error_code, position) tuple for each failed one */
+static PyObject* build_parse_results(const parse_item_type* items, Py_ssize_t num_items)
+{
+    PyObject* result = PyList_New(num_items);
+    PyObject* obj;
+    Py_ssize_t i;
+
+    if( !result ) {
+        return 0;
+    }
+    for( i = 0; i < num_items; i++ ) {
+        obj = items[i].is_ok ? new_template(&items[i].tmpl)
+                             : Py_BuildValue("(iI)", (int)items[i].error, items[i].pos);
+        if( !obj ) {
+            Py_DECREF(result);
+            return 0;
+        }
+        PyList_SET_ITEM(result, i, obj);
+    }
+
+    return result;
+}
+
+static Py_ssize_t count_lines(const char* buf, Py_ssize_t len)
+{
+    Py_ssize_t num_lines = 0;
+    Py_ssize_t i;
+
+    for( i = 0; i < len; i++ ) {
+        num_lines += buf[i] == '\n';
+    }
+    /* The last line does not need to end with a newline */
+    return num_lines + (len > 0 && buf[len-1] != '\n');
+}
+
+PyDoc_STRVAR(parse_batch_doc,
+"parse_batch(templates, mode=MODE_AMBIGOUS)\n\n"
+"Parse many templates at once, with the GIL released.\n"
+"templates is either a sequence of str or bytes objects, or a bytes-like buffer\n"
+"with one template per line. Returns a list with a Template for each successfully\n"
+"parsed template, and an (error_code, position) tuple for each failed one.");
+
+static PyObject* module_parse_batch(PyObject* module, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "templates", "mode", 0 };
+    PyObject* templates_obj;
+    PyObject* seq = 0;
+    PyObject* result = 0;
+    parse_item_type* items;
+    Py_buffer view;
+    Py_ssize_t num_items, i, start, end;
+    Py_ssize_t len;
+    int mode = BIP32_TEMPLATE_FORMAT_AMBIGOUS;
+    int has_view = 0;
+
+    (void)module;
+    if( !PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwlist, &templates_obj, &mode) ) {
+        return 0;
+    }
+    if( !check_mode(mode) ) {
+        return 0;
+    }
+
+    if( PyObject_CheckBuffer(templates_obj) ) {
+        if( PyObject_GetBuffer(templates_obj, &view, PyBUF_C_CONTIGUOUS) < 0 ) {
+            return 0;
+        }
+        has_view = 1;
+        num_items = count_lines(view.buf, view.len);
+    }
+    else {
+        /* The tuple holds the references to the strings while the GIL is released,
+         * the strings themselves are not copied */
+        seq = PySequence_Tuple(templates_obj);
+        if( !seq ) {
+            return 0;
+        }
+        num_items = PyTuple_GET_SIZE(seq);
+    }
+
+    items = PyMem_RawMalloc((num_items ? num_items : 1) * sizeof(items[0]));
+    if( !items ) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    if( has_view ) {
+        start = 0;
+        for( i = 0; i < num_items; i++ ) {
+            for( end = start; end < view.len && ((const char*)view.buf)[end] != '\n'; end++ ) {
+            }
+            items[i].str = (const char*)view.buf + start;
+            items[i].len = (size_t)(end - start);
+            start = end + 1;
+        }
+    }
+    else {
+        for( i = 0; i < num_items; i++ ) {
+            PyObject* item_obj = PyTuple_GET_ITEM(seq, i);
+            if( PyUnicode_Check(item_obj) ) {
+                items[i].str = PyUnicode_AsUTF8AndSize(item_obj, &len);
+                if( !items[i].str ) {
+                    goto done;
+                }
+            }
+            else if( PyBytes_Check(item_obj) ) {
+                items[i].str = PyBytes_AS_STRING(item_obj);
+                len = PyBytes_GET_SIZE(item_obj);
+            }
+            else {
+                PyErr_SetString(PyExc_TypeError, "templates must be str or bytes");
+                goto done;
+            }
+            items[i].len = (size_t)len;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for( i = 0; i < num_items; i++ ) {
+        parse_item(&items[i], mode);
+    }
+    Py_END_ALLOW_THREADS
+
+    result = build_parse_results(items, num_items);
+
+done:
+    PyMem_RawFree(items);
+    if( has_view ) {
+        PyBuffer_Release(&view);
+    }
+    Py_XDECREF(seq);
+
+    return result;
+}
+
+static PyObject* module_error_to_string(PyObject* module, PyObject* arg)
+{
+    long error = PyLong_AsLong(arg);
+
+    (void)module;
+    if( error == -1 && PyErr_Occurred() ) {
+        return 0;
+    }
+    if( error < BIP32_TEMPLATE_ERROR_FIRST || error > BIP32_TEMPLATE_ERROR_LAST ) {
+        PyErr_SetString(PyExc_ValueError, "unknown error code");
+        return 0;
+    }
+    return PyUnicode_FromString(bip32_template_error_to_string((bip32_template_error_type)error));
+}
+
+static PyMethodDef module_methods[] = {
+    { "parse", (PyCFunction)(void(*)(void))module_parse, METH_VARARGS | METH_KEYWORDS, parse_doc },
+    { "parse_batch", (PyCFunction)(void(*)(void))module_parse_batch, METH_VARARGS | METH_KEYWORDS,
+      parse_batch_doc },
+    { "error_to_string", module_error_to_string, METH_O,
+      PyDoc_STR("error_to_string(error_code)\n\nReturn the description of the error code.") },
+    { 0 }
+};
+
+static struct PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "bip32template",
+    .m_doc = PyDoc_STR("BIP32 path template parser"),
+    .m_size = -1,
+    .m_methods = module_methods,
+};
+
+#define ADD_ERROR_CONSTANT(name) \
+    if( PyModule_AddIntConstant(module, #name, BIP32_TEMPLATE_##name) < 0 ) goto fail
+
+PyMODINIT_FUNC PyInit_bip32template(void)
+{
+    PyObject* module;
+
+    if( PyType_Ready(&TemplateType) < 0 ) {
+        return 0;
+    }
+    module = PyModule_Create(&module_def);
+    if( !module ) {
+        return 0;
+    }
+    Py_INCREF(&TemplateType);
+    if( PyModule_AddObject(module, "Template", (PyObject*)&TemplateType) < 0 ) {
+        Py_DECREF(&TemplateType);
+        goto fail;
+    }
+
+    if( PyModule_AddIntConstant(module, "MODE_AMBIGOUS", BIP32_TEMPLATE_FORMAT_AMBIGOUS) < 0
+        || PyModule_AddIntConstant(module, "MODE_UNAMBIGOUS", BIP32_TEMPLATE_FORMAT_UNAMBIGOUS) < 0
+        || PyModule_AddIntConstant(module, "MODE_ONLYPATH", BIP32_TEMPLATE_FORMAT_ONLYPATH) < 0
+        || PyModule_AddIntConstant(module, "MAX_SECTIONS", BIP32_TEMPLATE_MAX_SECTIONS) < 0
+        || PyModule_AddIntConstant(module, "MAX_RANGES_PER_SECTION",
+                                   BIP32_TEMPLATE_MAX_RANGES_PER_SECTION) < 0 )
+    {
+        goto fail;
+    }
+
+    ADD_ERROR_CONSTANT(ERROR_UNDEFINED);
+    ADD_ERROR_CONSTANT(ERROR_GETCHAR_FAILED);
+    ADD_ERROR_CONSTANT(ERROR_UNEXPECTED_HARDENED_MARKER);
+    ADD_ERROR_CONSTANT(ERROR_UNEXPECTED_SPACE);
+    ADD_ERROR_CONSTANT(ERROR_UNEXPECTED_CHAR);
+    ADD_ERROR_CONSTANT(ERROR_UNEXPECTED_FINISH);
+    ADD_ERROR_CONSTANT(ERROR_UNEXPECTED_SLASH);
+    ADD_ERROR_CONSTANT(ERROR_INVALID_CHAR);
+    ADD_ERROR_CONSTANT(ERROR_INDEX_TOO_BIG);
+    ADD_ERROR_CONSTANT(ERROR_INDEX_HAS_LEADING_ZERO);
+    ADD_ERROR_CONSTANT(ERROR_PATH_EMPTY);
+    ADD_ERROR_CONSTANT(ERROR_PATH_TOO_LONG);
+    ADD_ERROR_CONSTANT(ERROR_PATH_SECTION_TOO_LONG);
+    ADD_ERROR_CONSTANT(ERROR_RANGES_INTERSECT);
+    ADD_ERROR_CONSTANT(ERROR_RANGE_ORDER_BAD);
+    ADD_ERROR_CONSTANT(ERROR_RANGE_EQUALS_WILDCARD);
+    ADD_ERROR_CONSTANT(ERROR_SINGLE_INDEX_AS_RANGE);
+    ADD_ERROR_CONSTANT(ERROR_RANGE_START_EQUALS_END);
+    ADD_ERROR_CONSTANT(ERROR_RANGE_START_NEXT_TO_PREVIOUS);
+    ADD_ERROR_CONSTANT(ERROR_GOT_HARDENED_AFTER_UNHARDENED);
+    ADD_ERROR_CONSTANT(ERROR_DIGIT_EXPECTED);
+
+    return module;
+
+fail:
+    Py_DECREF(module);
+    return 0;
+}
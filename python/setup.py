@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+import os
+
+from setuptools import setup, Extension
+
+# The limits can be set at build time, the same way as for the C library:
+# BIP32_TEMPLATE_MAX_SECTIONS=3 python3 setup.py build_ext --inplace
+define_macros = [(name, os.environ[name])
+                 for name in ('BIP32_TEMPLATE_MAX_SECTIONS',
+                              'BIP32_TEMPLATE_MAX_RANGES_PER_SECTION')
+                 if name in os.environ]
+
+setup(
+    name='bip32template',
+    version='0.1',
+    description='BIP32 path template parser',
+    ext_modules=[
+        Extension('bip32template',
+                  sources=['bip32template_module.c', '../bip32template.c'],
+                  include_dirs=['..'],
+                  define_macros=define_macros),
+    ],
+)
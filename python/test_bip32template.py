@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+import os
+import json
+import array
+import random
+import threading
+import unittest
+
+import bip32template
+
+TEST_DATA_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              '..', 'test', 'test_data.json')
+
+# The limits test/test_data.json was generated for
+CORPUS_MAX_SECTIONS = 3
+CORPUS_MAX_RANGES_PER_SECTION = 4
+
+
+class TestParse(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        with open(TEST_DATA_PATH) as f:
+            cls.test_data = json.load(f)
+
+    def test_success_cases(self):
+        cases = self.test_data['normal_finish']
+        results = bip32template.parse_batch([s for s, _ in cases])
+        for (tmpl_str, tmpl_data_str), result in zip(cases, results):
+            self.assertIsInstance(result, bip32template.Template, tmpl_str)
+            expected = tuple(tuple(tuple(r) for r in section)
+                             for section in json.loads(tmpl_data_str))
+            self.assertEqual(result.sections, expected, tmpl_str)
+            self.assertEqual(result.is_partial, not tmpl_str.startswith('m/'))
+
+    def test_error_cases(self):
+        skipped = set()
+        # With larger limits these strings can be valid or fail later
+        if bip32template.MAX_SECTIONS > CORPUS_MAX_SECTIONS:
+            skipped.add('error_path_too_long')
+        if bip32template.MAX_RANGES_PER_SECTION > CORPUS_MAX_RANGES_PER_SECTION:
+            skipped.add('error_path_section_too_long')
+        for state, strings in self.test_data.items():
+            if state == 'normal_finish' or state in skipped:
+                continue
+            error_code = getattr(bip32template, state.upper())
+            if error_code == bip32template.ERROR_RANGE_START_NEXT_TO_PREVIOUS:
+                mode = bip32template.MODE_UNAMBIGOUS
+            else:
+                mode = bip32template.MODE_AMBIGOUS
+            for result in bip32template.parse_batch(strings, mode):
+                self.assertEqual(result[0], error_code, state)
+
+    def test_buffer_is_same_as_list(self):
+        strings = [s for s, _ in self.test_data['normal_finish'][:1000]]
+        strings += self.test_data['error_unexpected_char'][:1000]
+        from_list = bip32template.parse_batch(strings)
+        from_buffer = bip32template.parse_batch('\n'.join(strings).encode())
+        self.assertEqual(len(from_list), len(from_buffer))
+        for a, b in zip(from_list, from_buffer):
+            if isinstance(a, bip32template.Template):
+                self.assertEqual(a.sections, b.sections)
+                self.assertEqual(a.is_partial, b.is_partial)
+            else:
+                self.assertEqual(a, b)
+
+    def test_parse_error(self):
+        with self.assertRaises(ValueError) as cm:
+            bip32template.parse("m/0/1/{2-1}")
+        message, pos, error_code = cm.exception.args
+        self.assertEqual(error_code, bip32template.ERROR_RANGE_ORDER_BAD)
+        self.assertEqual(message, bip32template.error_to_string(error_code))
+        self.assertEqual(pos, 11)
+        with self.assertRaises(ValueError):
+            bip32template.parse("0/{1,2}", bip32template.MODE_ONLYPATH)
+        with self.assertRaises(ValueError):
+            bip32template.parse("0", 100)
+
+
+class TestMatch(unittest.TestCase):
+
+    def setUp(self):
+        self.tmpl = bip32template.parse("m/{0-2}'/{0,1}/*")
+        rng = random.Random(1)
+        self.paths = [[0x80000000 + rng.randrange(4), rng.randrange(3), rng.choice([5, 0x80000005])]
+                      for _ in range(10000)]
+
+    def test_match(self):
+        self.assertTrue(self.tmpl.match([0x80000001, 1, 7]))
+        self.assertFalse(self.tmpl.match([0x80000001, 2, 7]))
+        self.assertFalse(self.tmpl.match([0x80000001, 1]))
+        self.assertFalse(self.tmpl.match([0x80000001, 1, 7] + [0] * 100))
+
+    def test_match_batch(self):
+        buf = array.array('I', [index for path in self.paths for index in path])
+        expected = bytes(int(self.tmpl.match(path)) for path in self.paths)
+        self.assertEqual(bytes(self.tmpl.match_batch(buf, 3)), expected)
+
+        out = bytearray(len(self.paths))
+        self.assertIs(self.tmpl.match_batch(memoryview(buf).cast('B').cast('I', (len(self.paths), 3)),
+                                            out=out), out)
+        self.assertEqual(bytes(out), expected)
+
+        # Paths of other length do not match
+        self.assertEqual(bytes(self.tmpl.match_batch(buf, 1)), bytes(len(buf)))
+
+        with self.assertRaises(ValueError):
+            self.tmpl.match_batch(buf, 7)
+        with self.assertRaises(TypeError):
+            self.tmpl.match_batch(array.array('H', [1, 2, 3]), 3)
+        with self.assertRaises(ValueError):
+            self.tmpl.match_batch(buf, 3, bytearray(1))
+
+    def test_match_batch_threads(self):
+        buf = array.array('I', [index for path in self.paths for index in path] * 20)
+        expected = bytes(self.tmpl.match_batch(buf, 3))
+        results = [None] * 4
+
+        def run(n):
+            results[n] = bytes(self.tmpl.match_batch(buf, 3))
+
+        threads = [threading.Thread(target=run, args=(n,)) for n in range(len(results))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(results, [expected] * len(results))
+
+
+if __name__ == '__main__':
+    unittest.main()
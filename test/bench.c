@@ -0,0 +1,191 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../bip32template.h"
+
+typedef struct {
+    const char* tmpl_str;
+    bip32_template_type tmpl;
+} testcase_success_type;
+
+#include "test_data.h"
+
+#define BENCH_ROUNDS 20
+
+static const char** corpus;
+static size_t corpus_size;
+
+/* Prevents the compiler from optimizing away the results */
+static volatile unsigned int sink;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_corpus(void)
+{
+    size_t i;
+    int ii;
+    size_t n = 0;
+
+    corpus_size = sizeof(testcase_success)/sizeof(testcase_success[0]);
+    for( i = 0; i < sizeof(testcase_errors)/sizeof(testcase_errors[0]); i++ ) {
+        corpus_size += testcase_errors[i].num_strings;
+    }
+
+    corpus = malloc(corpus_size * sizeof(corpus[0]));
+    if( !corpus ) {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    for( i = 0; i < sizeof(testcase_success)/sizeof(testcase_success[0]); i++ ) {
+        corpus[n++] = testcase_success[i].tmpl_str;
+    }
+    for( i = 0; i < sizeof(testcase_errors)/sizeof(testcase_errors[0]); i++ ) {
+        for( ii = 0; ii < testcase_errors[i].num_strings; ii++ ) {
+            corpus[n++] = testcase_errors[i].strings[ii];
+        }
+    }
+}
+
+static double bench_parse(void)
+{
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    unsigned int acc = 0;
+    double start = now_seconds();
+    size_t i;
+    int round;
+
+    for( round = 0; round < BENCH_ROUNDS; round++ ) {
+        for( i = 0; i < corpus_size; i++ ) {
+            acc += bip32_template_parse_string(corpus[i], BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                                               &tmpl, &error, &last_pos);
+            acc += last_pos + error;
+        }
+    }
+    sink = acc;
+
+    return now_seconds() - start;
+}
+
+static double bench_validate(void)
+{
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    unsigned int acc = 0;
+    double start = now_seconds();
+    size_t i;
+    int round;
+
+    for( round = 0; round < BENCH_ROUNDS; round++ ) {
+        for( i = 0; i < corpus_size; i++ ) {
+            acc += bip32_template_validate_string(corpus[i], BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                                                  &error, &last_pos);
+            acc += last_pos + error;
+        }
+    }
+    sink = acc;
+
+    return now_seconds() - start;
+}
+
+/* Each template of the corpus is matched against the path of the first index
+ * of each section, and against the same path with the last index past the end of its section */
+static double bench_match(size_t* num_matches_p)
+{
+    size_t num_templates = sizeof(testcase_success)/sizeof(testcase_success[0]);
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int acc = 0;
+    double start = now_seconds();
+    size_t i;
+    int round, ii, last;
+
+    for( round = 0; round < BENCH_ROUNDS; round++ ) {
+        for( i = 0; i < num_templates; i++ ) {
+            const bip32_template_type* template_p = &testcase_success[i].tmpl;
+            last = template_p->num_sections - 1;
+            for( ii = 0; ii <= last; ii++ ) {
+                path[ii] = template_p->sections[ii].ranges[0].range_start;
+            }
+            acc += bip32_template_match(template_p, path, template_p->num_sections);
+            if( last >= 0 ) {
+                path[last] = template_p->sections[last].ranges[0].range_end + 1;
+            }
+            acc += bip32_template_match(template_p, path, template_p->num_sections);
+        }
+    }
+    sink = acc;
+
+    *num_matches_p = num_templates * 2;
+    return now_seconds() - start;
+}
+
+static void report(const char* name, double seconds, double baseline_seconds)
+{
+    double total = (double)corpus_size * BENCH_ROUNDS;
+    printf("%-10s %8.1f ns/string %10.0f strings/s", name,
+           seconds * 1e9 / total, total / seconds);
+    if( baseline_seconds > 0 ) {
+        printf("  (%.2fx)", baseline_seconds / seconds);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    double parse_seconds, validate_seconds, match_seconds;
+    size_t num_matches;
+
+    load_corpus();
+
+    printf("corpus: %zu strings, %d rounds, MAX_SECTIONS=%d, MAX_RANGES_PER_SECTION=%d\n",
+           corpus_size, BENCH_ROUNDS,
+           BIP32_TEMPLATE_MAX_SECTIONS, BIP32_TEMPLATE_MAX_RANGES_PER_SECTION);
+
+    parse_seconds = bench_parse();
+    validate_seconds = bench_validate();
+
+    report("parse", parse_seconds, 0);
+    report("validate", validate_seconds, parse_seconds);
+
+    match_seconds = bench_match(&num_matches);
+    printf("%-10s %8.1f ns/path   %10.0f paths/s\n", "match",
+           match_seconds * 1e9 / ((double)num_matches * BENCH_ROUNDS),
+           (double)num_matches * BENCH_ROUNDS / match_seconds);
+
+    free(corpus);
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Match throughput of the readers while the templates are changed at a steady rate:
+ * the registry snapshots against the array of templates behind a mutex.
+ *
+ * Usage: test/bench_registry [-t threads] [-s seconds] [-u updates_per_second] */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../bip32template_registry.h"
+
+#define NUM_TEMPLATES 32
+#define MAX_THREADS 256
+#define BATCH_SIZE 64
+
+typedef struct {
+    int use_registry;
+    unsigned int reader_num;
+    unsigned long num_matched;
+    unsigned long num_paths;
+} reader_arg_type;
+
+static bip32_template_registry_type registry;
+static bip32_template_registry_reader_type readers[MAX_THREADS];
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static bip32_template_registry_entry_type locked_entries[NUM_TEMPLATES];
+static unsigned int num_locked_entries;
+
+static atomic_int is_stopped;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* bench_alloc(size_t size, void* arg)
+{
+    (void)arg;
+    return malloc(size);
+}
+
+static void bench_free(void* p, void* arg)
+{
+    (void)arg;
+    free(p);
+}
+
+/* Template number n is 84'/n'/{0,1}/{0-999} */
+static void make_template(uint32_t n, bip32_template_type* template_p)
+{
+    memset(template_p, 0, sizeof(*template_p));
+    template_p->num_sections = 4;
+    template_p->sections[0].num_ranges = 1;
+    template_p->sections[0].ranges[0].range_start = 0x80000000 + 84;
+    template_p->sections[0].ranges[0].range_end = 0x80000000 + 84;
+    template_p->sections[1].num_ranges = 1;
+    template_p->sections[1].ranges[0].range_start = 0x80000000 + n;
+    template_p->sections[1].ranges[0].range_end = 0x80000000 + n;
+    template_p->sections[2].num_ranges = 1;
+    template_p->sections[2].ranges[0].range_start = 0;
+    template_p->sections[2].ranges[0].range_end = 1;
+    template_p->sections[3].num_ranges = 1;
+    template_p->sections[3].ranges[0].range_start = 0;
+    template_p->sections[3].ranges[0].range_end = 999;
+}
+
+static unsigned int match_locked(const uint32_t* path_p)
+{
+    unsigned int num_matched = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&mutex);
+    for( i = 0; i < num_locked_entries; i++ ) {
+        num_matched += bip32_template_match(&locked_entries[i].tmpl, path_p, 4);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return num_matched;
+}
+
+static void* reader_thread(void* arg)
+{
+    reader_arg_type* reader_p = arg;
+    uint32_t path[4] = { 0x80000000 + 84, 0x80000000, 0, 0 };
+    uint32_t seed = reader_p->reader_num * 2654435761u + 1;
+    uint32_t id;
+    unsigned int i;
+
+    if( reader_p->use_registry ) {
+        bip32_template_registry_reader_online(&registry, reader_p->reader_num);
+    }
+
+    while( !atomic_load_explicit(&is_stopped, memory_order_relaxed) ) {
+        for( i = 0; i < BATCH_SIZE; i++ ) {
+            seed = seed * 1103515245 + 12345;
+            path[1] = 0x80000000 + (seed >> 8) % (NUM_TEMPLATES * 2);
+            path[2] = (seed >> 4) & 1;
+            path[3] = (seed >> 16) % 1200;
+            if( reader_p->use_registry ) {
+                reader_p->num_matched += bip32_template_registry_snapshot_match(
+                    bip32_template_registry_acquire(&registry), path, 4, &id, 1);
+            }
+            else {
+                reader_p->num_matched += match_locked(path);
+            }
+        }
+        reader_p->num_paths += BATCH_SIZE;
+        if( reader_p->use_registry ) {
+            bip32_template_registry_quiescent(&registry, reader_p->reader_num);
+        }
+    }
+
+    if( reader_p->use_registry ) {
+        bip32_template_registry_reader_offline(&registry, reader_p->reader_num);
+    }
+
+    return 0;
+}
+
+/* Alternately remove and add back one of the templates */
+static void update(int use_registry, unsigned long n)
+{
+    bip32_template_type tmpl;
+    uint32_t id = n / 2 % NUM_TEMPLATES;
+    unsigned int i;
+
+    make_template(id, &tmpl);
+
+    if( use_registry ) {
+        if( n % 2 ) {
+            bip32_template_registry_add(&registry, id, &tmpl);
+        }
+        else {
+            bip32_template_registry_remove(&registry, id);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    if( n % 2 ) {
+        locked_entries[num_locked_entries].id = id;
+        locked_entries[num_locked_entries].tmpl = tmpl;
+        num_locked_entries++;
+    }
+    else {
+        for( i = 0; i < num_locked_entries && locked_entries[i].id != id; i++ ) {
+        }
+        if( i < num_locked_entries ) {
+            locked_entries[i] = locked_entries[--num_locked_entries];
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+static double run(int use_registry, unsigned int num_threads, double seconds, unsigned int updates_per_second)
+{
+    bip32_template_allocator_type allocator = { bench_alloc, bench_free, 0 };
+    static reader_arg_type reader_args[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    struct timespec interval;
+    bip32_template_type tmpl;
+    unsigned long num_paths = 0;
+    unsigned long num_updates = 0;
+    double start, elapsed;
+    unsigned int i;
+
+    bip32_template_registry_init(&registry, readers, num_threads, &allocator);
+    num_locked_entries = 0;
+    for( i = 0; i < NUM_TEMPLATES; i++ ) {
+        make_template(i, &tmpl);
+        bip32_template_registry_add(&registry, i, &tmpl);
+        locked_entries[num_locked_entries].id = i;
+        locked_entries[num_locked_entries].tmpl = tmpl;
+        num_locked_entries++;
+    }
+
+    atomic_store(&is_stopped, 0);
+    for( i = 0; i < num_threads; i++ ) {
+        reader_args[i].use_registry = use_registry;
+        reader_args[i].reader_num = i;
+        reader_args[i].num_matched = 0;
+        reader_args[i].num_paths = 0;
+        pthread_create(&threads[i], 0, reader_thread, &reader_args[i]);
+    }
+
+    interval.tv_sec = 0;
+    interval.tv_nsec = updates_per_second ? 1000000000L / updates_per_second : 10000000L;
+    start = now_seconds();
+    while( (elapsed = now_seconds() - start) < seconds ) {
+        /* Catch up with the schedule if the sleep took longer */
+        while( updates_per_second && num_updates < elapsed * updates_per_second ) {
+            update(use_registry, num_updates++);
+        }
+        nanosleep(&interval, 0);
+    }
+
+    atomic_store(&is_stopped, 1);
+    for( i = 0; i < num_threads; i++ ) {
+        pthread_join(threads[i], 0);
+        num_paths += reader_args[i].num_paths;
+    }
+    elapsed = now_seconds() - start;
+
+    bip32_template_registry_destroy(&registry);
+
+    printf("%-10s %12.0f matches/s  %8lu updates\n", use_registry ? "registry" : "mutex",
+           num_paths / elapsed, num_updates);
+
+    return num_paths / elapsed;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int num_threads = 4;
+    unsigned int updates_per_second = 1000;
+    double seconds = 1.0;
+    double mutex_rate, registry_rate;
+    int opt;
+
+    while( (opt = getopt(argc, argv, "t:s:u:")) != -1 ) {
+        switch( opt ) {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 's':
+                seconds = atof(optarg);
+                break;
+            case 'u':
+                updates_per_second = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t threads] [-s seconds] [-u updates_per_second]\n", argv[0]);
+                return 1;
+        }
+    }
+    if( num_threads < 1 || num_threads > MAX_THREADS ) {
+        fprintf(stderr, "number of threads must be from 1 to %d\n", MAX_THREADS);
+        return 1;
+    }
+
+    printf("%u reader threads, %u templates, %u updates/s, %.1f s\n",
+           num_threads, NUM_TEMPLATES, updates_per_second, seconds);
+
+    mutex_rate = run(0, num_threads, seconds, updates_per_second);
+    registry_rate = run(1, num_threads, seconds, updates_per_second);
+    printf("registry/mutex: %.2fx\n", registry_rate / mutex_rate);
+
+    return 0;
+}
@@ -0,0 +1,695 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Conformance runner over the binary test corpus produced by
+ * `test/gentest.py --binary` (see the format description there).
+ *
+ * The corpus is mmap'ed, and the cases are split between threads.
+ * Each available backend (parse, validate, onlypath parse, path parse,
+ * string matching) is run over the whole corpus.
+ *
+ * The runner can be built with any limits not smaller than the limits
+ * the corpus was generated for. With larger limits, the cases that expect
+ * BIP32_TEMPLATE_ERROR_PATH_TOO_LONG or BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG
+ * are skipped, because their expectations only hold for the corpus limits. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../bip32template.h"
+
+#define CORPUS_MAGIC "B32TCORP"
+#define CORPUS_VERSION 1
+#define CORPUS_HEADER_SIZE (8 + 5*4)
+#define CORPUS_MAX_ERROR_NAMES 256
+#define MAX_REPORTED_FAILURES 10
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    uint32_t max_sections;
+    uint32_t max_ranges_per_section;
+    uint32_t num_records;
+    uint32_t num_error_names;
+    bip32_template_error_type errors[CORPUS_MAX_ERROR_NAMES];
+    const unsigned char* offsets;
+    int limits_match;
+} corpus_type;
+
+typedef struct {
+    int is_error;
+    bip32_template_error_type error;
+    const char* str;
+    unsigned int len;
+    bip32_template_type tmpl;
+} testcase_type;
+
+typedef enum {
+    CHECK_FAILED,
+    CHECK_PASSED,
+    CHECK_SKIPPED
+} check_result_type;
+
+typedef check_result_type (*check_func_type)(const corpus_type*, const testcase_type*, char*, size_t);
+
+typedef struct {
+    const char* name;
+    check_func_type check;
+} backend_type;
+
+typedef struct {
+    const corpus_type* corpus;
+    const backend_type* backend;
+    uint32_t start;
+    uint32_t end;
+    unsigned long passed;
+    unsigned long failed;
+    unsigned long skipped;
+} worker_type;
+
+#define ERROR_NAME(name) { #name, BIP32_TEMPLATE_##name }
+
+static const struct {
+    const char* name;
+    bip32_template_error_type error;
+} error_names[] = {
+    ERROR_NAME(ERROR_GETCHAR_FAILED),
+    ERROR_NAME(ERROR_UNEXPECTED_HARDENED_MARKER),
+    ERROR_NAME(ERROR_UNEXPECTED_SPACE),
+    ERROR_NAME(ERROR_UNEXPECTED_CHAR),
+    ERROR_NAME(ERROR_UNEXPECTED_FINISH),
+    ERROR_NAME(ERROR_UNEXPECTED_SLASH),
+    ERROR_NAME(ERROR_INVALID_CHAR),
+    ERROR_NAME(ERROR_INDEX_TOO_BIG),
+    ERROR_NAME(ERROR_INDEX_HAS_LEADING_ZERO),
+    ERROR_NAME(ERROR_PATH_EMPTY),
+    ERROR_NAME(ERROR_PATH_TOO_LONG),
+    ERROR_NAME(ERROR_PATH_SECTION_TOO_LONG),
+    ERROR_NAME(ERROR_RANGES_INTERSECT),
+    ERROR_NAME(ERROR_RANGE_ORDER_BAD),
+    ERROR_NAME(ERROR_RANGE_EQUALS_WILDCARD),
+    ERROR_NAME(ERROR_SINGLE_INDEX_AS_RANGE),
+    ERROR_NAME(ERROR_RANGE_START_EQUALS_END),
+    ERROR_NAME(ERROR_RANGE_START_NEXT_TO_PREVIOUS),
+    ERROR_NAME(ERROR_GOT_HARDENED_AFTER_UNHARDENED),
+    ERROR_NAME(ERROR_DIGIT_EXPECTED),
+};
+
+static uint32_t read_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void corpus_fail(const char* msg)
+{
+    fprintf(stderr, "bad corpus: %s\n", msg);
+    exit(-1);
+}
+
+static void load_corpus(const char* file_name, corpus_type* corpus)
+{
+    struct stat st;
+    const unsigned char* p;
+    const unsigned char* end;
+    uint32_t i;
+    size_t ii;
+    int fd = open(file_name, O_RDONLY);
+
+    if( fd < 0 || fstat(fd, &st) != 0 ) {
+        perror(file_name);
+        exit(-1);
+    }
+    if( (size_t)st.st_size < CORPUS_HEADER_SIZE ) {
+        corpus_fail("file too short");
+    }
+    corpus->size = st.st_size;
+    corpus->data = mmap(0, corpus->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if( corpus->data == MAP_FAILED ) {
+        perror("mmap");
+        exit(-1);
+    }
+    close(fd);
+
+    p = corpus->data;
+    end = corpus->data + corpus->size;
+    if( memcmp(p, CORPUS_MAGIC, 8) != 0 ) {
+        corpus_fail("wrong magic");
+    }
+    if( read_u32(p+8) != CORPUS_VERSION ) {
+        corpus_fail("unsupported version");
+    }
+    corpus->max_sections = read_u32(p+12);
+    corpus->max_ranges_per_section = read_u32(p+16);
+    corpus->num_records = read_u32(p+20);
+    corpus->num_error_names = read_u32(p+24);
+    p += CORPUS_HEADER_SIZE;
+
+    if( corpus->num_error_names > CORPUS_MAX_ERROR_NAMES ) {
+        corpus_fail("too many error names");
+    }
+    for( i = 0; i < corpus->num_error_names; i++ ) {
+        int found = 0;
+        if( p >= end || p + 1 + p[0] > end ) {
+            corpus_fail("error names truncated");
+        }
+        for( ii = 0; ii < sizeof(error_names)/sizeof(error_names[0]); ii++ ) {
+            if( strlen(error_names[ii].name) == p[0]
+                && memcmp(error_names[ii].name, p+1, p[0]) == 0 )
+            {
+                corpus->errors[i] = error_names[ii].error;
+                found = 1;
+                break;
+            }
+        }
+        if( !found ) {
+            corpus_fail("unknown error name");
+        }
+        p += 1 + p[0];
+    }
+
+    if( (size_t)(end - p) / 4 < corpus->num_records ) {
+        corpus_fail("offsets truncated");
+    }
+    corpus->offsets = p;
+
+    if( corpus->max_sections > BIP32_TEMPLATE_MAX_SECTIONS
+        || corpus->max_ranges_per_section > BIP32_TEMPLATE_MAX_RANGES_PER_SECTION )
+    {
+        fprintf(stderr, "corpus was generated for limits %ux%u, "
+                        "the runner was built with smaller limits %ux%u\n",
+                corpus->max_sections, corpus->max_ranges_per_section,
+                BIP32_TEMPLATE_MAX_SECTIONS, BIP32_TEMPLATE_MAX_RANGES_PER_SECTION);
+        exit(-1);
+    }
+    corpus->limits_match = ( corpus->max_sections == BIP32_TEMPLATE_MAX_SECTIONS
+                             && corpus->max_ranges_per_section == BIP32_TEMPLATE_MAX_RANGES_PER_SECTION );
+}
+
+static void read_testcase(const corpus_type* corpus, uint32_t record_num, testcase_type* tc)
+{
+    const unsigned char* end = corpus->data + corpus->size;
+    const unsigned char* p = corpus->data + read_u32(corpus->offsets + 4*(size_t)record_num);
+    unsigned int i, ii;
+
+    if( p + 4 > end ) {
+        corpus_fail("record truncated");
+    }
+    tc->is_error = p[0];
+    if( tc->is_error && p[1] >= corpus->num_error_names ) {
+        corpus_fail("bad error name index");
+    }
+    tc->error = tc->is_error ? corpus->errors[p[1]] : BIP32_TEMPLATE_ERROR_UNDEFINED;
+    tc->len = p[2] | (p[3] << 8);
+    p += 4;
+    if( p + tc->len + 1 > end || p[tc->len] != 0 ) {
+        corpus_fail("record string truncated");
+    }
+    tc->str = (const char*)p;
+    p += tc->len + 1;
+
+    if( tc->is_error ) {
+        return;
+    }
+
+    if( p + 2 > end ) {
+        corpus_fail("record template truncated");
+    }
+    tc->tmpl.is_partial = p[0];
+    tc->tmpl.num_sections = p[1];
+    p += 2;
+    if( tc->tmpl.num_sections > corpus->max_sections ) {
+        corpus_fail("too many sections in record template");
+    }
+    for( i = 0; i < tc->tmpl.num_sections; i++ ) {
+        if( p >= end || p[0] > corpus->max_ranges_per_section || p + 1 + 8*p[0] > end ) {
+            corpus_fail("bad section in record template");
+        }
+        tc->tmpl.sections[i].num_ranges = p[0];
+        p++;
+        for( ii = 0; ii < tc->tmpl.sections[i].num_ranges; ii++ ) {
+            tc->tmpl.sections[i].ranges[ii].range_start = read_u32(p);
+            tc->tmpl.sections[i].ranges[ii].range_end = read_u32(p+4);
+            p += 8;
+        }
+    }
+}
+
+static int templates_equal(const bip32_template_type* a, const bip32_template_type* b)
+{
+    int i, ii;
+
+    if( a->is_partial != b->is_partial || a->num_sections != b->num_sections ) {
+        return 0;
+    }
+    for( i = 0; i < a->num_sections; i++ ) {
+        if( a->sections[i].num_ranges != b->sections[i].num_ranges ) {
+            return 0;
+        }
+        for( ii = 0; ii < a->sections[i].num_ranges; ii++ ) {
+            if( a->sections[i].ranges[ii].range_start != b->sections[i].ranges[ii].range_start
+                || a->sections[i].ranges[ii].range_end != b->sections[i].ranges[ii].range_end )
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static int is_plain_path_string(const testcase_type* tc)
+{
+    return !strchr(tc->str, '{') && !strchr(tc->str, '*');
+}
+
+/* Same rules as in test/test.c */
+static unsigned int expected_error_pos(const testcase_type* tc)
+{
+    unsigned int expected_pos = tc->len;
+
+    if( tc->error == BIP32_TEMPLATE_ERROR_UNEXPECTED_FINISH
+        || tc->error == BIP32_TEMPLATE_ERROR_PATH_EMPTY )
+    {
+        expected_pos++;
+    }
+    else if( tc->error == BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH ) {
+        if( expected_pos > 1 && tc->str[expected_pos-2] != '/' ) {
+            expected_pos++;
+        }
+    }
+    else if( tc->error == BIP32_TEMPLATE_ERROR_PATH_TOO_LONG ) {
+        if( tc->str[expected_pos-1] == '\'' || tc->str[expected_pos-1] == 'h' ) {
+            expected_pos++;
+        }
+    }
+
+    return expected_pos;
+}
+
+static bip32_template_format_mode_type expected_mode(const testcase_type* tc)
+{
+    if( tc->error == BIP32_TEMPLATE_ERROR_RANGE_START_NEXT_TO_PREVIOUS ) {
+        return BIP32_TEMPLATE_FORMAT_UNAMBIGOUS;
+    }
+    return BIP32_TEMPLATE_FORMAT_AMBIGOUS;
+}
+
+static int is_limit_dependent(const corpus_type* corpus, const testcase_type* tc)
+{
+    return ( !corpus->limits_match
+             && ( tc->error == BIP32_TEMPLATE_ERROR_PATH_TOO_LONG
+                  || tc->error == BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG ) );
+}
+
+static check_result_type check_error_result(const testcase_type* tc,
+                                            int result, bip32_template_error_type error, unsigned int last_pos,
+                                            char* msg, size_t msg_size)
+{
+    unsigned int expected_pos = expected_error_pos(tc);
+
+    if( result ) {
+        snprintf(msg, msg_size, "succeeded, expected \"%s\"", bip32_template_error_to_string(tc->error));
+        return CHECK_FAILED;
+    }
+    if( error != tc->error ) {
+        snprintf(msg, msg_size, "failed with \"%s\", expected \"%s\"",
+                 bip32_template_error_to_string(error), bip32_template_error_to_string(tc->error));
+        return CHECK_FAILED;
+    }
+    if( last_pos != expected_pos ) {
+        snprintf(msg, msg_size, "failed at position %u, expected %u", last_pos, expected_pos);
+        return CHECK_FAILED;
+    }
+
+    return CHECK_PASSED;
+}
+
+static check_result_type check_parse(const corpus_type* corpus, const testcase_type* tc,
+                                     char* msg, size_t msg_size)
+{
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    int result;
+
+    if( is_limit_dependent(corpus, tc) ) {
+        return CHECK_SKIPPED;
+    }
+
+    result = bip32_template_parse_string(tc->str, expected_mode(tc), &tmpl, &error, &last_pos);
+
+    if( tc->is_error ) {
+        return check_error_result(tc, result, error, last_pos, msg, msg_size);
+    }
+
+    if( !result ) {
+        snprintf(msg, msg_size, "failed with \"%s\" at position %u",
+                 bip32_template_error_to_string(error), last_pos);
+        return CHECK_FAILED;
+    }
+    if( last_pos != tc->len + 1 ) {
+        snprintf(msg, msg_size, "succeeded at position %u, expected %u", last_pos, tc->len + 1);
+        return CHECK_FAILED;
+    }
+    if( !templates_equal(&tmpl, &tc->tmpl) ) {
+        snprintf(msg, msg_size, "resulting template differs from the corpus template");
+        return CHECK_FAILED;
+    }
+
+    return CHECK_PASSED;
+}
+
+static check_result_type check_validate(const corpus_type* corpus, const testcase_type* tc,
+                                        char* msg, size_t msg_size)
+{
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    int result;
+
+    if( is_limit_dependent(corpus, tc) ) {
+        return CHECK_SKIPPED;
+    }
+
+    result = bip32_template_validate_string(tc->str, expected_mode(tc), &error, &last_pos);
+
+    if( tc->is_error ) {
+        return check_error_result(tc, result, error, last_pos, msg, msg_size);
+    }
+
+    if( !result || last_pos != tc->len + 1 ) {
+        snprintf(msg, msg_size, "returned %d with \"%s\" at position %u",
+                 result, bip32_template_error_to_string(error), last_pos);
+        return CHECK_FAILED;
+    }
+
+    return CHECK_PASSED;
+}
+
+static check_result_type check_onlypath(const corpus_type* corpus, const testcase_type* tc,
+                                        char* msg, size_t msg_size)
+{
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    int result;
+
+    if( is_limit_dependent(corpus, tc) ) {
+        return CHECK_SKIPPED;
+    }
+
+    result = bip32_template_parse_string(tc->str, BIP32_TEMPLATE_FORMAT_ONLYPATH, &tmpl, &error, &last_pos);
+
+    if( !is_plain_path_string(tc) ) {
+        if( result ) {
+            snprintf(msg, msg_size, "template string succeeded with onlypath mode");
+            return CHECK_FAILED;
+        }
+        return CHECK_PASSED;
+    }
+
+    if( tc->is_error ) {
+        return check_error_result(tc, result, error, last_pos, msg, msg_size);
+    }
+
+    if( !result ) {
+        snprintf(msg, msg_size, "failed with \"%s\" at position %u",
+                 bip32_template_error_to_string(error), last_pos);
+        return CHECK_FAILED;
+    }
+    if( !templates_equal(&tmpl, &tc->tmpl) ) {
+        snprintf(msg, msg_size, "resulting template differs from the corpus template");
+        return CHECK_FAILED;
+    }
+
+    return CHECK_PASSED;
+}
+
+static check_result_type check_path_parse(const corpus_type* corpus, const testcase_type* tc,
+                                          char* msg, size_t msg_size)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int path_len = BIP32_TEMPLATE_MAX_SECTIONS;
+    unsigned int is_partial;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    int result;
+    int i;
+
+    if( is_limit_dependent(corpus, tc) || !is_plain_path_string(tc) ) {
+        return CHECK_SKIPPED;
+    }
+
+    result = bip32_path_parse(tc->str, tc->len, path, &path_len, &is_partial, &error, &last_pos);
+
+    if( tc->is_error ) {
+        return check_error_result(tc, result, error, last_pos, msg, msg_size);
+    }
+
+    if( !result ) {
+        snprintf(msg, msg_size, "failed with \"%s\" at position %u",
+                 bip32_template_error_to_string(error), last_pos);
+        return CHECK_FAILED;
+    }
+    if( path_len != tc->tmpl.num_sections || is_partial != tc->tmpl.is_partial ) {
+        snprintf(msg, msg_size, "path has wrong length or is_partial flag");
+        return CHECK_FAILED;
+    }
+    for( i = 0; i < tc->tmpl.num_sections; i++ ) {
+        if( path[i] != tc->tmpl.sections[i].ranges[0].range_start ) {
+            snprintf(msg, msg_size, "path index %d differs from the corpus template", i);
+            return CHECK_FAILED;
+        }
+    }
+
+    return CHECK_PASSED;
+}
+
+static check_result_type check_match_string(const corpus_type* corpus, const testcase_type* tc,
+                                            char* msg, size_t msg_size)
+{
+    bip32_template_type match_all;
+    char path_str[BIP32_TEMPLATE_MAX_SECTIONS*12+3];
+    size_t n = 0;
+    int i;
+
+    if( tc->is_error ) {
+        if( is_limit_dependent(corpus, tc) || !is_plain_path_string(tc) ) {
+            return CHECK_SKIPPED;
+        }
+        match_all.is_partial = 1;
+        for( i = 0; i < BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
+            match_all.sections[i].num_ranges = 1;
+            match_all.sections[i].ranges[0].range_start = 0;
+            match_all.sections[i].ranges[0].range_end = 0xFFFFFFFF;
+        }
+        for( i = 1; i <= BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
+            match_all.num_sections = i;
+            if( bip32_template_match_string(&match_all, tc->str, tc->len) ) {
+                snprintf(msg, msg_size, "invalid path matched as a string");
+                return CHECK_FAILED;
+            }
+        }
+        return CHECK_PASSED;
+    }
+
+    /* Make the path from the last index of the last range of each section */
+    if( !tc->tmpl.is_partial ) {
+        n += snprintf(path_str+n, sizeof(path_str)-n, "m/");
+    }
+    for( i = 0; i < tc->tmpl.num_sections; i++ ) {
+        const bip32_template_section_type* section_p = &tc->tmpl.sections[i];
+        uint32_t index = section_p->ranges[section_p->num_ranges-1].range_end;
+        n += snprintf(path_str+n, sizeof(path_str)-n, "%s%u%s", i > 0 ? "/" : "",
+                      index & 0x7FFFFFFF, index >= 0x80000000 ? "h" : "");
+    }
+
+    if( !bip32_template_match_string(&tc->tmpl, path_str, n) ) {
+        snprintf(msg, msg_size, "path \"%s\" did not match as a string", path_str);
+        return CHECK_FAILED;
+    }
+
+    return CHECK_PASSED;
+}
+
+static const backend_type backends[] = {
+    { "parse", check_parse },
+    { "validate", check_validate },
+    { "onlypath", check_onlypath },
+    { "path_parse", check_path_parse },
+    { "match_string", check_match_string },
+};
+
+static void* worker_run(void* arg)
+{
+    worker_type* worker = arg;
+    testcase_type tc;
+    char msg[256];
+    uint32_t i;
+
+    for( i = worker->start; i < worker->end; i++ ) {
+        read_testcase(worker->corpus, i, &tc);
+        switch( worker->backend->check(worker->corpus, &tc, msg, sizeof(msg)) ) {
+            case CHECK_PASSED:
+                worker->passed++;
+                break;
+            case CHECK_SKIPPED:
+                worker->skipped++;
+                break;
+            case CHECK_FAILED:
+                if( worker->failed < MAX_REPORTED_FAILURES ) {
+                    fprintf(stderr, "%s: %s-case %u (\"%s\"): %s\n",
+                            worker->backend->name, tc.is_error ? "error" : "success",
+                            i, tc.str, msg);
+                }
+                worker->failed++;
+                break;
+        }
+    }
+
+    return 0;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long run_backend(const corpus_type* corpus, const backend_type* backend,
+                                 unsigned int num_threads)
+{
+    worker_type* workers = calloc(num_threads, sizeof(worker_type));
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    unsigned long passed = 0, failed = 0, skipped = 0;
+    uint32_t per_thread = (corpus->num_records + num_threads - 1) / num_threads;
+    double start = now_seconds();
+    unsigned int i;
+
+    if( !workers || !threads ) {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    for( i = 0; i < num_threads; i++ ) {
+        workers[i].corpus = corpus;
+        workers[i].backend = backend;
+        workers[i].start = i * per_thread < corpus->num_records ? i * per_thread : corpus->num_records;
+        workers[i].end = workers[i].start + per_thread < corpus->num_records
+                            ? workers[i].start + per_thread : corpus->num_records;
+        if( pthread_create(&threads[i], 0, worker_run, &workers[i]) != 0 ) {
+            fprintf(stderr, "cannot create thread\n");
+            exit(-1);
+        }
+    }
+    for( i = 0; i < num_threads; i++ ) {
+        pthread_join(threads[i], 0);
+        passed += workers[i].passed;
+        failed += workers[i].failed;
+        skipped += workers[i].skipped;
+    }
+
+    printf("  %-14s %8lu passed %8lu failed %8lu skipped  %7.3f s\n",
+           backend->name, passed, failed, skipped, now_seconds() - start);
+
+    free(workers);
+    free(threads);
+
+    return failed;
+}
+
+static void usage(const char* prog)
+{
+    size_t i;
+
+    fprintf(stderr, "usage: %s [-j threads] [-b backend]... /path/to/test_data.bin\n", prog);
+    fprintf(stderr, "backends:");
+    for( i = 0; i < sizeof(backends)/sizeof(backends[0]); i++ ) {
+        fprintf(stderr, " %s", backends[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+    corpus_type corpus;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int selected[sizeof(backends)/sizeof(backends[0])] = { 0 };
+    int any_selected = 0;
+    unsigned long failed = 0;
+    size_t i;
+    int opt;
+
+    while( (opt = getopt(argc, argv, "j:b:")) != -1 ) {
+        switch( opt ) {
+            case 'j':
+                num_threads = atol(optarg);
+                break;
+            case 'b':
+                for( i = 0; i < sizeof(backends)/sizeof(backends[0]); i++ ) {
+                    if( strcmp(optarg, backends[i].name) == 0 ) {
+                        selected[i] = 1;
+                        any_selected = 1;
+                        break;
+                    }
+                }
+                if( i == sizeof(backends)/sizeof(backends[0]) ) {
+                    usage(argv[0]);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if( optind != argc - 1 || num_threads < 1 ) {
+        usage(argv[0]);
+    }
+
+    load_corpus(argv[optind], &corpus);
+
+    printf("%u cases, corpus limits %ux%u, build limits %ux%u, %ld threads\n",
+           corpus.num_records, corpus.max_sections, corpus.max_ranges_per_section,
+           BIP32_TEMPLATE_MAX_SECTIONS, BIP32_TEMPLATE_MAX_RANGES_PER_SECTION, num_threads);
+
+    for( i = 0; i < sizeof(backends)/sizeof(backends[0]); i++ ) {
+        if( !any_selected || selected[i] ) {
+            failed += run_backend(&corpus, &backends[i], num_threads);
+        }
+    }
+
+    munmap((void*)corpus.data, corpus.size);
+
+    if( failed ) {
+        fprintf(stderr, "%lu checks failed\n", failed);
+        return -1;
+    }
+
+    return 0;
+}
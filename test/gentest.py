@@ -22,15 +22,87 @@
 
 import sys
 import json
+import struct
+
+# Binary corpus format, used by test/conformance.c (all integers are little-endian):
+#
+#   header:  magic b"B32TCORP", u32 version, u32 max_sections, u32 max_ranges_per_section,
+#            u32 num_records, u32 num_error_names
+#   error names: for each name: u8 name_len, name bytes ("ERROR_INDEX_TOO_BIG", ...)
+#   offsets: u32 offset of each record from the start of the file
+#   records: u8 kind (0 = success, 1 = error), u8 error name index (0 for success),
+#            u16 string_len, string bytes followed by zero byte,
+#            and for success cases: u8 is_partial, u8 num_sections,
+#            and for each section: u8 num_ranges, and u32 range_start, u32 range_end for each range
+#
+# max_sections and max_ranges_per_section are the limits the corpus was generated for,
+# they match the limits used to build test/test.
+
+BINARY_CORPUS_MAGIC = b"B32TCORP"
+BINARY_CORPUS_VERSION = 1
+CORPUS_MAX_SECTIONS = 3
+CORPUS_MAX_RANGES_PER_SECTION = 4
+
+
+def write_binary_corpus(test_data, out):
+    error_states = [state for state in test_data.keys()
+                    if state != 'normal_finish']
+    records = []
+
+    for tmpl_str, tmpl_data_str in test_data['normal_finish']:
+        tmpl = json.loads(tmpl_data_str)
+        is_partial = int(not tmpl_str.startswith('m/'))
+        tmpl_bytes = tmpl_str.encode()
+        rec = struct.pack('<BBH', 0, 0, len(tmpl_bytes)) + tmpl_bytes + b'\0'
+        rec += struct.pack('<BB', is_partial, len(tmpl))
+        for section in tmpl:
+            rec += struct.pack('<B', len(section))
+            for r in section:
+                rec += struct.pack('<II', r[0], r[1])
+        records.append(rec)
+
+    for name_index, state in enumerate(error_states):
+        for tmpl_str in test_data[state]:
+            tmpl_bytes = tmpl_str.encode()
+            records.append(struct.pack('<BBH', 1, name_index, len(tmpl_bytes))
+                           + tmpl_bytes + b'\0')
+
+    header = BINARY_CORPUS_MAGIC
+    header += struct.pack('<IIIII', BINARY_CORPUS_VERSION,
+                          CORPUS_MAX_SECTIONS, CORPUS_MAX_RANGES_PER_SECTION,
+                          len(records), len(error_states))
+    for state in error_states:
+        name = state.upper().encode()
+        header += struct.pack('<B', len(name)) + name
+
+    offset = len(header) + 4 * len(records)
+    offsets = b''
+    for rec in records:
+        offsets += struct.pack('<I', offset)
+        offset += len(rec)
+
+    out.write(header)
+    out.write(offsets)
+    for rec in records:
+        out.write(rec)
+
 
 if __name__ == '__main__':
-    if len(sys.argv) < 2:
-        sys.stderr.write(f"usage: {sys.argv[0]} /path/to/test_data.json\n")
+    args = sys.argv[1:]
+    want_binary = '--binary' in args
+    args = [a for a in args if a != '--binary']
+
+    if len(args) < 1:
+        sys.stderr.write(f"usage: {sys.argv[0]} [--binary] /path/to/test_data.json\n")
         sys.exit(-1)
 
-    with open(sys.argv[1]) as f:
+    with open(args[0]) as f:
         test_data = json.load(f)
 
+    if want_binary:
+        write_binary_corpus(test_data, sys.stdout.buffer)
+        sys.exit(0)
+
     for state in test_data.keys():
         if state == 'normal_finish':
             print("testcase_success_type testcase_success[] = {")
@@ -161,6 +161,409 @@ static void show_path(u_int32_t* path_p, u_int len)
     }
 }
 
+static void format_path(uint32_t* path_p, unsigned int len, int is_partial, char* buf, size_t buf_size)
+{
+    unsigned int i;
+    size_t n = 0;
+    char marker = (rand() & 1) ? 'h' : '\'';
+
+    buf[0] = 0;
+    if( !is_partial ) {
+        n += snprintf(buf+n, buf_size-n, "m/");
+    }
+    for( i = 0; i < len; i++ ) {
+        if( path_p[i] >= 0x80000000 ) {
+            n += snprintf(buf+n, buf_size-n, "%u%c", path_p[i] ^ 0x80000000, marker);
+        }
+        else {
+            n += snprintf(buf+n, buf_size-n, "%u", path_p[i]);
+        }
+        if( i < len-1 ) {
+            n += snprintf(buf+n, buf_size-n, "/");
+        }
+    }
+}
+
+static void check_match_string(int case_num, const char* tmpl_str, bip32_template_type* tmpl,
+                               uint32_t* path_p, unsigned int path_len)
+{
+    char path_str[BIP32_TEMPLATE_MAX_SECTIONS*12+3];
+
+    format_path(path_p, path_len, tmpl->is_partial, path_str, sizeof(path_str));
+    if( bip32_template_match_string(tmpl, path_str, strlen(path_str))
+        != bip32_template_match(tmpl, path_p, path_len) )
+    {
+        fprintf(stderr, "success-case %d (%s) match_string result differs from match for \"%s\"\n",
+                case_num, tmpl_str, path_str);
+        show_template(tmpl);
+        exit(-1);
+    }
+}
+
+static void check_path_parse(const char* case_desc, const char* tmpl_str)
+{
+    bip32_template_type tmpl_onlypath;
+    bip32_template_error_type error_onlypath, error;
+    unsigned int last_pos_onlypath, last_pos;
+    uint32_t onlypath_path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int onlypath_path_len = BIP32_TEMPLATE_MAX_SECTIONS;
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int path_len = BIP32_TEMPLATE_MAX_SECTIONS;
+    unsigned int is_partial;
+    int result_onlypath, result;
+    unsigned int i;
+
+    result_onlypath = bip32_template_parse_string(tmpl_str, BIP32_TEMPLATE_FORMAT_ONLYPATH,
+                                                  &tmpl_onlypath, &error_onlypath, &last_pos_onlypath);
+    result = bip32_path_parse(tmpl_str, strlen(tmpl_str), path, &path_len, &is_partial,
+                              &error, &last_pos);
+    if( result != result_onlypath ) {
+        fprintf(stderr, "%s (\"%s\"): path_parse result differs from onlypath result\n",
+                case_desc, tmpl_str);
+        exit(-1);
+    }
+    if( !result ) {
+        if( error != error_onlypath || last_pos != last_pos_onlypath ) {
+            fprintf(stderr, "%s (\"%s\"): path_parse failed with \"%s\" at %u, "
+                            "but onlypath failed with \"%s\" at %u\n",
+                    case_desc, tmpl_str, bip32_template_error_to_string(error), last_pos,
+                    bip32_template_error_to_string(error_onlypath), last_pos_onlypath);
+            exit(-1);
+        }
+        return;
+    }
+    if( !bip32_template_to_path(&tmpl_onlypath, onlypath_path, &onlypath_path_len) ) {
+        fprintf(stderr, "%s (\"%s\"): template_to_path failed unexpectedly\n", case_desc, tmpl_str);
+        exit(-1);
+    }
+    if( path_len != onlypath_path_len || is_partial != tmpl_onlypath.is_partial ) {
+        fprintf(stderr, "%s (\"%s\"): path_parse result has wrong length or is_partial flag\n",
+                case_desc, tmpl_str);
+        exit(-1);
+    }
+    for( i = 0; i < path_len; i++ ) {
+        if( path[i] != onlypath_path[i] ) {
+            fprintf(stderr, "%s (\"%s\"): path_parse index %u differs from onlypath\n",
+                    case_desc, tmpl_str, i);
+            exit(-1);
+        }
+    }
+}
+
+static void check_validate(const char* case_desc, const char* tmpl_str, bip32_template_format_mode_type mode)
+{
+    bip32_template_type tmpl;
+    bip32_template_error_type error_parse, error;
+    unsigned int last_pos_parse, last_pos;
+    int result_parse, result;
+
+    result_parse = bip32_template_parse_string(tmpl_str, mode, &tmpl, &error_parse, &last_pos_parse);
+    result = bip32_template_validate_string(tmpl_str, mode, &error, &last_pos);
+    if( result != result_parse || error != error_parse || last_pos != last_pos_parse ) {
+        fprintf(stderr, "%s (\"%s\"): validate result %d (\"%s\" at %u) differs from "
+                        "parse result %d (\"%s\" at %u) in mode %d\n",
+                case_desc, tmpl_str,
+                result, bip32_template_error_to_string(error), last_pos,
+                result_parse, bip32_template_error_to_string(error_parse), last_pos_parse, mode);
+        exit(-1);
+    }
+}
+
+/* Reference for bip32_template_next_match(): depth-first search with linear scan of the ranges */
+static int ref_next_match(bip32_template_type* tmpl, uint32_t* path_p, uint32_t* out_p, int i, int is_tight)
+{
+    int r;
+    uint64_t v;
+    bip32_template_section_type* section_p;
+
+    if( i == tmpl->num_sections ) {
+        return 1;
+    }
+    section_p = &tmpl->sections[i];
+    if( !is_tight ) {
+        out_p[i] = section_p->ranges[0].range_start;
+        return ref_next_match(tmpl, path_p, out_p, i+1, 0);
+    }
+    for( r = 0; r < section_p->num_ranges; r++ ) {
+        if( path_p[i] >= section_p->ranges[r].range_start && path_p[i] <= section_p->ranges[r].range_end ) {
+            out_p[i] = path_p[i];
+            if( ref_next_match(tmpl, path_p, out_p, i+1, 1) ) {
+                return 1;
+            }
+        }
+    }
+    for( r = 0; r < section_p->num_ranges; r++ ) {
+        v = (uint64_t)path_p[i] + 1;
+        if( v < section_p->ranges[r].range_start ) {
+            v = section_p->ranges[r].range_start;
+        }
+        if( v <= section_p->ranges[r].range_end ) {
+            out_p[i] = (uint32_t)v;
+            return ref_next_match(tmpl, path_p, out_p, i+1, 0);
+        }
+    }
+    return 0;
+}
+
+static uint32_t random_nearby_index(bip32_template_section_type* section_p)
+{
+    bip32_template_section_range_type* range_p = &section_p->ranges[rand() % section_p->num_ranges];
+
+    switch( rand() % 6 ) {
+        case 0: return range_p->range_start - 1;
+        case 1: return range_p->range_start;
+        case 2: return range_p->range_end;
+        case 3: return range_p->range_end + 1;
+        case 4: return (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+        default: return range_p->range_start ^ 0x80000000;
+    }
+}
+
+static void check_next_match(int case_num, const char* tmpl_str, bip32_template_type* tmpl)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t out[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t ref_out[BIP32_TEMPLATE_MAX_SECTIONS];
+    int result, ref_result;
+    int round, i;
+
+    for( round = 0; round < 8; round++ ) {
+        for( i = 0; i < tmpl->num_sections; i++ ) {
+            path[i] = random_nearby_index(&tmpl->sections[i]);
+        }
+        result = bip32_template_next_match(tmpl, path, out);
+        ref_result = ref_next_match(tmpl, path, ref_out, 0, 1);
+        if( result != ref_result
+            || ( result && memcmp(out, ref_out, tmpl->num_sections * sizeof(out[0])) != 0 )
+            || ( result && !bip32_template_match(tmpl, out, tmpl->num_sections) ) )
+        {
+            fprintf(stderr, "success-case %d (%s) next_match differs from the reference for path ",
+                    case_num, tmpl_str);
+            show_path(path, tmpl->num_sections);
+            fprintf(stderr, "\n");
+            show_template(tmpl);
+            exit(-1);
+        }
+    }
+}
+
+static int section_has_index(const bip32_template_section_type* section_p, uint32_t index)
+{
+    int i;
+
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        if( index >= section_p->ranges[i].range_start && index <= section_p->ranges[i].range_end ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The ranges are sorted, disjoint, not next to each other, and all hardened or all unhardened */
+static int section_is_normalized(const bip32_template_section_type* section_p)
+{
+    uint32_t hardened_bit;
+    int i;
+
+    if( section_p->num_ranges == 0 || section_p->num_ranges > BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ) {
+        return 0;
+    }
+    hardened_bit = section_p->ranges[0].range_start & 0x80000000;
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        if( (section_p->ranges[i].range_start & 0x80000000) != hardened_bit
+            || (section_p->ranges[i].range_end & 0x80000000) != hardened_bit
+            || section_p->ranges[i].range_start > section_p->ranges[i].range_end )
+        {
+            return 0;
+        }
+        if( i > 0 && section_p->ranges[i-1].range_end + 1 >= section_p->ranges[i].range_start ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Add or remove random ranges near the existing ones and check the result
+ * at every index where it can differ from the original section */
+static void check_section_edits(int case_num, const char* tmpl_str, bip32_template_type* tmpl)
+{
+    bip32_template_type edited;
+    bip32_template_section_type* section_p;
+    bip32_template_error_type error;
+    uint32_t hardened_bit, start, end, v;
+    uint32_t points[4*BIP32_TEMPLATE_MAX_RANGES_PER_SECTION + 4];
+    unsigned int num_points, section, p;
+    int round, i, is_add, result, expected;
+
+    for( round = 0; round < 8; round++ ) {
+        section = rand() % tmpl->num_sections;
+        section_p = &tmpl->sections[section];
+        hardened_bit = section_p->ranges[0].range_start & 0x80000000;
+        start = random_nearby_index(section_p) & 0x7FFFFFFF;
+        end = random_nearby_index(section_p) & 0x7FFFFFFF;
+        if( start > end ) {
+            v = start;
+            start = end;
+            end = v;
+        }
+        is_add = rand() % 2;
+
+        edited = *tmpl;
+        if( is_add ) {
+            result = bip32_template_section_add_range(&edited, section, start, end, &error);
+        }
+        else {
+            result = bip32_template_section_remove_range(&edited, section, start, end, &error);
+        }
+
+        if( !result ) {
+            if( ( error != BIP32_TEMPLATE_ERROR_PATH_SECTION_TOO_LONG
+                  && ( is_add || error != BIP32_TEMPLATE_ERROR_PATH_EMPTY ) )
+                || memcmp(&edited, tmpl, sizeof(edited)) != 0 )
+            {
+                fprintf(stderr, "success-case %d (%s) %s of %u-%u in section %u failed: %s\n",
+                        case_num, tmpl_str, is_add ? "adding" : "removing", start, end, section,
+                        bip32_template_error_to_string(error));
+                exit(-1);
+            }
+            continue;
+        }
+
+        num_points = 0;
+        points[num_points++] = start - 1;
+        points[num_points++] = start;
+        points[num_points++] = end;
+        points[num_points++] = end + 1;
+        for( i = 0; i < section_p->num_ranges; i++ ) {
+            points[num_points++] = (section_p->ranges[i].range_start & 0x7FFFFFFF) - 1;
+            points[num_points++] = section_p->ranges[i].range_start & 0x7FFFFFFF;
+            points[num_points++] = section_p->ranges[i].range_end & 0x7FFFFFFF;
+            points[num_points++] = (section_p->ranges[i].range_end & 0x7FFFFFFF) + 1;
+        }
+
+        for( p = 0; p < num_points; p++ ) {
+            v = points[p] & 0x7FFFFFFF;
+            expected = section_has_index(section_p, v | hardened_bit);
+            if( v >= start && v <= end ) {
+                expected = is_add;
+            }
+            if( section_has_index(&edited.sections[section], v | hardened_bit) != expected ) {
+                break;
+            }
+        }
+
+        if( p < num_points || !section_is_normalized(&edited.sections[section])
+            || memcmp(edited.sections, tmpl->sections, section * sizeof(edited.sections[0])) != 0
+            || memcmp(&edited.sections[section+1], &tmpl->sections[section+1],
+                      (tmpl->num_sections - section - 1) * sizeof(edited.sections[0])) != 0 )
+        {
+            fprintf(stderr, "success-case %d (%s) %s of %u-%u in section %u gave wrong result\n",
+                    case_num, tmpl_str, is_add ? "adding" : "removing", start, end, section);
+            show_template(&edited);
+            exit(-1);
+        }
+    }
+}
+
+static void check_template_edit_errors(void)
+{
+    bip32_template_type tmpl, expected_tmpl;
+    bip32_template_error_type error;
+
+    if( !bip32_template_parse_string("m/1'/{2-3}", BIP32_TEMPLATE_FORMAT_AMBIGOUS, &tmpl, &error, 0) ) {
+        fprintf(stderr, "cannot parse the template to edit\n");
+        exit(-1);
+    }
+
+    /* Widening the last section, as gap-limit discovery does */
+    if( !bip32_template_section_add_range(&tmpl, 1, 4, 19, &error)
+        || !bip32_template_section_add_range(&tmpl, 1, 0, 39, &error)
+        || !bip32_template_section_remove_range(&tmpl, 1, 10, 10, &error)
+        || !bip32_template_section_set_hardened(&tmpl, 0, 0, &error)
+        || !bip32_template_append_section(&tmpl, 0, 0x7FFFFFFF, 0, &error) )
+    {
+        fprintf(stderr, "template edit failed: %s\n", bip32_template_error_to_string(error));
+        exit(-1);
+    }
+    bip32_template_parse_string("m/1/{0-9,11-39}/*", BIP32_TEMPLATE_FORMAT_AMBIGOUS, &expected_tmpl, &error, 0);
+    if( !templates_equal(&tmpl, &expected_tmpl) ) {
+        fprintf(stderr, "edited template differs from m/1/{0-9,11-39}/*\n");
+        show_template(&tmpl);
+        exit(-1);
+    }
+
+    if( bip32_template_section_add_range(&tmpl, 3, 0, 1, &error)
+        || error != BIP32_TEMPLATE_ERROR_PATH_TOO_LONG )
+    {
+        fprintf(stderr, "edit of a missing section succeeded\n");
+        exit(-1);
+    }
+    if( bip32_template_section_remove_range(&tmpl, 3, 0, 1, &error)
+        || error != BIP32_TEMPLATE_ERROR_PATH_TOO_LONG )
+    {
+        fprintf(stderr, "removal from a missing section succeeded\n");
+        exit(-1);
+    }
+    if( bip32_template_section_set_hardened(&tmpl, 3, 1, &error)
+        || error != BIP32_TEMPLATE_ERROR_PATH_TOO_LONG )
+    {
+        fprintf(stderr, "hardening of a missing section succeeded\n");
+        exit(-1);
+    }
+    /* error_p is optional */
+    if( bip32_template_section_add_range(&tmpl, 3, 0, 1, 0)
+        || bip32_template_section_remove_range(&tmpl, 3, 0, 1, 0)
+        || bip32_template_section_set_hardened(&tmpl, 3, 1, 0)
+        || bip32_template_append_section(&tmpl, 5, 0, 0, 0) )
+    {
+        fprintf(stderr, "edit without error_p succeeded\n");
+        exit(-1);
+    }
+    if( bip32_template_section_add_range(&tmpl, 1, 5, 0x80000000, &error)
+        || error != BIP32_TEMPLATE_ERROR_INDEX_TOO_BIG )
+    {
+        fprintf(stderr, "adding too big index succeeded\n");
+        exit(-1);
+    }
+    if( bip32_template_section_remove_range(&tmpl, 1, 5, 4, &error) || error != BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD ) {
+        fprintf(stderr, "removing the range in the wrong order succeeded\n");
+        exit(-1);
+    }
+    if( bip32_template_section_remove_range(&tmpl, 0, 0, 5, &error) || error != BIP32_TEMPLATE_ERROR_PATH_EMPTY ) {
+        fprintf(stderr, "removing all indexes of the section succeeded\n");
+        exit(-1);
+    }
+    if( bip32_template_section_set_hardened(&tmpl, 1, 1, &error)
+        || error != BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED )
+    {
+        fprintf(stderr, "hardening the section after unhardened one succeeded\n");
+        exit(-1);
+    }
+    if( BIP32_TEMPLATE_MAX_SECTIONS == 3
+        && ( bip32_template_append_section(&tmpl, 0, 0, 0, &error) || error != BIP32_TEMPLATE_ERROR_PATH_TOO_LONG ) )
+    {
+        fprintf(stderr, "appending section over the limit succeeded\n");
+        exit(-1);
+    }
+    if( !templates_equal(&tmpl, &expected_tmpl) ) {
+        fprintf(stderr, "failed edits changed the template\n");
+        exit(-1);
+    }
+}
+
+static void make_match_all_template(bip32_template_type* tmpl, unsigned int num_sections)
+{
+    unsigned int i;
+
+    tmpl->is_partial = 1;
+    tmpl->num_sections = num_sections;
+    for( i = 0; i < num_sections; i++ ) {
+        tmpl->sections[i].num_ranges = 1;
+        tmpl->sections[i].ranges[0].range_start = 0;
+        tmpl->sections[i].ranges[0].range_end = 0xFFFFFFFF;
+    }
+}
+
 int main(int argc, char** argv)
 {
     (void)argc;
@@ -174,6 +577,11 @@ int main(int argc, char** argv)
     bip32_template_format_mode_type mode;
     uint32_t test_path[BIP32_TEMPLATE_MAX_SECTIONS];
     unsigned int test_path_len;
+    bip32_template_type match_all_templates[BIP32_TEMPLATE_MAX_SECTIONS];
+
+    for( i = 0; i < BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
+        make_match_all_template(&match_all_templates[i], i+1);
+    }
 
     for( i = 0; i < (int)(sizeof(testcase_success)/sizeof(testcase_success[0])); i++ ) {
         tcs = &testcase_success[i];
@@ -201,6 +609,7 @@ int main(int argc, char** argv)
             show_template(&tmpl);
             exit(-1);
         }
+        check_match_string(i, tcs->tmpl_str, &tmpl, test_path, test_path_len);
         extract_path(&tmpl, test_path, &test_path_len, 1);
         if( bip32_template_match(&tmpl, test_path, test_path_len) ) {
             fprintf(stderr, "success-case %d (%s) non-match matched\n", i, tcs->tmpl_str);
@@ -210,6 +619,13 @@ int main(int argc, char** argv)
             fprintf(stderr, "\n");
             exit(-1);
         }
+        check_match_string(i, tcs->tmpl_str, &tmpl, test_path, test_path_len);
+        check_path_parse("success-case", tcs->tmpl_str);
+        check_next_match(i, tcs->tmpl_str, &tmpl);
+        check_section_edits(i, tcs->tmpl_str, &tmpl);
+        check_validate("success-case", tcs->tmpl_str, BIP32_TEMPLATE_FORMAT_AMBIGOUS);
+        check_validate("success-case", tcs->tmpl_str, BIP32_TEMPLATE_FORMAT_UNAMBIGOUS);
+        check_validate("success-case", tcs->tmpl_str, BIP32_TEMPLATE_FORMAT_ONLYPATH);
         test_path_len = BIP32_TEMPLATE_MAX_SECTIONS;
         if( bip32_template_parse_string(tcs->tmpl_str, BIP32_TEMPLATE_FORMAT_ONLYPATH, &tmpl_onlypath, 0, 0) ) {
             if( !bip32_template_to_path(&tmpl_onlypath, test_path, &test_path_len) ) {
@@ -244,7 +660,9 @@ int main(int argc, char** argv)
                         bip32_template_error_to_string(expected_error), ii+1, tmpl_str, last_pos);
                 exit(-1);
             }
+            check_validate("error-case", tmpl_str, mode);
             if( !strchr(tmpl_str, '{') && !strchr(tmpl_str, '*') ) {
+                check_validate("error-case", tmpl_str, BIP32_TEMPLATE_FORMAT_ONLYPATH);
                 if( bip32_template_parse_string(
                             tmpl_str, BIP32_TEMPLATE_FORMAT_ONLYPATH,
                             &tmpl_onlypath, &error_onlypath, &last_pos_onlypath) )
@@ -263,6 +681,14 @@ int main(int argc, char** argv)
                             bip32_template_error_to_string(expected_error), ii+1, tmpl_str, last_pos_onlypath, last_pos);
                     exit(-1);
                 }
+                check_path_parse("error-case", tmpl_str);
+                for( int n = 0; n < BIP32_TEMPLATE_MAX_SECTIONS; n++ ) {
+                    if( bip32_template_match_string(&match_all_templates[n], tmpl_str, strlen(tmpl_str)) ) {
+                        fprintf(stderr, "error-case \"%s\" sample %d (\"%s\") matched as a string\n",
+                                bip32_template_error_to_string(expected_error), ii+1, tmpl_str);
+                        exit(-1);
+                    }
+                }
             }
 
             if( error != expected_error ) {
@@ -315,4 +741,6 @@ int main(int argc, char** argv)
             }
         }
     }
+
+    check_template_edit_errors();
 }
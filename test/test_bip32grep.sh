@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+# Run bip32grep over the fixtures in test/bip32grep and compare the output with
+# the expected one. Each case is run with the input read from stdin and with -f,
+# and with different numbers of threads, so that the input is split at different lines.
+#
+# usage: test/test_bip32grep.sh path/to/bip32grep
+
+set -e
+
+BIP32GREP=$1
+FIXTURES=$(dirname "$0")/bip32grep
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+
+# The same as CHUNK_SIZE in tools/bip32grep.c
+CHUNK_SIZE=8388608
+
+fail() {
+    echo "bip32grep test failed: $1" >&2
+    exit 1
+}
+
+# check <input> <expected> <bip32grep options and templates...>
+check() {
+    input=$1
+    expected=$2
+    shift 2
+    for threads in 1 2 3 7; do
+        "$BIP32GREP" -j $threads "$@" < "$input" > "$TMPDIR/out" || true
+        cmp -s "$TMPDIR/out" "$expected" || fail "$* -j $threads on stdin of $input"
+        "$BIP32GREP" -j $threads -f "$input" "$@" > "$TMPDIR/out" || true
+        cmp -s "$TMPDIR/out" "$expected" || fail "$* -j $threads -f $input"
+    done
+}
+
+# A path is not matched within a word or a longer path, or with a different hardened marker
+check "$FIXTURES/input.txt" "$FIXTURES/lines.expected" "m/84h/0h/0h/{0,1}/*"
+
+# A partial template also matches the partial paths
+check "$FIXTURES/input.txt" "$FIXTURES/partial.expected" "m/84h/0h/0h/{0,1}/*" "{0,1}/*"
+
+check "$FIXTURES/input.txt" "$FIXTURES/histogram.expected" -H "m/84h/0h/0h/{0,1}/*" "{0-2}/{3,5,7-9}"
+
+echo 2 > "$TMPDIR/count.expected"
+check "$FIXTURES/input.txt" "$TMPDIR/count.expected" -c "m/84h/0h/0h/{0,1}/*"
+
+# A line longer than CHUNK_SIZE can be split, and where it is split depends on how the input
+# is read, but the path at its start and the paths on the lines around it are still found
+{
+    echo "m/84h/0h/0h/0/5"
+    printf "m/84h/0h/0h/1/1 "
+    head -c $CHUNK_SIZE /dev/zero | tr '\0' x
+    echo
+    echo "m/84h/0h/0h/1/3"
+} > "$TMPDIR/long.txt"
+echo 3 > "$TMPDIR/long.expected"
+check "$TMPDIR/long.txt" "$TMPDIR/long.expected" -c "m/84h/0h/0h/{0,1}/*"
+
+echo "bip32grep tests passed"
@@ -0,0 +1,337 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_builder.h"
+
+#define MAX_TEMPLATES 100000
+#define MAX_PATHS 20000
+
+typedef struct {
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int len;
+} test_path_type;
+
+static bip32_template_type templates[MAX_TEMPLATES];
+static unsigned int num_templates;
+static test_path_type paths[MAX_PATHS];
+static unsigned int num_paths;
+
+static void collect_template(const bip32_template_type* template_p, void* arg)
+{
+    (void)arg;
+    if( num_templates == MAX_TEMPLATES ) {
+        fprintf(stderr, "too many templates emitted\n");
+        exit(-1);
+    }
+    templates[num_templates++] = *template_p;
+}
+
+static uint64_t num_template_paths(const bip32_template_type* tmpl)
+{
+    uint64_t result = 1;
+    uint64_t width;
+    int i, ii;
+
+    for( i = 0; i < tmpl->num_sections; i++ ) {
+        width = 0;
+        for( ii = 0; ii < tmpl->sections[i].num_ranges; ii++ ) {
+            width += (uint64_t)tmpl->sections[i].ranges[ii].range_end
+                        - tmpl->sections[i].ranges[ii].range_start + 1;
+        }
+        result *= width;
+    }
+
+    return result;
+}
+
+static int compare_paths(const void* a, const void* b)
+{
+    const test_path_type* pa = a;
+    const test_path_type* pb = b;
+    unsigned int i;
+
+    for( i = 0; i < pa->len && i < pb->len; i++ ) {
+        if( pa->path[i] != pb->path[i] ) {
+            return pa->path[i] < pb->path[i] ? -1 : 1;
+        }
+    }
+    return (int)pa->len - (int)pb->len;
+}
+
+static void build(unsigned int max_false_positive_permille)
+{
+    bip32_template_builder_type builder;
+    bip32_template_error_type error;
+    unsigned int i;
+
+    num_templates = 0;
+    bip32_template_builder_init(&builder, 0, max_false_positive_permille, collect_template, 0);
+    for( i = 0; i < num_paths; i++ ) {
+        if( !bip32_template_builder_add_path(&builder, paths[i].path, paths[i].len, &error) ) {
+            fprintf(stderr, "add_path failed for path %u: %s\n", i, bip32_template_error_to_string(error));
+            exit(-1);
+        }
+    }
+    bip32_template_builder_finish(&builder);
+}
+
+static void check_templates_are_valid(void)
+{
+    unsigned int i;
+    int s, r;
+    int is_hardened, is_prev_hardened;
+
+    for( i = 0; i < num_templates; i++ ) {
+        is_prev_hardened = 1;
+        for( s = 0; s < templates[i].num_sections; s++ ) {
+            const bip32_template_section_type* section_p = &templates[i].sections[s];
+            if( section_p->num_ranges < 1 || section_p->num_ranges > BIP32_TEMPLATE_MAX_RANGES_PER_SECTION ) {
+                fprintf(stderr, "template %u section %d has bad number of ranges\n", i, s);
+                exit(-1);
+            }
+            is_hardened = section_p->ranges[0].range_start >= 0x80000000;
+            if( (section_p->ranges[section_p->num_ranges-1].range_end >= 0x80000000) != is_hardened ) {
+                fprintf(stderr, "template %u section %d mixes hardened and unhardened indexes\n", i, s);
+                exit(-1);
+            }
+            if( is_hardened && !is_prev_hardened ) {
+                fprintf(stderr, "template %u section %d is hardened after unhardened one\n", i, s);
+                exit(-1);
+            }
+            is_prev_hardened = is_hardened;
+            for( r = 0; r < section_p->num_ranges; r++ ) {
+                if( section_p->ranges[r].range_start > section_p->ranges[r].range_end
+                    || (section_p->ranges[r].range_start >= 0x80000000)
+                        != (section_p->ranges[r].range_end >= 0x80000000) )
+                {
+                    fprintf(stderr, "template %u section %d has bad range\n", i, s);
+                    exit(-1);
+                }
+                if( r > 0 && section_p->ranges[r].range_start <= section_p->ranges[r-1].range_end ) {
+                    fprintf(stderr, "template %u section %d has unordered ranges\n", i, s);
+                    exit(-1);
+                }
+            }
+            /* The unused ranges are set the same way as by the parser */
+            for( ; r < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; r++ ) {
+                if( section_p->ranges[r].range_start != 0x80000000
+                    || section_p->ranges[r].range_end != 0x80000000 )
+                {
+                    fprintf(stderr, "template %u section %d has unused range that is not cleared\n", i, s);
+                    exit(-1);
+                }
+            }
+        }
+    }
+}
+
+/* Each input path must be matched, and the templates must not match anything else */
+static void check_exact(const char* test_name)
+{
+    uint64_t total = 0;
+    unsigned int i, ii;
+    int matched;
+
+    check_templates_are_valid();
+
+    for( i = 0; i < num_templates; i++ ) {
+        total += num_template_paths(&templates[i]);
+    }
+    for( i = 0; i < num_paths; i++ ) {
+        matched = 0;
+        for( ii = 0; ii < num_templates && !matched; ii++ ) {
+            matched = bip32_template_match(&templates[ii], paths[i].path, paths[i].len);
+        }
+        if( !matched ) {
+            fprintf(stderr, "%s: path %u is not matched\n", test_name, i);
+            exit(-1);
+        }
+    }
+    /* Every path is matched, so if the sum of template sizes is the number of the paths,
+     * the templates are disjoint and do not match anything else */
+    if( total != num_paths ) {
+        fprintf(stderr, "%s: templates match %llu paths, expected %u\n",
+                test_name, (unsigned long long)total, num_paths);
+        exit(-1);
+    }
+}
+
+static void check_cover(const char* test_name, unsigned int max_false_positive_permille)
+{
+    unsigned int i, ii;
+    uint64_t size, num_matched;
+    int matched;
+
+    check_templates_are_valid();
+
+    for( i = 0; i < num_paths; i++ ) {
+        matched = 0;
+        for( ii = 0; ii < num_templates && !matched; ii++ ) {
+            matched = bip32_template_match(&templates[ii], paths[i].path, paths[i].len);
+        }
+        if( !matched ) {
+            fprintf(stderr, "%s: path %u is not matched\n", test_name, i);
+            exit(-1);
+        }
+    }
+    for( ii = 0; ii < num_templates; ii++ ) {
+        size = num_template_paths(&templates[ii]);
+        num_matched = 0;
+        for( i = 0; i < num_paths; i++ ) {
+            num_matched += bip32_template_match(&templates[ii], paths[i].path, paths[i].len);
+        }
+        if( (size - num_matched) * 1000 > max_false_positive_permille * size ) {
+            fprintf(stderr, "%s: template %u false positive rate is too high: %llu of %llu\n",
+                    test_name, ii, (unsigned long long)(size - num_matched), (unsigned long long)size);
+            exit(-1);
+        }
+    }
+}
+
+static void test_grid(void)
+{
+    uint32_t a, b, c;
+
+    num_paths = 0;
+    for( a = 0; a < 5; a++ ) {
+        for( b = 0; b < 2; b++ ) {
+            for( c = 0; c < 100; c++ ) {
+                paths[num_paths].len = 3;
+                paths[num_paths].path[0] = 0x80000000 + a;
+                paths[num_paths].path[1] = b;
+                paths[num_paths].path[2] = c;
+                num_paths++;
+            }
+        }
+    }
+
+    build(0);
+    check_exact("grid");
+    if( num_templates != 1 ) {
+        fprintf(stderr, "grid: expected one template, got %u\n", num_templates);
+        exit(-1);
+    }
+    if( templates[0].is_partial
+        || templates[0].sections[0].ranges[0].range_start != 0x80000000
+        || templates[0].sections[0].ranges[0].range_end != 0x80000004
+        || templates[0].sections[1].ranges[0].range_end != 1
+        || templates[0].sections[2].ranges[0].range_end != 99 )
+    {
+        fprintf(stderr, "grid: unexpected template\n");
+        exit(-1);
+    }
+}
+
+static void generate_random_paths(unsigned int count, uint32_t value_space)
+{
+    unsigned int i, ii, n = 0;
+    unsigned int num_hardened;
+
+    /* Hardened indexes can only go before the unhardened ones */
+    for( i = 0; i < count; i++ ) {
+        paths[i].len = 1 + rand() % BIP32_TEMPLATE_MAX_SECTIONS;
+        num_hardened = rand() % 2 == 0 ? 0 : (unsigned int)rand() % (paths[i].len + 1);
+        for( ii = 0; ii < paths[i].len; ii++ ) {
+            paths[i].path[ii] = rand() % value_space;
+            if( ii < num_hardened ) {
+                paths[i].path[ii] |= 0x80000000;
+            }
+        }
+    }
+    qsort(paths, count, sizeof(paths[0]), compare_paths);
+
+    for( i = 0; i < count; i++ ) {
+        if( n == 0 || compare_paths(&paths[n-1], &paths[i]) != 0 ) {
+            paths[n++] = paths[i];
+        }
+    }
+    num_paths = n;
+}
+
+static void test_random(void)
+{
+    int round;
+
+    for( round = 0; round < 50; round++ ) {
+        generate_random_paths(2000, 1 + round % 20);
+        build(0);
+        check_exact("random exact");
+        build(300);
+        check_cover("random cover", 300);
+    }
+}
+
+static void test_errors(void)
+{
+    bip32_template_builder_type builder;
+    bip32_template_error_type error;
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS+1] = { 5, 6, 7, 8 };
+
+    bip32_template_builder_init(&builder, 1, 0, collect_template, 0);
+    if( bip32_template_builder_add_path(&builder, path, 0, &error)
+        || error != BIP32_TEMPLATE_ERROR_PATH_EMPTY )
+    {
+        fprintf(stderr, "empty path was not rejected\n");
+        exit(-1);
+    }
+    if( bip32_template_builder_add_path(&builder, path, BIP32_TEMPLATE_MAX_SECTIONS+1, &error)
+        || error != BIP32_TEMPLATE_ERROR_PATH_TOO_LONG )
+    {
+        fprintf(stderr, "too long path was not rejected\n");
+        exit(-1);
+    }
+    path[1] |= 0x80000000;
+    if( bip32_template_builder_add_path(&builder, path, 2, &error)
+        || error != BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED )
+    {
+        fprintf(stderr, "hardened index after unhardened was not rejected\n");
+        exit(-1);
+    }
+    path[1] = 6;
+    if( !bip32_template_builder_add_path(&builder, path, 2, &error) ) {
+        fprintf(stderr, "valid path was rejected\n");
+        exit(-1);
+    }
+    path[1] = 5;
+    if( bip32_template_builder_add_path(&builder, path, 2, &error)
+        || error != BIP32_TEMPLATE_ERROR_RANGE_ORDER_BAD )
+    {
+        fprintf(stderr, "unsorted path was not rejected\n");
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_grid();
+    test_random();
+    test_errors();
+
+    return 0;
+}
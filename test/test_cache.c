@@ -0,0 +1,171 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_cache.h"
+
+#define MAX_NODES 64
+
+static const char* sections[] = {
+    "48'", "0'", "0h", "2'", "{0-4}'", "1", "{0,1}", "*", "*'", "{1-3,7}",
+    "{1,2}", "01", "{3-1}", "", "7x", "{0-1,1}", "{0-2147483647,5,9-100,200-300}'",
+};
+
+static const bip32_template_format_mode_type modes[] = {
+    BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+    BIP32_TEMPLATE_FORMAT_UNAMBIGOUS,
+    BIP32_TEMPLATE_FORMAT_ONLYPATH,
+};
+
+static int is_same_template(const bip32_template_type* a, const bip32_template_type* b)
+{
+    int i, ii;
+
+    if( a->is_partial != b->is_partial || a->num_sections != b->num_sections ) {
+        return 0;
+    }
+    for( i = 0; i < a->num_sections; i++ ) {
+        if( a->sections[i].num_ranges != b->sections[i].num_ranges ) {
+            return 0;
+        }
+        for( ii = 0; ii < a->sections[i].num_ranges; ii++ ) {
+            if( a->sections[i].ranges[ii].range_start != b->sections[i].ranges[ii].range_start
+                || a->sections[i].ranges[ii].range_end != b->sections[i].ranges[ii].range_end )
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* The children counts and the LRU list of the nodes without children must agree with the trie */
+static void check_cache(const bip32_template_cache_type* cache_p)
+{
+    uint32_t num_children[MAX_NODES] = { 0 };
+    uint32_t i, index, num_leaves = 0, num_in_lru = 0;
+
+    for( i = 0; i < cache_p->num_nodes; i++ ) {
+        if( cache_p->nodes[i].parent != BIP32_TEMPLATE_CACHE_NO_NODE ) {
+            num_children[cache_p->nodes[i].parent]++;
+        }
+    }
+    for( i = 0; i < cache_p->num_nodes; i++ ) {
+        if( num_children[i] != cache_p->nodes[i].num_children ) {
+            printf("node %u has %u children, expected %u\n", i, cache_p->nodes[i].num_children, num_children[i]);
+            exit(-1);
+        }
+        num_leaves += num_children[i] == 0;
+    }
+    for( index = cache_p->lru_head; index != BIP32_TEMPLATE_CACHE_NO_NODE; index = cache_p->nodes[index].lru_next ) {
+        if( cache_p->nodes[index].num_children != 0 ) {
+            printf("node %u with children is in the LRU list\n", index);
+            exit(-1);
+        }
+        num_in_lru++;
+    }
+    if( num_in_lru != num_leaves ) {
+        printf("%u nodes in the LRU list, expected %u\n", num_in_lru, num_leaves);
+        exit(-1);
+    }
+}
+
+static void random_template_string(char* str)
+{
+    int num_sections = 1 + rand() % (BIP32_TEMPLATE_MAX_SECTIONS + 1);
+    int i;
+
+    str += sprintf(str, rand() % 2 ? "m/" : "");
+    for( i = 0; i < num_sections; i++ ) {
+        /* The first sections are more often the same, to make shared prefixes */
+        str += sprintf(str, "%s%s", i > 0 ? "/" : "",
+                       sections[rand() % (i < 2 ? 4 : sizeof(sections)/sizeof(sections[0]))]);
+    }
+}
+
+static void test_random(uint32_t max_nodes, uint32_t num_buckets, bip32_template_format_mode_type mode)
+{
+    bip32_template_cache_type cache;
+    bip32_template_cache_node_type nodes[MAX_NODES];
+    uint32_t buckets[64];
+    bip32_template_getchar_context_type ctx;
+    bip32_template_type tmpl, expected_tmpl;
+    bip32_template_error_type error, expected_error;
+    unsigned int last_pos;
+    char str[256];
+    int round, result, expected;
+
+    if( !bip32_template_cache_init(&cache, mode, nodes, max_nodes, buckets, num_buckets) ) {
+        printf("cannot init the cache\n");
+        exit(-1);
+    }
+
+    for( round = 0; round < 20000; round++ ) {
+        random_template_string(str);
+        /* Parse only a part of the string sometimes, as the cache does not need NUL */
+        if( rand() % 8 == 0 ) {
+            str[rand() % (strlen(str) + 1)] = 0;
+        }
+
+        bip32_template_context_set_span(str, strlen(str), &ctx);
+        expected = bip32_template_parse(bip32_template_getchar_span, &ctx, mode, &expected_tmpl, &expected_error);
+
+        result = bip32_template_cache_parse(&cache, str, strlen(str), &tmpl, &error, &last_pos);
+        if( result != expected || error != expected_error || last_pos != ctx.pos
+            || (result && !is_same_template(&tmpl, &expected_tmpl)) )
+        {
+            printf("\"%s\" mode %d with %u nodes: got %d error %d pos %u, expected %d error %d pos %u\n",
+                   str, mode, max_nodes, result, error, last_pos, expected, expected_error, ctx.pos);
+            exit(-1);
+        }
+        if( round % 100 == 0 ) {
+            check_cache(&cache);
+        }
+    }
+    check_cache(&cache);
+
+    if( cache.stats.num_parses != 20000 || (max_nodes == MAX_NODES && cache.stats.num_hits < 10000) ) {
+        printf("%u nodes: only %llu hits\n", max_nodes, (unsigned long long)cache.stats.num_hits);
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int m;
+
+    (void)argc;
+    (void)argv;
+
+    for( m = 0; m < sizeof(modes)/sizeof(modes[0]); m++ ) {
+        test_random(1, 1, modes[m]);
+        test_random(3, 4, modes[m]);
+        test_random(10, 64, modes[m]);
+        test_random(MAX_NODES, 64, modes[m]);
+    }
+
+    return 0;
+}
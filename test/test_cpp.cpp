@@ -0,0 +1,200 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <execution>
+#include <iterator>
+#include <numeric>
+#include <ranges>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "../bip32template.hpp"
+
+static_assert( std::ranges::random_access_range<bip32::paths_view> );
+static_assert( std::ranges::sized_range<bip32::paths_view> );
+static_assert( std::ranges::borrowed_range<bip32::paths_view> );
+static_assert( std::ranges::view<bip32::paths_view> );
+static_assert( std::random_access_iterator<bip32::paths_view::iterator> );
+/* The paths are returned by value, so the iterators are not legacy forward iterators */
+static_assert( std::is_same_v<std::iterator_traits<bip32::paths_view::iterator>::iterator_category,
+                              std::input_iterator_tag> );
+
+static void fail(const char* what, std::string_view str)
+{
+    std::printf("%s: \"%.*s\"\n", what, int(str.size()), str.data());
+    std::exit(-1);
+}
+
+static bip32::path_template parse_or_die(std::string_view str,
+                                         bip32::format_mode mode = bip32::format_mode::ambiguous)
+{
+    auto r = bip32::path_template::parse(str, mode);
+
+    if( !r ) {
+        std::printf("cannot parse \"%.*s\": %s at %u\n", int(str.size()), str.data(),
+                    r.error().message(), r.error().pos());
+        std::exit(-1);
+    }
+    return *r;
+}
+
+/* The errors are the same as returned by the C functions */
+static void test_errors()
+{
+    struct {
+        std::string_view str;
+        bip32::format_mode mode;
+    } cases[] = {
+        { "m/0/{1,2,3}", bip32::format_mode::unambiguous },
+        { "m/0/*/1/2", bip32::format_mode::ambiguous },
+        { "m/0/*", bip32::format_mode::only_path },
+        { "m/{5-1}", bip32::format_mode::ambiguous },
+        { "m/0/1x", bip32::format_mode::ambiguous },
+    };
+
+    for( const auto& c : cases ) {
+        std::string s(c.str);
+        bip32_template_type tmpl;
+        bip32_template_error_type code;
+        unsigned int last_pos;
+
+        auto r = bip32::path_template::parse(c.str, c.mode);
+        if( r ) {
+            fail("parsed invalid template", c.str);
+        }
+        if( bip32_template_parse_string(s.c_str(), static_cast<bip32_template_format_mode_type>(c.mode),
+                                        &tmpl, &code, &last_pos) )
+        {
+            fail("C parser accepted invalid template", c.str);
+        }
+        if( r.error() != bip32::error(code, last_pos) ) {
+            fail("wrong error", c.str);
+        }
+    }
+
+    /* The template is parsed within the span, not up to the NUL */
+    std::string_view str = "m/0/1/2";
+    if( !bip32::path_template::parse(str.substr(0, 5)) ) {
+        fail("cannot parse within a span", str);
+    }
+}
+
+static void test_paths()
+{
+    auto t = parse_or_die("m/*/*/*");
+    if( t.num_paths() ) {
+        fail("too many paths counted", "m/*/*/*");
+    }
+    t = parse_or_die("m/*/*");
+    if( t.num_paths() != (uint64_t(1) << 62) || t.paths().back()[1] != 0x7FFFFFFF ) {
+        fail("wrong number of paths", "m/*/*");
+    }
+
+    t = parse_or_die("m/{0-1,5}'/{2-3}/{3,7-8}");
+    auto paths = t.paths();
+    if( paths.size() != 3*2*3 || *t.num_paths() != paths.size() ) {
+        fail("wrong number of paths", "m/{0-1,5}'/{2-3}/{3,7-8}");
+    }
+
+    /* The paths are all distinct, match the template, and are in lexicographic order */
+    bip32::path prev;
+    for( std::size_t i = 0; i < paths.size(); i++ ) {
+        bip32::path p = paths[i];
+        if( p.size() != 3 || !t.match(p) ) {
+            fail("path does not match", "m/{0-1,5}'/{2-3}/{3,7-8}");
+        }
+        if( i > 0 && !std::ranges::lexicographical_compare(prev, p) ) {
+            fail("paths are not in order", "m/{0-1,5}'/{2-3}/{3,7-8}");
+        }
+        prev = p;
+    }
+    if( paths[0][0] != 0x80000000 || paths[0][1] != 2 || paths[0][2] != 3 ) {
+        fail("wrong first path", "m/{0-1,5}'/{2-3}/{3,7-8}");
+    }
+    if( paths.back()[0] != 0x80000005 || paths.back()[1] != 3 || paths.back()[2] != 8 ) {
+        fail("wrong last path", "m/{0-1,5}'/{2-3}/{3,7-8}");
+    }
+
+    /* Iterator arithmetic agrees with indexing */
+    auto it = paths.begin() + 7;
+    if( *it != paths[7] || it - paths.begin() != 7 || (paths.end() - 1)[0] != paths.back() ) {
+        fail("wrong iterator arithmetic", "m/{0-1,5}'/{2-3}/{3,7-8}");
+    }
+
+    /* Range adaptors work on the view */
+    auto n = std::ranges::distance(paths | std::views::filter([](const bip32::path& p) { return p[2] == 7; }));
+    if( n != 6 ) {
+        fail("wrong filtered count", "m/{0-1,5}'/{2-3}/{3,7-8}");
+    }
+
+    if( !t.match(std::string_view("m/5'/2/8")) || t.match(std::string_view("m/5/2/8")) ) {
+        fail("wrong string match", "m/{0-1,5}'/{2-3}/{3,7-8}");
+    }
+
+    auto partial = parse_or_die("{0-1}/2");
+    if( !partial.is_partial() || !partial.paths()[0].is_partial() ) {
+        fail("partial flag is lost", "{0-1}/2");
+    }
+}
+
+static void test_parallel()
+{
+    auto t = parse_or_die("m/{0-99}/{0-99}/{0-49,100-149}");
+    auto paths = t.paths();
+
+    std::atomic<uint64_t> num_matched{0};
+    std::for_each(std::execution::par_unseq, paths.begin(), paths.end(),
+                  [&](const bip32::path& p) {
+                      if( t.match(p) ) {
+                          num_matched.fetch_add(1, std::memory_order_relaxed);
+                      }
+                  });
+    if( num_matched != paths.size() ) {
+        fail("wrong parallel match count", "m/{0-99}/{0-99}/{0-49,100-149}");
+    }
+
+    auto weight = [](const bip32::path& p) { return uint64_t(p[0]) * 1000003 + p[1] * 1009 + p[2]; };
+    uint64_t serial = std::transform_reduce(paths.begin(), paths.end(), uint64_t(0), std::plus<>(), weight);
+    uint64_t parallel = std::transform_reduce(std::execution::par, paths.begin(), paths.end(),
+                                              uint64_t(0), std::plus<>(), weight);
+    if( serial != parallel ) {
+        fail("parallel reduce differs", "m/{0-99}/{0-99}/{0-49,100-149}");
+    }
+}
+
+int main(void)
+{
+    test_errors();
+    test_paths();
+    test_parallel();
+
+    std::printf("C++ interface tests passed\n");
+
+    return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_descriptor.h"
+
+#define XPUB "xpub6DJ2dNUysrn5Vt36jH2KLBT2i1auw1tTSSomg8PhqNiUtx8QX2SvC9nrHu81fT41fvDUnhMjEzQgXnQjKEu3oaqMSzhSrHMxyyoEAmUHQbY"
+
+#define MAX_ITEMS 8
+
+typedef struct {
+    const char* descriptor;
+    bip32_template_format_mode_type mode;
+    unsigned int num_items;
+    struct {
+        bip32_template_descriptor_item_kind_type kind;
+        const char* path;
+        unsigned int multipath_index;
+        unsigned int num_multipath;
+        const char* equivalent_template;
+    } items[MAX_ITEMS];
+} descriptor_test_type;
+
+static const descriptor_test_type descriptor_tests[] = {
+    { "wpkh([d34db33f/84h/0h/0h]" XPUB "/<0;1>/*)#7a8b9c0d", BIP32_TEMPLATE_FORMAT_AMBIGOUS, 3,
+      { { BIP32_TEMPLATE_DESCRIPTOR_KEY_ORIGIN, "84h/0h/0h", 0, 1, "m/84h/0h/0h" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<0;1>/*", 0, 2, "0/*" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<0;1>/*", 1, 2, "1/*" } } },
+    /* The alternatives are an ordered list, not a set: adjacent and descending
+     * alternatives are not errors even in the unambigous mode */
+    { "wpkh(" XPUB "/<1;0;2h>/*)", BIP32_TEMPLATE_FORMAT_UNAMBIGOUS, 3,
+      { { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<1;0;2h>/*", 0, 3, "1/*" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<1;0;2h>/*", 1, 3, "0/*" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<1;0;2h>/*", 2, 3, "2h/*" } } },
+    { "wsh(multi(1," XPUB "/5/<{0-3};7>," XPUB "/<3;2>))", BIP32_TEMPLATE_FORMAT_AMBIGOUS, 4,
+      { { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "5/<{0-3};7>", 0, 2, "5/{0-3}" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "5/<{0-3};7>", 1, 2, "5/7" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<3;2>", 0, 2, "3" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "<3;2>", 1, 2, "2" } } },
+    { "wsh(sortedmulti(2,[00000000/48'/0'/2']" XPUB "/0/*,[aabbccdd]" XPUB "/{0-5}/*))",
+      BIP32_TEMPLATE_FORMAT_AMBIGOUS, 3,
+      { { BIP32_TEMPLATE_DESCRIPTOR_KEY_ORIGIN, "48'/0'/2'", 0, 1, "m/48'/0'/2'" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "0/*", 0, 1, "0/*" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "{0-5}/*", 0, 1, "{0-5}/*" } } },
+    { "tr(" XPUB "/0/*,{pk(" XPUB "/{1,3}/*),pk([aabbccdd]" XPUB "/2/{0-9,20})})",
+      BIP32_TEMPLATE_FORMAT_AMBIGOUS, 3,
+      { { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "0/*", 0, 1, "0/*" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "{1,3}/*", 0, 1, "{1,3}/*" },
+        { BIP32_TEMPLATE_DESCRIPTOR_KEY_SUFFIX, "2/{0-9,20}", 0, 1, "2/{0-9,20}" } } },
+    { "pkh(02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5)",
+      BIP32_TEMPLATE_FORMAT_AMBIGOUS, 0, { { 0, 0, 0, 0, 0 } } },
+};
+
+static int templates_equal(const bip32_template_type* a, const bip32_template_type* b)
+{
+    int i, ii;
+
+    if( a->is_partial != b->is_partial || a->num_sections != b->num_sections ) {
+        return 0;
+    }
+    for( i = 0; i < a->num_sections; i++ ) {
+        if( a->sections[i].num_ranges != b->sections[i].num_ranges ) {
+            return 0;
+        }
+        for( ii = 0; ii < a->sections[i].num_ranges; ii++ ) {
+            if( a->sections[i].ranges[ii].range_start != b->sections[i].ranges[ii].range_start
+                || a->sections[i].ranges[ii].range_end != b->sections[i].ranges[ii].range_end )
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void test_descriptors(void)
+{
+    bip32_template_descriptor_item_type items[MAX_ITEMS];
+    bip32_template_type expected;
+    bip32_template_descriptor_error_type error;
+    bip32_template_error_type template_error;
+    unsigned int num_items, i, ii;
+    size_t error_offset;
+    const char* descriptor;
+    const char* path_p;
+
+    for( i = 0; i < sizeof(descriptor_tests)/sizeof(descriptor_tests[0]); i++ ) {
+        descriptor = descriptor_tests[i].descriptor;
+        if( !bip32_template_descriptor_scan(descriptor, strlen(descriptor), descriptor_tests[i].mode,
+                                            items, MAX_ITEMS, &num_items, &error, &template_error, &error_offset) )
+        {
+            fprintf(stderr, "%s: scan failed at %u: %s: %s\n", descriptor, (unsigned int)error_offset,
+                    bip32_template_descriptor_error_to_string(error),
+                    bip32_template_error_to_string(template_error));
+            exit(-1);
+        }
+        if( num_items != descriptor_tests[i].num_items ) {
+            fprintf(stderr, "%s: got %u items, expected %u\n", descriptor, num_items,
+                    descriptor_tests[i].num_items);
+            exit(-1);
+        }
+        path_p = descriptor;
+        for( ii = 0; ii < num_items; ii++ ) {
+            /* The paths are listed in the order they appear */
+            path_p = strstr(path_p, descriptor_tests[i].items[ii].path);
+            if( !path_p || items[ii].offset != (size_t)(path_p - descriptor)
+                || items[ii].len != strlen(descriptor_tests[i].items[ii].path)
+                || items[ii].kind != descriptor_tests[i].items[ii].kind
+                || items[ii].multipath_index != descriptor_tests[i].items[ii].multipath_index
+                || items[ii].num_multipath != descriptor_tests[i].items[ii].num_multipath )
+            {
+                fprintf(stderr, "%s: unexpected span for item %u\n", descriptor, ii);
+                exit(-1);
+            }
+            /* All the alternatives of the multipath specifier have the same span */
+            if( items[ii].multipath_index + 1 == items[ii].num_multipath ) {
+                path_p += items[ii].len;
+            }
+            if( !bip32_template_parse_string(descriptor_tests[i].items[ii].equivalent_template,
+                                             BIP32_TEMPLATE_FORMAT_AMBIGOUS, &expected, &template_error, 0) )
+            {
+                fprintf(stderr, "cannot parse %s\n", descriptor_tests[i].items[ii].equivalent_template);
+                exit(-1);
+            }
+            if( !templates_equal(&items[ii].tmpl, &expected) ) {
+                fprintf(stderr, "%s: unexpected template for item %u\n", descriptor, ii);
+                exit(-1);
+            }
+        }
+    }
+}
+
+/* expected_template_error is checked only for BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE */
+static void check_scan_error(const char* descriptor, size_t descriptor_len, unsigned int max_items,
+                             bip32_template_format_mode_type mode,
+                             bip32_template_descriptor_error_type expected_error,
+                             bip32_template_error_type expected_template_error, size_t expected_offset)
+{
+    bip32_template_descriptor_item_type items[MAX_ITEMS];
+    bip32_template_descriptor_error_type error;
+    bip32_template_error_type template_error;
+    unsigned int num_items;
+    size_t error_offset;
+
+    if( bip32_template_descriptor_scan(descriptor, descriptor_len, mode, items, max_items,
+                                       &num_items, &error, &template_error, &error_offset) )
+    {
+        fprintf(stderr, "%s: scan did not fail\n", descriptor);
+        exit(-1);
+    }
+    if( error != expected_error || error_offset != expected_offset
+        || (error == BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE && template_error != expected_template_error) )
+    {
+        fprintf(stderr, "%s: got error %s (%s) at %u, expected %s (%s) at %u\n", descriptor,
+                bip32_template_descriptor_error_to_string(error),
+                bip32_template_error_to_string(template_error), (unsigned int)error_offset,
+                bip32_template_descriptor_error_to_string(expected_error),
+                bip32_template_error_to_string(expected_template_error), (unsigned int)expected_offset);
+        exit(-1);
+    }
+
+    /* The error outputs are optional */
+    if( bip32_template_descriptor_scan(descriptor, descriptor_len, mode, items, max_items,
+                                       &num_items, 0, 0, 0) )
+    {
+        fprintf(stderr, "%s: scan without the error outputs did not fail\n", descriptor);
+        exit(-1);
+    }
+}
+
+static void test_errors(void)
+{
+    const char* descriptor;
+
+    descriptor = "wpkh([d34db33f/84h/0h/0hh]" XPUB ")";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, BIP32_TEMPLATE_ERROR_UNEXPECTED_CHAR,
+                     strstr(descriptor, "hh]") + 1 - descriptor);
+
+    descriptor = "wpkh([d34db33f/84h/0h/0h" XPUB ")";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_KEY_ORIGIN, BIP32_TEMPLATE_ERROR_UNDEFINED,
+                     strlen(descriptor));
+
+    /* The end of the path before ')' is seen by the parser as the end of the string */
+    descriptor = "wpkh(" XPUB "/0/)";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH,
+                     strlen(descriptor) - 1);
+
+    /* The error position in an alternative is the position within the descriptor */
+    descriptor = "wpkh(" XPUB "/<0;1;02>/*)";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, BIP32_TEMPLATE_ERROR_INDEX_HAS_LEADING_ZERO,
+                     strstr(descriptor, "02>") + 1 - descriptor);
+
+    descriptor = "wpkh(" XPUB "/<0;>/*)";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH,
+                     strstr(descriptor, ">/*") + 1 - descriptor);
+
+    descriptor = "wpkh(" XPUB "/<0>/*)";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_MULTIPATH_TOO_SHORT, BIP32_TEMPLATE_ERROR_UNDEFINED,
+                     strstr(descriptor, "<0>") - descriptor);
+
+    descriptor = "wpkh(" XPUB "/<0;1/*)";
+    check_scan_error(descriptor, strlen(descriptor), MAX_ITEMS, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_UNTERMINATED_MULTIPATH, BIP32_TEMPLATE_ERROR_UNDEFINED,
+                     strstr(descriptor, "<0;1") - descriptor);
+
+    descriptor = "wsh(multi(1,[00000000/1]" XPUB "/0/*))";
+    check_scan_error(descriptor, strlen(descriptor), 1, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TOO_MANY_PATHS, BIP32_TEMPLATE_ERROR_UNDEFINED,
+                     strstr(descriptor, "/0/*") + 1 - descriptor);
+
+    /* All the alternatives must fit */
+    descriptor = "wsh(multi(1,[00000000/1]" XPUB "/<0;1>/*))";
+    check_scan_error(descriptor, strlen(descriptor), 2, BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TOO_MANY_PATHS, BIP32_TEMPLATE_ERROR_UNDEFINED,
+                     strstr(descriptor, "/<0;1>") + 1 - descriptor);
+
+    /* The scan must not read past the given length */
+    descriptor = "wpkh(" XPUB "/0/1h)";
+    check_scan_error(descriptor, strstr(descriptor, "/1h") + 1 - descriptor, MAX_ITEMS,
+                     BIP32_TEMPLATE_FORMAT_ONLYPATH,
+                     BIP32_TEMPLATE_DESCRIPTOR_ERROR_TEMPLATE, BIP32_TEMPLATE_ERROR_UNEXPECTED_SLASH,
+                     strstr(descriptor, "/1h") + 1 - descriptor);
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_descriptors();
+    test_errors();
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_discovery.h"
+
+#define NUM_ACCOUNTS 3
+#define NUM_CHANGE 2
+#define NUM_BRANCHES (NUM_ACCOUNTS*NUM_CHANGE)
+#define MAX_INDEX 400
+#define MAX_OUTSTANDING 4096
+
+/* Which indexes are "used on chain" for each branch */
+static unsigned char used[NUM_BRANCHES][MAX_INDEX];
+static unsigned char issued[NUM_BRANCHES][MAX_INDEX];
+static int branch_done[NUM_BRANCHES];
+static int branch_has_used[NUM_BRANCHES];
+static uint32_t branch_last_used[NUM_BRANCHES];
+
+static int branch_num(const uint32_t* prefix_p)
+{
+    return (prefix_p[0] - 0x80000000) * NUM_CHANGE + prefix_p[1];
+}
+
+static void on_done(const uint32_t* prefix_p, unsigned int prefix_len,
+                    int has_used, uint32_t last_used_index, void* arg)
+{
+    int b = branch_num(prefix_p);
+
+    (void)arg;
+    if( prefix_len != 2 ) {
+        fprintf(stderr, "unexpected prefix length %u\n", prefix_len);
+        exit(-1);
+    }
+    if( branch_done[b] ) {
+        fprintf(stderr, "branch %d is done twice\n", b);
+        exit(-1);
+    }
+    branch_done[b] = 1;
+    branch_has_used[b] = has_used;
+    branch_last_used[b] = last_used_index;
+}
+
+static void run_discovery(uint32_t gap_limit, unsigned int num_slots, unsigned int batch_size)
+{
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    bip32_template_discovery_type discovery;
+    bip32_template_discovery_branch_type slots[NUM_BRANCHES];
+    static bip32_template_discovery_candidate_type outstanding[MAX_OUTSTANDING];
+    unsigned int num_outstanding = 0;
+    unsigned int n, i;
+    int b, idx, last_used;
+
+    memset(issued, 0, sizeof(issued));
+    memset(branch_done, 0, sizeof(branch_done));
+
+    if( !bip32_template_parse_string("{0-2}'/{0,1}/*", BIP32_TEMPLATE_FORMAT_AMBIGOUS, &tmpl, &error, 0) ) {
+        fprintf(stderr, "parse failed: %s\n", bip32_template_error_to_string(error));
+        exit(-1);
+    }
+    if( !bip32_template_discovery_init(&discovery, &tmpl, gap_limit, slots, num_slots, on_done, 0) ) {
+        fprintf(stderr, "discovery init failed\n");
+        exit(-1);
+    }
+
+    while( !bip32_template_discovery_is_finished(&discovery) ) {
+        if( num_outstanding + batch_size <= MAX_OUTSTANDING ) {
+            n = bip32_template_discovery_next_batch(&discovery, &outstanding[num_outstanding], batch_size);
+            for( i = num_outstanding; i < num_outstanding + n; i++ ) {
+                b = branch_num(outstanding[i].path);
+                idx = outstanding[i].path[2];
+                if( !bip32_template_match(&tmpl, outstanding[i].path, outstanding[i].path_len) ) {
+                    fprintf(stderr, "candidate does not match the template\n");
+                    exit(-1);
+                }
+                if( branch_done[b] || idx >= MAX_INDEX || issued[b][idx] ) {
+                    fprintf(stderr, "branch %d index %d issued unexpectedly\n", b, idx);
+                    exit(-1);
+                }
+                issued[b][idx] = 1;
+            }
+            num_outstanding += n;
+            if( n == 0 && num_outstanding == 0 ) {
+                fprintf(stderr, "discovery is stuck\n");
+                exit(-1);
+            }
+        }
+
+        /* Report some of the outstanding results, in random order */
+        n = num_outstanding ? 1 + rand() % num_outstanding : 0;
+        while( n-- > 0 ) {
+            i = rand() % num_outstanding;
+            b = branch_num(outstanding[i].path);
+            if( !bip32_template_discovery_report(&discovery, &outstanding[i], used[b][outstanding[i].path[2]]) ) {
+                fprintf(stderr, "report was rejected\n");
+                exit(-1);
+            }
+            outstanding[i] = outstanding[--num_outstanding];
+        }
+    }
+
+    if( num_outstanding != 0 ) {
+        fprintf(stderr, "discovery finished with outstanding candidates\n");
+        exit(-1);
+    }
+
+    for( b = 0; b < NUM_BRANCHES; b++ ) {
+        /* Sequential scan with the same gap limit */
+        last_used = -1;
+        for( idx = 0; idx - last_used <= (int)gap_limit; idx++ ) {
+            if( used[b][idx] ) {
+                last_used = idx;
+            }
+        }
+        if( !branch_done[b] ) {
+            fprintf(stderr, "branch %d is not done\n", b);
+            exit(-1);
+        }
+        if( branch_has_used[b] != (last_used >= 0)
+            || ( last_used >= 0 && branch_last_used[b] != (uint32_t)last_used ) )
+        {
+            fprintf(stderr, "branch %d: last used index %d, expected %d\n",
+                    b, branch_has_used[b] ? (int)branch_last_used[b] : -1, last_used);
+            exit(-1);
+        }
+        for( idx = 0; idx < MAX_INDEX; idx++ ) {
+            if( issued[b][idx] != (idx <= last_used + (int)gap_limit) ) {
+                fprintf(stderr, "branch %d: index %d issued: %d\n", b, idx, issued[b][idx]);
+                exit(-1);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    int round, b, idx;
+
+    for( round = 0; round < 200; round++ ) {
+        memset(used, 0, sizeof(used));
+        for( b = 0; b < NUM_BRANCHES; b++ ) {
+            int num_used = rand() % 8;
+            while( num_used-- > 0 ) {
+                used[b][rand() % (MAX_INDEX/4)] = 1;
+            }
+        }
+        /* The indexes after the last used one that are checked must stay below MAX_INDEX */
+        for( b = 0; b < NUM_BRANCHES; b++ ) {
+            for( idx = MAX_INDEX/4; idx < MAX_INDEX; idx++ ) {
+                used[b][idx] = 0;
+            }
+        }
+        run_discovery(1 + rand() % 30, 1 + rand() % NUM_BRANCHES, 1 + rand() % 50);
+    }
+
+    return 0;
+}
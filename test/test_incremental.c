@@ -0,0 +1,252 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_incremental.h"
+
+#define MAX_STRING_LEN 64
+
+static const char* template_strings[] = {
+    "m/0'/1'/{0-5,9}",
+    "m/0h/{1,3-9}h/*",
+    "{0,1}/*",
+    "m/*'/5/{10-20}",
+    "0/1/2",
+    "m/0/1'/2",
+    "m/{0-3,5}/{0,1}/{0-2,10-20}",
+    "m/0'/1'/2'/3'",
+    "m/{0-1,4,2147483647}/2147483647/*",
+    "{0-1,1}/0",
+    "m/{1,2,3}",
+    "m/0h/1'",
+};
+
+static const bip32_template_format_mode_type modes[] = {
+    BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+    BIP32_TEMPLATE_FORMAT_UNAMBIGOUS,
+    BIP32_TEMPLATE_FORMAT_ONLYPATH,
+};
+
+static const char edit_chars[] = "0123456789/{}-,*h'm";
+
+static unsigned long num_chars_parsed_incremental = 0;
+static unsigned long num_chars_parsed_full = 0;
+
+static int is_same_template(const bip32_template_type* a, const bip32_template_type* b)
+{
+    int i, ii;
+
+    if( a->is_partial != b->is_partial || a->num_sections != b->num_sections ) {
+        return 0;
+    }
+    for( i = 0; i < BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
+        if( a->sections[i].num_ranges != b->sections[i].num_ranges ) {
+            return 0;
+        }
+        for( ii = 0; ii < BIP32_TEMPLATE_MAX_RANGES_PER_SECTION; ii++ ) {
+            if( a->sections[i].ranges[ii].range_start != b->sections[i].ranges[ii].range_start
+                || a->sections[i].ranges[ii].range_end != b->sections[i].ranges[ii].range_end )
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* The updated state must be the same as after parsing the edited string from scratch,
+ * and the result must be the same as of bip32_template_parse_string() */
+static void check_state(const bip32_template_incremental_type* inc_p, const char* str, size_t len,
+                        const char* what)
+{
+    bip32_template_incremental_type full;
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    size_t offset, span_len, full_offset, full_span_len;
+    unsigned int i;
+    int result;
+
+    result = bip32_template_parse_string(str, inc_p->mode, &tmpl, &error, &last_pos);
+    if( result != inc_p->is_valid || error != inc_p->error || last_pos != inc_p->last_pos
+        || !is_same_template(&tmpl, &inc_p->tmpl) )
+    {
+        printf("%s: \"%s\" mode %d: got result %d error %d pos %u, expected %d error %d pos %u\n",
+               what, str, inc_p->mode, inc_p->is_valid, inc_p->error, inc_p->last_pos,
+               result, error, last_pos);
+        exit(-1);
+    }
+
+    bip32_template_incremental_parse(&full, str, len, inc_p->mode);
+    num_chars_parsed_full += full.num_chars_parsed;
+    if( full.num_boundaries != inc_p->num_boundaries ) {
+        printf("%s: \"%s\": %u boundaries, expected %u\n", what, str, inc_p->num_boundaries, full.num_boundaries);
+        exit(-1);
+    }
+    for( i = 0; i < full.num_boundaries; i++ ) {
+        if( memcmp(&full.boundaries[i], &inc_p->boundaries[i], sizeof(full.boundaries[i])) != 0 ) {
+            printf("%s: \"%s\": boundary %u differs\n", what, str, i);
+            exit(-1);
+        }
+    }
+    for( i = 0; i <= BIP32_TEMPLATE_MAX_SECTIONS; i++ ) {
+        result = bip32_template_incremental_section_span(inc_p, i, &offset, &span_len);
+        if( result != bip32_template_incremental_section_span(&full, i, &full_offset, &full_span_len)
+            || (result && (offset != full_offset || span_len != full_span_len)) )
+        {
+            printf("%s: \"%s\": span of section %u differs\n", what, str, i);
+            exit(-1);
+        }
+    }
+}
+
+static void test_random_edits(void)
+{
+    bip32_template_incremental_type inc;
+    char str[MAX_STRING_LEN+1];
+    char edited[MAX_STRING_LEN+1];
+    size_t len, edit_offset, removed_len, inserted_len, i;
+    unsigned int t, m;
+    int round, edit;
+
+    for( round = 0; round < 2000; round++ ) {
+        for( t = 0; t < sizeof(template_strings)/sizeof(template_strings[0]); t++ ) {
+            for( m = 0; m < sizeof(modes)/sizeof(modes[0]); m++ ) {
+                strcpy(str, template_strings[t]);
+                len = strlen(str);
+                bip32_template_incremental_parse(&inc, str, len, modes[m]);
+                check_state(&inc, str, len, "parse");
+
+                for( edit = 0; edit < 10; edit++ ) {
+                    edit_offset = rand() % (len + 1);
+                    removed_len = rand() % (len - edit_offset < 3 ? len - edit_offset + 1 : 4);
+                    inserted_len = rand() % 3;
+                    if( len - removed_len + inserted_len > MAX_STRING_LEN ) {
+                        break;
+                    }
+                    memcpy(edited, str, edit_offset);
+                    for( i = 0; i < inserted_len; i++ ) {
+                        edited[edit_offset + i] = edit_chars[rand() % (sizeof(edit_chars) - 1)];
+                    }
+                    memcpy(edited + edit_offset + inserted_len, str + edit_offset + removed_len,
+                           len - edit_offset - removed_len + 1);
+                    len = len - removed_len + inserted_len;
+                    memcpy(str, edited, len + 1);
+
+                    bip32_template_incremental_update(&inc, str, len, edit_offset, removed_len, inserted_len);
+                    num_chars_parsed_incremental += inc.num_chars_parsed;
+                    check_state(&inc, str, len, "update");
+                }
+            }
+        }
+    }
+
+    /* The updates must not read more than the full parses, and usually read much less */
+    if( num_chars_parsed_incremental > num_chars_parsed_full ) {
+        printf("incremental updates read %lu chars, full parses %lu\n",
+               num_chars_parsed_incremental, num_chars_parsed_full);
+        exit(-1);
+    }
+}
+
+static void apply_edit(bip32_template_incremental_type* inc_p, char* str,
+                       size_t edit_offset, size_t removed_len, const char* inserted)
+{
+    size_t len = strlen(str);
+    size_t inserted_len = strlen(inserted);
+
+    memmove(str + edit_offset + inserted_len, str + edit_offset + removed_len,
+            len - edit_offset - removed_len + 1);
+    memcpy(str + edit_offset, inserted, inserted_len);
+    bip32_template_incremental_update(inc_p, str, strlen(str), edit_offset, removed_len, inserted_len);
+    check_state(inc_p, str, strlen(str), "edit");
+}
+
+static void test_edits(void)
+{
+    bip32_template_incremental_type inc;
+    char str[MAX_STRING_LEN+1];
+    size_t offset, len;
+
+    /* Change of a range bound reparses only the edited section */
+    strcpy(str, "m/0'/1'/{0-5,9}");
+    bip32_template_incremental_parse(&inc, str, strlen(str), BIP32_TEMPLATE_FORMAT_AMBIGOUS);
+    apply_edit(&inc, str, 11, 1, "6");
+    if( !inc.is_valid || inc.tmpl.sections[2].ranges[0].range_end != 6 || inc.num_chars_parsed != 8 ) {
+        printf("range bound edit: valid %d, read %u chars\n", inc.is_valid, inc.num_chars_parsed);
+        exit(-1);
+    }
+    if( !bip32_template_incremental_section_span(&inc, 2, &offset, &len) || offset != 8 || len != 7 ) {
+        printf("range bound edit: wrong section span\n");
+        exit(-1);
+    }
+
+    /* The parsing stops at the first boundary with the same state */
+    strcpy(str, "m/0'/1'/{0-5,9}");
+    bip32_template_incremental_parse(&inc, str, strlen(str), BIP32_TEMPLATE_FORMAT_AMBIGOUS);
+    apply_edit(&inc, str, 2, 1, "10");
+    if( !inc.is_valid || inc.tmpl.sections[0].ranges[0].range_start != 0x8000000a
+        || inc.num_chars_parsed != 6 || inc.last_pos != 17 )
+    {
+        printf("first section edit: valid %d, read %u chars, pos %u\n",
+               inc.is_valid, inc.num_chars_parsed, inc.last_pos);
+        exit(-1);
+    }
+
+    /* Unhardening a section makes the next hardened section an error, and back */
+    strcpy(str, "m/0'/1'/{0-5,9}");
+    bip32_template_incremental_parse(&inc, str, strlen(str), BIP32_TEMPLATE_FORMAT_AMBIGOUS);
+    apply_edit(&inc, str, 3, 1, "");
+    if( inc.is_valid || inc.error != BIP32_TEMPLATE_ERROR_GOT_HARDENED_AFTER_UNHARDENED || inc.last_pos != 6 ) {
+        printf("unhardening: valid %d, error %d, pos %u\n", inc.is_valid, inc.error, inc.last_pos);
+        exit(-1);
+    }
+    apply_edit(&inc, str, 3, 0, "'");
+    if( !inc.is_valid ) {
+        printf("hardening back: error %d\n", inc.error);
+        exit(-1);
+    }
+
+    /* The edit after the error does not need any parsing */
+    strcpy(str, "m/0/1'/2/3");
+    bip32_template_incremental_parse(&inc, str, strlen(str), BIP32_TEMPLATE_FORMAT_AMBIGOUS);
+    apply_edit(&inc, str, 9, 1, "4");
+    if( inc.is_valid || inc.num_chars_parsed != 0 ) {
+        printf("edit after error: valid %d, read %u chars\n", inc.is_valid, inc.num_chars_parsed);
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_edits();
+    test_random_edits();
+
+    return 0;
+}
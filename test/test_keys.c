@@ -0,0 +1,273 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_keys.h"
+
+#define MAX_KEY_RANGES 1000
+
+static const char* template_strings[] = {
+    "m/{0-2}/{5,7-9}/*",
+    "m/0/*",
+    "m/*'/5",
+    "m/{0-3}'/{0,1}/{0-2,10-20}",
+    "m/*/*",
+    "m/*'",
+    "{0,1}/*",
+    "m/{0-1,4,2147483647}/2147483647/*",
+};
+
+static uint32_t random_index(void)
+{
+    uint32_t index = rand() % 4 == 0 ? (uint32_t)(2147483647 - rand() % 3) : (uint32_t)(rand() % 25);
+
+    if( rand() % 3 == 0 ) {
+        index |= 0x80000000;
+    }
+    return index;
+}
+
+static int compare_paths(const uint32_t* a, const uint32_t* b, unsigned int len)
+{
+    unsigned int i;
+
+    for( i = 0; i < len; i++ ) {
+        if( a[i] != b[i] ) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int sign(int v)
+{
+    return v < 0 ? -1 : v > 0;
+}
+
+static void test_encoding(void)
+{
+    uint32_t a[BIP32_TEMPLATE_MAX_SECTIONS], b[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t decoded[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint8_t key_a[BIP32_PATH_KEY_MAX_SIZE], key_b[BIP32_PATH_KEY_MAX_SIZE];
+    unsigned int len, key_len, decoded_len, decoded_is_partial, i;
+    int round, is_partial;
+
+    for( round = 0; round < 100000; round++ ) {
+        len = rand() % (BIP32_TEMPLATE_MAX_SECTIONS + 1);
+        is_partial = rand() % 2;
+        for( i = 0; i < len; i++ ) {
+            a[i] = random_index();
+            b[i] = rand() % 2 ? a[i] : random_index();
+        }
+        key_len = bip32_path_to_key(a, len, is_partial, key_a);
+        if( key_len != BIP32_PATH_KEY_HEADER_SIZE + len*4
+            || bip32_path_to_key(b, len, is_partial, key_b) != key_len )
+        {
+            fprintf(stderr, "unexpected key length\n");
+            exit(-1);
+        }
+        if( sign(memcmp(key_a, key_b, key_len)) != compare_paths(a, b, len) ) {
+            fprintf(stderr, "key order differs from path order\n");
+            exit(-1);
+        }
+        if( !bip32_path_from_key(key_a, key_len, decoded, &decoded_len, &decoded_is_partial)
+            || decoded_len != len || decoded_is_partial != (unsigned int)is_partial
+            || compare_paths(a, decoded, len) != 0 )
+        {
+            fprintf(stderr, "key does not decode back to the path\n");
+            exit(-1);
+        }
+        if( key_len > BIP32_PATH_KEY_HEADER_SIZE
+            && bip32_path_from_key(key_a, key_len - 1, decoded, &decoded_len, &decoded_is_partial) )
+        {
+            fprintf(stderr, "truncated key was decoded\n");
+            exit(-1);
+        }
+    }
+
+    if( bip32_path_to_key(a, BIP32_TEMPLATE_MAX_SECTIONS + 1, 0, key_a) != 0 ) {
+        fprintf(stderr, "too long path was encoded\n");
+        exit(-1);
+    }
+}
+
+static int is_key_in_ranges(const uint8_t* key_p, unsigned int key_len,
+                            const bip32_path_key_range_type* ranges, unsigned int num_ranges)
+{
+    unsigned int i, len;
+
+    for( i = 0; i < num_ranges; i++ ) {
+        len = ranges[i].lo_len < key_len ? ranges[i].lo_len : key_len;
+        if( memcmp(key_p, ranges[i].lo, len) < 0 ) {
+            continue;
+        }
+        if( ranges[i].hi_len == 0 ) {
+            return 1;
+        }
+        len = ranges[i].hi_len < key_len ? ranges[i].hi_len : key_len;
+        /* The key is below hi if its prefix of the size of hi is below hi */
+        if( memcmp(key_p, ranges[i].hi, len) < 0 ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void check_key_ranges(const char* template_string, const bip32_template_type* template_p,
+                             unsigned int max_ranges)
+{
+    static bip32_path_key_range_type ranges[MAX_KEY_RANGES];
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint8_t key[BIP32_PATH_KEY_MAX_SIZE];
+    unsigned int num_ranges, len, key_len, i;
+    int is_exact, is_partial, round, is_matched, is_in_ranges;
+
+    if( !bip32_template_to_key_ranges(template_p, ranges, max_ranges, &num_ranges, &is_exact) ) {
+        fprintf(stderr, "%s: no key ranges for limit %u\n", template_string, max_ranges);
+        exit(-1);
+    }
+    if( num_ranges == 0 || num_ranges > max_ranges ) {
+        fprintf(stderr, "%s: %u key ranges for limit %u\n", template_string, num_ranges, max_ranges);
+        exit(-1);
+    }
+    for( i = 0; i < num_ranges; i++ ) {
+        if( ranges[i].hi_len != 0 && ranges[i].hi_len != ranges[i].lo_len ) {
+            fprintf(stderr, "%s: bad key range\n", template_string);
+            exit(-1);
+        }
+        if( ranges[i].hi_len != 0 && memcmp(ranges[i].lo, ranges[i].hi, ranges[i].lo_len) >= 0 ) {
+            fprintf(stderr, "%s: empty key range\n", template_string);
+            exit(-1);
+        }
+        /* Touching ranges must be merged */
+        if( i > 0 && ( ranges[i-1].hi_len == 0
+                       || memcmp(ranges[i-1].hi, ranges[i].lo, ranges[i].lo_len) >= 0 ) )
+        {
+            fprintf(stderr, "%s: key ranges are not ordered\n", template_string);
+            exit(-1);
+        }
+    }
+
+    for( round = 0; round < 20000; round++ ) {
+        len = rand() % 4 == 0 ? rand() % (BIP32_TEMPLATE_MAX_SECTIONS + 1) : template_p->num_sections;
+        is_partial = rand() % 4 == 0 ? !template_p->is_partial : template_p->is_partial;
+        for( i = 0; i < len; i++ ) {
+            path[i] = rand() % 2 ? template_p->sections[i < (unsigned int)template_p->num_sections ? i : 0]
+                                     .ranges[0].range_start + rand() % 3
+                                 : random_index();
+        }
+        key_len = bip32_path_to_key(path, len, is_partial, key);
+        is_matched = is_partial == template_p->is_partial && bip32_template_match(template_p, path, len);
+        is_in_ranges = is_key_in_ranges(key, key_len, ranges, num_ranges);
+        if( is_matched && !is_in_ranges ) {
+            fprintf(stderr, "%s: matching path is not in the key ranges for limit %u\n",
+                    template_string, max_ranges);
+            exit(-1);
+        }
+        if( is_exact && !is_matched && is_in_ranges ) {
+            fprintf(stderr, "%s: non-matching path is in the exact key ranges for limit %u\n",
+                    template_string, max_ranges);
+            exit(-1);
+        }
+        if( len != (unsigned int)template_p->num_sections && is_in_ranges ) {
+            fprintf(stderr, "%s: path of different length is in the key ranges\n", template_string);
+            exit(-1);
+        }
+    }
+}
+
+static void test_key_ranges(void)
+{
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    unsigned int i, max_ranges;
+
+    for( i = 0; i < sizeof(template_strings)/sizeof(template_strings[0]); i++ ) {
+        if( !bip32_template_parse_string(template_strings[i], BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                                         &tmpl, &error, 0) )
+        {
+            fprintf(stderr, "%s: parse failed: %s\n", template_strings[i],
+                    bip32_template_error_to_string(error));
+            exit(-1);
+        }
+        for( max_ranges = 1; max_ranges <= 20; max_ranges++ ) {
+            check_key_ranges(template_strings[i], &tmpl, max_ranges);
+        }
+        check_key_ranges(template_strings[i], &tmpl, MAX_KEY_RANGES);
+    }
+}
+
+static void test_known_plan(void)
+{
+    bip32_path_key_range_type ranges[4];
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    unsigned int num_ranges;
+    int is_exact;
+
+    if( !bip32_template_parse_string("m/{0,1}/*", BIP32_TEMPLATE_FORMAT_AMBIGOUS, &tmpl, &error, 0) ) {
+        fprintf(stderr, "parse failed\n");
+        exit(-1);
+    }
+    /* The wildcard section gives one range for each of the two branches */
+    if( !bip32_template_to_key_ranges(&tmpl, ranges, 4, &num_ranges, &is_exact)
+        || num_ranges != 2 || !is_exact
+        || ranges[0].lo_len != 10
+        || memcmp(ranges[0].lo, "\x00\x02\x00\x00\x00\x00\x00\x00\x00\x00", 10) != 0
+        || memcmp(ranges[0].hi, "\x00\x02\x00\x00\x00\x00\x80\x00\x00\x00", 10) != 0
+        || memcmp(ranges[1].lo, "\x00\x02\x00\x00\x00\x01\x00\x00\x00\x00", 10) != 0
+        || memcmp(ranges[1].hi, "\x00\x02\x00\x00\x00\x01\x80\x00\x00\x00", 10) != 0 )
+    {
+        fprintf(stderr, "unexpected key ranges for m/{0,1}/*\n");
+        exit(-1);
+    }
+    /* With the limit of one range, the whole first section is one range */
+    if( !bip32_template_to_key_ranges(&tmpl, ranges, 1, &num_ranges, &is_exact)
+        || num_ranges != 1 || is_exact
+        || ranges[0].lo_len != 6 || ranges[0].hi_len != 6
+        || memcmp(ranges[0].lo, "\x00\x02\x00\x00\x00\x00", 6) != 0
+        || memcmp(ranges[0].hi, "\x00\x02\x00\x00\x00\x02", 6) != 0 )
+    {
+        fprintf(stderr, "unexpected limited key range for m/{0,1}/*\n");
+        exit(-1);
+    }
+    if( bip32_template_to_key_ranges(&tmpl, ranges, 0, &num_ranges, &is_exact) ) {
+        fprintf(stderr, "zero limit was accepted\n");
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_encoding();
+    test_key_ranges();
+    test_known_plan();
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_registry.h"
+
+#define NUM_READERS 4
+#define NUM_UPDATES 20000
+#define MAX_ID 64
+
+static bip32_template_registry_type registry;
+static bip32_template_registry_reader_type readers[NUM_READERS];
+static atomic_int is_writer_done;
+static unsigned long num_allocs;
+static unsigned long num_frees;
+
+static void* test_alloc(size_t size, void* arg)
+{
+    (void)arg;
+    num_allocs++;
+    return malloc(size);
+}
+
+/* The freed memory is overwritten, so that the reader that uses a freed snapshot
+ * would likely see the broken entries */
+static void test_free(void* p, void* arg)
+{
+    bip32_template_registry_snapshot_type* snapshot_p = p;
+
+    (void)arg;
+    num_frees++;
+    memset(snapshot_p->entries, 0xA5, snapshot_p->num_entries * sizeof(snapshot_p->entries[0]));
+    snapshot_p->num_entries = 0xA5A5A5A5;
+    free(p);
+}
+
+/* The template of the id matches only the paths id/{0-id} */
+static void make_template(uint32_t id, bip32_template_type* template_p)
+{
+    memset(template_p, 0, sizeof(*template_p));
+    template_p->num_sections = 2;
+    template_p->sections[0].num_ranges = 1;
+    template_p->sections[0].ranges[0].range_start = id;
+    template_p->sections[0].ranges[0].range_end = id;
+    template_p->sections[1].num_ranges = 1;
+    template_p->sections[1].ranges[0].range_start = 0;
+    template_p->sections[1].ranges[0].range_end = id;
+}
+
+static void check_snapshot(const bip32_template_registry_snapshot_type* snapshot_p)
+{
+    uint32_t path[2];
+    uint32_t ids[2];
+    unsigned int i;
+
+    if( snapshot_p->num_entries > MAX_ID ) {
+        fprintf(stderr, "snapshot is broken\n");
+        exit(-1);
+    }
+    for( i = 0; i < snapshot_p->num_entries; i++ ) {
+        const bip32_template_registry_entry_type* entry_p = &snapshot_p->entries[i];
+        if( (i > 0 && entry_p->id <= snapshot_p->entries[i-1].id)
+            || entry_p->tmpl.num_sections != 2
+            || entry_p->tmpl.sections[0].ranges[0].range_start != entry_p->id
+            || entry_p->tmpl.sections[1].ranges[0].range_end != entry_p->id )
+        {
+            fprintf(stderr, "snapshot entry is broken\n");
+            exit(-1);
+        }
+        path[0] = entry_p->id;
+        path[1] = entry_p->id / 2;
+        if( bip32_template_registry_snapshot_match(snapshot_p, path, 2, ids, 2) != 1 || ids[0] != entry_p->id ) {
+            fprintf(stderr, "path does not match the template in the snapshot\n");
+            exit(-1);
+        }
+    }
+}
+
+static void* reader_thread(void* arg)
+{
+    unsigned int reader_num = (unsigned int)(size_t)arg;
+    const bip32_template_registry_snapshot_type* snapshot_p;
+    uint64_t last_version = 0;
+    unsigned int round = 0;
+    unsigned int i;
+
+    bip32_template_registry_reader_online(&registry, reader_num);
+    while( !atomic_load(&is_writer_done) ) {
+        for( i = 0; i < 16; i++ ) {
+            snapshot_p = bip32_template_registry_acquire(&registry);
+            if( snapshot_p->version < last_version ) {
+                fprintf(stderr, "reader %u went back from version %llu to %llu\n", reader_num,
+                        (unsigned long long)last_version, (unsigned long long)snapshot_p->version);
+                exit(-1);
+            }
+            last_version = snapshot_p->version;
+            check_snapshot(snapshot_p);
+        }
+        if( ++round % 64 == 0 ) {
+            bip32_template_registry_reader_offline(&registry, reader_num);
+            bip32_template_registry_reader_online(&registry, reader_num);
+        }
+        else {
+            bip32_template_registry_quiescent(&registry, reader_num);
+        }
+    }
+    bip32_template_registry_reader_offline(&registry, reader_num);
+
+    return 0;
+}
+
+static void test_concurrent(void)
+{
+    bip32_template_allocator_type allocator = { test_alloc, test_free, 0 };
+    bip32_template_type tmpl;
+    pthread_t threads[NUM_READERS];
+    unsigned int i;
+    uint32_t id;
+
+    if( !bip32_template_registry_init(&registry, readers, NUM_READERS, &allocator) ) {
+        fprintf(stderr, "registry init failed\n");
+        exit(-1);
+    }
+    for( i = 0; i < NUM_READERS; i++ ) {
+        pthread_create(&threads[i], 0, reader_thread, (void*)(size_t)i);
+    }
+
+    for( i = 0; i < NUM_UPDATES; i++ ) {
+        id = rand() % MAX_ID;
+        if( rand() % 2 ) {
+            make_template(id, &tmpl);
+            if( !bip32_template_registry_add(&registry, id, &tmpl) ) {
+                fprintf(stderr, "add failed\n");
+                exit(-1);
+            }
+        }
+        else {
+            bip32_template_registry_remove(&registry, id);
+        }
+    }
+
+    atomic_store(&is_writer_done, 1);
+    for( i = 0; i < NUM_READERS; i++ ) {
+        pthread_join(threads[i], 0);
+    }
+
+    /* All readers are offline, so all replaced snapshots can be freed */
+    bip32_template_registry_reclaim(&registry);
+    if( registry.retired ) {
+        fprintf(stderr, "replaced snapshots are not freed\n");
+        exit(-1);
+    }
+    check_snapshot(bip32_template_registry_acquire(&registry));
+    bip32_template_registry_destroy(&registry);
+    if( num_allocs != num_frees ) {
+        fprintf(stderr, "%lu snapshots allocated, %lu freed\n", num_allocs, num_frees);
+        exit(-1);
+    }
+}
+
+/* The snapshot held by the reader is not freed until the reader passes a quiescent point */
+static void test_reclaim(void)
+{
+    bip32_template_allocator_type allocator = { test_alloc, test_free, 0 };
+    const bip32_template_registry_snapshot_type* snapshot_p;
+    bip32_template_type tmpl;
+
+    num_allocs = num_frees = 0;
+    bip32_template_registry_init(&registry, readers, NUM_READERS, &allocator);
+    bip32_template_registry_reader_online(&registry, 1);
+    snapshot_p = bip32_template_registry_acquire(&registry);
+
+    make_template(5, &tmpl);
+    bip32_template_registry_add(&registry, 5, &tmpl);
+    bip32_template_registry_add(&registry, 7, &tmpl);
+    if( num_frees != 0 || snapshot_p->num_entries != 0 ) {
+        fprintf(stderr, "held snapshot was freed\n");
+        exit(-1);
+    }
+    if( !bip32_template_registry_remove(&registry, 7) || bip32_template_registry_remove(&registry, 7) ) {
+        fprintf(stderr, "unexpected remove result\n");
+        exit(-1);
+    }
+
+    bip32_template_registry_quiescent(&registry, 1);
+    snapshot_p = bip32_template_registry_acquire(&registry);
+    if( bip32_template_registry_reclaim(&registry) != 3 || num_frees != 3
+        || snapshot_p->num_entries != 1 || snapshot_p->entries[0].id != 5 || snapshot_p->version != 3 )
+    {
+        fprintf(stderr, "unexpected reclaim result\n");
+        exit(-1);
+    }
+
+    bip32_template_registry_reader_offline(&registry, 1);
+    bip32_template_registry_destroy(&registry);
+    if( num_allocs != num_frees ) {
+        fprintf(stderr, "%lu snapshots allocated, %lu freed\n", num_allocs, num_frees);
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_reclaim();
+    test_concurrent();
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../bip32template_sample.h"
+
+#define NUM_SAMPLES 180000
+
+static uint64_t splitmix64(void* arg)
+{
+    uint64_t* state_p = arg;
+    uint64_t z = (*state_p += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void parse_or_die(const char* str, bip32_template_type* template_p)
+{
+    bip32_template_error_type error;
+    unsigned int last_pos;
+
+    if( !bip32_template_parse_string(str, BIP32_TEMPLATE_FORMAT_AMBIGOUS, template_p, &error, &last_pos) ) {
+        printf("cannot parse \"%s\": %s at %u\n", str, bip32_template_error_to_string(error), last_pos);
+        exit(-1);
+    }
+}
+
+/* The count is expected to be within 5 standard deviations of the mean */
+static void check_count(const char* what, unsigned long count, unsigned long num_samples, double p)
+{
+    double mean = num_samples * p;
+    double sigma = sqrt(num_samples * p * (1 - p));
+
+    if( fabs(count - mean) > 5 * sigma ) {
+        printf("%s: %lu samples, expected %.1f +- %.1f\n", what, count, mean, sigma);
+        exit(-1);
+    }
+}
+
+/* Every path of a small template is drawn about equally often */
+static void test_uniform(int is_batch)
+{
+    static uint32_t paths[NUM_SAMPLES * 3];
+    static const uint32_t firsts[] = { 0x80000000, 0x80000001, 0x80000005 };
+    static const uint32_t lasts[] = { 3, 7, 8 };
+    unsigned long counts[3][2][3] = { { { 0 } } };
+    bip32_template_sampler_type sampler;
+    bip32_template_type tmpl;
+    uint64_t state = 1;
+    uint32_t* path_p;
+    char what[64];
+    int i, a, b, c;
+
+    parse_or_die("m/{0-1,5}'/{2-3}/{3,7-8}", &tmpl);
+    if( !bip32_template_sampler_init(&sampler, &tmpl) || bip32_template_sampler_num_paths(&sampler) != 18 ) {
+        printf("wrong number of paths\n");
+        exit(-1);
+    }
+
+    if( is_batch ) {
+        bip32_template_sample_batch(&sampler, splitmix64, &state, paths, NUM_SAMPLES);
+    }
+    for( i = 0; i < NUM_SAMPLES; i++ ) {
+        path_p = &paths[i * 3];
+        if( !is_batch ) {
+            bip32_template_sample(&sampler, splitmix64, &state, path_p);
+        }
+        if( !bip32_template_match(&tmpl, path_p, 3) ) {
+            printf("sampled path %x/%u/%u does not match\n", path_p[0], path_p[1], path_p[2]);
+            exit(-1);
+        }
+        for( a = 0; firsts[a] != path_p[0]; a++ );
+        for( c = 0; lasts[c] != path_p[2]; c++ );
+        counts[a][path_p[1] - 2][c]++;
+    }
+
+    for( a = 0; a < 3; a++ ) {
+        for( b = 0; b < 2; b++ ) {
+            for( c = 0; c < 3; c++ ) {
+                snprintf(what, sizeof(what), "%s path %x/%u/%u", is_batch ? "batch" : "single",
+                         firsts[a], b + 2, lasts[c]);
+                check_count(what, counts[a][b][c], NUM_SAMPLES, 1.0 / 18);
+            }
+        }
+    }
+}
+
+/* With wildcard sections, the ranges are chosen in proportion to their widths */
+static void test_wide(void)
+{
+    static uint32_t paths[NUM_SAMPLES * 2];
+    bip32_template_sampler_type sampler;
+    bip32_template_type tmpl;
+    uint64_t state = 2;
+    unsigned long num_low = 0, num_high_half = 0;
+    int i;
+
+    parse_or_die("{0,1000000000-2147483647}'/*", &tmpl);
+    bip32_template_sampler_init(&sampler, &tmpl);
+    bip32_template_sample_batch(&sampler, splitmix64, &state, paths, NUM_SAMPLES);
+    for( i = 0; i < NUM_SAMPLES; i++ ) {
+        if( !bip32_template_match(&tmpl, &paths[i * 2], 2) ) {
+            printf("sampled path %x/%x does not match\n", paths[i * 2], paths[i * 2 + 1]);
+            exit(-1);
+        }
+        num_low += paths[i * 2] == 0x80000000;
+        num_high_half += paths[i * 2 + 1] >= 0x40000000;
+    }
+    if( num_low > 2 ) {
+        printf("the single index was drawn %lu times\n", num_low);
+        exit(-1);
+    }
+    check_count("wildcard upper half", num_high_half, NUM_SAMPLES, 0.5);
+}
+
+/* The sections made by hand, not by the parser, can be empty or span both halves */
+static void test_bad_sections(void)
+{
+    bip32_template_sampler_type sampler;
+    bip32_template_type tmpl;
+
+    parse_or_die("0/*", &tmpl);
+    tmpl.sections[1].ranges[1].range_start = 0x80000000;
+    tmpl.sections[1].ranges[1].range_end = 0xFFFFFFFF;
+    tmpl.sections[1].num_ranges = 2;
+    if( bip32_template_sampler_init(&sampler, &tmpl) ) {
+        printf("section wider than 2^31 was accepted\n");
+        exit(-1);
+    }
+
+    parse_or_die("0/*", &tmpl);
+    tmpl.sections[1].num_ranges = 0;
+    if( bip32_template_sampler_init(&sampler, &tmpl) ) {
+        printf("empty section was accepted\n");
+        exit(-1);
+    }
+}
+
+/* The templates are chosen in proportion to their sizes */
+static void test_multi(void)
+{
+    static const char* strs[] = { "m/0/{0-9}", "m/1/{0-29}", "m/2/{0-2}/{0-19}", "m/3/4" };
+    static const double sizes[] = { 10, 30, 60, 1 };
+    bip32_template_sampler_type samplers[4];
+    bip32_template_alias_entry_type entries[4];
+    bip32_template_multi_sampler_type multi;
+    bip32_template_type tmpl;
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int path_len, chosen;
+    unsigned long counts[4] = { 0 };
+    uint64_t state = 3;
+    char what[64];
+    int i;
+
+    for( i = 0; i < 4; i++ ) {
+        parse_or_die(strs[i], &tmpl);
+        bip32_template_sampler_init(&samplers[i], &tmpl);
+    }
+    if( bip32_template_multi_sampler_init(&multi, samplers, 0, entries) ) {
+        printf("multi-sampler without templates was created\n");
+        exit(-1);
+    }
+    bip32_template_multi_sampler_init(&multi, samplers, 4, entries);
+
+    for( i = 0; i < NUM_SAMPLES; i++ ) {
+        chosen = bip32_template_multi_sample(&multi, splitmix64, &state, path, &path_len);
+        if( chosen >= 4 || path_len != samplers[chosen].tmpl.num_sections
+            || !bip32_template_match(&samplers[chosen].tmpl, path, path_len) )
+        {
+            printf("multi-sampled path does not match the chosen template %u\n", chosen);
+            exit(-1);
+        }
+        counts[chosen]++;
+    }
+    for( i = 0; i < 4; i++ ) {
+        snprintf(what, sizeof(what), "template %s", strs[i]);
+        check_count(what, counts[i], NUM_SAMPLES, sizes[i] / 101);
+    }
+
+    /* The sizes that do not fit into 64 bits */
+    parse_or_die("*/*/*", &tmpl);
+    bip32_template_sampler_init(&samplers[0], &tmpl);
+    parse_or_die("*/*", &tmpl);
+    bip32_template_sampler_init(&samplers[1], &tmpl);
+    bip32_template_multi_sampler_init(&multi, samplers, 2, entries);
+    for( i = 0; i < 1000; i++ ) {
+        if( bip32_template_multi_sample(&multi, splitmix64, &state, path, &path_len) != 0 ) {
+            printf("the template 2^31 times smaller was chosen\n");
+            exit(-1);
+        }
+    }
+}
+
+int main(void)
+{
+    test_uniform(0);
+    test_uniform(1);
+    test_wide();
+    test_bad_sections();
+    test_multi();
+
+    printf("sample tests passed\n");
+
+    return 0;
+}
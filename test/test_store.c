@@ -0,0 +1,286 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_store.h"
+
+#define MAX_PATHS 50000
+#define MAX_PREFIXES MAX_PATHS
+#define MAX_BLOCKS MAX_PATHS
+#define MAX_WORDS MAX_PATHS
+
+typedef struct {
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int len;
+} test_path_type;
+
+static test_path_type paths[MAX_PATHS];
+static unsigned int num_paths;
+
+static bip32_template_store_prefix_type prefixes[MAX_PREFIXES];
+static bip32_template_store_block_type blocks[MAX_BLOCKS];
+static uint32_t words[MAX_WORDS];
+static bip32_template_store_type store;
+
+static uint64_t next_expected;
+static const bip32_template_type* matched_template;
+
+static const char* template_strings[] = {
+    "m/84'/0'/*",
+    "m/84'/{0-2}'/{0-99}",
+    "m/84'/1'/{5,100-200,1000-1999}",
+    "m/{0-100}'/*'/*",
+    "m/*/*",
+    "m/0",
+    "m/*",
+    "m/84'/0'/2147483647",
+};
+
+/* Paths like 84'/a'/i with increasing i, mixed with other paths */
+static void generate_paths(void)
+{
+    uint32_t last = 0;
+    unsigned int i;
+
+    num_paths = 0;
+    while( num_paths < MAX_PATHS ) {
+        test_path_type* p = &paths[num_paths++];
+        switch( rand() % 20 ) {
+            case 0:
+                /* A different prefix or a different length */
+                p->len = 1 + rand() % BIP32_TEMPLATE_MAX_SECTIONS;
+                for( i = 0; i < p->len; i++ ) {
+                    p->path[i] = rand() % 3 ? (uint32_t)rand() % 200 : 0x80000000 + rand() % 200;
+                }
+                break;
+            case 1:
+                /* Start over with a new account */
+                last = rand() % 10;
+                /* fall through */
+            default:
+                p->len = 3;
+                p->path[0] = 0x80000000 + 84;
+                p->path[1] = 0x80000000 + (rand() % 100 == 0 ? (uint32_t)(rand() % 3) : num_paths / 20000);
+                last += rand() % 4 == 0 ? rand() % 100000 : rand() % 3;
+                p->path[2] = rand() % 1000 == 0 ? 2147483647 : last;
+                break;
+        }
+    }
+}
+
+static void fill_store(void)
+{
+    bip32_template_error_type error;
+    unsigned int i;
+
+    bip32_template_store_init(&store, prefixes, MAX_PREFIXES, blocks, MAX_BLOCKS, words, MAX_WORDS);
+    for( i = 0; i < num_paths; i++ ) {
+        if( !bip32_template_store_add_path(&store, paths[i].path, paths[i].len, &error) ) {
+            fprintf(stderr, "add_path failed for path %u: %s\n", i, bip32_template_error_to_string(error));
+            exit(-1);
+        }
+    }
+}
+
+static void check_get_path(void)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int len, i;
+
+    for( i = 0; i < num_paths; i++ ) {
+        if( !bip32_template_store_get_path(&store, i, path, &len)
+            || len != paths[i].len || memcmp(path, paths[i].path, len * sizeof(path[0])) != 0 )
+        {
+            fprintf(stderr, "path %u is not stored correctly\n", i);
+            exit(-1);
+        }
+    }
+    if( bip32_template_store_get_path(&store, num_paths, path, &len) ) {
+        fprintf(stderr, "path past the end was returned\n");
+        exit(-1);
+    }
+}
+
+/* Each matching path must be reported in order, and no other path */
+static void on_match(uint64_t path_num, const uint32_t* path_p, unsigned int path_len, void* arg)
+{
+    (void)arg;
+    while( next_expected < path_num ) {
+        if( bip32_template_match(matched_template, paths[next_expected].path, paths[next_expected].len) ) {
+            fprintf(stderr, "path %llu was not reported\n", (unsigned long long)next_expected);
+            exit(-1);
+        }
+        next_expected++;
+    }
+    if( path_num != next_expected || path_len != paths[path_num].len
+        || memcmp(path_p, paths[path_num].path, path_len * sizeof(path_p[0])) != 0
+        || !bip32_template_match(matched_template, path_p, path_len) )
+    {
+        fprintf(stderr, "path %llu was reported unexpectedly\n", (unsigned long long)path_num);
+        exit(-1);
+    }
+    next_expected++;
+}
+
+static void check_match(const char* template_string)
+{
+    bip32_template_store_match_stats_type stats = { 0, 0, 0 };
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    uint64_t expected = 0;
+    uint64_t count;
+    unsigned int i;
+
+    if( !bip32_template_parse_string(template_string, BIP32_TEMPLATE_FORMAT_AMBIGOUS, &tmpl, &error, 0) ) {
+        fprintf(stderr, "%s: parse failed\n", template_string);
+        exit(-1);
+    }
+    for( i = 0; i < num_paths; i++ ) {
+        expected += bip32_template_match(&tmpl, paths[i].path, paths[i].len);
+    }
+
+    count = bip32_template_store_match(&store, &tmpl, 0, 0, &stats);
+    if( count != expected ) {
+        fprintf(stderr, "%s: %llu paths matched, expected %llu\n", template_string,
+                (unsigned long long)count, (unsigned long long)expected);
+        exit(-1);
+    }
+    if( stats.num_blocks_skipped + stats.num_blocks_matched + stats.num_blocks_unpacked != store.num_blocks ) {
+        fprintf(stderr, "%s: unexpected block stats\n", template_string);
+        exit(-1);
+    }
+
+    next_expected = 0;
+    matched_template = &tmpl;
+    if( bip32_template_store_match(&store, &tmpl, on_match, 0, 0) != expected ) {
+        fprintf(stderr, "%s: unexpected count with callback\n", template_string);
+        exit(-1);
+    }
+    for( ; next_expected < num_paths; next_expected++ ) {
+        if( bip32_template_match(&tmpl, paths[next_expected].path, paths[next_expected].len) ) {
+            fprintf(stderr, "%s: path %llu was not reported\n", template_string,
+                    (unsigned long long)next_expected);
+            exit(-1);
+        }
+    }
+}
+
+static void test_store(void)
+{
+    unsigned int i;
+    int round;
+
+    for( round = 0; round < 5; round++ ) {
+        generate_paths();
+        fill_store();
+        check_get_path();
+        for( i = 0; i < sizeof(template_strings)/sizeof(template_strings[0]); i++ ) {
+            check_match(template_strings[i]);
+        }
+        if( store.num_words * 4 + store.num_blocks * sizeof(blocks[0]) >= num_paths * 12 ) {
+            fprintf(stderr, "store is not smaller than the paths\n");
+            exit(-1);
+        }
+    }
+}
+
+/* The blocks of the other accounts are skipped without unpacking */
+static void test_skip(void)
+{
+    bip32_template_store_match_stats_type stats = { 0, 0, 0 };
+    bip32_template_type tmpl;
+    bip32_template_error_type error;
+    uint32_t path[3] = { 0x80000000 + 84, 0x80000000, 0 };
+    unsigned int i;
+
+    bip32_template_store_init(&store, prefixes, MAX_PREFIXES, blocks, MAX_BLOCKS, words, MAX_WORDS);
+    for( i = 0; i < 4 * BIP32_TEMPLATE_STORE_BLOCK_SIZE; i++ ) {
+        path[1] = 0x80000000 + i / BIP32_TEMPLATE_STORE_BLOCK_SIZE;
+        path[2] = i % BIP32_TEMPLATE_STORE_BLOCK_SIZE;
+        bip32_template_store_add_path(&store, path, 3, &error);
+    }
+    path[2] = 0;
+    bip32_template_store_add_path(&store, path, 3, &error);
+
+    bip32_template_parse_string("m/84'/{1-2}'/*", BIP32_TEMPLATE_FORMAT_AMBIGOUS, &tmpl, &error, 0);
+    if( bip32_template_store_match(&store, &tmpl, 0, 0, &stats) != 2 * BIP32_TEMPLATE_STORE_BLOCK_SIZE
+        || stats.num_blocks_skipped != 2 || stats.num_blocks_matched != 2 || stats.num_blocks_unpacked != 0 )
+    {
+        fprintf(stderr, "blocks are not skipped as expected\n");
+        exit(-1);
+    }
+
+    bip32_template_parse_string("m/84'/0'/{5,10}", BIP32_TEMPLATE_FORMAT_AMBIGOUS, &tmpl, &error, 0);
+    stats.num_blocks_skipped = stats.num_blocks_matched = stats.num_blocks_unpacked = 0;
+    if( bip32_template_store_match(&store, &tmpl, 0, 0, &stats) != 2
+        || stats.num_blocks_skipped != 3 || stats.num_blocks_unpacked != 1 )
+    {
+        fprintf(stderr, "blocks are not unpacked as expected\n");
+        exit(-1);
+    }
+}
+
+static void test_errors(void)
+{
+    bip32_template_error_type error;
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS + 1] = { 1, 2, 3 };
+
+    bip32_template_store_init(&store, prefixes, 1, blocks, 1, words, 0);
+    if( bip32_template_store_add_path(&store, path, 0, &error) || error != BIP32_TEMPLATE_ERROR_PATH_EMPTY ) {
+        fprintf(stderr, "empty path was not rejected\n");
+        exit(-1);
+    }
+    if( bip32_template_store_add_path(&store, path, BIP32_TEMPLATE_MAX_SECTIONS + 1, &error)
+        || error != BIP32_TEMPLATE_ERROR_PATH_TOO_LONG )
+    {
+        fprintf(stderr, "too long path was not rejected\n");
+        exit(-1);
+    }
+    /* The same index does not need any words, a different one does */
+    if( !bip32_template_store_add_path(&store, path, 2, &error)
+        || !bip32_template_store_add_path(&store, path, 2, &error) )
+    {
+        fprintf(stderr, "path was not added\n");
+        exit(-1);
+    }
+    path[0] = 5;
+    if( bip32_template_store_add_path(&store, path, 2, &error) || error != BIP32_TEMPLATE_ERROR_UNDEFINED ) {
+        fprintf(stderr, "path with new prefix was added to the full dictionary\n");
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_store();
+    test_skip();
+    test_errors();
+
+    return 0;
+}
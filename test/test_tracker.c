@@ -0,0 +1,275 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_tracker.h"
+
+#define WINDOW_SIZE 300000
+
+static long num_outstanding_allocs;
+static long allocs_left = -1; /* fail the allocations after this many, -1 to never fail */
+
+static void* test_alloc(size_t size, void* arg)
+{
+    (void)arg;
+    if( allocs_left == 0 ) {
+        return NULL;
+    }
+    if( allocs_left > 0 ) {
+        allocs_left--;
+    }
+    num_outstanding_allocs++;
+    return malloc(size);
+}
+
+static void test_free(void* p, void* arg)
+{
+    (void)arg;
+    num_outstanding_allocs--;
+    free(p);
+}
+
+static const bip32_template_tracker_allocator_type allocator = { test_alloc, test_free, 0 };
+
+static void parse_or_die(const char* str, bip32_template_type* template_p)
+{
+    bip32_template_error_type error;
+    unsigned int last_pos;
+
+    if( !bip32_template_parse_string(str, BIP32_TEMPLATE_FORMAT_AMBIGOUS, template_p, &error, &last_pos) ) {
+        printf("cannot parse \"%s\": %s at %u\n", str, bip32_template_error_to_string(error), last_pos);
+        exit(-1);
+    }
+}
+
+static void test_ordinals(void)
+{
+    bip32_template_tracker_type tracker;
+    bip32_template_type tmpl;
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t prev[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint32_t bad_path[3] = { 4 + 0x80000000, 0, 0 };
+    uint64_t ordinal, back;
+    unsigned int i;
+
+    parse_or_die("m/{0-3,5}'/{0,1}/{0-2,10-20}", &tmpl);
+    if( !bip32_template_tracker_init(&tracker, &tmpl, &allocator) || tracker.num_paths != 140 ) {
+        printf("wrong number of paths\n");
+        exit(-1);
+    }
+
+    for( ordinal = 0; ordinal < tracker.num_paths; ordinal++ ) {
+        bip32_template_tracker_path_at(&tracker, ordinal, path);
+        if( !bip32_template_match(&tmpl, path, tmpl.num_sections)
+            || !bip32_template_tracker_path_ordinal(&tracker, path, tmpl.num_sections, &back)
+            || back != ordinal )
+        {
+            printf("ordinal %llu does not round-trip\n", (unsigned long long)ordinal);
+            exit(-1);
+        }
+        if( ordinal > 0 ) {
+            for( i = 0; i < tmpl.num_sections && prev[i] == path[i]; i++ ) {
+            }
+            if( i == tmpl.num_sections || prev[i] > path[i] ) {
+                printf("ordinal %llu is out of order\n", (unsigned long long)ordinal);
+                exit(-1);
+            }
+        }
+        memcpy(prev, path, sizeof(prev));
+    }
+
+    if( bip32_template_tracker_path_ordinal(&tracker, bad_path, 3, &ordinal)
+        || bip32_template_tracker_path_ordinal(&tracker, path, 2, &ordinal) )
+    {
+        printf("non-matching path has an ordinal\n");
+        exit(-1);
+    }
+    bip32_template_tracker_destroy(&tracker);
+
+    parse_or_die("*/*", &tmpl);
+    if( !bip32_template_tracker_init(&tracker, &tmpl, &allocator) || tracker.num_paths != (1ULL << 62) ) {
+        printf("wrong number of paths of */*\n");
+        exit(-1);
+    }
+    parse_or_die("*/*/*", &tmpl);
+    if( bip32_template_tracker_init(&tracker, &tmpl, &allocator) ) {
+        printf("the number of paths of */*/* does not fit, but init succeeded\n");
+        exit(-1);
+    }
+}
+
+static void check_against_reference(const bip32_template_tracker_type* tracker_p, const uint8_t* ref,
+                                    uint64_t base, const char* what)
+{
+    static uint32_t ref_counts[WINDOW_SIZE + 1];
+    uint64_t from, expected, got, start, end, count;
+    int round, is_found;
+
+    for( round = 0; round < 5000; round++ ) {
+        from = base + rand() % (WINDOW_SIZE + 100) - 50;
+        if( bip32_template_tracker_test(tracker_p, from)
+            != (from >= base && from < base + WINDOW_SIZE && ref[from - base]) )
+        {
+            printf("%s: test of %llu is wrong\n", what, (unsigned long long)from);
+            exit(-1);
+        }
+
+        for( expected = from; expected >= base && expected < base + WINDOW_SIZE && ref[expected - base];
+             expected++ )
+        {
+        }
+        is_found = bip32_template_tracker_next_unused(tracker_p, from, &got);
+        if( !is_found || got != expected ) {
+            printf("%s: next unused from %llu is %llu, expected %llu\n", what,
+                   (unsigned long long)from, (unsigned long long)got, (unsigned long long)expected);
+            exit(-1);
+        }
+    }
+
+    ref_counts[0] = 0;
+    for( from = 0; from < WINDOW_SIZE; from++ ) {
+        ref_counts[from + 1] = ref_counts[from] + ref[from];
+    }
+
+    for( round = 0; round < 2000; round++ ) {
+        start = rand() % WINDOW_SIZE;
+        end = start + rand() % (WINDOW_SIZE - start + 1);
+        count = ref_counts[end] - ref_counts[start];
+        if( bip32_template_tracker_count(tracker_p, base + start, base + end) != count ) {
+            printf("%s: count of %llu-%llu is wrong\n", what, (unsigned long long)start, (unsigned long long)end);
+            exit(-1);
+        }
+    }
+}
+
+static void test_random(void)
+{
+    bip32_template_tracker_type tracker;
+    bip32_template_tracker_type restored;
+    bip32_template_type tmpl;
+    static uint8_t ref[WINDOW_SIZE];
+    uint32_t prefix[2] = { 3, 1 };
+    uint64_t base, ordinal, count, expected;
+    uint8_t* buf;
+    size_t size;
+    int i, ii, run_len;
+
+    /* The window starts before the branch 3/1 and covers its beginning */
+    parse_or_die("{0-9}/{0,1}/*", &tmpl);
+    if( !bip32_template_tracker_init(&tracker, &tmpl, &allocator) ) {
+        printf("cannot init the tracker\n");
+        exit(-1);
+    }
+    base = (3 * 2 + 1) * (1ULL << 31) - 100000;
+
+    memset(ref, 0, sizeof(ref));
+    for( i = 0; i < 200; i++ ) {
+        /* Dense runs make bitmaps, the single ordinals stay in arrays */
+        run_len = rand() % 4 == 0 ? rand() % 20000 : 1;
+        ordinal = rand() % WINDOW_SIZE;
+        for( ii = 0; ii < run_len && ordinal + ii < WINDOW_SIZE; ii++ ) {
+            ref[ordinal + ii] = 1;
+            if( !bip32_template_tracker_set(&tracker, base + ordinal + ii) ) {
+                printf("cannot set %llu\n", (unsigned long long)(base + ordinal + ii));
+                exit(-1);
+            }
+        }
+    }
+    if( bip32_template_tracker_set(&tracker, tracker.num_paths) ) {
+        printf("ordinal past the end was set\n");
+        exit(-1);
+    }
+
+    check_against_reference(&tracker, ref, base, "random");
+
+    expected = 0;
+    for( i = 100000; i < WINDOW_SIZE; i++ ) {
+        expected += ref[i];
+    }
+    if( !bip32_template_tracker_branch_count(&tracker, prefix, 2, &count) || count != expected
+        || !bip32_template_tracker_branch_count(&tracker, prefix, 0, &count) || count != tracker.num_set )
+    {
+        printf("wrong branch count\n");
+        exit(-1);
+    }
+
+    size = bip32_template_tracker_serialized_size(&tracker);
+    buf = malloc(size);
+    if( bip32_template_tracker_serialize(&tracker, buf, size - 1) != 0
+        || bip32_template_tracker_serialize(&tracker, buf, size) != size )
+    {
+        printf("wrong serialized size\n");
+        exit(-1);
+    }
+    bip32_template_tracker_init(&restored, &tmpl, &allocator);
+    if( !bip32_template_tracker_deserialize(&restored, buf, size) || restored.num_set != tracker.num_set ) {
+        printf("cannot deserialize\n");
+        exit(-1);
+    }
+    check_against_reference(&restored, ref, base, "deserialized");
+
+    if( bip32_template_tracker_deserialize(&restored, buf, size - 1) || restored.num_set != 0 ) {
+        printf("truncated data was deserialized\n");
+        exit(-1);
+    }
+    /* The first container claims no ordinals */
+    memset(buf + 16 + 8, 0, 4);
+    if( bip32_template_tracker_deserialize(&restored, buf, size) ) {
+        printf("corrupted data was deserialized\n");
+        exit(-1);
+    }
+    free(buf);
+    bip32_template_tracker_destroy(&restored);
+
+    /* Failed allocation leaves the tracker as it was */
+    allocs_left = 0;
+    for( i = 0; i < 1000; i++ ) {
+        ordinal = (uint64_t)rand() * rand() % tracker.num_paths;
+        if( bip32_template_tracker_set(&tracker, ordinal) != bip32_template_tracker_test(&tracker, ordinal) ) {
+            printf("failed set changed the tracker\n");
+            exit(-1);
+        }
+    }
+    allocs_left = -1;
+    check_against_reference(&tracker, ref, base, "after failed allocations");
+
+    bip32_template_tracker_destroy(&tracker);
+    if( num_outstanding_allocs != 0 ) {
+        printf("%ld allocations are not freed\n", num_outstanding_allocs);
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_ordinals();
+    test_random();
+
+    return 0;
+}
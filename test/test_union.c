@@ -0,0 +1,266 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bip32template_union.h"
+
+#define MAX_TEMPLATES 6
+/* The indexes of the random templates are below this */
+#define VALUE_SPACE 28
+
+static bip32_template_type templates[MAX_TEMPLATES];
+static unsigned int num_templates;
+
+static void parse_or_die(const char* str, bip32_template_type* template_p)
+{
+    bip32_template_error_type error;
+    unsigned int last_pos;
+
+    if( !bip32_template_parse_string(str, BIP32_TEMPLATE_FORMAT_AMBIGOUS, template_p, &error, &last_pos) ) {
+        printf("cannot parse \"%s\": %s at %u\n", str, bip32_template_error_to_string(error), last_pos);
+        exit(-1);
+    }
+}
+
+static void check_run(const bip32_template_union_run_type* run_p, const unsigned int* sources,
+                      const uint32_t* path, uint32_t last_start, uint32_t last_end,
+                      unsigned int num_sources, unsigned int source)
+{
+    unsigned int i;
+
+    for( i = 0; i + 1 < run_p->path_len; i++ ) {
+        if( run_p->path[i] != path[i] ) {
+            printf("run prefix differs at %u: %u, expected %u\n", i, run_p->path[i], path[i]);
+            exit(-1);
+        }
+    }
+    if( run_p->path[i] != last_start || run_p->last_end != last_end
+        || run_p->num_sources != num_sources || sources[0] != source )
+    {
+        printf("run %u-%u from %u sources (first %u), expected %u-%u from %u (first %u)\n",
+               run_p->path[i], run_p->last_end, run_p->num_sources, sources[0],
+               last_start, last_end, num_sources, source);
+        exit(-1);
+    }
+}
+
+static void test_overlapping(void)
+{
+    bip32_template_union_type u;
+    bip32_template_union_cursor_type cursors[2];
+    bip32_template_union_run_type run;
+    unsigned int heap[2];
+    unsigned int sources[2];
+    uint32_t prefix_0[] = { 0x80000000, 0 };
+    uint32_t prefix_1[] = { 0x80000000, 1 };
+    uint32_t prefix_2[] = { 0x80000001, 0 };
+
+    parse_or_die("m/*'/0/*", &templates[0]);
+    parse_or_die("m/{0-4}'/{0,1}/{0-99}", &templates[1]);
+    bip32_template_union_init(&u, templates, 2, cursors, heap);
+
+    if( !bip32_template_union_next(&u, &run, sources) ) {
+        printf("union is empty\n");
+        exit(-1);
+    }
+    check_run(&run, sources, prefix_0, 0, 99, 2, 0);
+    bip32_template_union_next(&u, &run, sources);
+    check_run(&run, sources, prefix_0, 100, 0x7FFFFFFF, 1, 0);
+    bip32_template_union_next(&u, &run, sources);
+    check_run(&run, sources, prefix_1, 0, 99, 1, 1);
+    bip32_template_union_next(&u, &run, sources);
+    check_run(&run, sources, prefix_2, 0, 99, 2, 0);
+}
+
+/* The order of bip32template_keys.c keys */
+static int compare_paths(const uint32_t* a, unsigned int len_a, unsigned int partial_a,
+                         const uint32_t* b, unsigned int len_b, unsigned int partial_b)
+{
+    unsigned int i;
+
+    if( partial_a != partial_b ) {
+        return partial_a ? 1 : -1;
+    }
+    if( len_a != len_b ) {
+        return len_a < len_b ? -1 : 1;
+    }
+    for( i = 0; i < len_a; i++ ) {
+        if( a[i] != b[i] ) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int is_matched_by(unsigned int t, const uint32_t* path, unsigned int len, unsigned int is_partial)
+{
+    return templates[t].num_sections == len && templates[t].is_partial == is_partial
+        && bip32_template_match(&templates[t], path, len);
+}
+
+static void random_template_string(char* str)
+{
+    int num_sections = 1 + rand() % BIP32_TEMPLATE_MAX_SECTIONS;
+    int num_hardened = rand() % (num_sections + 1);
+    int i, r, num_ranges, value;
+    char section[64];
+    char* p;
+
+    str += sprintf(str, rand() % 2 ? "m/" : "");
+    for( i = 0; i < num_sections; i++ ) {
+        num_ranges = 1 + rand() % 3;
+        value = 0;
+        p = section;
+        for( r = 0; r < num_ranges; r++ ) {
+            value += rand() % 4;
+            p += sprintf(p, "%s%d", r > 0 ? "," : "", value);
+            if( rand() % 2 ) {
+                value += 1 + rand() % 4;
+                p += sprintf(p, "-%d", value);
+            }
+            value += 2;
+        }
+        /* A single index is not allowed within braces */
+        str += sprintf(str, strpbrk(section, ",-") ? "%s{%s}%s" : "%s%s%s",
+                       i > 0 ? "/" : "", section, i < num_hardened ? "'" : "");
+    }
+}
+
+/* Count the distinct paths of all templates, by checking every path that can be matched */
+static uint64_t count_union(void)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    uint64_t count = 0;
+    unsigned int len, is_partial, i, t, v;
+    uint64_t n, num_paths;
+
+    for( len = 1; len <= BIP32_TEMPLATE_MAX_SECTIONS; len++ ) {
+        num_paths = 1;
+        for( i = 0; i < len; i++ ) {
+            num_paths *= 2 * VALUE_SPACE;
+        }
+        for( is_partial = 0; is_partial < 2; is_partial++ ) {
+            for( n = 0; n < num_paths; n++ ) {
+                uint64_t rest = n;
+                for( i = 0; i < len; i++ ) {
+                    v = (unsigned int)(rest % (2 * VALUE_SPACE));
+                    rest /= 2 * VALUE_SPACE;
+                    path[i] = v >= VALUE_SPACE ? 0x80000000 + v - VALUE_SPACE : v;
+                }
+                for( t = 0; t < num_templates; t++ ) {
+                    if( is_matched_by(t, path, len, is_partial) ) {
+                        count++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+static void test_random(void)
+{
+    bip32_template_union_type u;
+    bip32_template_union_cursor_type cursors[MAX_TEMPLATES];
+    bip32_template_union_run_type run;
+    unsigned int heap[MAX_TEMPLATES];
+    unsigned int sources[MAX_TEMPLATES];
+    uint32_t prev[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int prev_len = 0, prev_is_partial = 0;
+    char str[256];
+    uint64_t count, expected_count;
+    unsigned int t, s;
+    uint32_t last;
+    int round;
+
+    for( round = 0; round < 50; round++ ) {
+        num_templates = 1 + rand() % MAX_TEMPLATES;
+        for( t = 0; t < num_templates; t++ ) {
+            random_template_string(str);
+            parse_or_die(str, &templates[t]);
+            /* Make some templates the same length to get overlaps */
+            if( t > 0 && rand() % 2 ) {
+                templates[t].is_partial = templates[0].is_partial;
+            }
+        }
+
+        bip32_template_union_init(&u, templates, num_templates, cursors, heap);
+        count = 0;
+        prev_len = 0;
+        while( bip32_template_union_next(&u, &run, sources) ) {
+            if( run.last_end < run.path[run.path_len-1] ) {
+                printf("round %d: empty run\n", round);
+                exit(-1);
+            }
+            for( last = run.path[run.path_len-1]; ; last++ ) {
+                run.path[run.path_len-1] = last;
+                if( prev_len && compare_paths(prev, prev_len, prev_is_partial,
+                                              run.path, run.path_len, run.is_partial) >= 0 )
+                {
+                    printf("round %d: paths out of order\n", round);
+                    exit(-1);
+                }
+                s = 0;
+                for( t = 0; t < num_templates; t++ ) {
+                    int is_source = s < run.num_sources && sources[s] == t;
+                    if( is_source != is_matched_by(t, run.path, run.path_len, run.is_partial) ) {
+                        printf("round %d: template %u is%s a source of a path it does%s match\n",
+                               round, t, is_source ? "" : " not", is_source ? " not" : "");
+                        exit(-1);
+                    }
+                    s += is_source;
+                }
+                memcpy(prev, run.path, sizeof(prev));
+                prev_len = run.path_len;
+                prev_is_partial = run.is_partial;
+                count++;
+                if( last == run.last_end ) {
+                    break;
+                }
+            }
+        }
+
+        expected_count = count_union();
+        if( count != expected_count ) {
+            printf("round %d: %llu paths, expected %llu\n", round,
+                   (unsigned long long)count, (unsigned long long)expected_count);
+            exit(-1);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_overlapping();
+    test_random();
+
+    return 0;
+}
@@ -0,0 +1,554 @@
+/*
+ * Copyright 2020 Dmitry Petukhov https://github.com/dgpv
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* bip32grep: print the lines of a log that contain paths matching any of the given templates.
+ *
+ * The input is a file given with -f, which is mmap'ed, or stdin, which is read
+ * in large blocks. Either way, the input is processed in batches of whole lines:
+ * each batch is split at line boundaries between the threads, each thread scans its
+ * part for path tokens and copies the matching lines into its own output buffer,
+ * and the buffers are then written out in order. The memory used depends only on
+ * the batch size and the number of threads, not on the size of the input.
+ *
+ * A path token is a run of digits, '/', 'h' and '\'' that starts with a digit or "m/"
+ * and is not a part of a longer word. The tokens are parsed with bip32_path_parse(),
+ * which has the same rules as BIP32_TEMPLATE_FORMAT_ONLYPATH, and the tokens that
+ * are not valid paths are ignored. A template that starts with "m/" matches only
+ * the paths that start with "m/", and a partial template matches both.
+ *
+ * With -c, only the number of matching lines is printed. With -H, each matching
+ * path is counted for every template that matches it, and for each template the number
+ * of matching paths is printed, followed by the numbers for each range of its last section.
+ * With -s, the number of lines, the time and the throughput are printed to stderr.
+ *
+ * Lines longer than CHUNK_SIZE can be split. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../bip32template.h"
+
+/* The bytes of input processed by each thread in one batch */
+#define CHUNK_SIZE (8 << 20)
+
+#define CHAR_CLASS_WORD 1
+#define CHAR_CLASS_PATH 2
+#define CHAR_CLASS_DIGIT 4
+
+typedef enum {
+    OUTPUT_LINES,
+    OUTPUT_COUNT,
+    OUTPUT_HISTOGRAM
+} output_mode_type;
+
+typedef struct {
+    const bip32_template_type* templates;
+    unsigned int num_templates;
+    output_mode_type output_mode;
+    /* To skip the tokens that cannot match without parsing them:
+     * has_num_sections[N] is set if any template has N sections */
+    uint8_t has_num_sections[BIP32_TEMPLATE_MAX_SECTIONS + 1];
+    int has_partial_templates;
+} grep_type;
+
+typedef struct {
+    const grep_type* grep;
+    const char* data;
+    size_t len;
+    char* out;
+    size_t out_len;
+    uint64_t num_lines;
+    uint64_t num_matched_lines;
+    /* For each template, the number of matching paths,
+     * and the numbers for each range of the last section */
+    uint64_t* counts;
+} worker_type;
+
+static unsigned char char_class[256];
+
+static void init_char_class(void)
+{
+    int c;
+
+    for( c = '0'; c <= '9'; c++ ) {
+        char_class[c] = CHAR_CLASS_WORD | CHAR_CLASS_PATH | CHAR_CLASS_DIGIT;
+    }
+    for( c = 'a'; c <= 'z'; c++ ) {
+        char_class[c] = CHAR_CLASS_WORD;
+        char_class[c - 'a' + 'A'] = CHAR_CLASS_WORD;
+    }
+    char_class['_'] = CHAR_CLASS_WORD;
+    char_class['h'] |= CHAR_CLASS_PATH;
+    char_class['/'] = CHAR_CLASS_PATH;
+    char_class['\''] = CHAR_CLASS_PATH;
+}
+
+static unsigned int template_counts_size(void)
+{
+    return 1 + BIP32_TEMPLATE_MAX_RANGES_PER_SECTION;
+}
+
+static void count_match(const bip32_template_type* template_p, const uint32_t* path, unsigned int path_len,
+                        uint64_t* counts)
+{
+    const bip32_template_section_type* section_p = &template_p->sections[path_len-1];
+    int i;
+
+    counts[0]++;
+    for( i = 0; i < section_p->num_ranges; i++ ) {
+        if( path[path_len-1] >= section_p->ranges[i].range_start
+            && path[path_len-1] <= section_p->ranges[i].range_end )
+        {
+            counts[1+i]++;
+            break;
+        }
+    }
+}
+
+/* Returns 1 if the path token matches any template. In histogram mode all matching templates are counted */
+static int match_token(const grep_type* grep, const char* token, size_t len, uint64_t* counts)
+{
+    uint32_t path[BIP32_TEMPLATE_MAX_SECTIONS];
+    unsigned int path_len = BIP32_TEMPLATE_MAX_SECTIONS;
+    unsigned int is_partial;
+    const bip32_template_type* template_p;
+    int is_matched = 0;
+    unsigned int i;
+
+    if( !bip32_path_parse(token, len, path, &path_len, &is_partial, 0, 0) ) {
+        return 0;
+    }
+
+    for( i = 0; i < grep->num_templates; i++ ) {
+        template_p = &grep->templates[i];
+        if( is_partial && !template_p->is_partial ) {
+            continue;
+        }
+        if( bip32_template_match(template_p, path, path_len) ) {
+            is_matched = 1;
+            if( grep->output_mode != OUTPUT_HISTOGRAM ) {
+                break;
+            }
+            count_match(template_p, path, path_len, &counts[i * template_counts_size()]);
+        }
+    }
+
+    return is_matched;
+}
+
+static int match_line(const grep_type* grep, const char* line, size_t len, uint64_t* counts)
+{
+    const unsigned char* p = (const unsigned char*)line;
+    const unsigned char* slash;
+    int is_matched = 0;
+    unsigned int num_slashes;
+    size_t i = 0;
+    size_t start;
+
+    while( i < len ) {
+        if( !grep->has_partial_templates ) {
+            /* Only the tokens that start with "m/" can match, so go to the next slash */
+            slash = memchr(p + i, '/', len - i);
+            if( !slash ) {
+                break;
+            }
+            i = slash - p + 1;
+            if( i < 2 || p[i-2] != 'm' || (i > 2 && (char_class[p[i-3]] & (CHAR_CLASS_WORD | CHAR_CLASS_PATH))) ) {
+                continue;
+            }
+            i -= 2;
+        }
+        else if( !(char_class[p[i]] & CHAR_CLASS_DIGIT)
+                 && !(p[i] == 'm' && i + 1 < len && p[i+1] == '/') )
+        {
+            /* Skip to the start of the next word or path */
+            if( char_class[p[i]] & CHAR_CLASS_WORD ) {
+                while( i < len && (char_class[p[i]] & CHAR_CLASS_WORD) ) {
+                    i++;
+                }
+            }
+            else {
+                i++;
+            }
+            continue;
+        }
+        else if( i > 0 && (char_class[p[i-1]] & (CHAR_CLASS_WORD | CHAR_CLASS_PATH)) ) {
+            i++;
+            continue;
+        }
+
+        start = i;
+        num_slashes = 0;
+        if( p[i] == 'm' ) {
+            i++;
+        }
+        while( i < len && (char_class[p[i]] & CHAR_CLASS_PATH) ) {
+            num_slashes += p[i] == '/';
+            i++;
+        }
+        if( i < len && (char_class[p[i]] & CHAR_CLASS_WORD) ) {
+            while( i < len && (char_class[p[i]] & CHAR_CLASS_WORD) ) {
+                i++;
+            }
+            continue;
+        }
+
+        /* The number of sections is the number of slashes, plus one for partial paths */
+        if( p[start] != 'm' ) {
+            if( !grep->has_partial_templates ) {
+                continue;
+            }
+            num_slashes++;
+        }
+        if( num_slashes > BIP32_TEMPLATE_MAX_SECTIONS || !grep->has_num_sections[num_slashes] ) {
+            continue;
+        }
+
+        if( match_token(grep, line + start, i - start, counts) ) {
+            is_matched = 1;
+            if( grep->output_mode != OUTPUT_HISTOGRAM ) {
+                break;
+            }
+        }
+    }
+
+    return is_matched;
+}
+
+static void* worker_run(void* arg)
+{
+    worker_type* worker = arg;
+    const char* p = worker->data;
+    const char* end = worker->data + worker->len;
+    const char* eol;
+    size_t line_len;
+
+    worker->out_len = 0;
+
+    while( p < end ) {
+        eol = memchr(p, '\n', end - p);
+        line_len = eol ? (size_t)(eol - p) : (size_t)(end - p);
+        worker->num_lines++;
+        if( match_line(worker->grep, p, line_len, worker->counts) ) {
+            worker->num_matched_lines++;
+            if( worker->grep->output_mode == OUTPUT_LINES ) {
+                memcpy(worker->out + worker->out_len, p, line_len);
+                worker->out_len += line_len;
+                worker->out[worker->out_len++] = '\n';
+            }
+        }
+        p += line_len + 1;
+    }
+
+    return 0;
+}
+
+/* The start of the line after p, but not more than CHUNK_SIZE bytes after p,
+ * so that the parts given to the workers stay bounded even with very long lines */
+static const char* next_line_start(const char* p, const char* end)
+{
+    const char* limit = (size_t)(end - p) > CHUNK_SIZE ? p + CHUNK_SIZE : end;
+    const char* eol = memchr(p, '\n', limit - p);
+
+    return eol ? eol + 1 : limit;
+}
+
+/* Split the lines between the workers, run them and write out the matching lines in order */
+static void run_batch(worker_type* workers, pthread_t* threads, unsigned int num_threads,
+                      const char* data, size_t len)
+{
+    size_t part = (len + num_threads - 1) / num_threads;
+    const char* end = data + len;
+    const char* p = data;
+    const char* part_end;
+    unsigned int i;
+
+    for( i = 0; i < num_threads; i++ ) {
+        part_end = next_line_start((size_t)(end - p) > part ? p + part : end, end);
+        workers[i].data = p;
+        workers[i].len = part_end - p;
+        p = part_end;
+    }
+
+    if( num_threads == 1 ) {
+        worker_run(&workers[0]);
+    }
+    else {
+        for( i = 0; i < num_threads; i++ ) {
+            if( pthread_create(&threads[i], 0, worker_run, &workers[i]) != 0 ) {
+                fprintf(stderr, "cannot create thread\n");
+                exit(2);
+            }
+        }
+        for( i = 0; i < num_threads; i++ ) {
+            pthread_join(threads[i], 0);
+        }
+    }
+
+    for( i = 0; i < num_threads; i++ ) {
+        if( workers[i].out_len > 0 && fwrite(workers[i].out, 1, workers[i].out_len, stdout) != workers[i].out_len ) {
+            perror("write");
+            exit(2);
+        }
+    }
+}
+
+static uint64_t grep_file(const char* file_name, worker_type* workers, pthread_t* threads,
+                          unsigned int num_threads)
+{
+    size_t batch_size = (size_t)CHUNK_SIZE * num_threads;
+    const char* data;
+    const char* p;
+    const char* batch_end;
+    const char* end;
+    struct stat st;
+    int fd = open(file_name, O_RDONLY);
+
+    if( fd < 0 || fstat(fd, &st) != 0 ) {
+        perror(file_name);
+        exit(2);
+    }
+    if( st.st_size == 0 ) {
+        close(fd);
+        return 0;
+    }
+    data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if( data == MAP_FAILED ) {
+        perror("mmap");
+        exit(2);
+    }
+    close(fd);
+    madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
+
+    end = data + st.st_size;
+    for( p = data; p < end; p = batch_end ) {
+        batch_end = next_line_start((size_t)(end - p) > batch_size ? p + batch_size : end, end);
+        run_batch(workers, threads, num_threads, p, batch_end - p);
+    }
+
+    munmap((void*)data, st.st_size);
+
+    return st.st_size;
+}
+
+static uint64_t grep_stdin(worker_type* workers, pthread_t* threads, unsigned int num_threads)
+{
+    size_t batch_size = (size_t)CHUNK_SIZE * num_threads;
+    char* buf = malloc(batch_size);
+    uint64_t total = 0;
+    size_t filled = 0;
+    size_t batch_len;
+    ssize_t n = 1;
+
+    if( !buf ) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+
+    while( n > 0 || filled > 0 ) {
+        while( filled < batch_size && (n = read(0, buf + filled, batch_size - filled)) > 0 ) {
+            filled += n;
+            total += n;
+        }
+        if( n < 0 ) {
+            perror("read");
+            exit(2);
+        }
+
+        /* Keep the incomplete last line for the next batch, unless it fills the whole buffer */
+        batch_len = filled;
+        if( n > 0 ) {
+            while( batch_len > 0 && buf[batch_len-1] != '\n' ) {
+                batch_len--;
+            }
+            if( batch_len == 0 ) {
+                batch_len = filled;
+            }
+        }
+
+        run_batch(workers, threads, num_threads, buf, batch_len);
+        memmove(buf, buf + batch_len, filled - batch_len);
+        filled -= batch_len;
+    }
+
+    free(buf);
+
+    return total;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-c | -H] [-s] [-j threads] [-f file] template...\n", prog);
+    fprintf(stderr, "  -c  print only the number of matching lines\n");
+    fprintf(stderr, "  -H  print the number of matching paths for each template and each range of its last section\n");
+    fprintf(stderr, "  -s  print the number of lines and the throughput to stderr\n");
+    fprintf(stderr, "  -f  read the file instead of stdin\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    grep_type grep;
+    bip32_template_type* templates;
+    worker_type* workers;
+    pthread_t* threads;
+    bip32_template_error_type error;
+    unsigned int last_pos;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* file_name = 0;
+    int is_stats = 0;
+    uint64_t num_bytes, num_lines = 0, num_matched_lines = 0, count;
+    double start, elapsed;
+    unsigned int i, ii, r;
+    int opt;
+
+    grep.output_mode = OUTPUT_LINES;
+
+    while( (opt = getopt(argc, argv, "cHsj:f:")) != -1 ) {
+        switch( opt ) {
+            case 'c':
+                grep.output_mode = OUTPUT_COUNT;
+                break;
+            case 'H':
+                grep.output_mode = OUTPUT_HISTOGRAM;
+                break;
+            case 's':
+                is_stats = 1;
+                break;
+            case 'j':
+                num_threads = atol(optarg);
+                break;
+            case 'f':
+                file_name = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if( optind >= argc || num_threads < 1 ) {
+        usage(argv[0]);
+    }
+
+    grep.num_templates = argc - optind;
+    templates = calloc(grep.num_templates, sizeof(bip32_template_type));
+    workers = calloc(num_threads, sizeof(worker_type));
+    threads = calloc(num_threads, sizeof(pthread_t));
+    if( !templates || !workers || !threads ) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+
+    for( i = 0; i < grep.num_templates; i++ ) {
+        if( !bip32_template_parse_string(argv[optind + i], BIP32_TEMPLATE_FORMAT_AMBIGOUS,
+                                         &templates[i], &error, &last_pos) )
+        {
+            fprintf(stderr, "template \"%s\": %s at position %u\n",
+                    argv[optind + i], bip32_template_error_to_string(error), last_pos);
+            exit(2);
+        }
+    }
+    grep.templates = templates;
+    memset(grep.has_num_sections, 0, sizeof(grep.has_num_sections));
+    grep.has_partial_templates = 0;
+    for( i = 0; i < grep.num_templates; i++ ) {
+        grep.has_num_sections[templates[i].num_sections] = 1;
+        grep.has_partial_templates |= templates[i].is_partial;
+    }
+
+    for( i = 0; i < num_threads; i++ ) {
+        workers[i].grep = &grep;
+        /* The part of a worker is less than 3 chunks (see next_line_start()), and the matching
+         * lines are copied with a newline, that the last line of the part may not have */
+        workers[i].out = grep.output_mode == OUTPUT_LINES ? malloc(CHUNK_SIZE * 4) : 0;
+        workers[i].counts = calloc(grep.num_templates, template_counts_size() * sizeof(uint64_t));
+        if( (grep.output_mode == OUTPUT_LINES && !workers[i].out) || !workers[i].counts ) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+
+    init_char_class();
+    setvbuf(stdout, 0, _IOFBF, 1 << 20);
+
+    start = now_seconds();
+    num_bytes = file_name ? grep_file(file_name, workers, threads, num_threads)
+                          : grep_stdin(workers, threads, num_threads);
+    elapsed = now_seconds() - start;
+
+    for( i = 0; i < num_threads; i++ ) {
+        num_lines += workers[i].num_lines;
+        num_matched_lines += workers[i].num_matched_lines;
+    }
+
+    if( grep.output_mode == OUTPUT_COUNT ) {
+        printf("%llu\n", (unsigned long long)num_matched_lines);
+    }
+    else if( grep.output_mode == OUTPUT_HISTOGRAM ) {
+        for( i = 0; i < grep.num_templates; i++ ) {
+            const bip32_template_section_type* section_p = &templates[i].sections[templates[i].num_sections-1];
+            for( r = 0; r < template_counts_size(); r++ ) {
+                if( r > section_p->num_ranges ) {
+                    break;
+                }
+                count = 0;
+                for( ii = 0; ii < num_threads; ii++ ) {
+                    count += workers[ii].counts[i * template_counts_size() + r];
+                }
+                if( r == 0 ) {
+                    printf("%s\t%llu\n", argv[optind + i], (unsigned long long)count);
+                }
+                else {
+                    printf("  %u-%u%s\t%llu\n",
+                           section_p->ranges[r-1].range_start & 0x7FFFFFFF,
+                           section_p->ranges[r-1].range_end & 0x7FFFFFFF,
+                           section_p->ranges[r-1].range_start & 0x80000000 ? "'" : "",
+                           (unsigned long long)count);
+                }
+            }
+        }
+    }
+    fflush(stdout);
+
+    if( is_stats ) {
+        fprintf(stderr, "%llu lines, %llu matched, %llu bytes in %.3f s, %.2f GB/s, %ld threads\n",
+                (unsigned long long)num_lines, (unsigned long long)num_matched_lines,
+                (unsigned long long)num_bytes, elapsed, elapsed > 0 ? num_bytes / elapsed / 1e9 : 0.0,
+                num_threads);
+    }
+
+    return num_matched_lines > 0 ? 0 : 1;
+}